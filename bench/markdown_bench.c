@@ -0,0 +1,143 @@
+// markdown_bench.c
+// Measures the markdown scanner's throughput with each classifier the CPU supports, against the scalar
+// loop, on synthetic notes or on the files given as arguments.
+#include "../utils/markdown.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_BYTES (64L * 1024 * 1024)
+#define BENCH_RUNS 5
+
+static const char *kernel_names[] = {"scalar", "sse4.2", "avx2", "neon"};
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+// Function to fill a buffer with notes shaped like a real vault: mostly prose, with headings, links,
+// tags, tasks, code spans and the odd fenced block
+static char *generate_notes(size_t size) {
+    static const char *words[] = {"the", "meeting", "notes", "about", "deploy", "pipeline", "and", "review",
+                                  "for", "a", "service", "latency", "budget", "with", "team", "follow-up"};
+    char *text = malloc(size);
+    if (text == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    unsigned int seed = 42;
+    size_t used = 0;
+    while (used + 256 < size) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int pick = seed >> 16;
+        int written;
+        switch (pick % 16) {
+            case 0:
+                written = snprintf(text + used, size - used, "## Section %u\n", pick % 100);
+                break;
+            case 1:
+                written = snprintf(text + used, size - used, "- [%c] Follow up on [[note-%u]]\n",
+                                   pick & 1 ? 'x' : ' ', pick % 1000);
+                break;
+            case 2:
+                written = snprintf(text + used, size - used, "```c\nint x = a[%u] + b[i];  // #not-a-tag\n```\n",
+                                   pick % 10);
+                break;
+            default: {
+                written = 0;
+                for (int i = 0; i < 12; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    unsigned int word = seed >> 16;
+                    const char *format = word % 29 == 0 ? "[[%s]] " : word % 31 == 0 ? "#%s " :
+                                         word % 37 == 0 ? "`%s` " : "%s ";
+                    written += snprintf(text + used + written, size - used - written, format, words[word % 16]);
+                }
+                text[used + written - 1] = '\n';
+            }
+        }
+        used += (size_t)written;
+    }
+    memset(text + used, '\n', size - used);
+    return text;
+}
+
+// Function to read the files named on the command line into one buffer, notes separated by newlines
+static char *read_files(int argc, char *argv[], size_t *size) {
+    char *text = NULL;
+    *size = 0;
+    for (int i = 0; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        char *grown = length >= 0 ? realloc(text, *size + (size_t)length + 1) : NULL;
+        if (grown == NULL) {
+            fclose(file);
+            continue;
+        }
+        text = grown;
+        *size += fread(text + *size, 1, (size_t)length, file);
+        text[(*size)++] = '\n';
+        fclose(file);
+    }
+    return text;
+}
+
+// Function to time one classifier over the buffer, returns the best run in ms and the token count
+static double time_kernel(const char *text, size_t size, long *tokens) {
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        markdown_scanner scanner;
+        markdown_token token;
+        long count = 0;
+        double start = now_ms();
+        markdown_scanner_init(&scanner, text, size);
+        while (markdown_scanner_next(&scanner, &token)) {
+            count++;
+        }
+        double elapsed = now_ms() - start;
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        *tokens = count;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = BENCH_DEFAULT_BYTES;
+    char *text = argc > 1 ? read_files(argc - 1, argv + 1, &size) : generate_notes(size);
+    if (text == NULL || size == 0) {
+        fprintf(stderr, "Nothing to scan\n");
+        return EXIT_FAILURE;
+    }
+    printf("Scanning %.1f MB of %s, best of %d runs\n", size / 1e6, argc > 1 ? "notes" : "synthetic notes",
+           BENCH_RUNS);
+
+    double scalar_ms = 0;
+    long scalar_tokens = 0;
+    for (size_t i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); i++) {
+        if (!markdown_select_kernel(kernel_names[i])) {
+            continue;
+        }
+        long tokens;
+        double ms = time_kernel(text, size, &tokens);
+        if (i == 0) {
+            scalar_ms = ms;
+            scalar_tokens = tokens;
+        }
+        printf("%-8s %8.2f ms  %6.2f GB/s  %5.2fx  %ld tokens%s\n", kernel_names[i], ms, size / ms / 1e6,
+               scalar_ms / ms, tokens, tokens == scalar_tokens ? "" : "  MISMATCH");
+    }
+
+    free(text);
+    return EXIT_SUCCESS;
+}
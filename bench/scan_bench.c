@@ -0,0 +1,210 @@
+// scan_bench.c
+// Measures how the vault scanner's throughput scales with its thread count on a synthetic vault,
+// against the single-threaded readdir+stat walk the catalog used to do.
+#include "../utils/scan.h"
+#include "../utils/catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BENCH_DEFAULT_VAULT "/tmp/silica-scan-bench"
+#define BENCH_DEFAULT_FILES 100000
+#define BENCH_FILES_PER_DIR 100
+#define BENCH_DIRS_PER_PARENT 10
+#define BENCH_RUNS 3
+
+typedef struct {
+    long dirs;
+    long files;
+} scan_totals;
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+// Function to lay out files over org/repo/topic directories the way a grown vault looks
+static int generate_vault(const char *root, long files) {
+    char marker[CATALOG_PATH_MAX];
+    snprintf(marker, sizeof(marker), "%s/.bench-%ld", root, files);
+    if (access(marker, F_OK) == 0) {
+        return 1;  // Generated by an earlier run
+    }
+
+    DIR *existing = opendir(root);
+    if (existing) {
+        struct dirent *entry;
+        while ((entry = readdir(existing)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                fprintf(stderr, "%s is not empty and was not generated for %ld notes, refusing to write into it\n",
+                        root, files);
+                closedir(existing);
+                return 0;
+            }
+        }
+        closedir(existing);
+    }
+
+    printf("Generating %ld notes under %s...\n", files, root);
+    mkdir(root, 0755);
+    long dir_count = (files + BENCH_FILES_PER_DIR - 1) / BENCH_FILES_PER_DIR;
+    for (long d = 0; d < dir_count; d++) {
+        char path[CATALOG_PATH_MAX];
+        long org = d / (BENCH_DIRS_PER_PARENT * BENCH_DIRS_PER_PARENT);
+        long repo = d / BENCH_DIRS_PER_PARENT % BENCH_DIRS_PER_PARENT;
+        snprintf(path, sizeof(path), "%s/org%ld", root, org);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/org%ld/repo%ld", root, org, repo);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/org%ld/repo%ld/topic%ld", root, org, repo, d % BENCH_DIRS_PER_PARENT);
+        if (mkdir(path, 0755) != 0 && access(path, F_OK) != 0) {
+            perror("mkdir");
+            return 0;
+        }
+
+        for (long f = 0; f < BENCH_FILES_PER_DIR && d * BENCH_FILES_PER_DIR + f < files; f++) {
+            char file_path[CATALOG_PATH_MAX + 32];
+            snprintf(file_path, sizeof(file_path), "%s/note-%ld.md", path, f);
+            FILE *file = fopen(file_path, "w");
+            if (file == NULL) {
+                perror("fopen");
+                return 0;
+            }
+            fprintf(file, "# Note %ld\n\nSynthetic benchmark note.\n", d * BENCH_FILES_PER_DIR + f);
+            fclose(file);
+        }
+    }
+
+    FILE *file = fopen(marker, "w");
+    if (file) {
+        fclose(file);
+    }
+    return 1;
+}
+
+// Function to drop the page, dentry and inode caches so every run starts cold (Linux, root only)
+static int drop_caches(void) {
+    sync();
+    FILE *file = fopen("/proc/sys/vm/drop_caches", "w");
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = fputs("3\n", file) >= 0;
+    return fclose(file) == 0 && ok;
+}
+
+// Function to walk the tree on one thread with opendir, readdir and fstatat, as catalog refresh does
+static void serial_walk(const char *path, scan_totals *totals) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    totals->dirs++;
+
+    int fd = dirfd(dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(fd, entry->d_name, &st, 0) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            char child[CATALOG_PATH_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            serial_walk(child, totals);
+        } else if (S_ISREG(st.st_mode)) {
+            totals->files++;
+        }
+    }
+    closedir(dir);
+}
+
+static void count_dir(const scan_dir *dir, void *ctx) {
+    scan_totals *totals = ctx;
+    totals->dirs++;
+    for (size_t i = 0; i < dir->entry_count; i++) {
+        totals->files += !dir->entries[i].is_dir;
+    }
+}
+
+// Function to time one configuration, threads 0 meaning the serial walk. Returns the best run in ms.
+static double time_scan(const char *root, int threads, int cold, scan_totals *totals) {
+    double best = -1;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        if (cold) {
+            drop_caches();
+        }
+        memset(totals, 0, sizeof(*totals));
+        double start = now_ms();
+        if (threads == 0) {
+            serial_walk(root, totals);
+        } else {
+            scan_options options;
+            scan_default_options(&options);
+            options.threads = threads;
+            scan_tree(root, &options, count_dir, totals);
+        }
+        double elapsed = now_ms() - start;
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    const char *root = BENCH_DEFAULT_VAULT;
+    long files = BENCH_DEFAULT_FILES;
+    int cold = 0;
+    int max_threads = 16;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+            files = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            max_threads = (int)strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cold") == 0) {
+            cold = 1;
+        } else if (argv[i][0] != '-') {
+            root = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [vault] [--files N] [--max-threads N] [--cold]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!generate_vault(root, files)) {
+        return EXIT_FAILURE;
+    }
+    if (cold && !drop_caches()) {
+        fprintf(stderr, "Cannot drop caches (needs root on Linux), measuring warm\n");
+        cold = 0;
+    }
+
+    printf("%ld CPUs online, %s cache, best of %d runs\n", sysconf(_SC_NPROCESSORS_ONLN), cold ? "cold" : "warm",
+           BENCH_RUNS);
+    printf("%-12s %8s %9s %10s %12s %8s\n", "scanner", "dirs", "files", "ms", "files/s", "speedup");
+
+    scan_totals totals;
+    double serial = time_scan(root, 0, cold, &totals);
+    printf("%-12s %8ld %9ld %10.1f %12.0f %8s\n", "readdir", totals.dirs, totals.files, serial,
+           totals.files / (serial / 1000.0), "1.00x");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double elapsed = time_scan(root, threads, cold, &totals);
+        char label[32];
+        snprintf(label, sizeof(label), "scan x%d", threads);
+        printf("%-12s %8ld %9ld %10.1f %12.0f %7.2fx\n", label, totals.dirs, totals.files, elapsed,
+               totals.files / (elapsed / 1000.0), serial / elapsed);
+    }
+    return EXIT_SUCCESS;
+}
@@ -7,6 +7,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "../utils/completion.h"
 
 #define INITIAL_DIR "/Users/shaneshort/Documents/Notes/obs-cli/obs-cli/"
 
@@ -28,67 +29,49 @@ void change_directory(const char *path) {
     }
 }
 
-// Generator function to return matches one by one
+// Generator function to return matches one by one from the cached directory listing
 char *generator(const char *text, int state) {
-    static DIR *dir;
-    static struct dirent *entry;
-    static int len;
-    static char directory[1024];
-    static char *last_slash;
+    static const completion_entry *matches;
+    static size_t match_count;
+    static size_t match_index;
+    static size_t len;
 
-    // Determine the base directory to open based on the input
+    // Look up the matches once per completion, later calls just walk the range
     if (state == 0) {  // Reset state when a new text input is processed
-        if ((last_slash = strrchr(text, '/')) != NULL) {
-            // If there is a slash, open the specified subdirectory
+        char directory[1024];
+        const char *last_slash = strrchr(text, '/');
+        if (last_slash != NULL) {
+            // If there is a slash, look in the specified subdirectory
             snprintf(directory, sizeof(directory), "%s/%.*s", current_dir, (int)(last_slash - text), text);
         } else {
-            // Otherwise, open the current directory
-            strncpy(directory, current_dir, sizeof(directory));
-        }
-
-        // Open the directory for the first time
-        if (dir) closedir(dir);  // Close previously opened directory
-        dir = opendir(directory);
-        if (dir == NULL) {
-            perror("opendir");
-            return NULL;
+            // Otherwise, look in the current directory
+            snprintf(directory, sizeof(directory), "%s", current_dir);
         }
 
         len = last_slash ? strlen(last_slash + 1) : strlen(text);  // Length of text after the last slash
+        match_index = 0;
+        if (!completion_lookup(directory, text + strlen(text) - len, &matches, &match_count)) {
+            match_count = 0;
+        }
     }
 
-    // Read directory entries and match against the input text
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_name[0] == '.')  // Skip hidden files and directories
-            continue;
-
-        // Compare based on the length after the last slash
-        if (strncmp(entry->d_name, last_slash ? last_slash + 1 : text, len) == 0) {
-            // Allocate space for the result and build it with full path
-            char *result;
-            char full_path[1024];
-            snprintf(full_path, sizeof(full_path), "%s/%s", directory, entry->d_name);
-
-            struct stat path_stat;
-            if (stat(full_path, &path_stat) == 0) {
-                if (S_ISDIR(path_stat.st_mode)) {  // Directory found
-                    result = (char *)malloc(strlen(text) + strlen(entry->d_name) + 2);  // +1 for '/' and +1 for '\0'
-                    snprintf(result, strlen(text) - len + 1, "%s", text);  // Copy the path up to the last slash
-                    strcat(result, entry->d_name);
-                    strcat(result, "/");
-                } else {  // File found
-                    result = (char *)malloc(strlen(text) + strlen(entry->d_name) + 1);
-                    snprintf(result, strlen(text) - len + 1, "%s", text);  // Copy the path up to the last slash
-                    strcat(result, entry->d_name);
-                }
-                return result;
-            }
-        }
+    if (match_index >= match_count) {
+        return NULL;  // No more matches found
     }
 
-    closedir(dir);  // Close directory when done
-    dir = NULL;     // Reset directory pointer
-    return NULL;    // No more matches found
+    // Build the result from the path up to the last slash plus the entry name
+    const completion_entry *entry = &matches[match_index++];
+    size_t head = strlen(text) - len;
+    char *result = (char *)malloc(head + strlen(entry->name) + 2);  // +1 for '/' and +1 for '\0'
+    if (result == NULL) {
+        return NULL;
+    }
+    snprintf(result, head + 1, "%s", text);
+    strcat(result, entry->name);
+    if (entry->is_dir) {  // Directory found
+        strcat(result, "/");
+    }
+    return result;
 }
 
 // The completion function called by readline to generate matches
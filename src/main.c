@@ -4,33 +4,74 @@
 #include <string.h>
 #include <unistd.h>
 #include "../utils/utils.h"
+#include "../utils/catalog.h"
+#include "../utils/git_repo.h"
+#include "../utils/fuzzy.h"
+#include "../utils/search_index.h"
+#include "../utils/tag_index.h"
+#include "../utils/time_index.h"
+#include "../utils/link_index.h"
+#include "../utils/link_rewrite.h"
+#include "../utils/dupe_index.h"
+#include "../utils/related_index.h"
+#include "../utils/watch.h"
+#include "../utils/naming.h"
+#include "../utils/clean_batch.h"
+#include "../utils/name_cache.h"
+#include "../utils/daemon.h"
+#include "../utils/silica.h"
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <dirent.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #define FILE_PATH_MAX 512
 #define TIMESTAMP_MAX 80
-#define OBS_CONFIG_FILE "obs/.config"
-#define MAX_LINE_LENGTH 256
 
 char target_dir[128];
 char api_key[128];
+silica_config config;
 char current_dir[1024];
 char original_dir[FILE_PATH_MAX];
+static volatile sig_atomic_t stop_requested = 0;
 
 void create_note();
 void edit_note(const char *filepath);
-void clean_note();  // New function prototype
-void list_notes();
+void fuzzy_edit_note(const char *query);
+void open_in_neovim(const char *path);
+void auto_name_note(const char *path);
+void clean_note(int argc, char *argv[]);  // New function prototype
+void clean_all_notes(int argc, char *argv[]);
+int finish_interrupted_clean();
+void print_link_stats(const link_rewrite_stats *stats);
+void list_notes(int argc, char *argv[]);
+void print_list_usage();
+void list_tagged_notes(const tag_term *terms, size_t term_count);
+void list_recent_notes(const tag_term *terms, size_t term_count, time_field field, long recent, int64_t since,
+                       int64_t until);
+void find_duplicates(int argc, char *argv[]);
+void show_links(const char *note, int backlinks);
+void show_related(int argc, char *argv[]);
+void print_catalog_line(const char *line, void *ctx);
+void grep_notes(int argc, char *argv[]);
+void watch_vault();
+void serve_vault();
+void request_stop(int signal_number);
 void config_target_dir();
 int load_target_dir_from_config();
 void write_target_dir_to_config(const char *path, const char *key);
-char *send_prompt(const char *root_directory, const char *prompt, long prompt_size);
 
 int main(int argc, char *argv[]) {
 
+    // Naming workers are fed through pipes, one that dies mid-request fails the write instead of
+    // ending the process with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
     // Save the current working directory for use later in the file parsing script
     if (getcwd(original_dir, sizeof(original_dir)) == NULL) {
         perror("getcwd");
@@ -55,20 +96,72 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Commands:\n");
         fprintf(stderr, "  add                  Create a new note\n");
         fprintf(stderr, "  edit <filepath>      Edit an existing note\n");
+        fprintf(stderr, "  edit --fuzzy [query] Find a note anywhere in the vault and edit it\n");
         fprintf(stderr, "  clean                Clean and parse a note\n");  // New command
+        fprintf(stderr, "  clean --all [dir]    Name every timestamp-named note under dir\n");
         fprintf(stderr, "  list                 List all notes\n");
+        fprintf(stderr, "  list [--tag X] [--where key[=value]] [--and | --or ...]  List notes by tag or frontmatter\n");
+        fprintf(stderr, "  list [--recent N] [--since D] [--until D] [--created]  List notes by time, newest first\n");
+        fprintf(stderr, "  links <note>         List the notes a note links to\n");
+        fprintf(stderr, "  backlinks <note>     List the notes linking to a note\n");
+        fprintf(stderr, "  dupes [dir] [--threshold T]  Find clusters of near-duplicate notes\n");
+        fprintf(stderr, "  related <note> [--same-repo | --repo <org/repo>] [-n N]  List the notes most like a note\n");
+        fprintf(stderr, "  grep [--repo <org/repo>] <words | \"phrase\">  Search note contents\n");
+        fprintf(stderr, "  watch                Keep the catalog and search index up to date\n");
+        fprintf(stderr, "  serve                Answer list, completion, grep, link and repo lookups from memory\n");
         fprintf(stderr, "  config               Set or update the target directory\n");
+        fprintf(stderr, "Queries trust the saved indexes, --rescan first looks at every note for edits made in place\n");
         return EXIT_FAILURE;
     }
 
+    // Without a daemon only directories whose mtime moved are rescanned, --rescan also restats every note
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--rescan") == 0) {
+            memmove(&argv[i], &argv[i + 1], (size_t)(argc - i) * sizeof(char *));
+            argc--;
+            if (!silica_update_indexes(target_dir, SILICA_INDEX_RESCAN)) {
+                return EXIT_FAILURE;
+            }
+            break;
+        }
+    }
+
     if (strcmp(argv[1], "add") == 0) {
         create_note();
     } else if (strcmp(argv[1], "edit") == 0) {
-        edit_note(argv[2]);
+        if (argc >= 3 && strcmp(argv[2], "--fuzzy") == 0) {
+            fuzzy_edit_note(argc >= 4 ? argv[3] : NULL);
+        } else {
+            edit_note(argv[2]);
+        }
     } else if (strcmp(argv[1], "clean") == 0) {  // Handle clean command
-        clean_note();
+        int all = 0;
+        for (int i = 2; i < argc; i++) {
+            all |= strcmp(argv[i], "--all") == 0;
+        }
+        if (all) {
+            clean_all_notes(argc - 2, argv + 2);
+        } else {
+            clean_note(argc - 2, argv + 2);
+        }
     } else if (strcmp(argv[1], "list") == 0) {
-        list_notes();
+        list_notes(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "links") == 0 || strcmp(argv[1], "backlinks") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s %s <note>\n", argv[0], argv[1]);
+            return EXIT_FAILURE;
+        }
+        show_links(argv[2], argv[1][0] == 'b');
+    } else if (strcmp(argv[1], "dupes") == 0) {
+        find_duplicates(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "related") == 0) {
+        show_related(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "grep") == 0) {
+        grep_notes(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "watch") == 0) {
+        watch_vault();
+    } else if (strcmp(argv[1], "serve") == 0) {
+        serve_vault();
     } else {
         fprintf(stderr, "Unknown command: %s\n", argv[1]);
         return EXIT_FAILURE;
@@ -79,7 +172,26 @@ int main(int argc, char *argv[]) {
 
 
 // New function to clean a note
-void clean_note() {
+void clean_note(int argc, char *argv[]) {
+    naming_options naming;
+    naming_default_options(&naming);
+    int use_cache = 1, refresh_cache = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--refresh") == 0) {
+            refresh_cache = 1;
+        } else if (!naming_parse_option(&naming, argc, argv, &i)) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return;
+        }
+    }
+
+    // Links to the notes of a batch that was cut short are put right before this note is renamed
+    if (!finish_interrupted_clean()) {
+        return;
+    }
+
     // Set the current directory for autocomplete to the target directory
     set_current_dir(target_dir);
     printf("Current directory: %s\n", current_dir);
@@ -101,57 +213,74 @@ void clean_note() {
                 if (S_ISREG(path_stat.st_mode)) {
                     printf("You are processing the file: %s\n", full_path);
 
-                    // Read the file contents
-                    FILE *file = fopen(full_path, "r");
-                    if (file == NULL) {
-                        perror("Error opening file for reading");
+                    // Map the file contents, only the parts sent for naming are read
+                    naming_note note;
+                    if (!naming_note_open(&note, full_path)) {
                         free(input);
-                        continue; 
+                        continue;
                     }
 
-                    fseek(file, 0, SEEK_END);
-                    long file_size = ftell(file);
-                    fseek(file, 0, SEEK_SET);
-
-                    char *file_contents = malloc(file_size + 1);
-                    if (file_contents) {
-                        fread(file_contents, 1, file_size, file);
-                        file_contents[file_size] = '\0'; 
-                        fclose(file);
-
-                        // Send the file contents to src/file-parsing.py to create a relevant filename
-                        char *new_filename = send_prompt(original_dir, file_contents, file_size);
-                        printf("Suggested filename: %s\n", new_filename);
-
-                        // Get the directory part of the full_path
-                        char *last_slash = strrchr(full_path, '/');
-                        if (last_slash != NULL) {
-                            // Extract the directory path
-                            size_t dir_length = last_slash - full_path + 1;
-                            char file_dir[FILE_PATH_MAX];
-                            strncpy(file_dir, full_path, dir_length);
-                            file_dir[dir_length] = '\0';
-
-                            // Rename the file if a new filename was returned
-                            if (new_filename && strlen(new_filename) > 0) {
-                                char new_file_path[FILE_PATH_MAX];
-                                snprintf(new_file_path, sizeof(new_file_path), "%s%s.md", file_dir, new_filename);
-                                if (rename(full_path, new_file_path) == 0) {
-                                    printf("File renamed to: %s\n", new_file_path);
-                                } else {
-                                    perror("Error renaming file");
-                                }
-                            } else {
-                                printf("No new filename returned.\n");
-                            }
+                    // A note whose content was named before resolves locally from the name cache
+                    char cache_path[FILE_PATH_MAX];
+                    name_cache_default_path(cache_path, sizeof(cache_path));
+                    name_cache cache;
+                    name_cache_init(&cache);
+                    uint64_t key = name_cache_key(note.data, note.size, naming.engine);
+                    char *new_filename = NULL;
+                    if (use_cache) {
+                        name_cache_load(&cache, cache_path);
+                        if (!refresh_cache) {
+                            new_filename = name_cache_get(&cache, key, note.size);
                         }
+                    }
 
-                        free(file_contents);
-                        free(new_filename);
-                    } else {
-                        perror("Memory allocation failed");
-                        fclose(file);
+                    // Send the file contents to src/file-parsing.py to create a relevant filename
+                    if (new_filename == NULL) {
+                        int retryable;
+                        naming_session session;
+                        naming_session_init(&session, &naming);
+                        new_filename = naming_suggest(&session, &note, &retryable);
+                        naming_session_close(&session);
+                        if (new_filename && use_cache) {
+                            name_cache_put(&cache, key, note.size, new_filename);
+                        }
+                    }
+                    if (use_cache) {
+                        name_cache_save(&cache, cache_path);
+                    }
+                    name_cache_free(&cache);
+                    naming_note_close(&note);
+                    printf("Suggested filename: %s\n", new_filename ? new_filename : "(none)");
+
+                    // Get the directory part of the full_path
+                    char *last_slash = strrchr(full_path, '/');
+                    if (last_slash != NULL) {
+                        // Extract the directory path
+                        size_t dir_length = last_slash - full_path + 1;
+                        char file_dir[FILE_PATH_MAX];
+                        strncpy(file_dir, full_path, dir_length);
+                        file_dir[dir_length] = '\0';
+
+                        // Rename the file if a new filename was returned
+                        if (new_filename && strlen(new_filename) > 0) {
+                            char new_file_path[FILE_PATH_MAX];
+                            snprintf(new_file_path, sizeof(new_file_path), "%s%s.md", file_dir, new_filename);
+                            // Links elsewhere in the vault follow the note to its new name
+                            link_rewrite_stats stats;
+                            int renamed = silica_rename_note(target_dir, full_path, new_file_path, &stats);
+                            if (renamed != 0) {
+                                printf("File renamed to: %s\n", new_file_path);
+                                print_link_stats(&stats);
+                            }
+                            if (renamed < 0) {
+                                fprintf(stderr, "Error rewriting links, run clean again to finish\n");
+                            }
+                        } else {
+                            printf("No new filename returned.\n");
+                        }
                     }
+
+                    free(new_filename);
                     break; // Exit the loop after processing the file
                 } else {
                     printf("Invalid path: %s\n", full_path);
@@ -165,111 +294,189 @@ void clean_note() {
 }
 
 
-// Function to send the contents of a chosen file to open AI for parsing and return a filename
-char *send_prompt(const char *root_directory, const char *prompt, long prompt_size) {
-    FILE *fp;
-    char *new_filename = malloc(2048);
+// What the batch clean's report needs to print a note
+typedef struct {
+    size_t root_length;
+    const clean_batch_options *options;
+} clean_report;
+
+// Function to report each note of a batch clean as soon as it completes
+void print_clean_result(const clean_job *job, size_t done, size_t total, void *ctx) {
+    const clean_report *report = ctx;
+    if (job == NULL) {
+        printf("Naming %zu notes with %d workers%s\n", total, report->options->concurrency,
+               report->options->dry_run ? " (dry run)" : "");
+        fflush(stdout);
+        return;
+    }
+
+    size_t root_length = report->root_length;
+    const char *old_name = job->path + root_length;
+    if (job->status == CLEAN_RENAMED && job->cached) {
+        printf("[%zu/%zu] %s -> %s (cached)\n", done, total, old_name, job->new_path + root_length);
+    } else if (job->status == CLEAN_RENAMED) {
+        printf("[%zu/%zu] %s -> %s (%d attempt%s, %lld ms)\n", done, total, old_name,
+               job->new_path + root_length, job->attempts, job->attempts == 1 ? "" : "s", job->elapsed_ms);
+    } else {
+        printf("[%zu/%zu] %s: no name after %d attempt%s\n", done, total, old_name, job->attempts,
+               job->attempts == 1 ? "" : "s");
+    }
+    fflush(stdout);
+}
 
-    size_t command_size = strlen(root_directory) + prompt_size + 50;
-    char *command = malloc(command_size);
+// Function to name every note under a directory that still carries its timestamp name
+void clean_all_notes(int argc, char *argv[]) {
+    clean_batch_options options;
+    clean_batch_default_options(&options);
+    const char *subdir = "";
+    int use_cache = 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--all") == 0) {
+            continue;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.concurrency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            options.rate_per_second = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            options.max_retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            options.dry_run = 1;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--refresh") == 0) {
+            options.refresh_cache = 1;
+        } else if (naming_parse_option(&options.naming, argc, argv, &i)) {
+            continue;
+        } else if (argv[i][0] != '-') {
+            subdir = argv[i];
+        } else {
+            fprintf(stderr, "Usage: silica clean --all [dir] [--jobs N] [--rate per-second] [--retries N]\n"
+                            "                   [--engine=openai|local|stub|mock] [--mock-latency MS] "
+                            "[--mock-failure-rate P] [--dry-run]\n"
+                            "                   [--no-cache] [--refresh]\n");
+            return;
+        }
+    }
 
-    if (command == NULL) {
-        perror("malloc failed");
-        exit(EXIT_FAILURE);
+    // Links to the notes of a batch that was cut short are put right before anything else is renamed
+    if (!options.dry_run && !finish_interrupted_clean()) {
+        return;
     }
 
-    snprintf(command, command_size, "python3 ~/obs/file_parsing.py \"%s\"", prompt);
+    // An interrupt lets the requests in flight finish but starts no new ones
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    options.cancel = &stop_requested;
 
-    fp = popen(command, "r");
-    if (fp == NULL) {
-        printf("Failed to run command\n");
-        free(command);
-        free(new_filename);
-        exit(1);
+    clean_report report = {strlen(target_dir) + 1, &options};
+    silica_clean_result result;
+    if (!silica_clean_all(target_dir, subdir, &options, use_cache, print_clean_result, &report, &result)) {
+        return;
+    }
+    if (result.jobs == 0) {
+        printf("No timestamp-named notes under %s\n", subdir[0] ? subdir : target_dir);
+        return;
+    }
+    print_link_stats(&result.links);
+    if (result.links_pending) {
+        fprintf(stderr, "Error rewriting links, run clean again to finish\n");
     }
 
-    // Read the output from the Python script (expected to be the new filename)
-    if (fgets(new_filename, 2048, fp) != NULL) {
-        new_filename[strcspn(new_filename, "\n")] = '\0';
-    } else {
-        perror("Error reading from Python script");
-        free(new_filename);
-        new_filename = NULL;
+    if (result.renamed < 0) {
+        fprintf(stderr, "Error starting the naming workers\n");
+        return;
     }
+    long long elapsed = result.elapsed_ms;
+    printf("%s %d, failed %zu, skipped %zu in %.1f s (%.1f notes/s)\n", options.dry_run ? "Would rename" : "Renamed",
+           result.renamed, result.failed, result.cancelled, elapsed / 1000.0,
+           (result.renamed + result.failed) * 1000.0 / (elapsed > 0 ? elapsed : 1));
+}
 
-    pclose(fp);
-    free(command);
+// Function to finish the link rewrite of a clean that was cut short, returns 0 when it is still pending
+int finish_interrupted_clean() {
+    link_rewrite_stats stats;
+    int finished = silica_finish_renames(target_dir, &stats);
+    if (finished < 0) {
+        fprintf(stderr, "Error finishing the link rewrite of an interrupted clean, run clean again to resume\n");
+        return 0;
+    }
+    if (finished > 0) {
+        printf("Finished the link rewrite of an interrupted clean\n");
+        print_link_stats(&stats);
+    }
+    return 1;
+}
 
-    return new_filename;
+void print_link_stats(const link_rewrite_stats *stats) {
+    if (stats->links_rewritten > 0) {
+        printf("Rewrote %zu link%s in %zu note%s\n", stats->links_rewritten, stats->links_rewritten == 1 ? "" : "s",
+               stats->files_rewritten, stats->files_rewritten == 1 ? "" : "s");
+    }
+    if (stats->renames_unindexed > 0) {
+        fprintf(stderr, "%zu renamed note%s missing from the link index, links to them were left as they were\n",
+                stats->renames_unindexed, stats->renames_unindexed == 1 ? " was" : "s were");
+    }
 }
 
 // Function to create a new note
 void create_note() {
     char file_path[FILE_PATH_MAX];
-    char timestamp[TIMESTAMP_MAX];
-
-    generate_timestamp(timestamp, sizeof(timestamp));
-
-    if (is_git_repository()) {
-        char *url = get_remote_url();
-        if (url) {
-            char git_organisation[256] = {0};
-            char repo_name[256] = {0};
-            parse_url(url, git_organisation, repo_name);
-
-            char user_dir[FILE_PATH_MAX];
-            char repo_dir[FILE_PATH_MAX];
+    if (!silica_create_note(&config, original_dir, file_path, sizeof(file_path))) {
+        return;
+    }
+    printf("File '%s' created.\n", file_path);
 
-            snprintf(user_dir, sizeof(user_dir), "%s/%s", target_dir, git_organisation);
-            if (!dir_exists(user_dir)) {
-                create_directory(user_dir);
-            }
+    // Open the new file in Neovim
+    open_in_neovim(file_path);
 
-            snprintf(repo_dir, sizeof(repo_dir), "%s/%s", user_dir, repo_name);
-            if (!dir_exists(repo_dir)) {
-                create_directory(repo_dir);
-            }
+    if (config.auto_name) {
+        auto_name_note(file_path);
+    }
+}
 
-            snprintf(file_path, sizeof(file_path), "%s/%s/%s.md", user_dir, repo_name, timestamp);
-            FILE *fp = fopen(file_path, "w");
-            if (fp) {
-                printf("File '%s' created.\n", file_path);
-                fclose(fp);
-            } else {
-                perror("Failed to create file");
-                return;
-            }
-        } else {
-            printf("Failed to retrieve remote URL.\n");
-            return;
-        }
-    } else {
-        // Not a Git repository, create note in a '/temp' directory 
-        char temp_dir[FILE_PATH_MAX];
+// Function to rename a freshly written note after its keywords, without any network access
+void auto_name_note(const char *path) {
+    naming_note note;
+    if (!naming_note_open(&note, path)) {
+        return;
+    }
 
-        snprintf(temp_dir, sizeof(temp_dir), "%s/temp", target_dir);
-        if (!dir_exists(temp_dir)) {
-            create_directory(temp_dir);
-        }
+    // A note that was never written to keeps its timestamp name
+    static const char placeholder[] = "New note created.\n";
+    if (note.size == 0 || (note.size == sizeof(placeholder) - 1 && memcmp(note.data, placeholder, note.size) == 0)) {
+        naming_note_close(&note);
+        return;
+    }
 
-        snprintf(file_path, sizeof(file_path), "%s/temp/%s.md", target_dir, timestamp);
+    naming_options naming;
+    naming_default_options(&naming);
+    naming.engine = NAMING_ENGINE_LOCAL;
+    naming_session session;
+    naming_session_init(&session, &naming);
+    int retryable;
+    char *name = naming_suggest(&session, &note, &retryable);
+    naming_session_close(&session);
+    naming_note_close(&note);
+    if (name == NULL) {
+        return;
+    }
 
-        FILE *file = fopen(file_path, "w");
-        if (file) {
-            fprintf(file, "New note created.\n");
-            fclose(file);
-            printf("File '%s' created.\n", file_path);
-        } else {
-            perror("Error opening file");
-            return;
-        }
+    char *target = clean_target_path(path, name, NULL, NULL);
+    if (target && rename(path, target) == 0) {
+        printf("File renamed to: %s\n", target);
+    } else if (target) {
+        perror("Error renaming file");
     }
+    free(target);
+    free(name);
+}
 
-    // Open the new file in Neovim
+// Function to open a note in Neovim
+void open_in_neovim(const char *path) {
     char vim_command[FILE_PATH_MAX + 6];
-    snprintf(vim_command, sizeof(vim_command), "nvim %s", file_path);
-    int status = system(vim_command);
-    if (status == -1) {
+    snprintf(vim_command, sizeof(vim_command), "nvim %s", path);
+    if (system(vim_command) == -1) {
         perror("Error executing Neovim");
     }
 }
@@ -301,11 +508,7 @@ void edit_note(const char *filepath) {
                     printf("You are opening the file: %s\n", full_path);
                     
                     // Open the file in Neovim
-                    char vim_command[FILE_PATH_MAX + 6];
-                    snprintf(vim_command, sizeof(vim_command), "nvim %s", full_path);
-                    if (system(vim_command) == -1) {
-                        perror("Error executing Neovim");
-                    }
+                    open_in_neovim(full_path);
                     break;
                 }
             } else {
@@ -316,14 +519,499 @@ void edit_note(const char *filepath) {
     }
 }
 
-// Function to list all notes
-void list_notes() {
-    char list_command[FILE_PATH_MAX];
-    snprintf(list_command, sizeof(list_command), "tree %s", target_dir);
-    printf("Command: %s\n", list_command);
-    int status = system(list_command);
-    if (status == -1) {
-        perror("Error listing notes");
+// State shared with the readline redisplay hook while the fuzzy prompt is open
+static fuzzy_index fuzzy_notes;
+static fuzzy_result fuzzy_results[FUZZY_TOP_N];
+static size_t fuzzy_result_count;
+static size_t fuzzy_selected;
+
+// Function to print a path with the characters matched by the query in bold
+void print_fuzzy_match(FILE *out, size_t candidate, const char *query, int width) {
+    int positions[FUZZY_QUERY_MAX];
+    size_t matched = isatty(fileno(out)) ? fuzzy_match_positions(&fuzzy_notes, candidate, query, positions, FUZZY_QUERY_MAX) : 0;
+    const char *path = fuzzy_notes.paths[candidate];
+
+    size_t next = 0;
+    for (int i = 0; path[i] && i < width; i++) {
+        if (next < matched && positions[next] == i) {
+            fprintf(out, "\033[1m%c\033[0m", path[i]);
+            next++;
+        } else {
+            fputc(path[i], out);
+        }
+    }
+}
+
+// Readline redisplay hook: rank the vault against the current input and draw the results below the prompt
+void fuzzy_redisplay(void) {
+    FILE *out = rl_outstream ? rl_outstream : stdout;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fuzzy_result_count = fuzzy_search(&fuzzy_notes, rl_line_buffer, fuzzy_results, FUZZY_TOP_N);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    if (fuzzy_selected >= fuzzy_result_count) {
+        fuzzy_selected = fuzzy_result_count ? fuzzy_result_count - 1 : 0;
+    }
+
+    rl_redisplay();
+
+    int rows, cols;
+    rl_get_screen_size(&rows, &cols);
+
+    fputs("\0337\n\r\033[J", out);  // Save the cursor and clear everything below the prompt
+    fprintf(out, "  %zu/%zu notes (%.2f ms, %s)", fuzzy_notes.survivor_count, fuzzy_notes.count,
+            elapsed_ms, fuzzy_prefilter_name());
+    for (size_t i = 0; i < fuzzy_result_count; i++) {
+        fprintf(out, "\n\r%s ", i == fuzzy_selected ? ">" : " ");
+        print_fuzzy_match(out, fuzzy_results[i].index, rl_line_buffer, cols - 3);
+    }
+    fputs("\0338", out);
+    fflush(out);
+}
+
+int fuzzy_select_next(int count, int key) {
+    (void)count;
+    (void)key;
+    if (fuzzy_selected + 1 < fuzzy_result_count) {
+        fuzzy_selected++;
+    }
+    return 0;
+}
+
+int fuzzy_select_previous(int count, int key) {
+    (void)count;
+    (void)key;
+    if (fuzzy_selected > 0) {
+        fuzzy_selected--;
+    }
+    return 0;
+}
+
+// Function to find a note anywhere in the vault by fuzzy matching its path
+void fuzzy_edit_note(const char *query) {
+    char catalog_path[FILE_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, target_dir, catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        catalog_free(&cat);
+        return;
+    }
+
+    const char **paths = malloc((cat.entry_count ? cat.entry_count : 1) * sizeof(char *));
+    if (paths == NULL) {
+        perror("Memory allocation failed");
+        catalog_free(&cat);
+        return;
+    }
+    for (size_t i = 0; i < cat.entry_count; i++) {
+        paths[i] = cat.entries[i].path;
+    }
+
+    if (!fuzzy_index_build(&fuzzy_notes, paths, cat.entry_count)) {
+        free(paths);
+        catalog_free(&cat);
+        return;
+    }
+
+    const char *chosen = NULL;
+    if (query) {
+        // One-shot query: print the ranking and let the user pick a number
+        fuzzy_result_count = fuzzy_search(&fuzzy_notes, query, fuzzy_results, FUZZY_TOP_N);
+        if (fuzzy_result_count == 0) {
+            printf("No notes match '%s'.\n", query);
+        }
+        for (size_t i = 0; i < fuzzy_result_count; i++) {
+            printf("%2zu  ", i + 1);
+            print_fuzzy_match(stdout, fuzzy_results[i].index, query, FILE_PATH_MAX);
+            printf("\n");
+        }
+
+        char *input = fuzzy_result_count ? readline("Open note [1]: ") : NULL;
+        if (input) {
+            long pick = strlen(input) > 0 ? strtol(input, NULL, 10) : 1;
+            if (pick >= 1 && (size_t)pick <= fuzzy_result_count) {
+                chosen = paths[fuzzy_results[pick - 1].index];
+            } else {
+                printf("Invalid selection: %s\n", input);
+            }
+            free(input);
+        }
+    } else {
+        // Interactive prompt: results are re-ranked on every keystroke by the redisplay hook
+        rl_redisplay_function = fuzzy_redisplay;
+        rl_bind_key('\t', fuzzy_select_next);
+        rl_bind_key(14, fuzzy_select_next);      // Ctrl-N
+        rl_bind_key(16, fuzzy_select_previous);  // Ctrl-P
+
+        // Reserve room for the result list so the prompt does not scroll away
+        for (int i = 0; i <= FUZZY_TOP_N; i++) {
+            putchar('\n');
+        }
+        printf("\033[%dA", FUZZY_TOP_N + 1);
+
+        char *input = readline("Find note: ");
+        printf("\033[J");
+        fflush(stdout);
+        if (input && fuzzy_result_count > 0) {
+            chosen = paths[fuzzy_results[fuzzy_selected].index];
+        }
+        free(input);
+        rl_redisplay_function = rl_redisplay;
+    }
+
+    if (chosen) {
+        char full_path[FILE_PATH_MAX];
+        snprintf(full_path, sizeof(full_path), "%s/%s", target_dir, chosen);
+        printf("You are opening the file: %s\n", full_path);
+        open_in_neovim(full_path);
+    }
+
+    fuzzy_index_free(&fuzzy_notes);
+    free(paths);
+    catalog_free(&cat);
+}
+
+// Function to print one line of the vault listing
+void print_catalog_line(const char *line, void *ctx) {
+    (void)ctx;
+    printf("%s\n", line);
+}
+
+void print_list_usage() {
+    fprintf(stderr, "Usage: silica list [--tag <tag>] [--where <key>[=<value>]] [--and | --or ...]\n");
+    fprintf(stderr, "                   [--recent N] [--since <date>] [--until <date>] [--created]\n");
+}
+
+// Function to list all notes from the vault catalog, rescanning only changed directories
+void list_notes(int argc, char *argv[]) {
+    tag_term *terms = calloc((size_t)argc + 1, sizeof(tag_term));
+    if (terms == NULL) {
+        perror("calloc");
+        return;
+    }
+
+    // Terms combine left to right, --or joins the next term by OR instead of the default AND
+    size_t term_count = 0;
+    int next_or = 0;
+    int by_time = 0;
+    long recent = 0;
+    int64_t since = INT64_MIN, until = INT64_MAX;
+    time_field field = TIME_MODIFIED;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--recent") == 0 && i + 1 < argc) {
+            char *end;
+            errno = 0;
+            recent = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || errno == ERANGE || recent <= 0) {
+                fprintf(stderr, "--recent takes a number of notes greater than 0, not '%s'\n", argv[i]);
+                print_list_usage();
+                free(terms);
+                return;
+            }
+            by_time = 1;
+        } else if ((strcmp(argv[i], "--since") == 0 || strcmp(argv[i], "--until") == 0) && i + 1 < argc) {
+            int is_until = argv[i][2] == 'u';
+            if (!time_parse(argv[++i], is_until, is_until ? &until : &since)) {
+                fprintf(stderr, "Unrecognised time '%s', use YYYY-MM-DD[ HH:MM], today, yesterday or 7d\n", argv[i]);
+                free(terms);
+                return;
+            }
+            by_time = 1;
+        } else if (strcmp(argv[i], "--created") == 0) {
+            field = TIME_CREATED;
+            by_time = 1;
+        } else if (strcmp(argv[i], "--or") == 0) {
+            next_or = 1;
+        } else if (strcmp(argv[i], "--and") == 0) {
+            next_or = 0;
+        } else if (strcmp(argv[i], "--tag") == 0 && i + 1 < argc) {
+            terms[term_count].key = TAG_KEY;
+            terms[term_count].value = argv[++i];
+            terms[term_count++].or = next_or;
+            next_or = 0;
+        } else if (strcmp(argv[i], "--where") == 0 && i + 1 < argc) {
+            char *equals = strchr(argv[++i], '=');
+            if (equals) {
+                *equals = '\0';
+            }
+            terms[term_count].key = argv[i];
+            terms[term_count].value = equals ? equals + 1 : NULL;
+            terms[term_count++].or = next_or;
+            next_or = 0;
+        } else {
+            print_list_usage();
+            free(terms);
+            return;
+        }
+    }
+    if (by_time) {
+        list_recent_notes(terms, term_count, field, recent, since, until);
+        free(terms);
+        return;
+    }
+    if (term_count > 0) {
+        list_tagged_notes(terms, term_count);
+        free(terms);
+        return;
+    }
+    free(terms);
+
+    // A running daemon already holds the rendered listing
+    if (daemon_list(print_catalog_line, NULL)) {
+        return;
+    }
+
+    char catalog_path[FILE_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, target_dir, catalog_path)) {
+        fprintf(stderr, "Error listing notes\n");
+        catalog_free(&cat);
+        return;
+    }
+
+    catalog_walk_tree(&cat, print_catalog_line, NULL);
+    catalog_free(&cat);
+}
+
+// Function to list the notes matching tag and frontmatter terms from the tag index
+void list_tagged_notes(const tag_term *terms, size_t term_count) {
+    silica_hits hits;
+    if (!silica_list_tagged(target_dir, terms, term_count, &hits)) {
+        return;
+    }
+    if (hits.count == 0) {
+        printf("No notes match.\n");
+    }
+    for (size_t i = 0; i < hits.count; i++) {
+        printf("%s\n", hits.hits[i].path);
+    }
+    silica_hits_free(&hits);
+}
+
+// Function to list notes newest first by modification or creation time. Tag terms, when given, filter
+// the listing.
+void list_recent_notes(const tag_term *terms, size_t term_count, time_field field, long recent, int64_t since,
+                       int64_t until) {
+    silica_hits hits;
+    if (!silica_list_recent(target_dir, terms, term_count, field, recent, since, until, &hits)) {
+        return;
+    }
+    if (hits.count == 0) {
+        printf("No notes match.\n");
+    }
+    for (size_t i = 0; i < hits.count; i++) {
+        time_t seconds = (time_t)(hits.hits[i].time / 1000000000LL);
+        struct tm local;
+        char when[TIMESTAMP_MAX];
+        localtime_r(&seconds, &local);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &local);
+        printf("%s  %s\n", when, hits.hits[i].path);
+    }
+    silica_hits_free(&hits);
+}
+
+// Function to print the notes a note links to, or with backlinks the notes linking to it. The note is
+// named by its path in the vault or the way a [[link]] would name it.
+void show_links(const char *note, int backlinks) {
+    silica_hits hits;
+    int found = silica_links(target_dir, note, backlinks, &hits);
+    if (found < 0) {
+        return;
+    }
+    if (!found) {
+        fprintf(stderr, "No note matches %s\n", note);
+    } else if (hits.count == 0) {
+        printf(backlinks ? "No notes link here.\n" : "No links.\n");
+    }
+    for (size_t i = 0; i < hits.count; i++) {
+        printf(hits.hits[i].resolved ? "%s\n" : "%s (no such note)\n", hits.hits[i].path);
+    }
+    silica_hits_free(&hits);
+}
+
+// Function to list the notes whose contents are most like a note's, by the cosine similarity of their
+// embeddings. Results can be kept to one org/repo bucket, or with --same-repo to the note's own.
+void show_related(int argc, char *argv[]) {
+    const char *note = NULL, *bucket = NULL;
+    int same_repo = 0;
+    long count = RELATED_DEFAULT_COUNT;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--same-repo") == 0) {
+            same_repo = 1;
+        } else if (strcmp(argv[i], "--repo") == 0 && i + 1 < argc) {
+            bucket = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (argv[i][0] != '-' && note == NULL) {
+            note = argv[i];
+        } else {
+            note = NULL;
+            break;
+        }
+    }
+    if (note == NULL || count <= 0 || count > 1000) {
+        fprintf(stderr, "Usage: silica related <note> [--same-repo | --repo <org/repo>] [-n 10]\n");
+        return;
+    }
+
+    silica_hits hits;
+    int found = silica_related(target_dir, note, bucket, same_repo, (size_t)count, &hits);
+    if (found < 0) {
+        return;
+    }
+    if (!found) {
+        fprintf(stderr, "No note matches %s\n", note);
+    } else if (hits.count == 0) {
+        printf("No related notes.\n");
+    }
+    for (size_t i = 0; i < hits.count; i++) {
+        printf("%3.0f%%  %s\n", hits.hits[i].similarity * 100.0f, hits.hits[i].path);
+    }
+    silica_hits_free(&hits);
+}
+
+// Function to list clusters of near-duplicate notes grouped by bucket, each note with its estimated
+// similarity to the first one. A directory restricts the report to clusters with a note under it.
+void find_duplicates(int argc, char *argv[]) {
+    double threshold = DUPE_DEFAULT_THRESHOLD;
+    const char *subdir = "";
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+            threshold = threshold > 1.0 ? threshold / 100.0 : threshold;  // Also accept a percentage
+        } else if (argv[i][0] != '-') {
+            subdir = argv[i];
+        } else {
+            fprintf(stderr, "Usage: silica dupes [dir] [--threshold 0.8]\n");
+            return;
+        }
+    }
+    if (threshold <= 0.0 || threshold > 1.0) {
+        fprintf(stderr, "The threshold is a similarity between 0 and 1\n");
+        return;
+    }
+
+    silica_cluster *clusters;
+    size_t cluster_count;
+    if (!silica_find_duplicates(target_dir, subdir, threshold, &clusters, &cluster_count)) {
+        return;
+    }
+
+    size_t note_count = 0;
+    for (size_t i = 0; i < cluster_count; i++) {
+        const silica_cluster *cluster = &clusters[i];
+        if (i == 0 || strcmp(cluster->bucket, clusters[i - 1].bucket) != 0) {
+            printf("%s%s\n", i ? "\n" : "", cluster->bucket[0] ? cluster->bucket : "(vault root)");
+        } else {
+            printf("\n");
+        }
+        for (size_t j = 0; j < cluster->notes.count; j++) {
+            const silica_hit *hit = &cluster->notes.hits[j];
+            if (j == 0) {
+                printf("          %s\n", hit->path);
+            } else {
+                printf("    %3.0f%%  %s\n", hit->similarity * 100.0, hit->path);
+            }
+        }
+        note_count += cluster->notes.count;
+    }
+    if (cluster_count == 0) {
+        printf("No near-duplicate notes at %.0f%% similarity.\n", threshold * 100.0);
+    } else {
+        printf("\n%zu notes in %zu cluster%s at %.0f%% similarity or more\n", note_count, cluster_count,
+               cluster_count == 1 ? "" : "s", threshold * 100.0);
+    }
+    silica_clusters_free(clusters, cluster_count);
+}
+
+// Function to search note contents through the inverted index, printing the first matching line of each
+void grep_notes(int argc, char *argv[]) {
+    const char *bucket = NULL;
+    long limit = 50;
+    char query[1024] = "";
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--repo") == 0 && i + 1 < argc) {
+            bucket = argv[++i];
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit = strtol(argv[++i], NULL, 10);
+        } else {
+            // An argument the shell kept together is treated as a phrase
+            int phrase = strchr(argv[i], ' ') != NULL && strchr(argv[i], '"') == NULL;
+            size_t used = strlen(query);
+            snprintf(query + used, sizeof(query) - used, "%s%s%s%s", used ? " " : "",
+                     phrase ? "\"" : "", argv[i], phrase ? "\"" : "");
+        }
+    }
+
+    if (query[0] == '\0') {
+        fprintf(stderr, "Usage: silica grep [--repo <org/repo>] [--limit N] <words | \"phrase\">\n");
+        return;
+    }
+
+    silica_hits hits;
+    if (!silica_grep(target_dir, query, bucket, limit > 0 ? (size_t)limit : 0, &hits)) {
+        return;
+    }
+    if (hits.count == 0) {
+        printf("No notes match.\n");
+    }
+    for (size_t i = 0; i < hits.count; i++) {
+        char line[1024];
+        int line_number = silica_snippet(target_dir, hits.hits[i].path, query, line, sizeof(line));
+        if (line_number > 0) {
+            printf("%s:%d: %.200s\n", hits.hits[i].path, line_number, line);
+        } else {
+            printf("%s\n", hits.hits[i].path);
+        }
+    }
+    silica_hits_free(&hits);
+}
+
+void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Function to print what the watcher is doing, once when it starts and then after every batch
+void print_watch_batch(const vault_watcher *watcher, const watch_batch *batch, long long elapsed_ms, void *ctx) {
+    (void)ctx;
+    if (batch == NULL && watcher->fd >= 0) {
+        printf("Watching %s (%zu directories)\n", target_dir, watcher->watch_count);
+    } else if (batch == NULL) {
+        printf("inotify unavailable, polling %s every %d ms\n", target_dir, WATCH_POLL_INTERVAL_MS);
+    } else {
+        char timestamp[TIMESTAMP_MAX];
+        generate_timestamp(timestamp, sizeof(timestamp));
+        printf("[%s] %s%zu directories rescanned, %d notes indexed (%lld ms)\n", timestamp,
+               batch->overflow ? "event queue overflowed, " : "", batch->dirs_rescanned, batch->notes_indexed,
+               elapsed_ms);
+    }
+    fflush(stdout);
+}
+
+// Function to keep the catalog and search index in step with the vault until interrupted
+void watch_vault() {
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    silica_watch(target_dir, &stop_requested, print_watch_batch, NULL);
+}
+
+// Function to run the daemon that answers other silica invocations from memory
+void serve_vault() {
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    if (!daemon_serve(target_dir, &stop_requested)) {
+        fprintf(stderr, "Error starting the silica daemon\n");
     }
 }
 
@@ -356,65 +1044,19 @@ void config_target_dir() {
     free(api_input);
 }
 
+// Function to load the settings into config and the target_dir and api_key globals
 int load_target_dir_from_config() {
-    char config_path[FILE_PATH_MAX];
-    snprintf(config_path, sizeof(config_path), "%s/%s", getenv("HOME"), OBS_CONFIG_FILE);
-
-    FILE *file = fopen(config_path, "r");
-    if (!file) {
-        return 0;
-    }
-
-    char line[MAX_LINE_LENGTH];
-    while (fgets(line, sizeof(line), file)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-        }
-
-        // Check for the target_dir line
-        if (strncmp(line, "TARGET_DIR=", 11) == 0) {
-            strncpy(target_dir, line + 11, sizeof(target_dir) - 1);
-            target_dir[sizeof(target_dir) - 1] = '\0';
-        }
-
-        // Check for the api_key line
-        else if (strncmp(line, "OPEN_AI_API_KEY=", 16) == 0) {
-            strncpy(api_key, line + 16, sizeof(api_key) - 1);
-            api_key[sizeof(api_key) - 1] = '\0';
-        }
-    }
-
-    fclose(file);
-
-    // Verify both target_dir and api_key were loaded
-    if (strlen(target_dir) > 0 && strlen(api_key) > 0) {
-        return 1;
-    }
-
-    return 0;
+    int loaded = silica_config_load(&config);
+    snprintf(target_dir, sizeof(target_dir), "%s", config.target_dir);
+    snprintf(api_key, sizeof(api_key), "%s", config.api_key);
+    return loaded;
 }
 
 void write_target_dir_to_config(const char *path, const char *key) {
-    char config_path[FILE_PATH_MAX];
-    snprintf(config_path, sizeof(config_path), "%s/%s", getenv("HOME"), OBS_CONFIG_FILE);
-
-    FILE *file = fopen(config_path, "w");
-    if (!file) {
-        perror("Failed to open config file");
-        return;
+    snprintf(config.target_dir, sizeof(config.target_dir), "%s", path);
+    snprintf(config.api_key, sizeof(config.api_key), "%s", key);
+    if (silica_config_save(&config)) {
+        snprintf(target_dir, sizeof(target_dir), "%s", config.target_dir);
+        snprintf(api_key, sizeof(api_key), "%s", config.api_key);
     }
-
-    // Write the target directory and the API key to the config file
-    fprintf(file, "TARGET_DIR=%s\n", path);
-    fprintf(file, "OPEN_AI_API_KEY=%s\n", key);
-    fclose(file);
-
-    // Update the global target_dir and api_key variables
-    strncpy(target_dir, path, sizeof(target_dir) - 1);
-    target_dir[sizeof(target_dir) - 1] = '\0';
-
-    strncpy(api_key, key, sizeof(api_key) - 1);
-    api_key[sizeof(api_key) - 1] = '\0';
 }
-
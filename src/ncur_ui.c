@@ -1,13 +1,30 @@
+#define _GNU_SOURCE  // fopencookie
 #include <ncurses.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <locale.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../utils/silica.h"
+#include "../utils/vault_tree.h"
+#include "../utils/fuzzy.h"
 
 #define ASCII_ART_FILE "/Users/shaneshort/Documents/Development/noodling/obs-cli/static/ascii_logo.txt"
-#define CONFIG_FILE_PATH "/Users/shaneshort/obs/.config"
+#define ASCII_ART_MAX_LINES 32
 #define MAX_LINES_PER_PAGE 13 // Adjust this value as needed for your box height
+#define STATS_ENV "SILICA_TUI_STATS" // File to log the bytes written to the terminal per frame
+#define VAULT_LOOKAHEAD MAX_LINES_PER_PAGE // Rows drawn ahead of the page on either side
+#define VAULT_WINDOW_ROWS (MAX_LINES_PER_PAGE + 2 * VAULT_LOOKAHEAD)
+#define VAULT_POLL_MS 20 // How often keys stop waiting to look for the loader's progress
+#define PREVIEW_TAB_WIDTH 4
 
 // Define menu options
 char *menu_items[] = {
@@ -18,45 +35,82 @@ char *menu_items[] = {
     "Clean up a rough note"
 };
 
-// Function to display ASCII art
-void display_ascii_art(int start_row, int col) {
+// The regions of the screen, each a window of its own that is repainted only when marked dirty
+enum {
+    PANE_WELCOME,
+    PANE_ART,
+    PANE_MENU,
+    PANE_DETAIL,
+    PANE_STATUS,
+    PANE_PREVIEW,               // Over the ASCII art while the vault browser has the keys
+    PANE_COUNT
+};
+
+typedef struct {
+    WINDOW *win;
+    int dirty;
+    int hidden;                 // Kept off the screen, the panes below show instead
+} tui_pane;
+
+static tui_pane panes[PANE_COUNT];
+
+// The ASCII art, read once at startup
+static char art_lines[ASCII_ART_MAX_LINES][256];
+static int art_line_count = -1;  // -1 when the file could not be read
+
+// With STATS_ENV set, ncurses draws on a pseudo-terminal and a thread copies its output to the real
+// terminal, counting the bytes, while another forwards the keys
+typedef struct {
+    FILE *log;
+    int master;
+    FILE *slave;
+    struct termios saved;       // Mode of the real terminal to restore
+    pthread_t output_thread;
+    atomic_llong bytes;         // Written to the real terminal so far
+    long long frame_start;      // Value of bytes when the current frame was drawn
+    long long frames;
+    const char *frame_reason;
+    double started_ms;          // When the terminal was opened
+    double frame_ms;            // When the current frame was drawn
+} terminal_stats;
+
+static terminal_stats stats = {0};
+
+// Function to read the ASCII art into memory
+void load_ascii_art(void) {
     FILE *file = fopen(ASCII_ART_FILE, "r");
     if (file == NULL) {
-        mvprintw(start_row, col, "Failed to open ASCII art file.");
         return;
     }
 
-    char line[256];
-    int current_row = start_row;
-
-    // Read each line from the file and print it to the screen
-    while (fgets(line, sizeof(line), file)) {
-        mvprintw(current_row++, col, "%s", line);  // Print line at the specified position
+    art_line_count = 0;
+    while (art_line_count < ASCII_ART_MAX_LINES && fgets(art_lines[art_line_count], sizeof(art_lines[0]), file)) {
+        art_lines[art_line_count][strcspn(art_lines[art_line_count], "\n")] = '\0';
+        art_line_count++;
     }
 
     fclose(file);
 }
 
-// Function to draw rounded corners box
-void draw_rounded_box(int start_row, int start_col, int height, int width) {
-    mvaddch(start_row, start_col, ACS_ULCORNER); // Upper left corner
-    mvaddch(start_row, start_col + width - 1, ACS_URCORNER); // Upper right corner
-    mvaddch(start_row + height - 1, start_col, ACS_LLCORNER); // Lower left corner
-    mvaddch(start_row + height - 1, start_col + width - 1, ACS_LRCORNER); // Lower right corner
-
-    for (int i = 1; i < width - 1; i++) {
-        mvaddch(start_row, start_col + i, ACS_HLINE); // Top horizontal line
-        mvaddch(start_row + height - 1, start_col + i, ACS_HLINE); // Bottom horizontal line
+// Function to display the ASCII art loaded at startup
+void display_ascii_art(WINDOW *win) {
+    if (art_line_count < 0) {
+        mvwprintw(win, 0, 0, "Failed to open ASCII art file.");
+        return;
     }
 
-    for (int i = 1; i < height - 1; i++) {
-        mvaddch(start_row + i, start_col, ACS_VLINE); // Left vertical line
-        mvaddch(start_row + i, start_col + width - 1, ACS_VLINE); // Right vertical line
+    for (int i = 0; i < art_line_count; i++) {
+        mvwaddstr(win, i, 0, art_lines[i]);
     }
 }
 
+// Function to draw rounded corners box around a window
+void draw_rounded_box(WINDOW *win) {
+    wborder(win, ACS_VLINE, ACS_VLINE, ACS_HLINE, ACS_HLINE, ACS_ULCORNER, ACS_URCORNER, ACS_LLCORNER, ACS_LRCORNER);
+}
+
 // Function to print multi-line text within a box
-void print_multiline(int start_row, int start_col, const char *message, int width) {
+void print_multiline(WINDOW *win, int start_row, int start_col, const char *message, int width) {
     int line_start = 0;
     int message_length = strlen(message);
 
@@ -83,7 +137,7 @@ void print_multiline(int start_row, int start_col, const char *message, int widt
         line_buffer[line_length] = '\0';  // Null-terminate the string
 
         // Print the line, ensuring it starts within the box boundaries
-        mvprintw(start_row++, start_col + 1, "%s", line_buffer);
+        mvwprintw(win, start_row++, start_col + 1, "%s", line_buffer);
 
         // Skip past the processed part of the message
         line_start += line_length;
@@ -95,235 +149,1084 @@ void print_multiline(int start_row, int start_col, const char *message, int widt
     }
 }
 
-// Function to read the configuration file and return its contents
-char* read_config_file(const char* filepath) {
-    FILE *file = fopen(filepath, "r");
-    if (file == NULL) {
-        return strdup("Failed to open configuration file.");
-    }
-
-    char *buffer = NULL;
-    size_t total_size = 0;
-    
-    // Temporary buffer to read chunks of the file
-    char temp_buffer[256];
-    
-    while (fgets(temp_buffer, sizeof(temp_buffer), file) != NULL) {
-        size_t temp_len = strlen(temp_buffer);
-        char *new_buffer = realloc(buffer, total_size + temp_len + 1); // Reallocate memory
-        
-        if (new_buffer == NULL) {
-            free(buffer); // Free the previous buffer if realloc fails
-            fclose(file);
-            return strdup("Memory allocation error.");
+// Function to describe the configuration, with all but the end of the API key masked
+char* read_config(void) {
+    silica_config config;
+    char config_path[CATALOG_PATH_MAX];
+    silica_config_path(config_path, sizeof(config_path));
+    if (!silica_config_load(&config) && config.target_dir[0] == '\0') {
+        char message[CATALOG_PATH_MAX + 64];
+        snprintf(message, sizeof(message), "No configuration in %s, run 'silica config'.", config_path);
+        return strdup(message);
+    }
+
+    char masked[SILICA_CONFIG_VALUE_MAX] = "(not set)";
+    size_t key_length = strlen(config.api_key);
+    if (key_length > 0) {
+        size_t shown = key_length > 8 ? 4 : 0;
+        size_t stars = key_length - shown < sizeof(masked) - shown - 1 ? key_length - shown : sizeof(masked) - shown - 1;
+        memset(masked, '*', stars);
+        snprintf(masked + stars, sizeof(masked) - stars, "%s", config.api_key + key_length - shown);
+    }
+
+    char *contents = malloc(CATALOG_PATH_MAX * 2);
+    if (contents == NULL) {
+        return strdup("Memory allocation error.");
+    }
+    snprintf(contents, CATALOG_PATH_MAX * 2, "Config: %s\nVault: %s\nAPI key: %s\nAuto name: %s", config_path,
+             config.target_dir, masked, config.auto_name ? "on" : "off");
+    return contents;
+}
+
+// A copy of the vault as the loader hands it over, its notes sorted by path and indexed for the filter
+typedef struct {
+    silica_vault vault;
+    const char **paths;         // Borrowed from the catalog
+    fuzzy_index notes;
+    int fresh;                  // The copy has been checked against the disk
+} vault_copy;
+
+// One row of the filtered list, with the characters the query matched
+typedef struct {
+    size_t note;
+    size_t matched;
+    int positions[FUZZY_QUERY_MAX];
+} filter_row;
+
+// The vault browser. A loader thread hands over copies of the vault, first as the catalog saved it and then
+// brought up to date, while keys keep working. Only the rows around the page are ever drawn.
+typedef struct {
+    pthread_t thread;
+    int loading;                // The loader thread has not been joined yet
+    pthread_mutex_t lock;       // Guards pending and finished
+    vault_copy *pending;        // Handed over by the loader, not shown yet
+    int finished;
+    vault_copy *vault;          // Shown
+    vault_tree tree;
+    size_t cursor;              // Row under the cursor
+    size_t top;                 // First row on the page
+    size_t window_first;        // First row held in the window
+    int window_count;           // Rows held in the window, -1 after the rows changed
+    char window[VAULT_WINDOW_ROWS][VAULT_TREE_LINE_MAX];
+
+    // The filter, listing the matching notes instead of the outline while it is active
+    int filtered;
+    int editing;                // Keys go to the query
+    char query[FUZZY_QUERY_MAX];
+    size_t query_length;
+    size_t tree_cursor;         // Where the outline was left
+    size_t tree_top;
+    filter_row filter_window[VAULT_WINDOW_ROWS];
+} vault_browser;
+
+static vault_browser browser = {.lock = PTHREAD_MUTEX_INITIALIZER, .window_count = -1};
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+void free_vault_copy(vault_copy *copy) {
+    if (copy == NULL) {
+        return;
+    }
+    fuzzy_index_free(&copy->notes);
+    free(copy->paths);
+    silica_vault_close(&copy->vault);
+    free(copy);
+}
+
+// Function to read a copy of the vault, from the saved catalog or brought up to date, and index its notes
+vault_copy *read_vault_copy(const char *root, int fresh) {
+    vault_copy *copy = calloc(1, sizeof(vault_copy));
+    if (copy == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    if (!(fresh ? silica_vault_open(&copy->vault, root) : silica_vault_load(&copy->vault, root))) {
+        free_vault_copy(copy);
+        return NULL;
+    }
+    copy->fresh = fresh;
+
+    const catalog *cat = &copy->vault.cat;
+    copy->paths = malloc((cat->entry_count ? cat->entry_count : 1) * sizeof(char *));
+    if (copy->paths == NULL) {
+        perror("malloc");
+        free_vault_copy(copy);
+        return NULL;
+    }
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        copy->paths[i] = cat->entries[i].path;
+    }
+    qsort(copy->paths, cat->entry_count, sizeof(char *), compare_paths);
+    if (!fuzzy_index_build(&copy->notes, copy->paths, cat->entry_count)) {
+        free_vault_copy(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+// Function to pass a copy of the vault to the UI, replacing one it has not picked up yet
+static void hand_over_vault(vault_copy *copy) {
+    pthread_mutex_lock(&browser.lock);
+    free_vault_copy(browser.pending);
+    browser.pending = copy;
+    pthread_mutex_unlock(&browser.lock);
+}
+
+// Function run by the loader thread: the saved catalog is handed over at once, the synced one when ready
+static void *load_vault(void *arg) {
+    (void)arg;
+    silica_config config;
+    silica_config_load(&config);
+
+    if (config.target_dir[0] != '\0') {
+        vault_copy *saved = read_vault_copy(config.target_dir, 0);
+        if (saved != NULL) {
+            hand_over_vault(saved);
         }
+        vault_copy *synced = read_vault_copy(config.target_dir, 1);
+        if (synced != NULL) {
+            hand_over_vault(synced);
+        }
+    }
 
-        buffer = new_buffer;
-        strcpy(buffer + total_size, temp_buffer); // Append new data to the buffer
-        total_size += temp_len;
+    pthread_mutex_lock(&browser.lock);
+    browser.finished = 1;
+    pthread_mutex_unlock(&browser.lock);
+    return NULL;
+}
+
+// Function to start reading the vault in the background, unless that is already under way
+void start_vault_loader(void) {
+    if (browser.loading) {
+        return;
+    }
+    browser.finished = 0;
+    if (pthread_create(&browser.thread, NULL, load_vault, NULL) != 0) {
+        perror("pthread_create");
+        return;
     }
+    browser.loading = 1;
+}
 
-    fclose(file);
+// Function to count the rows the browser is showing, notes matching the filter or the outline
+size_t browser_rows(void) {
+    if (browser.vault == NULL) {
+        return 0;
+    }
+    return browser.filtered ? browser.vault->notes.survivor_count : vault_tree_rows(&browser.tree);
+}
 
-    // Check if no data was read
-    if (total_size == 0) {
-        free(buffer);
-        return strdup("Configuration file is empty.");
+// Function to keep the cursor on a row and the page around it
+void clamp_vault_cursor(void) {
+    size_t rows = browser_rows();
+    if (browser.cursor >= rows) {
+        browser.cursor = rows > 0 ? rows - 1 : 0;
     }
+    if (browser.top > browser.cursor) {
+        browser.top = browser.cursor;
+    }
+}
 
-    return buffer;
+// Function to narrow the notes to those matching the query. fuzzy_search only rescans the last matches
+// when the query extends the previous one, so typing costs less with every key.
+void run_filter(void) {
+    if (browser.vault != NULL) {
+        fuzzy_search(&browser.vault->notes, browser.query, NULL, 0);
+    }
+    browser.window_count = -1;
 }
 
-char** split_output_into_lines(char* output, int* total_lines) {
-    char** lines = NULL;
-    char* line = strtok(output, "\n");
-    int count = 0;
+// Function to show the copy of the vault the loader handed over, keeping open directories open.
+// Returns 1 when the browser changed.
+int poll_vault_loader(void) {
+    if (!browser.loading) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&browser.lock);
+    vault_copy *copy = browser.pending;
+    int finished = browser.finished;
+    browser.pending = NULL;
+    pthread_mutex_unlock(&browser.lock);
 
-    while (line != NULL) {
-        lines = realloc(lines, sizeof(char*) * (count + 1));
-        lines[count] = strdup(line);
-        count++;
-        line = strtok(NULL, "\n");
+    // The loader hands its last copy over before it finishes, so nothing can arrive after this
+    if (finished) {
+        pthread_join(browser.thread, NULL);
+        browser.loading = 0;
+    }
+    if (copy == NULL) {
+        return finished;
     }
 
-    *total_lines = count; // Set total lines
-    return lines;
+    vault_tree tree;
+    if (!vault_tree_init(&tree, &copy->vault)) {
+        free_vault_copy(copy);
+        return finished;
+    }
+    if (browser.vault != NULL) {
+        vault_tree_reopen(&tree, &browser.tree);
+        vault_tree_free(&browser.tree);
+        free_vault_copy(browser.vault);
+    }
+    browser.vault = copy;
+    browser.tree = tree;
+    browser.window_count = -1;
+    if (browser.filtered) {
+        run_filter();
+    }
+    clamp_vault_cursor();
+    return 1;
 }
 
-// Modify the `run_obs_list` function to return total lines
-char** run_obs_list(int* total_lines) {
-    FILE *fp;
-    char *buffer = NULL;
-    size_t total_size = 0;
+// Function to draw the rows around the page into the window, if they are not there already.
+// Filtered rows keep the positions the query matched, so redrawing them does not match again.
+void fill_vault_window(void) {
+    size_t rows = browser_rows();
+    size_t page_end = browser.top + MAX_LINES_PER_PAGE < rows ? browser.top + MAX_LINES_PER_PAGE : rows;
+    if (browser.window_count >= 0 && browser.top >= browser.window_first &&
+        page_end <= browser.window_first + (size_t)browser.window_count) {
+        return;
+    }
 
-    fp = popen("silica list", "r");
-    if (fp == NULL) {
-        *total_lines = 0; // Set total lines to 0 on failure
-        return NULL;
+    browser.window_first = browser.top > VAULT_LOOKAHEAD ? browser.top - VAULT_LOOKAHEAD : 0;
+    browser.window_count = 0;
+    if (browser.filtered) {
+        const fuzzy_index *notes = &browser.vault->notes;
+        for (size_t row = browser.window_first; row < rows && browser.window_count < VAULT_WINDOW_ROWS; row++) {
+            filter_row *filter = &browser.filter_window[browser.window_count++];
+            filter->note = notes->survivors[row];
+            filter->matched = fuzzy_match_positions(notes, filter->note, browser.query, filter->positions,
+                                                    FUZZY_QUERY_MAX);
+        }
+        return;
     }
 
-    char temp_buffer[256];
-    while (fgets(temp_buffer, sizeof(temp_buffer), fp) != NULL) {
-        size_t temp_len = strlen(temp_buffer);
-        char *new_buffer = realloc(buffer, total_size + temp_len + 1);
-        if (new_buffer == NULL) {
-            free(buffer);
-            pclose(fp);
-            *total_lines = 0; // Set total lines to 0 on failure
-            return NULL;
+    vault_tree_cursor cursor;
+    if (!vault_tree_seek(&browser.tree, browser.window_first, &cursor)) {
+        return;
+    }
+    do {
+        vault_tree_format(&cursor, browser.window[browser.window_count], VAULT_TREE_LINE_MAX);
+        browser.window_count++;
+    } while (browser.window_count < VAULT_WINDOW_ROWS && vault_tree_next(&cursor));
+}
+
+// Function to move the cursor by delta rows, scrolling the page to keep it in view
+void move_vault_cursor(long long delta) {
+    size_t rows = browser_rows();
+    if (rows == 0) {
+        return;
+    }
+
+    long long cursor = (long long)browser.cursor + delta;
+    cursor = cursor < 0 ? 0 : cursor >= (long long)rows ? (long long)rows - 1 : cursor;
+    browser.cursor = (size_t)cursor;
+    if (browser.cursor < browser.top) {
+        browser.top = browser.cursor;
+    } else if (browser.cursor >= browser.top + MAX_LINES_PER_PAGE) {
+        browser.top = browser.cursor - MAX_LINES_PER_PAGE + 1;
+    }
+    if (rows >= MAX_LINES_PER_PAGE && browser.top > rows - MAX_LINES_PER_PAGE) {
+        browser.top = rows - MAX_LINES_PER_PAGE;
+    }
+}
+
+// Function to open or close the directory under the cursor. With close_only, a note or a closed
+// directory moves the cursor to its parent instead.
+void toggle_vault_dir(int close_only) {
+    vault_tree_cursor cursor;
+    if (browser.vault == NULL || browser.filtered || !vault_tree_seek(&browser.tree, browser.cursor, &cursor)) {
+        return;
+    }
+
+    const silica_item *item = vault_tree_item(&cursor);
+    if (item->dir >= 0 && vault_tree_is_open(&browser.tree, item->dir)) {
+        vault_tree_close(&browser.tree, item->dir);
+    } else if (item->dir >= 0 && !close_only) {
+        vault_tree_open(&browser.tree, item->dir);
+    } else {
+        move_vault_cursor(-(long long)(browser.cursor - vault_tree_parent_row(&cursor)));
+        return;
+    }
+    browser.window_count = -1;
+    move_vault_cursor(0);
+}
+
+// Function to start typing a filter, keeping the query when one is already active
+void start_filter(void) {
+    if (!browser.filtered) {
+        browser.tree_cursor = browser.cursor;
+        browser.tree_top = browser.top;
+        browser.query[0] = '\0';
+        browser.query_length = 0;
+        browser.filtered = 1;
+        browser.cursor = 0;
+        browser.top = 0;
+        run_filter();
+    }
+    browser.editing = 1;
+}
+
+// Function to drop the filter and go back to where the outline was left
+void clear_filter(void) {
+    browser.filtered = 0;
+    browser.editing = 0;
+    browser.cursor = browser.tree_cursor;
+    browser.top = browser.tree_top;
+    browser.window_count = -1;
+    clamp_vault_cursor();
+}
+
+// Function to apply a key typed while the filter has the keys
+void edit_filter(int c) {
+    if (c == 10) { // Enter keeps the filter and hands the keys back to the list
+        browser.editing = 0;
+    } else if (c == 27) {
+        clear_filter();
+    } else if (c == KEY_DOWN || c == KEY_UP) {
+        move_vault_cursor(c == KEY_DOWN ? 1 : -1);
+    } else if (c == KEY_BACKSPACE || c == 127 || c == 8) {
+        if (browser.query_length > 0) {
+            browser.query[--browser.query_length] = '\0';
+            browser.cursor = 0;
+            browser.top = 0;
+            run_filter();
         }
-        buffer = new_buffer;
-        strcpy(buffer + total_size, temp_buffer);
-        total_size += temp_len;
+    } else if (c >= 32 && c < 127 && browser.query_length < FUZZY_QUERY_MAX - 1) {
+        browser.query[browser.query_length++] = (char)c;
+        browser.query[browser.query_length] = '\0';
+        browser.cursor = 0;
+        browser.top = 0;
+        run_filter();
+    }
+}
+
+// Function to stop the loader and free the vault
+void free_vault_browser(void) {
+    if (browser.loading) {
+        pthread_join(browser.thread, NULL);
+        browser.loading = 0;
+    }
+    free_vault_copy(browser.pending);
+    browser.pending = NULL;
+    if (browser.vault != NULL) {
+        vault_tree_free(&browser.tree);
+        free_vault_copy(browser.vault);
+        browser.vault = NULL;
     }
+}
 
-    pclose(fp);
+// The note in the preview pane. It is mapped rather than read and its lines are found only as far down as
+// the pane has been scrolled, so a huge note costs what is on the screen.
+typedef struct {
+    char wanted[CATALOG_PATH_MAX];  // Note under the cursor, "" on a directory
+    int pending;                    // wanted is loaded once no key is waiting, a key arriving first replaces it
+    char path[CATALOG_PATH_MAX];    // Note mapped, "" when it could not be
+    int fd;
+    const char *text;
+    size_t size;
+    long long mtime;
+    size_t *lines;                  // Offsets of the line starts found so far
+    size_t line_count;
+    size_t line_capacity;
+    int complete;                   // Every line start has been found
+    size_t top;                     // First line in the pane
+} note_preview;
 
-    // Check if no data was read
-    if (total_size == 0) {
-        free(buffer);
-        *total_lines = 0; // Set total lines to 0 on empty output
-        return NULL;
+static note_preview preview = {.fd = -1};
+
+// Function to unmap the previewed note
+void close_preview(void) {
+    if (preview.text != NULL) {
+        munmap((void *)preview.text, preview.size);
+    }
+    if (preview.fd >= 0) {
+        close(preview.fd);
+    }
+    free(preview.lines);
+    preview.path[0] = '\0';
+    preview.fd = -1;
+    preview.text = NULL;
+    preview.size = 0;
+    preview.lines = NULL;
+    preview.line_count = 0;
+    preview.line_capacity = 0;
+    preview.complete = 0;
+}
+
+// Function to map a note for the preview, returns 0 when it cannot be read
+int open_preview(const char *path) {
+    close_preview();
+    preview.fd = open(path, O_RDONLY);
+    struct stat st;
+    if (preview.fd < 0 || fstat(preview.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close_preview();
+        return 0;
     }
 
-    // Split output into lines
-    return split_output_into_lines(buffer, total_lines);
+    preview.size = (size_t)st.st_size;
+    preview.mtime = CATALOG_STAT_MTIME(st);
+    if (preview.size > 0) {
+        void *text = mmap(NULL, preview.size, PROT_READ, MAP_PRIVATE, preview.fd, 0);
+        if (text == MAP_FAILED) {
+            preview.size = 0;
+            close_preview();
+            return 0;
+        }
+        preview.text = text;
+    }
+
+    preview.lines = malloc(64 * sizeof(size_t));
+    if (preview.lines == NULL) {
+        close_preview();
+        return 0;
+    }
+    preview.line_capacity = 64;
+    preview.lines[0] = 0;
+    preview.line_count = 1;
+    preview.complete = preview.size == 0;
+    snprintf(preview.path, sizeof(preview.path), "%s", path);
+    return 1;
 }
 
-int main() {
-    setlocale(LC_ALL, "");
+// Function to find line starts until the end of line last is known, or the note runs out
+void find_preview_lines(size_t last) {
+    while (!preview.complete && preview.line_count <= last + 1) {
+        size_t start = preview.lines[preview.line_count - 1];
+        const char *newline = memchr(preview.text + start, '\n', preview.size - start);
+        if (newline == NULL || (size_t)(newline - preview.text) + 1 >= preview.size) {
+            preview.complete = 1;
+            break;
+        }
 
-    // Initialize ncurses mode
-    initscr();
-    clear();
-    noecho();
-    cbreak(); // Disable line buffering, pass input directly
-    keypad(stdscr, TRUE); // Enable special keys to be captured
+        if (preview.line_count == preview.line_capacity) {
+            size_t *lines = realloc(preview.lines, preview.line_capacity * 2 * sizeof(size_t));
+            if (lines == NULL) {
+                preview.complete = 1;  // Show what has been found
+                break;
+            }
+            preview.lines = lines;
+            preview.line_capacity *= 2;
+        }
+        preview.lines[preview.line_count++] = (size_t)(newline - preview.text) + 1;
+    }
+}
 
-    // Initialize color support
-    start_color();
-    init_pair(1, COLOR_CYAN, COLOR_BLACK); // Define color pair (foreground, background)
+// Function to note which note the cursor is on, to be loaded once the keys stop coming
+void request_preview(void) {
+    char wanted[CATALOG_PATH_MAX] = "";
+    const char *note = NULL;
+    if (browser.vault != NULL && browser.filtered && browser.cursor < browser.vault->notes.survivor_count) {
+        note = browser.vault->paths[browser.vault->notes.survivors[browser.cursor]];
+    } else if (browser.vault != NULL && !browser.filtered) {
+        vault_tree_cursor cursor;
+        if (vault_tree_seek(&browser.tree, browser.cursor, &cursor) && vault_tree_item(&cursor)->dir < 0) {
+            note = vault_tree_item(&cursor)->path;
+        }
+    }
+    if (note != NULL) {
+        snprintf(wanted, sizeof(wanted), "%s/%s", browser.vault->vault.cat.root, note);
+    }
 
-    // Get the screen size
-    int row, col;
-    getmaxyx(stdscr, row, col);
+    if (strcmp(wanted, preview.wanted) != 0) {
+        snprintf(preview.wanted, sizeof(preview.wanted), "%s", wanted);
+        preview.pending = 1;
+    }
+}
 
-    // Menu setup
-    int num_choices = sizeof(menu_items) / sizeof(menu_items[0]);
-    int highlight = 0; // Keeps track of the currently highlighted item
-    int choice = 0;    // Keeps track of the selected choice
+// Function to map the note the cursor settled on
+void load_preview(void) {
+    preview.pending = 0;
+    preview.top = 0;
+    if (preview.wanted[0] == '\0' || !open_preview(preview.wanted)) {
+        close_preview();
+    }
+}
+
+// Function to scroll the preview by delta lines, finding line starts only as far as the new top
+void scroll_preview(long long delta) {
+    if (preview.path[0] == '\0') {
+        return;
+    }
+    if (delta < 0) {
+        preview.top = (size_t)-delta > preview.top ? 0 : preview.top - (size_t)-delta;
+        return;
+    }
+
+    find_preview_lines(preview.top + (size_t)delta);
+    preview.top += (size_t)delta;
+    if (preview.complete && preview.top >= preview.line_count) {
+        preview.top = preview.line_count - 1;
+    }
+}
+
+// Function to read the monotonic clock in milliseconds
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+// Function to copy everything ncurses writes to the pseudo-terminal out to the real one
+static void *relay_output(void *arg) {
+    (void)arg;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(stats.master, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t written = 0; written < n;) {
+            ssize_t w = write(STDOUT_FILENO, buffer + written, n - written);
+            if (w <= 0) {
+                return NULL;
+            }
+            written += w;
+        }
+        atomic_fetch_add(&stats.bytes, n);
+    }
+    return NULL;
+}
+
+// Function to forward the keys typed on the real terminal to the pseudo-terminal
+static void *relay_input(void *arg) {
+    (void)arg;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+        if (write(stats.master, buffer, n) != n) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Function to start ncurses on a pseudo-terminal the size of the real one, logging bytes per frame to
+// log_path. Returns 0 when that is not possible, so the caller falls back to initscr().
+int open_stats_terminal(const char *log_path) {
+    stats.log = fopen(log_path, "w");
+    if (stats.log == NULL) {
+        perror("Failed to open stats log");
+        return 0;
+    }
+
+    stats.master = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave = -1;
+    if (stats.master >= 0 && grantpt(stats.master) == 0 && unlockpt(stats.master) == 0) {
+        slave = open(ptsname(stats.master), O_RDWR | O_NOCTTY);
+    }
+    if (slave < 0 || tcgetattr(STDIN_FILENO, &stats.saved) != 0) {
+        perror("Failed to open pseudo-terminal");
+        fclose(stats.log);
+        stats.log = NULL;
+        return 0;
+    }
+
+    struct winsize size;
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == 0) {
+        ioctl(slave, TIOCSWINSZ, &size);
+    }
+
+    // The line discipline of the pseudo-terminal does what ncurses asks for, the real one passes bytes through
+    struct termios raw = stats.saved;
+    cfmakeraw(&raw);
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+    pthread_t input_thread;
+    pthread_create(&stats.output_thread, NULL, relay_output, NULL);
+    pthread_create(&input_thread, NULL, relay_input, NULL);
+    pthread_detach(input_thread);
+
+    stats.slave = fdopen(slave, "r+");
+    stats.started_ms = now_ms();
+    return newterm(NULL, stats.slave, stats.slave) != NULL;
+}
+
+// Function to log the bytes the previous frame sent to the terminal. Its output has been relayed by the
+// time the next key arrives, so each frame is logged when the next one starts.
+static void log_frame(void) {
+    long long bytes = atomic_load(&stats.bytes);
+    if (stats.frames > 0) {
+        fprintf(stats.log, "frame %lld at %.1f ms: %lld bytes (%s)\n", stats.frames, stats.frame_ms,
+                bytes - stats.frame_start, stats.frame_reason);
+    }
+    stats.frame_start = bytes;
+}
+
+// Function to end ncurses, restore the real terminal and write the totals to the stats log
+void close_terminal(void) {
+    if (stats.log == NULL) {
+        endwin();
+        return;
+    }
+
+    log_frame();
+    endwin();
+    fclose(stats.slave);  // The output thread stops once it has read the rest
+    pthread_join(stats.output_thread, NULL);
+    tcsetattr(STDIN_FILENO, TCSANOW, &stats.saved);
+
+    long long total = atomic_load(&stats.bytes);
+    fprintf(stats.log, "exit: %lld bytes\n", total - stats.frame_start);
+    fprintf(stats.log, "%lld frames, %lld bytes\n", stats.frames, total);
+    fclose(stats.log);
+    close(stats.master);
+}
+
+// Function to create a pane's window, clipped to the screen. The window is NULL when none of it is visible.
+void open_pane(int pane, int height, int width, int start_row, int start_col) {
+    if (panes[pane].win != NULL) {
+        delwin(panes[pane].win);
+    }
+    panes[pane].win = NULL;
+    panes[pane].dirty = 1;
 
-    // Declare variables for vault management
-    char **vault_lines = NULL; // Lines for the vault
-    int total_lines = 0;       // Total number of lines
-    int total_pages = 0;       // Total pages for vault lines
-    int current_page = 0;      // Current page of vault lines
+    if (start_row < 0) {
+        height += start_row;
+        start_row = 0;
+    }
+    if (start_row + height > LINES) {
+        height = LINES - start_row;
+    }
+    if (start_col + width > COLS) {
+        width = COLS - start_col;
+    }
+    if (height > 0 && width > 0) {
+        panes[pane].win = newwin(height, width, start_row, start_col);
+    }
+}
+
+// Function to put the panes back on the screen after the preview covering some of them is hidden
+void uncover_panes(void) {
+    touchwin(stdscr);
+    wnoutrefresh(stdscr);
+    for (int i = 0; i < PANE_COUNT; i++) {
+        if (panes[i].win != NULL) {
+            touchwin(panes[i].win);
+            panes[i].dirty = 1;
+        }
+    }
+}
+
+// Function to lay the panes out for the current screen size
+void layout_panes(int num_choices) {
+    int row = LINES;
+    int col = COLS;
 
     // Calculate vertical centering for menu and ASCII art
     int menu_start_row = (row - num_choices) / 2 - 6; // Start the menu at the vertical center
     int ascii_start_row = row / 6 - 2; // Start ASCII art vertically above center
     int selected_opt_row = row - 21;
 
-    // Instructions message
-    char *instructions = "Use hjkl to navigate, Enter to select, i to edit config, q to quit";
-    char *welcome_message = "Obsidian CLI: Here you can view, create, edit, and otherwise manage notes in your obsidian vault.";
+    open_pane(PANE_WELCOME, 6, 44, ascii_start_row, 8);
+    open_pane(PANE_ART, art_line_count > 0 ? art_line_count : 1, col - 70, ascii_start_row, 70);
+    open_pane(PANE_MENU, num_choices + 2, 25, menu_start_row, 8);
+    open_pane(PANE_DETAIL, 16, 55, selected_opt_row, 8);
+    open_pane(PANE_STATUS, 3, col, row - 2, 0);
+    open_pane(PANE_PREVIEW, selected_opt_row + 16 - ascii_start_row, col - 67, ascii_start_row, 66);
 
-    // Variable to hold configuration file contents
-    char *config_contents = NULL;
+    // The screen behind the panes is blank, it is cleared once here instead of on every key
+    clearok(curscr, TRUE);
+    touchwin(stdscr);
+    wnoutrefresh(stdscr);
+}
 
-    // Main loop
-    while (1) {
-        // Clear the screen and print instructions and ASCII art
-        clear();
-
-        // Draw boxes around elements
-        draw_rounded_box(ascii_start_row, 8, 6, 44); // Increased height for ASCII art box
-        draw_rounded_box(menu_start_row, 8, num_choices + 2, 25); // Box for menu
-        draw_rounded_box(row - 2, 0, 3, col); // Box for instructions
-        draw_rounded_box(selected_opt_row, 8, 16, 55); // Box for selected option display
-
-        // Print welcome message using the new function
-        print_multiline(ascii_start_row + 1, 9, welcome_message, 43); // 44 is the box width
-        display_ascii_art(ascii_start_row, 70); // Adjust width as needed
-
-        // Display the menu on the left side, centered vertically
-        for (int i = 0; i < num_choices; ++i) {
-            if (i == highlight) {
-                attron(A_REVERSE); // Highlight the selected menu item
-            }
-            mvprintw(menu_start_row + 1 + i, 10, menu_items[i]); // Align menu items vertically centered
-            attroff(A_REVERSE); // Turn off highlighting
+// Function to copy the panes that changed to the screen and send the difference to the terminal
+void present_frame(const char *reason) {
+    int dirty = 0;
+    for (int i = 0; i < PANE_COUNT; i++) {
+        dirty |= panes[i].dirty;
+    }
+    if (!dirty) {
+        return;
+    }
+
+    for (int i = 0; i < PANE_COUNT; i++) {
+        if (panes[i].dirty && panes[i].win != NULL && !panes[i].hidden) {
+            wnoutrefresh(panes[i].win);
         }
+        panes[i].dirty = 0;
+    }
+
+    if (stats.log != NULL) {
+        log_frame();
+        stats.frames++;
+        stats.frame_reason = reason;
+        stats.frame_ms = now_ms() - stats.started_ms;
+    }
+    doupdate();
+}
+
+// Function to draw the instructions for whichever pane has the keys
+void draw_status(const char *instructions) {
+    WINDOW *win = panes[PANE_STATUS].win;
+    if (win == NULL) {
+        return;
+    }
+
+    werase(win);
+    draw_rounded_box(win);
+    mvwprintw(win, 1, 2, "%s", instructions);
+    panes[PANE_STATUS].dirty = 1;
+}
+
+// Function to draw the panes that only change with the screen size
+void draw_static_panes(const char *welcome_message, const char *instructions) {
+    WINDOW *win = panes[PANE_WELCOME].win;
+    if (win != NULL) {
+        draw_rounded_box(win);
+        print_multiline(win, 1, 0, welcome_message, 43); // 44 is the box width
+    }
+
+    if (panes[PANE_ART].win != NULL) {
+        display_ascii_art(panes[PANE_ART].win);
+    }
+
+    draw_status(instructions);
+}
 
-        // Print instructions at the bottom
-        mvprintw(row - 1, 2, instructions);
+// Function to draw the menu with the highlighted item in reverse video
+void draw_menu(int num_choices, int highlight) {
+    WINDOW *win = panes[PANE_MENU].win;
+    if (win == NULL) {
+        return;
+    }
 
-        // Print the selected option in the bottom right box
-        if (highlight == 0) {
-            mvprintw(selected_opt_row + 1, 9, "Selected: %s", menu_items[highlight]); // Print selection in box
+    werase(win);
+    draw_rounded_box(win);
+    for (int i = 0; i < num_choices; ++i) {
+        if (i == highlight) {
+            wattron(win, A_REVERSE); // Highlight the selected menu item
         }
+        mvwprintw(win, 1 + i, 2, "%s", menu_items[i]);
+        wattroff(win, A_REVERSE);
+    }
+    panes[PANE_MENU].dirty = 1;
+}
 
+// Function to find how many bytes of a UTF-8 line fit in columns, one column per character
+int clip_utf8(const char *line, int columns) {
+    int bytes = 0;
+    while (line[bytes] != '\0' && columns > 0) {
+        bytes++;
+        while ((line[bytes] & 0xC0) == 0x80) {
+            bytes++;
+        }
+        columns--;
+    }
+    return bytes;
+}
 
-        // Print the selected option in the bottom right box
-        if (highlight >= 0 && highlight < num_choices) {
-            // Prepare the formatted string for the selected option
-            char buffer[100]; // Buffer for the formatted string
-            snprintf(buffer, sizeof(buffer), "Selected: %s", menu_items[highlight]); // Format selection
+// Function to draw a note matched by the filter, the matched characters in bold
+void draw_filter_row(WINDOW *win, int y, const filter_row *filter, int columns) {
+    const char *path = browser.vault->paths[filter->note];
+    int limit = clip_utf8(path, columns);
+    int drawn = 0;
+    for (size_t i = 0; i < filter->matched && filter->positions[i] < limit; i++) {
+        int position = filter->positions[i];
+        mvwaddnstr(win, y, 1 + drawn, path + drawn, position - drawn);
+        wattron(win, A_BOLD | A_UNDERLINE);
+        waddch(win, (unsigned char)path[position]);
+        wattroff(win, A_BOLD | A_UNDERLINE);
+        drawn = position + 1;
+    }
+    mvwaddnstr(win, y, 1 + drawn, path + drawn, limit - drawn);
+}
 
-            // Calculate the position to print the selected item
-            int left_column = 9; // Column for "Selected: " text
-            mvprintw(selected_opt_row + 1, left_column, "%s", buffer); // Print the formatted string on the left
+// Function to draw the page of the vault browser, the cursor row in reverse video while it has the keys
+void draw_vault_page(WINDOW *win, int browsing) {
+    if (browser.vault == NULL) {
+        mvwprintw(win, 2, 1, browser.loading ? "Loading vault..." : "No output from obs list.");
+        return;
+    }
 
-            // Calculate the position for the page number
-            if (total_pages > 0) {
-                // Format the page info
-                char page_info[20]; // Buffer for page info
-                snprintf(page_info, sizeof(page_info), "[%d/%d]", current_page + 1, total_pages); // Page number format
+    size_t rows = browser_rows();
+    char page_info[64];
+    snprintf(page_info, sizeof(page_info), "%s[%zu/%zu]", browser.vault->fresh ? "" : "syncing ",
+             rows > 0 ? browser.cursor + 1 : 0, rows);
+    mvwprintw(win, 1, getmaxx(win) - (int)strlen(page_info) - 2, "%s", page_info);
+    if (browser.filtered) {
+        // Over "Selected: View vault", which is as wide as the longest query that fits
+        mvwprintw(win, 1, 1, "%-*s", getmaxx(win) - (int)strlen(page_info) - 4, "");
+        mvwprintw(win, 1, 1, "Filter: /%.*s", getmaxx(win) - (int)strlen(page_info) - 14, browser.query);
+    }
 
-                int box_width = 55; // Width of your box
-                int page_info_column = box_width - strlen(page_info) - 2; // Calculate column for right-justifying the page info
+    fill_vault_window();
+    wattron(win, COLOR_PAIR(1)); // Turn on the color pair for vault content
+    for (size_t row = browser.top; row < browser.top + MAX_LINES_PER_PAGE && row < rows; row++) {
+        int y = 2 + (int)(row - browser.top);
+        if (browsing && row == browser.cursor) {
+            wattron(win, A_REVERSE);
+        }
+        if (browser.filtered) {
+            draw_filter_row(win, y, &browser.filter_window[row - browser.window_first], getmaxx(win) - 2);
+        } else {
+            const char *line = browser.window[row - browser.window_first];
+            mvwaddnstr(win, y, 1, line, clip_utf8(line, getmaxx(win) - 2));
+        }
+        wattroff(win, A_REVERSE);
+    }
+    wattroff(win, COLOR_PAIR(1)); // Turn off the color pair
+}
 
-                // Print the page info at the calculated position
-                mvprintw(selected_opt_row + 1, page_info_column, "%s", page_info);
+// Function to draw one line of a note from its first character, tabs expanded and cut at the pane's edge
+void draw_note_line(WINDOW *win, int y, const char *text, size_t length, int columns) {
+    int column = 0;
+    size_t i = 0;
+    wmove(win, y, 1);
+    while (i < length && column < columns) {
+        size_t width = 1;
+        while (i + width < length && ((unsigned char)text[i + width] & 0xC0) == 0x80) {
+            width++;
+        }
+
+        unsigned char c = (unsigned char)text[i];
+        if (c == '\t') {
+            int spaces = PREVIEW_TAB_WIDTH - column % PREVIEW_TAB_WIDTH;
+            for (; spaces > 0 && column < columns; spaces--, column++) {
+                waddch(win, ' ');
             }
+        } else if (c >= 32 && c != 127) {
+            waddnstr(win, text + i, (int)width);
+            column++;
         }
-        // Display configuration file contents if "Configuration" is selected
-        if (highlight == 0 && config_contents) {
-            attron(COLOR_PAIR(1)); // Turn on the color pair for configuration content
-            print_multiline(selected_opt_row + 2, 9, config_contents, 54); // Print contents in the box
-            attroff(COLOR_PAIR(1)); // Turn off the color pair
+        i += width;
+    }
+}
+
+// Function to draw the lines of the previewed note that fit in the pane, and no others
+void draw_preview(void) {
+    WINDOW *win = panes[PANE_PREVIEW].win;
+    if (win == NULL) {
+        return;
+    }
+    panes[PANE_PREVIEW].dirty = 1;
+    werase(win);
+    draw_rounded_box(win);
+    int height = getmaxy(win) - 2;
+    int columns = getmaxx(win) - 2;
+
+    // A note rewritten since it was mapped is mapped again, reading past a shortened file would fault
+    struct stat st;
+    if (preview.path[0] != '\0' && (fstat(preview.fd, &st) != 0 || (size_t)st.st_size != preview.size ||
+                                    CATALOG_STAT_MTIME(st) != preview.mtime)) {
+        size_t top = preview.top;
+        load_preview();
+        scroll_preview((long long)top);
+    }
+
+    if (preview.path[0] == '\0') {
+        if (preview.wanted[0] != '\0' && !preview.pending) {
+            mvwprintw(win, 1, 1, "Could not read the note.");
         }
+        return;
+    }
 
-        if (highlight == 1) {
-            if (vault_lines == NULL) {
-                vault_lines = run_obs_list(&total_lines); // Load new vault contents
-                total_pages = (total_lines + MAX_LINES_PER_PAGE - 1) / MAX_LINES_PER_PAGE; // Calculate total pages
-                current_page = 0; // Reset to first page
-            }
+    const char *slash = strrchr(preview.path, '/');
+    mvwprintw(win, 0, 2, " %.*s ", columns - 4, slash ? slash + 1 : preview.path);
+
+    find_preview_lines(preview.top + (size_t)height - 1);
+    for (int i = 0; i < height && preview.top + (size_t)i < preview.line_count; i++) {
+        size_t line = preview.top + (size_t)i;
+        size_t start = preview.lines[line];
+        size_t end = line + 1 < preview.line_count ? preview.lines[line + 1] - 1 : preview.size;
+        if (end > start && preview.text[end - 1] == '\n') {
+            end--;  // The last line's newline
+        }
+        draw_note_line(win, 1 + i, preview.text + start, end - start, columns);
+    }
+
+    char position[64];
+    if (preview.complete) {
+        snprintf(position, sizeof(position), " %zu/%zu ", preview.top + 1, preview.line_count);
+    } else {
+        snprintf(position, sizeof(position), " %zu/? ", preview.top + 1);
+    }
+    mvwprintw(win, height + 1, columns - (int)strlen(position), "%s", position);
+}
+
+// Function to draw the instructions while the vault browser has the keys, or the query being typed
+void draw_browser_status(void) {
+    char prompt[FUZZY_QUERY_MAX + 64];
+    if (browser.editing) {
+        snprintf(prompt, sizeof(prompt), "/%s_   Enter to keep the filter, Esc to clear it", browser.query);
+    } else if (browser.filtered) {
+        snprintf(prompt, sizeof(prompt),
+                 "j/k to move, n/N to page, J/K to scroll the note, / to change the filter, Esc to clear it");
+    } else {
+        snprintf(prompt, sizeof(prompt),
+                 "j/k to move, l/Enter to open, h to close, n/N to page, J/K to scroll the note, / to filter, "
+                 "r to reload, Esc to go back");
+    }
+    draw_status(prompt);
+}
 
-            if (vault_lines != NULL) {
-                attron(COLOR_PAIR(1)); // Turn on the color pair for vault content
+// Function to draw the box for the selected option: the configuration, or the vault browser
+void draw_detail(int highlight, const char *config_contents, int browsing) {
+    WINDOW *win = panes[PANE_DETAIL].win;
+    if (win == NULL) {
+        return;
+    }
 
-                // Calculate the starting and ending line for current page
-                int start_line = current_page * MAX_LINES_PER_PAGE;
-                int end_line = (start_line + MAX_LINES_PER_PAGE < total_lines) ? start_line + MAX_LINES_PER_PAGE : total_lines;
+    werase(win);
+    draw_rounded_box(win);
+    mvwprintw(win, 1, 1, "Selected: %s", menu_items[highlight]);
 
-                // Print the lines for the current page
-                for (int i = start_line; i < end_line; i++) {
-                    mvprintw(selected_opt_row + 2 + (i - start_line), 9, "%s", vault_lines[i]);
-                }
+    // Display configuration file contents if "Configuration" is selected
+    if (highlight == 0 && config_contents) {
+        wattron(win, COLOR_PAIR(1)); // Turn on the color pair for configuration content
+        print_multiline(win, 2, 0, config_contents, 54); // Print contents in the box
+        wattroff(win, COLOR_PAIR(1)); // Turn off the color pair
+    }
 
-                attroff(COLOR_PAIR(1)); // Turn off the color pair
-            } else {
-                mvprintw(selected_opt_row + 2, 9, "No output from obs list.");
-            }
+    if (highlight == 1) {
+        draw_vault_page(win, browsing);
+    }
+    panes[PANE_DETAIL].dirty = 1;
+}
+
+int main() {
+    setlocale(LC_ALL, "");
+    load_ascii_art();
+
+    // Initialize ncurses mode, on a counting pseudo-terminal when asked to measure the output
+    const char *stats_path = getenv(STATS_ENV);
+    if (stats_path == NULL || stats_path[0] == '\0' || !open_stats_terminal(stats_path)) {
+        initscr();
+    }
+    noecho();
+    cbreak(); // Disable line buffering, pass input directly
+    curs_set(0);
+    set_escdelay(25); // Esc leaves the vault browser, there is no need to wait for the rest of a sequence
+
+    // Initialize color support
+    start_color();
+    init_pair(1, COLOR_CYAN, COLOR_BLACK); // Define color pair (foreground, background)
+
+    // Menu setup
+    int num_choices = sizeof(menu_items) / sizeof(menu_items[0]);
+    int highlight = 0; // Keeps track of the currently highlighted item
+    int choice = 0;    // Keeps track of the selected choice
+    int browsing = 0;  // The vault browser has the keys
+
+    // Instructions message
+    char *instructions = "Use hjkl to navigate, Enter to select, i to edit config, q to quit";
+    char *welcome_message = "Obsidian CLI: Here you can view, create, edit, and otherwise manage notes in your obsidian vault.";
+
+    // Variable to hold configuration file contents
+    char *config_contents = NULL;
+
+    // Every pane is drawn once, after that only the ones a key changed are repainted
+    layout_panes(num_choices);
+    panes[PANE_PREVIEW].hidden = 1; // Shown over the art while the vault browser has the keys
+    draw_static_panes(welcome_message, instructions);
+    draw_menu(num_choices, highlight);
+    draw_detail(highlight, config_contents, browsing);
+    const char *reason = "start";
+
+    // Main loop
+    while (1) {
+        present_frame(reason);
+
+        // Capture user input, keys come through the menu window so stdscr is never refreshed over the panes.
+        // While the vault loads, waiting for a key times out now and then to show what has arrived. A note
+        // waiting for the preview is only opened when no key is, so a held j does not open every note it passes.
+        WINDOW *input = panes[PANE_MENU].win != NULL ? panes[PANE_MENU].win : stdscr;
+        keypad(input, TRUE); // Enable special keys to be captured
+        wtimeout(input, browsing && preview.pending ? 0 : browser.loading ? VAULT_POLL_MS : -1);
+        int c = wgetch(input);
+        if (poll_vault_loader() && highlight == 1) {
+            draw_detail(highlight, config_contents, browsing);
+            request_preview();
+        }
+        reason = c == ERR ? "vault" : "key";
+        if (c == ERR && browsing && preview.pending) {
+            load_preview();
+            draw_preview();
+            reason = "preview";
+        }
+        if (c == ERR) {
+            continue;
         }
 
-        // Refresh the screen to show changes
-        refresh();
+        int previous_highlight = highlight;
+        int previous_browsing = browsing;
+        int previous_filter = browser.filtered * 2 + browser.editing;
+        if (browsing && browser.editing && c != KEY_RESIZE) {
+            edit_filter(c);
+            draw_browser_status(); // Shows the query as it is typed
+            draw_detail(highlight, config_contents, browsing);
+            request_preview();
+            continue;
+        }
+        if (browsing) {
+            switch (c) {
+                case 'j':
+                case KEY_DOWN:
+                    move_vault_cursor(1);
+                    break;
+                case 'k':
+                case KEY_UP:
+                    move_vault_cursor(-1);
+                    break;
+                case 'n': // Next page
+                    browser.top += MAX_LINES_PER_PAGE;
+                    move_vault_cursor(MAX_LINES_PER_PAGE);
+                    break;
+                case 'N': // Previous page
+                    browser.top = browser.top > MAX_LINES_PER_PAGE ? browser.top - MAX_LINES_PER_PAGE : 0;
+                    move_vault_cursor(-MAX_LINES_PER_PAGE);
+                    break;
+                case 'l':
+                case 10:
+                    toggle_vault_dir(0);
+                    break;
+                case 'h':
+                    toggle_vault_dir(1);
+                    break;
+                case 'r': // Read the vault again
+                    start_vault_loader();
+                    break;
+                case '/': // Narrow the notes as a query is typed
+                    start_filter();
+                    break;
+                case 'J': // Scroll the preview
+                    scroll_preview(1);
+                    draw_preview();
+                    break;
+                case 'K':
+                    scroll_preview(-1);
+                    draw_preview();
+                    break;
+                case 'D':
+                    scroll_preview(MAX_LINES_PER_PAGE);
+                    draw_preview();
+                    break;
+                case 'U':
+                    scroll_preview(-MAX_LINES_PER_PAGE);
+                    draw_preview();
+                    break;
+                case 27: // Esc clears the filter, or hands the keys back to the menu
+                    if (browser.filtered) {
+                        clear_filter();
+                    } else {
+                        browsing = 0;
+                    }
+                    break;
+            }
+            if (c != 'q' && c != KEY_RESIZE) { // The rest only mean something to the browser
+                if (browsing != previous_browsing) {
+                    panes[PANE_PREVIEW].hidden = 1;
+                    uncover_panes();
+                    draw_status(instructions);
+                } else if (browser.filtered * 2 + browser.editing != previous_filter) {
+                    draw_browser_status();
+                }
+                draw_detail(highlight, config_contents, browsing);
+                request_preview();
+                continue;
+            }
+        }
 
-        // Capture user input
-        int c = getch();
         switch (c) {
             case 'k': // Move up (Vim-style)
                 highlight = (highlight == 0) ? num_choices - 1 : highlight - 1;
@@ -336,44 +1239,56 @@ int main() {
                 // Handle the selection
                 if (choice == 0) {
                     free(config_contents); // Free previously allocated memory
-                    config_contents = read_config_file(CONFIG_FILE_PATH); // Load new config contents
+                    config_contents = read_config(); // Load new config contents
                 }
-                if (choice == 1) { // Only if "View vault" is selected
-                    free(vault_lines); // Free previously allocated memory
-                    vault_lines = NULL; // Reset the vault lines
+                if (choice == 1) { // Browse the vault, reading it first if that has not happened yet
+                    if (browser.vault == NULL) {
+                        start_vault_loader();
+                    }
+                    browsing = 1;
+                    draw_browser_status();
+                    panes[PANE_PREVIEW].hidden = 0;
+                    request_preview();
+                    draw_preview();
                 }
+                draw_detail(highlight, config_contents, browsing);
                 break;
-            case 'n': // Next page
-                if (current_page < total_pages - 1) {
-                    current_page++;
-                }
-                break;
-            case 'N': // Previous page
-                if (current_page > 0) {
-                    current_page--;
+            case KEY_RESIZE: // Lay the panes out again and redraw all of them
+                layout_panes(num_choices);
+                draw_static_panes(welcome_message, instructions);
+                if (browsing) {
+                    draw_browser_status();
+                    draw_preview();
                 }
+                draw_menu(num_choices, highlight);
+                draw_detail(highlight, config_contents, browsing);
+                reason = "resize";
                 break;
             case 'i': // Open configuration file in Neovim
                 // ... [existing code]
                 break;
             case 'q': // Exit on 'q' key
                 free(config_contents);
-                for (int i = 0; i < total_lines; i++) {
-                    free(vault_lines[i]);
-                }
-                free(vault_lines); // Free vault lines before exit
-                endwin();
+                free_vault_browser();
+                close_preview();
+                close_terminal();
                 return 0;
         }
+
+        if (highlight != previous_highlight) {
+            // The vault starts loading as soon as it is highlighted, so it is usually there by Enter
+            if (highlight == 1 && browser.vault == NULL) {
+                start_vault_loader();
+            }
+            draw_menu(num_choices, highlight);
+            draw_detail(highlight, config_contents, browsing);
+        }
     }
 
     // Cleanup before exiting
     free(config_contents);
-    for (int i = 0; i < total_lines; i++) {
-        free(vault_lines[i]);
-    }
-    free(vault_lines);
-    endwin();
+    free_vault_browser();
+    close_preview();
+    close_terminal();
     return 0;
 }
-
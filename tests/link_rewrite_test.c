@@ -0,0 +1,112 @@
+// link_rewrite_test.c
+// Journals two renames of a batch but only makes the first, as a batch cut short between journaling a
+// rename and making it would, and updates the link index after the rename as a running daemon would.
+// Resuming must rewrite the links to the renamed note from the index kept with the journal and leave
+// the links to the note that was never renamed alone.
+#include "catalog.h"
+#include "link_index.h"
+#include "link_rewrite.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char root[CATALOG_PATH_MAX];
+static char vault[CATALOG_PATH_MAX];
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    failures += !ok;
+}
+
+static void vault_path(const char *relative, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", vault, relative);
+}
+
+static void write_note(const char *relative, const char *text) {
+    char path[CATALOG_PATH_MAX];
+    vault_path(relative, path, sizeof(path));
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+static int note_is(const char *relative, const char *text) {
+    char path[CATALOG_PATH_MAX], buffer[256] = "";
+    vault_path(relative, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[length] = '\0';
+    fclose(file);
+    return strcmp(buffer, text) == 0;
+}
+
+// Function to bring the catalog and the link index up to date as obs does
+static int update_links(const char *index_path) {
+    char catalog_path[CATALOG_PATH_MAX];
+    snprintf(catalog_path, sizeof(catalog_path), "%s/catalog", root);
+    catalog cat;
+    catalog_init(&cat);
+    int ok = catalog_sync(&cat, vault, catalog_path) && catalog_restat(&cat) >= 0 &&
+             link_index_update(&cat, index_path) >= 0;
+    catalog_free(&cat);
+    return ok;
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/link_rewrite_test.XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(vault, sizeof(vault), "%s/vault", root);
+    mkdir(vault, 0777);
+
+    char index_path[CATALOG_PATH_MAX], journal_path[CATALOG_PATH_MAX], snapshot[CATALOG_PATH_MAX];
+    snprintf(index_path, sizeof(index_path), "%s/link_index", root);
+    snprintf(journal_path, sizeof(journal_path), "%s/rename_journal", root);
+    snprintf(snapshot, sizeof(snapshot), "%s.links", journal_path);
+
+    write_note("first.md", "one\n");
+    write_note("second.md", "two\n");
+    write_note("source.md", "[[first]] and [[second]]\n");
+    check(update_links(index_path), "index the links");
+
+    FILE *journal = link_journal_begin(journal_path, index_path);
+    check(journal != NULL && access(snapshot, F_OK) == 0, "begin the journal with a copy of the index");
+    if (journal == NULL) {
+        return 1;
+    }
+
+    char old_path[CATALOG_PATH_MAX], new_path[CATALOG_PATH_MAX];
+    vault_path("first.md", old_path, sizeof(old_path));
+    vault_path("renamed.md", new_path, sizeof(new_path));
+    check(link_journal_record(journal, "first.md", "renamed.md") && rename(old_path, new_path) == 0,
+          "journal a rename, then make it");
+    check(link_journal_record(journal, "second.md", "never.md"), "journal a rename that is never made");
+    fclose(journal);
+    check(update_links(index_path), "update the index after the rename");
+
+    link_rewrite_stats stats;
+    check(link_rewrite_apply(vault, index_path, journal_path, &stats), "resume the journal");
+    check(stats.renames == 1 && stats.renames_unindexed == 0 && stats.links_rewritten == 1,
+          "only the rename that was made counts");
+    check(note_is("source.md", "[[renamed]] and [[second]]\n"), "the link follows the renamed note");
+    check(access(journal_path, F_OK) != 0 && access(snapshot, F_OK) != 0, "the journal and its index are removed");
+
+    char command[CATALOG_PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    if (system(command) != 0) {
+        fprintf(stderr, "Failed to remove %s\n", root);
+    }
+    return failures > 0;
+}
@@ -0,0 +1,92 @@
+// related_index_test.c
+// Builds the related index from a vault of empty notes, then adds notes with words and updates it
+// incrementally. The first build has no entry point, the update must start the graph instead of
+// searching from one.
+#include "catalog.h"
+#include "search_index.h"
+#include "related_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char root[CATALOG_PATH_MAX];
+static char vault[CATALOG_PATH_MAX];
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    failures += !ok;
+}
+
+static void write_note(const char *relative, const char *text) {
+    char path[CATALOG_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", vault, relative);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+// Function to bring the catalog, the search index and the related index up to date as obs does
+static int update_indexes(void) {
+    char catalog_path[CATALOG_PATH_MAX], terms_path[CATALOG_PATH_MAX], related_path[CATALOG_PATH_MAX];
+    snprintf(catalog_path, sizeof(catalog_path), "%s/catalog", root);
+    snprintf(terms_path, sizeof(terms_path), "%s/search_index", root);
+    snprintf(related_path, sizeof(related_path), "%s/related_index", root);
+
+    catalog cat;
+    catalog_init(&cat);
+    search_index terms;
+    int ok = catalog_sync(&cat, vault, catalog_path) && catalog_restat(&cat) >= 0 &&
+             search_index_update(&cat, terms_path) >= 0 && search_index_open(&terms, terms_path);
+    if (ok) {
+        ok = related_index_update(&cat, &terms, related_path) >= 0;
+        search_index_close(&terms);
+    }
+    catalog_free(&cat);
+    return ok;
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/related_index_test.XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(vault, sizeof(vault), "%s/vault", root);
+    mkdir(vault, 0777);
+
+    write_note("a.md", "");
+    write_note("b.md", "");
+    check(update_indexes(), "index a vault of empty notes");
+
+    write_note("c.md", "rust borrow checker lifetimes and ownership rules\n");
+    write_note("d.md", "ownership rules and lifetimes in the rust borrow checker\n");
+    check(update_indexes(), "add notes with words to it");
+
+    char related_path[CATALOG_PATH_MAX];
+    snprintf(related_path, sizeof(related_path), "%s/related_index", root);
+    related_index index;
+    int opened = related_index_open(&index, related_path);
+    check(opened, "open the updated index");
+    if (opened) {
+        uint32_t note = related_index_find(&index, "c.md");
+        related_hit hits[RELATED_DEFAULT_COUNT];
+        size_t count = note != UINT32_MAX ? related_index_query(&index, note, NULL, hits, RELATED_DEFAULT_COUNT) : 0;
+        check(count == 1 && strcmp(related_node_path(&index, hits[0].note, NULL), "d.md") == 0,
+              "c.md is related to d.md");
+        related_index_close(&index);
+    }
+
+    char command[CATALOG_PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    if (system(command) != 0) {
+        fprintf(stderr, "Failed to remove %s\n", root);
+    }
+    return failures > 0;
+}
@@ -0,0 +1,96 @@
+// search_index_test.c
+// Indexes a vault, then edits, removes and adds notes. The update appends the new postings to the
+// existing lists and only marks the replaced notes, which queries must skip.
+#include "catalog.h"
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char root[CATALOG_PATH_MAX];
+static char vault[CATALOG_PATH_MAX];
+static char index_path[CATALOG_PATH_MAX];
+static int failures = 0;
+
+static void check(int ok, const char *what) {
+    printf("%s: %s\n", ok ? "ok" : "FAIL", what);
+    failures += !ok;
+}
+
+static void write_note(const char *relative, const char *text) {
+    char path[CATALOG_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", vault, relative);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+// Function to bring the catalog and the search index up to date as obs does
+static int update_index(void) {
+    char catalog_path[CATALOG_PATH_MAX];
+    snprintf(catalog_path, sizeof(catalog_path), "%s/catalog", root);
+
+    catalog cat;
+    catalog_init(&cat);
+    int ok = catalog_sync(&cat, vault, catalog_path) && catalog_restat(&cat) >= 0 &&
+             search_index_update(&cat, index_path) >= 0;
+    catalog_free(&cat);
+    return ok;
+}
+
+// Function to check that a query matches exactly one note, the expected one
+static int only_match(const search_index *index, const char *query, const char *expected) {
+    search_hit *hits;
+    size_t count = search_index_query(index, query, NULL, &hits);
+    int ok = count == 1 && strcmp(search_note_path(index, hits[0].note, NULL), expected) == 0;
+    free(hits);
+    return ok;
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/search_index_test.XXXXXX");
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(vault, sizeof(vault), "%s/vault", root);
+    snprintf(index_path, sizeof(index_path), "%s/search_index", root);
+    mkdir(vault, 0777);
+
+    write_note("a.md", "alpha beta\n");
+    write_note("b.md", "beta gamma\n");
+    check(update_index(), "index a vault");
+
+    write_note("a.md", "delta beta beta\n");
+    char removed[CATALOG_PATH_MAX];
+    snprintf(removed, sizeof(removed), "%s/b.md", vault);
+    unlink(removed);
+    write_note("c.md", "alpha gamma\n");
+    check(update_index(), "edit, remove and add notes");
+
+    search_index index;
+    int opened = search_index_open(&index, index_path);
+    check(opened, "open the updated index");
+    if (opened) {
+        check(index.header->note_count == 4 && index.header->live_count == 2,
+              "the new notes were appended and the old ones marked");
+        check(only_match(&index, "alpha", "c.md"), "the edited note no longer matches its old words");
+        check(only_match(&index, "beta", "a.md"), "the removed note no longer matches");
+        check(only_match(&index, "\"delta beta\"", "a.md"), "a phrase matches the edited note");
+        check(only_match(&index, "gamma", "c.md"), "a word of an old and a new note matches the new one");
+        search_index_close(&index);
+    }
+
+    char command[CATALOG_PATH_MAX + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    if (system(command) != 0) {
+        fprintf(stderr, "Failed to remove %s\n", root);
+    }
+    return failures > 0;
+}
@@ -0,0 +1,787 @@
+// catalog.c
+#include "catalog.h"
+#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define CATALOG_MAGIC "SILICA-CATALOG 1"
+#define CATALOG_LINE_MAX 4096
+
+// Old directory paths sorted for lookup while refreshing
+typedef struct {
+    const char *path;
+    int index;
+} dir_lookup;
+
+typedef struct {
+    catalog *out;
+    catalog *old;
+    dir_lookup *sorted;
+    size_t sorted_count;
+    const char *root;
+    const char **forced;        // Sorted directories to rescan even when their mtime is unchanged
+    size_t forced_count;
+    int trust_unforced;         // Reuse every other known directory without a stat
+    int rescanned;
+} refresh_state;
+
+// A directory listed by the parallel scanner, waiting to be placed in the catalog tree
+typedef struct {
+    char *path;
+    long long mtime;
+    catalog_entry *files;       // Paths owned until moved into the catalog
+    size_t file_count;
+    char **subdirs;
+    size_t subdir_count;
+} scanned_dir;
+
+typedef struct {
+    scanned_dir *dirs;
+    size_t count;
+    size_t capacity;
+    int failed;
+} scan_collector;
+
+// A child of a directory when printing the tree
+typedef struct {
+    const char *name;
+    int dir;
+} tree_node;
+
+void catalog_init(catalog *cat) {
+    memset(cat, 0, sizeof(*cat));
+}
+
+void catalog_free(catalog *cat) {
+    for (size_t i = 0; i < cat->dir_count; i++) {
+        free(cat->dirs[i].path);
+        free(cat->dirs[i].bucket);
+    }
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        free(cat->entries[i].path);
+    }
+    free(cat->dirs);
+    free(cat->entries);
+    catalog_init(cat);
+}
+
+// Function to build the default catalog location under ~/obs
+void catalog_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", CATALOG_FILE);
+}
+
+// Function to derive the repo bucket ("org/repo" or "temp") of a directory
+void catalog_bucket_for(const char *relative_path, char *bucket, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    bucket[0] = '\0';
+
+    const char *first = strchr(relative_path, '/');
+    size_t first_len = first ? (size_t)(first - relative_path) : strlen(relative_path);
+    if (first_len == 4 && strncmp(relative_path, "temp", 4) == 0) {
+        snprintf(bucket, size, "temp");
+        return;
+    }
+    if (first == NULL) {
+        return;
+    }
+
+    const char *second = strchr(first + 1, '/');
+    size_t len = second ? (size_t)(second - relative_path) : strlen(relative_path);
+    snprintf(bucket, size, "%.*s", (int)len, relative_path);
+}
+
+// Function to append a directory record, linking it under its parent
+static int append_dir(catalog *cat, const char *path, long long mtime, int parent) {
+    if (cat->dir_count == cat->dir_capacity) {
+        size_t capacity = cat->dir_capacity ? cat->dir_capacity * 2 : 64;
+        catalog_dir *dirs = realloc(cat->dirs, capacity * sizeof(*dirs));
+        if (dirs == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        cat->dirs = dirs;
+        cat->dir_capacity = capacity;
+    }
+
+    char bucket[CATALOG_BUCKET_MAX];
+    catalog_bucket_for(path, bucket, sizeof(bucket));
+
+    int index = (int)cat->dir_count;
+    catalog_dir *dir = &cat->dirs[index];
+    dir->path = strdup(path);
+    dir->bucket = strdup(bucket);
+    if (dir->path == NULL || dir->bucket == NULL) {
+        free(dir->path);
+        free(dir->bucket);
+        perror("strdup");
+        return -1;
+    }
+    dir->mtime = mtime;
+    dir->parent = parent;
+    dir->first_child = -1;
+    dir->next_sibling = -1;
+    dir->first_entry = cat->entry_count;
+    dir->entry_count = 0;
+
+    if (parent >= 0) {
+        dir->next_sibling = cat->dirs[parent].first_child;
+        cat->dirs[parent].first_child = index;
+    }
+
+    cat->dir_count++;
+    return index;
+}
+
+// Function to append a note to the catalog, taking ownership of path
+static int append_entry(catalog *cat, int dir, char *path, long long size, long long mtime, unsigned long long inode) {
+    if (cat->entry_count == cat->entry_capacity) {
+        size_t capacity = cat->entry_capacity ? cat->entry_capacity * 2 : 256;
+        catalog_entry *entries = realloc(cat->entries, capacity * sizeof(*entries));
+        if (entries == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        cat->entries = entries;
+        cat->entry_capacity = capacity;
+    }
+
+    catalog_entry *entry = &cat->entries[cat->entry_count++];
+    entry->path = path;
+    entry->bucket = cat->dirs[dir].bucket;
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->inode = inode;
+    entry->dir = dir;
+    return 0;
+}
+
+static int compare_lookup(const void *a, const void *b) {
+    return strcmp(((const dir_lookup *)a)->path, ((const dir_lookup *)b)->path);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const catalog_entry *)a)->path, ((const catalog_entry *)b)->path);
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Function to find a directory of the previous catalog by path
+static int find_old_dir(const refresh_state *state, const char *path) {
+    size_t low = 0, high = state->sorted_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(state->sorted[mid].path, path);
+        if (cmp == 0) {
+            return state->sorted[mid].index;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return -1;
+}
+
+// Function to join the vault root and a relative path
+static void join_path(char *buf, size_t size, const char *root, const char *relative_path) {
+    if (relative_path[0] != '\0') {
+        snprintf(buf, size, "%s/%s", root, relative_path);
+    } else {
+        snprintf(buf, size, "%s", root);
+    }
+}
+
+static int is_forced(const refresh_state *state, const char *path) {
+    size_t low = 0, high = state->forced_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(state->forced[mid], path);
+        if (cmp == 0) {
+            return 1;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+static int refresh_dir(refresh_state *state, const char *relative_path, int old_index, int parent);
+
+// Function to move an unchanged directory's notes across and descend into its known subdirectories
+static int reuse_dir(refresh_state *state, int index, int old_index) {
+    catalog *out = state->out;
+    catalog *old = state->old;
+    const catalog_dir *previous = &old->dirs[old_index];
+
+    for (size_t i = previous->first_entry; i < previous->first_entry + previous->entry_count; i++) {
+        catalog_entry *entry = &old->entries[i];
+        if (append_entry(out, index, entry->path, entry->size, entry->mtime, entry->inode) != 0) {
+            return -1;
+        }
+        entry->path = NULL;
+    }
+    out->dirs[index].entry_count = previous->entry_count;
+
+    for (int child = previous->first_child; child >= 0; child = old->dirs[child].next_sibling) {
+        if (refresh_dir(state, old->dirs[child].path, child, index) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to refresh one directory, reusing the previous listing if its mtime is unchanged
+static int refresh_dir(refresh_state *state, const char *relative_path, int old_index, int parent) {
+    catalog *out = state->out;
+    catalog *old = state->old;
+    int forced = is_forced(state, relative_path);
+
+    if (state->trust_unforced && !forced && old_index >= 0) {
+        // The caller knows this directory did not change, skip even the stat
+        int index = append_dir(out, relative_path, old->dirs[old_index].mtime, parent);
+        return index < 0 ? -1 : reuse_dir(state, index, old_index);
+    }
+
+    char full_path[CATALOG_PATH_MAX];
+    join_path(full_path, sizeof(full_path), state->root, relative_path);
+
+    struct stat dir_stat;
+    if (stat(full_path, &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+        return 0;  // Directory vanished since it was listed
+    }
+
+    long long mtime = CATALOG_STAT_MTIME(dir_stat);
+    int index = append_dir(out, relative_path, mtime, parent);
+    if (index < 0) {
+        return -1;
+    }
+
+    if (!forced && old_index >= 0 && old->dirs[old_index].mtime == mtime) {
+        return reuse_dir(state, index, old_index);
+    }
+
+    state->rescanned++;
+
+    DIR *dir = opendir(full_path);
+    if (dir == NULL) {
+        perror("opendir");
+        return 0;
+    }
+
+    int fd = dirfd(dir);
+    char **subdirs = NULL;
+    size_t subdir_count = 0, subdir_capacity = 0;
+    int status = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {  // Skip hidden files and directories
+            continue;
+        }
+        if (strpbrk(entry->d_name, "\t\n") != NULL) {  // Not representable in the catalog file
+            continue;
+        }
+
+        // Symlinks are skipped, as in scan.c, so a loop or a link out of the vault is never walked
+        struct stat file_stat;
+        if (fstatat(fd, entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+
+        char child[CATALOG_PATH_MAX];
+        if (relative_path[0] != '\0') {
+            snprintf(child, sizeof(child), "%s/%s", relative_path, entry->d_name);
+        } else {
+            snprintf(child, sizeof(child), "%s", entry->d_name);
+        }
+
+        char *copy = strdup(child);
+        if (copy == NULL) {
+            perror("strdup");
+            status = -1;
+            break;
+        }
+
+        if (S_ISDIR(file_stat.st_mode)) {
+            if (subdir_count == subdir_capacity) {
+                subdir_capacity = subdir_capacity ? subdir_capacity * 2 : 16;
+                char **grown = realloc(subdirs, subdir_capacity * sizeof(*grown));
+                if (grown == NULL) {
+                    perror("realloc");
+                    free(copy);
+                    status = -1;
+                    break;
+                }
+                subdirs = grown;
+            }
+            subdirs[subdir_count++] = copy;
+        } else if (S_ISREG(file_stat.st_mode)) {
+            if (append_entry(out, index, copy, file_stat.st_size, CATALOG_STAT_MTIME(file_stat), file_stat.st_ino) != 0) {
+                free(copy);
+                status = -1;
+                break;
+            }
+        } else {
+            free(copy);
+        }
+    }
+    closedir(dir);
+
+    catalog_dir *current = &out->dirs[index];
+    current->entry_count = out->entry_count - current->first_entry;
+    qsort(out->entries + current->first_entry, current->entry_count, sizeof(catalog_entry), compare_entries);
+    qsort(subdirs, subdir_count, sizeof(char *), compare_strings);
+
+    for (size_t i = 0; i < subdir_count; i++) {
+        if (status == 0) {
+            status = refresh_dir(state, subdirs[i], find_old_dir(state, subdirs[i]), index);
+        }
+        free(subdirs[i]);
+    }
+    free(subdirs);
+
+    return status;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static char *child_path(const char *parent, const char *name) {
+    char child[CATALOG_PATH_MAX];
+    if (parent[0] != '\0') {
+        snprintf(child, sizeof(child), "%s/%s", parent, name);
+    } else {
+        snprintf(child, sizeof(child), "%s", name);
+    }
+    char *copy = strdup(child);
+    if (copy == NULL) {
+        perror("strdup");
+    }
+    return copy;
+}
+
+// Function to keep one scanned directory's listing until the whole tree has been read
+static void collect_scanned_dir(const scan_dir *dir, void *ctx) {
+    scan_collector *collector = ctx;
+    if (collector->failed) {
+        return;
+    }
+    if (collector->count == collector->capacity) {
+        size_t capacity = collector->capacity ? collector->capacity * 2 : 64;
+        scanned_dir *dirs = realloc(collector->dirs, capacity * sizeof(*dirs));
+        if (dirs == NULL) {
+            perror("realloc");
+            collector->failed = 1;
+            return;
+        }
+        collector->dirs = dirs;
+        collector->capacity = capacity;
+    }
+
+    scanned_dir *copy = &collector->dirs[collector->count++];
+    memset(copy, 0, sizeof(*copy));
+    copy->path = strdup(dir->path);
+    copy->mtime = dir->mtime;
+    copy->files = malloc((dir->entry_count + 1) * sizeof(catalog_entry));
+    copy->subdirs = malloc((dir->entry_count + 1) * sizeof(char *));
+    if (copy->path == NULL || copy->files == NULL || copy->subdirs == NULL) {
+        perror("malloc");
+        collector->failed = 1;
+        return;
+    }
+
+    for (size_t i = 0; i < dir->entry_count; i++) {
+        const scan_entry *entry = &dir->entries[i];
+        if (strpbrk(entry->name, "\t\n") != NULL) {  // Not representable in the catalog file
+            continue;
+        }
+        char *path = child_path(dir->path, entry->name);
+        if (path == NULL) {
+            collector->failed = 1;
+            return;
+        }
+        if (entry->is_dir) {
+            copy->subdirs[copy->subdir_count++] = path;
+        } else {
+            catalog_entry *file = &copy->files[copy->file_count++];
+            memset(file, 0, sizeof(*file));
+            file->path = path;
+            file->size = entry->size;
+            file->mtime = entry->mtime;
+            file->inode = entry->inode;
+        }
+    }
+}
+
+static int compare_scanned_dirs(const void *a, const void *b) {
+    return strcmp(((const scanned_dir *)a)->path, ((const scanned_dir *)b)->path);
+}
+
+// Function to append a scanned directory and, depth first in name order, everything under it, giving
+// the same layout refresh_dir builds
+static int place_scanned_dir(catalog *out, scan_collector *collector, scanned_dir *dir, int parent) {
+    int index = append_dir(out, dir->path, dir->mtime, parent);
+    if (index < 0) {
+        return -1;
+    }
+
+    qsort(dir->files, dir->file_count, sizeof(catalog_entry), compare_entries);
+    for (size_t i = 0; i < dir->file_count; i++) {
+        catalog_entry *file = &dir->files[i];
+        if (append_entry(out, index, file->path, file->size, file->mtime, file->inode) != 0) {
+            return -1;
+        }
+        file->path = NULL;
+    }
+    out->dirs[index].entry_count = dir->file_count;
+
+    qsort(dir->subdirs, dir->subdir_count, sizeof(char *), compare_strings);
+    for (size_t i = 0; i < dir->subdir_count; i++) {
+        scanned_dir key = {0};
+        key.path = dir->subdirs[i];
+        scanned_dir *child = bsearch(&key, collector->dirs, collector->count, sizeof(scanned_dir),
+                                     compare_scanned_dirs);
+        if (child && place_scanned_dir(out, collector, child, index) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to build a catalog from nothing with the parallel scanner, returns the number of directories read
+static int scan_catalog(catalog *out, const char *root) {
+    scan_collector collector = {0};
+    scan_options options;
+    scan_default_options(&options);
+
+    long scanned = scan_tree(root, &options, collect_scanned_dir, &collector);
+    int status = scanned < 0 || collector.failed ? -1 : 0;
+    if (status == 0) {
+        qsort(collector.dirs, collector.count, sizeof(scanned_dir), compare_scanned_dirs);
+        scanned_dir key = {0};
+        key.path = (char *)"";
+        scanned_dir *top = bsearch(&key, collector.dirs, collector.count, sizeof(scanned_dir), compare_scanned_dirs);
+        status = top ? place_scanned_dir(out, &collector, top, -1) : 0;
+    }
+
+    for (size_t i = 0; i < collector.count; i++) {
+        scanned_dir *dir = &collector.dirs[i];
+        for (size_t f = 0; f < dir->file_count; f++) {
+            free(dir->files[f].path);
+        }
+        for (size_t d = 0; d < dir->subdir_count; d++) {
+            free(dir->subdirs[d]);
+        }
+        free(dir->files);
+        free(dir->subdirs);
+        free(dir->path);
+    }
+    free(collector.dirs);
+    return status < 0 ? -1 : (int)scanned;
+}
+
+// Function to rebuild the catalog from the previous one, see catalog_refresh and catalog_refresh_dirs
+static int refresh_catalog(catalog *cat, const char *root, const char **dirs, size_t dir_count, int trust_unforced) {
+    char root_copy[CATALOG_PATH_MAX];
+    snprintf(root_copy, sizeof(root_copy), "%s", root);
+
+    if (strcmp(cat->root, root_copy) != 0) {
+        catalog_free(cat);  // Different vault, nothing can be reused
+    }
+
+    catalog fresh;
+    catalog_init(&fresh);
+    snprintf(fresh.root, sizeof(fresh.root), "%s", root_copy);
+
+    refresh_state state = {0};
+    state.out = &fresh;
+    state.old = cat;
+    state.root = root_copy;
+    state.trust_unforced = trust_unforced && cat->dir_count > 0;
+
+    if (dir_count > 0) {
+        state.forced = malloc(dir_count * sizeof(char *));
+        if (state.forced == NULL) {
+            perror("malloc");
+            return -1;
+        }
+        memcpy(state.forced, dirs, dir_count * sizeof(char *));
+        state.forced_count = dir_count;
+        qsort(state.forced, dir_count, sizeof(char *), compare_paths);
+    }
+
+    if (cat->dir_count > 0) {
+        state.sorted = malloc(cat->dir_count * sizeof(dir_lookup));
+        if (state.sorted == NULL) {
+            perror("malloc");
+            free(state.forced);
+            return -1;
+        }
+        for (size_t i = 0; i < cat->dir_count; i++) {
+            state.sorted[i].path = cat->dirs[i].path;
+            state.sorted[i].index = (int)i;
+        }
+        state.sorted_count = cat->dir_count;
+        qsort(state.sorted, state.sorted_count, sizeof(dir_lookup), compare_lookup);
+    }
+
+    int status;
+    if (cat->dir_count == 0 && dir_count == 0) {
+        // Nothing to reuse, read the whole tree in parallel
+        status = scan_catalog(&fresh, root_copy);
+        state.rescanned = status < 0 ? 0 : status;
+        status = status < 0 ? -1 : 0;
+    } else {
+        status = refresh_dir(&state, "", find_old_dir(&state, ""), -1);
+    }
+    if (status == 0 && fresh.dir_count != cat->dir_count && state.rescanned == 0) {
+        state.rescanned = 1;  // Count a vanished root as a change
+    }
+
+    free(state.sorted);
+    free(state.forced);
+    catalog_free(cat);
+    *cat = fresh;
+
+    return status < 0 ? -1 : state.rescanned;
+}
+
+// Function to bring the catalog up to date with the vault, returns the number of rescanned directories
+int catalog_refresh(catalog *cat, const char *root) {
+    return refresh_catalog(cat, root, NULL, 0, 0);
+}
+
+// Function to rescan the given directories (relative paths) even if their mtime is unchanged. Used when a
+// watcher already knows what changed; new subdirectories are picked up as they are found. With trust_others
+// the rest of the catalog is reused without a stat, otherwise every other directory whose mtime moved is
+// rescanned too.
+int catalog_refresh_dirs(catalog *cat, const char **dirs, size_t dir_count, int trust_others) {
+    char root[CATALOG_PATH_MAX];
+    snprintf(root, sizeof(root), "%s", cat->root);
+    return refresh_catalog(cat, root, dirs, dir_count, trust_others);
+}
+
+// Function to read a catalog written by catalog_save, replacing whatever cat held rather than adding to it
+int catalog_load(catalog *cat, const char *catalog_path) {
+    catalog_free(cat);
+    FILE *file = fopen(catalog_path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char line[CATALOG_LINE_MAX];
+    if (fgets(line, sizeof(line), file) == NULL || strncmp(line, CATALOG_MAGIC, strlen(CATALOG_MAGIC)) != 0) {
+        fclose(file);
+        return 0;
+    }
+
+    int current = -1;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *field = line + 2;
+        char *end;
+
+        if (strncmp(line, "R\t", 2) == 0) {
+            snprintf(cat->root, sizeof(cat->root), "%s", field);
+        } else if (strncmp(line, "D\t", 2) == 0) {
+            // D <parent> <mtime> <bucket> <path>
+            long parent = strtol(field, &end, 10);
+            if (*end != '\t' || parent >= (long)cat->dir_count) {
+                ok = 0;
+                break;
+            }
+            long long mtime = strtoll(end + 1, &end, 10);
+            char *path = *end == '\t' ? strchr(end + 1, '\t') : NULL;
+            if (path == NULL) {
+                ok = 0;
+                break;
+            }
+            current = append_dir(cat, path + 1, mtime, (int)parent);
+            ok = current >= 0;
+        } else if (strncmp(line, "F\t", 2) == 0) {
+            // F <size> <mtime> <inode> <path>
+            long long size = strtoll(field, &end, 10);
+            long long mtime = *end == '\t' ? strtoll(end + 1, &end, 10) : 0;
+            unsigned long long inode = *end == '\t' ? strtoull(end + 1, &end, 10) : 0;
+            char *path = *end == '\t' ? strdup(end + 1) : NULL;
+            if (current < 0 || path == NULL || append_entry(cat, current, path, size, mtime, inode) != 0) {
+                free(path);
+                ok = 0;
+                break;
+            }
+            cat->dirs[current].entry_count++;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        catalog_free(cat);  // Corrupt catalog, the caller will rebuild from scratch
+        return 0;
+    }
+    return 1;
+}
+
+// Function to write the catalog atomically through a temporary file
+int catalog_save(const catalog *cat, const char *catalog_path) {
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", catalog_path);
+
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) {
+        perror("Failed to open catalog file");
+        return 0;
+    }
+
+    fprintf(file, "%s\n", CATALOG_MAGIC);
+    fprintf(file, "R\t%s\n", cat->root);
+    for (size_t i = 0; i < cat->dir_count; i++) {
+        const catalog_dir *dir = &cat->dirs[i];
+        fprintf(file, "D\t%d\t%lld\t%s\t%s\n", dir->parent, dir->mtime, dir->bucket, dir->path);
+        for (size_t j = dir->first_entry; j < dir->first_entry + dir->entry_count; j++) {
+            const catalog_entry *entry = &cat->entries[j];
+            fprintf(file, "F\t%lld\t%lld\t%llu\t%s\n", entry->size, entry->mtime, entry->inode, entry->path);
+        }
+    }
+
+    if (fclose(file) != 0 || rename(temp_path, catalog_path) != 0) {
+        perror("Failed to write catalog file");
+        unlink(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to load, incrementally refresh and persist the catalog for a vault
+int catalog_sync(catalog *cat, const char *root, const char *catalog_path) {
+    catalog_load(cat, catalog_path);
+
+    int rescanned = catalog_refresh(cat, root);
+    if (rescanned < 0) {
+        return 0;
+    }
+    if (rescanned > 0) {
+        catalog_save(cat, catalog_path);
+    }
+    return 1;
+}
+
+// Function to re-stat every note, catching edits that rewrote a file without touching its directory
+int catalog_restat(catalog *cat) {
+    int changed = 0;
+    char full_path[CATALOG_PATH_MAX];
+
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        catalog_entry *entry = &cat->entries[i];
+        join_path(full_path, sizeof(full_path), cat->root, entry->path);
+
+        struct stat file_stat;
+        if (lstat(full_path, &file_stat) != 0) {
+            continue;  // Removed, the next directory rescan drops it
+        }
+
+        long long mtime = CATALOG_STAT_MTIME(file_stat);
+        if (entry->mtime != mtime || entry->size != (long long)file_stat.st_size ||
+            entry->inode != (unsigned long long)file_stat.st_ino) {
+            entry->mtime = mtime;
+            entry->size = file_stat.st_size;
+            entry->inode = file_stat.st_ino;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+static int compare_nodes(const void *a, const void *b) {
+    return strcmp(((const tree_node *)a)->name, ((const tree_node *)b)->name);
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Function to emit one directory level in the same layout as `tree`
+static void walk_dir(const catalog *cat, int index, char *prefix, size_t prefix_size,
+                     void (*emit)(const char *line, void *ctx), void *ctx, size_t *dirs, size_t *files) {
+    const catalog_dir *dir = &cat->dirs[index];
+
+    size_t count = dir->entry_count;
+    for (int child = dir->first_child; child >= 0; child = cat->dirs[child].next_sibling) {
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    tree_node *nodes = malloc(count * sizeof(tree_node));
+    if (nodes == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    size_t n = 0;
+    for (int child = dir->first_child; child >= 0; child = cat->dirs[child].next_sibling) {
+        nodes[n].name = base_name(cat->dirs[child].path);
+        nodes[n++].dir = child;
+    }
+    for (size_t i = dir->first_entry; i < dir->first_entry + dir->entry_count; i++) {
+        nodes[n].name = base_name(cat->entries[i].path);
+        nodes[n++].dir = -1;
+    }
+    qsort(nodes, count, sizeof(tree_node), compare_nodes);
+
+    size_t prefix_len = strlen(prefix);
+    char line[CATALOG_LINE_MAX];
+    for (size_t i = 0; i < count; i++) {
+        int last = (i == count - 1);
+        snprintf(line, sizeof(line), "%s%s%s", prefix, last ? "└── " : "├── ", nodes[i].name);
+        emit(line, ctx);
+
+        if (nodes[i].dir >= 0) {
+            (*dirs)++;
+            snprintf(prefix + prefix_len, prefix_size - prefix_len, "%s", last ? "    " : "│   ");
+            walk_dir(cat, nodes[i].dir, prefix, prefix_size, emit, ctx, dirs, files);
+            prefix[prefix_len] = '\0';
+        } else {
+            (*files)++;
+        }
+    }
+
+    free(nodes);
+}
+
+// Function to render the catalog as a tree listing, one line at a time
+void catalog_walk_tree(const catalog *cat, void (*emit)(const char *line, void *ctx), void *ctx) {
+    if (cat->dir_count == 0) {
+        return;
+    }
+
+    char prefix[CATALOG_LINE_MAX] = "";
+    size_t dirs = 0, files = 0;
+
+    emit(cat->root, ctx);
+    walk_dir(cat, 0, prefix, sizeof(prefix), emit, ctx, &dirs, &files);
+
+    char summary[128];
+    snprintf(summary, sizeof(summary), "%zu director%s, %zu file%s",
+             dirs, dirs == 1 ? "y" : "ies", files, files == 1 ? "" : "s");
+    emit("", ctx);
+    emit(summary, ctx);
+}
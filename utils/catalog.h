@@ -0,0 +1,63 @@
+// catalog.h
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stddef.h>
+
+#define CATALOG_FILE "obs/.catalog"
+#define CATALOG_PATH_MAX 1024
+#define CATALOG_BUCKET_MAX 512
+
+// Modification time of a struct stat in nanoseconds
+#ifdef __APPLE__
+#define CATALOG_STAT_MTIME(st) ((long long)(st).st_mtimespec.tv_sec * 1000000000LL + (st).st_mtimespec.tv_nsec)
+#else
+#define CATALOG_STAT_MTIME(st) ((long long)(st).st_mtim.tv_sec * 1000000000LL + (st).st_mtim.tv_nsec)
+#endif
+
+// A single note recorded in the catalog
+typedef struct {
+    char *path;             // Path relative to the vault root
+    const char *bucket;     // Owned by the containing directory
+    long long size;
+    long long mtime;        // Nanoseconds since the epoch
+    unsigned long long inode;
+    int dir;                // Index of the containing directory
+} catalog_entry;
+
+// A directory recorded in the catalog, its notes are stored contiguously
+typedef struct {
+    char *path;             // Path relative to the vault root, "" for the root itself
+    char *bucket;           // "org/repo", "temp" or "" for the root
+    long long mtime;
+    int parent;
+    int first_child;
+    int next_sibling;
+    size_t first_entry;
+    size_t entry_count;
+} catalog_dir;
+
+typedef struct {
+    char root[CATALOG_PATH_MAX];
+    catalog_dir *dirs;
+    size_t dir_count;
+    size_t dir_capacity;
+    catalog_entry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+} catalog;
+
+// Function declarations
+void catalog_init(catalog *cat);
+void catalog_free(catalog *cat);
+void catalog_default_path(char *buf, size_t size);
+void catalog_bucket_for(const char *relative_path, char *bucket, size_t size);
+int catalog_load(catalog *cat, const char *catalog_path);
+int catalog_save(const catalog *cat, const char *catalog_path);
+int catalog_refresh(catalog *cat, const char *root);
+int catalog_refresh_dirs(catalog *cat, const char **dirs, size_t dir_count, int trust_others);
+int catalog_sync(catalog *cat, const char *root, const char *catalog_path);
+int catalog_restat(catalog *cat);
+void catalog_walk_tree(const catalog *cat, void (*emit)(const char *line, void *ctx), void *ctx);
+
+#endif // CATALOG_H
@@ -0,0 +1,269 @@
+// clean_batch.c
+#include "clean_batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CLEAN_MAX_JOBS 64
+
+// Shared state of one batch, the mutex guards everything below it
+typedef struct {
+    clean_job *jobs;
+    size_t job_count;
+    const clean_batch_options *options;
+    void (*report)(const clean_job *job, size_t done, size_t total, void *ctx);
+    void *ctx;
+
+    pthread_mutex_t lock;
+    size_t next_job;
+    size_t done;
+    long long next_slot_ms;     // Earliest start of the next naming request under the rate limit
+} clean_batch;
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(long long ms) {
+    if (ms <= 0) {
+        return;
+    }
+    struct timespec delay = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+}
+
+void clean_batch_default_options(clean_batch_options *options) {
+    options->concurrency = CLEAN_DEFAULT_JOBS;
+    options->rate_per_second = CLEAN_DEFAULT_RATE;
+    options->max_retries = CLEAN_DEFAULT_RETRIES;
+    options->backoff_ms = CLEAN_DEFAULT_BACKOFF_MS;
+    options->dry_run = 0;
+    options->cache = NULL;
+    options->refresh_cache = 0;
+    options->cancel = NULL;
+    options->before_rename = NULL;
+    options->rename_ctx = NULL;
+    naming_default_options(&options->naming);
+}
+
+// Function to check whether a filename is still the one generate_timestamp() gave it
+int clean_is_timestamp_name(const char *filename) {
+    static const char pattern[] = "####-##-##_##-##-##.md";
+
+    for (size_t i = 0; i < sizeof(pattern) - 1; i++) {
+        unsigned char c = (unsigned char)filename[i];
+        if (pattern[i] == '#' ? !isdigit(c) : c != (unsigned char)pattern[i]) {
+            return 0;
+        }
+    }
+    return filename[sizeof(pattern) - 1] == '\0';
+}
+
+// Function to wait for a free slot of the rate limit, slots are handed out evenly spaced
+static void wait_for_slot(clean_batch *batch) {
+    if (batch->options->rate_per_second <= 0) {
+        return;
+    }
+
+    long long interval = (long long)(1000.0 / batch->options->rate_per_second);
+    pthread_mutex_lock(&batch->lock);
+    long long now = now_ms();
+    long long slot = batch->next_slot_ms > now ? batch->next_slot_ms : now;
+    batch->next_slot_ms = slot + interval;
+    pthread_mutex_unlock(&batch->lock);
+
+    sleep_ms(slot - now);
+}
+
+// Function to check whether an earlier job of a dry run already planned this target
+static int planned(const char *path, void *ctx) {
+    const clean_batch *batch = ctx;
+    for (size_t i = 0; i < batch->job_count; i++) {
+        if (batch->jobs[i].new_path && strcmp(batch->jobs[i].new_path, path) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to pick the path a note gets under its new name, next to where it is now. Names already
+// taken, on disk or by the optional taken callback, get a numeric suffix rather than being overwritten.
+char *clean_target_path(const char *path, const char *name, int (*taken)(const char *path, void *ctx), void *ctx) {
+    const char *last_slash = strrchr(path, '/');
+    int dir_length = last_slash ? (int)(last_slash - path + 1) : 0;
+
+    size_t size = strlen(path) + strlen(name) + 16;
+    char *target = malloc(size);
+    if (target == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    struct stat st;
+    for (int suffix = 1;; suffix++) {
+        if (suffix == 1) {
+            snprintf(target, size, "%.*s%s.md", dir_length, path, name);
+        } else {
+            snprintf(target, size, "%.*s%s-%d.md", dir_length, path, name, suffix);
+        }
+        if (lstat(target, &st) != 0 && !(taken && taken(target, ctx))) {
+            return target;
+        }
+    }
+}
+
+// Function to move a note to its new name, called with the lock held
+static void finish_job(clean_batch *batch, clean_job *job, const char *name) {
+    char *target = clean_target_path(job->path, name, batch->options->dry_run ? planned : NULL, batch);
+    if (target == NULL) {
+        job->status = CLEAN_FAILED;
+        return;
+    }
+
+    // The rename is journaled before it happens, a note whose rename could not be journaled is not renamed
+    const clean_batch_options *options = batch->options;
+    if (!options->dry_run && options->before_rename && !options->before_rename(job->path, target, options->rename_ctx)) {
+        free(target);
+        job->status = CLEAN_FAILED;
+        return;
+    }
+    if (!options->dry_run && rename(job->path, target) != 0) {
+        perror("Error renaming file");
+        free(target);
+        job->status = CLEAN_FAILED;
+        return;
+    }
+    job->new_path = target;
+    job->status = CLEAN_RENAMED;
+}
+
+static void process_job(clean_batch *batch, clean_job *job, naming_session *session) {
+    const clean_batch_options *options = batch->options;
+    long long start = now_ms();
+
+    naming_note note;
+    int opened = naming_note_open(&note, job->path);
+    char *name = NULL;
+
+    // Unchanged content resolves from the cache without using up a rate limit slot
+    uint64_t key = 0;
+    if (opened && options->cache) {
+        key = name_cache_key(note.data, note.size, options->naming.engine);
+        if (!options->refresh_cache) {
+            name = name_cache_get(options->cache, key, note.size);
+            job->cached = name != NULL;
+        }
+    }
+
+    while (opened && name == NULL) {
+        wait_for_slot(batch);
+        job->attempts++;
+
+        int retryable = 0;
+        name = naming_suggest(session, &note, &retryable);
+        if (name != NULL || !retryable || job->attempts > options->max_retries) {
+            break;
+        }
+        if (options->cancel && *options->cancel) {
+            break;
+        }
+
+        // Exponential backoff with jitter so failed workers do not retry in lockstep. The doubling stops at
+        // the cap, however many retries are allowed, and the jitter comes from the worker's own seed.
+        long long backoff = options->backoff_ms;
+        for (int i = 1; i < job->attempts && backoff > 0 && backoff < CLEAN_MAX_BACKOFF_MS; i++) {
+            backoff *= 2;
+        }
+        if (backoff > CLEAN_MAX_BACKOFF_MS) {
+            backoff = CLEAN_MAX_BACKOFF_MS;
+        }
+        sleep_ms(backoff / 2 + rand_r(&session->seed) % (backoff / 2 + 1));
+    }
+    if (name != NULL && !job->cached && options->cache) {
+        name_cache_put(options->cache, key, note.size, name);
+    }
+    naming_note_close(&note);
+
+    pthread_mutex_lock(&batch->lock);
+    if (name != NULL) {
+        finish_job(batch, job, name);
+    } else {
+        job->status = CLEAN_FAILED;
+    }
+    job->elapsed_ms = now_ms() - start;
+    batch->done++;
+    if (batch->report) {
+        batch->report(job, batch->done, batch->job_count, batch->ctx);
+    }
+    pthread_mutex_unlock(&batch->lock);
+
+    free(name);
+}
+
+// Function run by each pool thread, its naming worker process lives as long as the thread
+static void *clean_worker(void *arg) {
+    clean_batch *batch = arg;
+    naming_session session;
+    naming_session_init(&session, &batch->options->naming);
+
+    while (1) {
+        pthread_mutex_lock(&batch->lock);
+        int cancelled = batch->options->cancel && *batch->options->cancel;
+        clean_job *job = !cancelled && batch->next_job < batch->job_count ? &batch->jobs[batch->next_job++] : NULL;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (job == NULL) {
+            naming_session_close(&session);
+            return NULL;
+        }
+        process_job(batch, job, &session);
+    }
+}
+
+// Function to name and rename every job through a bounded pool of workers. Results are reported as
+// each job completes. Returns the number of notes renamed, or -1 if no worker could be started.
+int clean_batch_run(clean_job *jobs, size_t job_count, const clean_batch_options *options,
+                    void (*report)(const clean_job *job, size_t done, size_t total, void *ctx), void *ctx) {
+    clean_batch batch = {jobs, job_count, options, report, ctx, PTHREAD_MUTEX_INITIALIZER, 0, 0, 0};
+
+    int concurrency = options->concurrency < 1 ? 1 : options->concurrency;
+    if (concurrency > CLEAN_MAX_JOBS) {
+        concurrency = CLEAN_MAX_JOBS;
+    }
+    if ((size_t)concurrency > job_count) {
+        concurrency = (int)job_count;
+    }
+
+    pthread_t threads[CLEAN_MAX_JOBS];
+    int started = 0;
+    for (int i = 0; i < concurrency; i++) {
+        if (pthread_create(&threads[started], NULL, clean_worker, &batch) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+    if (started == 0 && job_count > 0) {
+        return -1;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&batch.lock);
+
+    int renamed = 0;
+    for (size_t i = 0; i < job_count; i++) {
+        if (jobs[i].status == CLEAN_PENDING) {
+            jobs[i].status = CLEAN_CANCELLED;
+        } else if (jobs[i].status == CLEAN_RENAMED) {
+            renamed++;
+        }
+    }
+    return renamed;
+}
@@ -0,0 +1,54 @@
+// clean_batch.h
+#ifndef CLEAN_BATCH_H
+#define CLEAN_BATCH_H
+
+#include <stddef.h>
+#include <signal.h>
+#include "naming.h"
+#include "name_cache.h"
+
+#define CLEAN_DEFAULT_JOBS 4
+#define CLEAN_DEFAULT_RATE 3.0
+#define CLEAN_DEFAULT_RETRIES 3
+#define CLEAN_DEFAULT_BACKOFF_MS 500
+#define CLEAN_MAX_BACKOFF_MS 10000
+
+typedef enum {
+    CLEAN_PENDING,
+    CLEAN_RENAMED,
+    CLEAN_FAILED,
+    CLEAN_CANCELLED
+} clean_status;
+
+// A note waiting for a name, path is absolute
+typedef struct {
+    char *path;
+    char *new_path;             // Set once renamed, or the planned target of a dry run
+    clean_status status;
+    int attempts;
+    int cached;                 // Named from the name cache without asking the backend
+    long long elapsed_ms;
+} clean_job;
+
+typedef struct {
+    int concurrency;
+    double rate_per_second;     // Naming requests started per second, 0 for no limit
+    int max_retries;
+    int backoff_ms;             // Doubled after every failed attempt
+    int dry_run;
+    naming_options naming;
+    name_cache *cache;          // NULL with --no-cache
+    int refresh_cache;          // Ask the backend even on a hit, then store the new name
+    const volatile sig_atomic_t *cancel;  // Stops handing out new jobs once set
+    int (*before_rename)(const char *path, const char *new_path, void *ctx);  // 0 keeps the note as it is
+    void *rename_ctx;
+} clean_batch_options;
+
+// Function declarations
+void clean_batch_default_options(clean_batch_options *options);
+int clean_is_timestamp_name(const char *filename);
+char *clean_target_path(const char *path, const char *name, int (*taken)(const char *path, void *ctx), void *ctx);
+int clean_batch_run(clean_job *jobs, size_t job_count, const clean_batch_options *options,
+                    void (*report)(const clean_job *job, size_t done, size_t total, void *ctx), void *ctx);
+
+#endif // CLEAN_BATCH_H
@@ -0,0 +1,163 @@
+// completion.c
+#include "completion.h"
+#include "catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Sorted listing of one directory, valid while the directory keeps its mtime
+typedef struct {
+    char *path;
+    long long mtime;
+    unsigned long last_used;
+    completion_entry *entries;
+    size_t count;
+} completion_dir;
+
+static completion_dir cache[COMPLETION_CACHE_SLOTS];
+static unsigned long use_clock;
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const completion_entry *)a)->name, ((const completion_entry *)b)->name);
+}
+
+static void free_slot(completion_dir *slot) {
+    for (size_t i = 0; i < slot->count; i++) {
+        free(slot->entries[i].name);
+    }
+    free(slot->entries);
+    free(slot->path);
+    memset(slot, 0, sizeof(*slot));
+}
+
+void completion_cache_clear(void) {
+    for (int i = 0; i < COMPLETION_CACHE_SLOTS; i++) {
+        free_slot(&cache[i]);
+    }
+}
+
+// Function to read a directory into a sorted entry list, using d_type to avoid a stat per entry
+static int load_slot(completion_dir *slot, const char *directory, long long mtime) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        perror("opendir");
+        return 0;
+    }
+
+    int fd = dirfd(dir);
+    completion_entry *entries = NULL;
+    size_t count = 0, capacity = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {  // Skip hidden files and directories
+            continue;
+        }
+
+        int is_dir = 0;
+#ifdef DT_UNKNOWN
+        if (entry->d_type == DT_DIR) {
+            is_dir = 1;
+        } else if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            // Some filesystems do not fill d_type, and symlinks need resolving to know their target
+            struct stat path_stat;
+            is_dir = fstatat(fd, entry->d_name, &path_stat, 0) == 0 && S_ISDIR(path_stat.st_mode);
+        }
+#else
+        struct stat path_stat;
+        is_dir = fstatat(fd, entry->d_name, &path_stat, 0) == 0 && S_ISDIR(path_stat.st_mode);
+#endif
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            completion_entry *grown = realloc(entries, capacity * sizeof(*grown));
+            if (grown == NULL) {
+                perror("realloc");
+                break;
+            }
+            entries = grown;
+        }
+
+        entries[count].name = strdup(entry->d_name);
+        if (entries[count].name == NULL) {
+            break;
+        }
+        entries[count++].is_dir = is_dir;
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(completion_entry), compare_entries);
+
+    free_slot(slot);
+    slot->path = strdup(directory);
+    slot->mtime = mtime;
+    slot->entries = entries;
+    slot->count = count;
+    return 1;
+}
+
+// Function to find the cached listing of a directory, re-reading it only if its mtime changed
+static completion_dir *get_slot(const char *directory) {
+    struct stat dir_stat;
+    if (stat(directory, &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+        return NULL;
+    }
+    long long mtime = CATALOG_STAT_MTIME(dir_stat);
+
+    completion_dir *victim = &cache[0];
+    for (int i = 0; i < COMPLETION_CACHE_SLOTS; i++) {
+        completion_dir *slot = &cache[i];
+        if (slot->path && strcmp(slot->path, directory) == 0) {
+            if (slot->mtime != mtime && !load_slot(slot, directory, mtime)) {
+                return NULL;
+            }
+            slot->last_used = ++use_clock;
+            return slot;
+        }
+        if (slot->last_used < victim->last_used) {
+            victim = slot;  // Least recently used, empty slots first
+        }
+    }
+
+    if (!load_slot(victim, directory, mtime)) {
+        return NULL;
+    }
+    victim->last_used = ++use_clock;
+    return victim;
+}
+
+// Function to find every entry of directory starting with prefix by binary search.
+// The matches stay valid until the next lookup.
+int completion_lookup(const char *directory, const char *prefix, const completion_entry **matches, size_t *count) {
+    *matches = NULL;
+    *count = 0;
+
+    completion_dir *slot = get_slot(directory);
+    if (slot == NULL) {
+        return 0;
+    }
+
+    size_t len = strlen(prefix);
+    size_t low = 0, high = slot->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strncmp(slot->entries[mid].name, prefix, len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t end = low;
+    while (end < slot->count && strncmp(slot->entries[end].name, prefix, len) == 0) {
+        end++;
+    }
+
+    *matches = slot->entries + low;
+    *count = end - low;
+    return 1;
+}
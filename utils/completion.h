@@ -0,0 +1,19 @@
+// completion.h
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stddef.h>
+
+#define COMPLETION_CACHE_SLOTS 32
+
+// A visible entry of a completion directory
+typedef struct {
+    char *name;
+    int is_dir;
+} completion_entry;
+
+// Function declarations
+int completion_lookup(const char *directory, const char *prefix, const completion_entry **matches, size_t *count);
+void completion_cache_clear(void);
+
+#endif // COMPLETION_H
@@ -0,0 +1,813 @@
+// daemon.c
+#include "daemon.h"
+#include "catalog.h"
+#include "search_index.h"
+#include "link_index.h"
+#include "related_index.h"
+#include "tag_index.h"
+#include "time_index.h"
+#include "dupe_index.h"
+#include "git_repo.h"
+#include "watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS has SO_NOSIGPIPE on the socket instead
+#endif
+
+// Growable reply or request payload
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} daemon_buffer;
+
+// Everything the daemon keeps hot between requests
+typedef struct {
+    catalog cat;
+    search_index index;
+    int index_open;
+    link_index links;
+    int links_open;
+    related_index related;
+    int related_open;
+    daemon_buffer listing;      // Rendered tree, rebuilt on the first LIST after a change
+    int listing_valid;
+    char catalog_path[CATALOG_PATH_MAX];
+    char index_path[CATALOG_PATH_MAX];
+    char link_path[CATALOG_PATH_MAX];
+    char related_path[CATALOG_PATH_MAX];
+    char tag_path[CATALOG_PATH_MAX];
+    char time_path[CATALOG_PATH_MAX];
+    char dupe_path[CATALOG_PATH_MAX];
+} daemon_state;
+
+void daemon_socket_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", DAEMON_SOCKET_FILE);
+}
+
+static int buffer_reserve(daemon_buffer *buffer, size_t size) {
+    if (size <= buffer->capacity) {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    char *grown = realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        perror("realloc");
+        return 0;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int buffer_append(daemon_buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, buffer->size + size)) {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+// Function to send every byte. A peer that went away fails the send instead of raising SIGPIPE, which
+// is left to the process to decide on.
+static int write_all(int fd, const void *data, size_t size) {
+    const char *cursor = data;
+    while (size > 0) {
+        ssize_t written = send(fd, cursor, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 0;
+        }
+        cursor += written;
+        size -= (size_t)written;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    char *cursor = data;
+    while (size > 0) {
+        ssize_t got = read(fd, cursor, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        cursor += got;
+        size -= (size_t)got;
+    }
+    return 1;
+}
+
+// Function to bound how long either end blocks on a peer that stopped talking
+static void set_io_timeout(int fd) {
+    struct timeval timeout = {DAEMON_IO_TIMEOUT_MS / 1000, (DAEMON_IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+static int fill_address(struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    char path[CATALOG_PATH_MAX];
+    daemon_socket_path(path, sizeof(path));
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 0;
+    }
+    memcpy(address->sun_path, path, strlen(path) + 1);
+    return 1;
+}
+
+// ---- Server ----
+
+static void collect_line(const char *line, void *ctx) {
+    daemon_buffer *buffer = ctx;
+    buffer_append(buffer, line, strlen(line));
+    buffer_append(buffer, "\n", 1);
+}
+
+static void reopen_index(daemon_state *state) {
+    if (state->index_open) {
+        search_index_close(&state->index);
+    }
+    state->index_open = search_index_open(&state->index, state->index_path);
+}
+
+static void refresh_links(daemon_state *state) {
+    if (state->links_open) {
+        link_index_close(&state->links);
+    }
+    link_index_update(&state->cat, state->link_path);
+    state->links_open = link_index_open(&state->links, state->link_path);
+}
+
+// Function to embed the notes that changed, which needs the search index for its term weights
+static void refresh_related(daemon_state *state) {
+    if (state->related_open) {
+        related_index_close(&state->related);
+    }
+    if (state->index_open) {
+        related_index_update(&state->cat, &state->index, state->related_path);
+    }
+    state->related_open = related_index_open(&state->related, state->related_path);
+}
+
+// Function to keep the indexes clients open themselves current, so their queries need not look at the vault
+static void refresh_saved_indexes(daemon_state *state) {
+    tag_index_update(&state->cat, state->tag_path);
+    time_index_update(&state->cat, state->time_path);
+    dupe_index_update(&state->cat, state->dupe_path);
+}
+
+static void handle_list(daemon_state *state, daemon_buffer *reply) {
+    if (!state->listing_valid) {
+        state->listing.size = 0;
+        catalog_walk_tree(&state->cat, collect_line, &state->listing);
+        state->listing_valid = 1;
+    }
+    buffer_append(reply, state->listing.data, state->listing.size);
+}
+
+static int handle_complete(const char *payload, size_t length, daemon_buffer *reply) {
+    const char *directory = payload;
+    size_t directory_length = strnlen(payload, length);
+    if (directory_length >= length) {
+        return 0;
+    }
+    const char *prefix = payload + directory_length + 1;
+
+    const completion_entry *matches;
+    size_t count;
+    if (!completion_lookup(directory, prefix, &matches, &count)) {
+        return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t name_length = strlen(matches[i].name);
+        uint8_t is_dir = (uint8_t)matches[i].is_dir;
+        uint16_t encoded = (uint16_t)(name_length > UINT16_MAX ? UINT16_MAX : name_length);
+        buffer_append(reply, &is_dir, 1);
+        buffer_append(reply, &encoded, 2);
+        buffer_append(reply, matches[i].name, encoded);
+    }
+    return 1;
+}
+
+static int handle_search(daemon_state *state, const char *payload, size_t length, daemon_buffer *reply) {
+    if (!state->index_open || length < 5 || payload[length - 1] != '\0') {
+        return 0;
+    }
+
+    uint32_t limit;
+    memcpy(&limit, payload, 4);
+    const char *bucket = payload + 4;
+    const char *query = bucket + strlen(bucket) + 1;
+    if (query >= payload + length) {
+        return 0;
+    }
+
+    search_hit *hits;
+    size_t hit_count = search_index_query(&state->index, query, bucket[0] ? bucket : NULL, &hits);
+    for (size_t i = 0; i < hit_count && (limit == 0 || i < limit); i++) {
+        size_t path_length;
+        const char *path = search_note_path(&state->index, hits[i].note, &path_length);
+        uint16_t encoded = (uint16_t)(path_length > UINT16_MAX ? UINT16_MAX : path_length);
+        buffer_append(reply, &hits[i].hits, 4);
+        buffer_append(reply, &encoded, 2);
+        buffer_append(reply, path, encoded);
+    }
+    free(hits);
+    return 1;
+}
+
+static int handle_resolve_repo(const char *payload, size_t length, daemon_buffer *reply) {
+    if (length == 0 || payload[length - 1] != '\0') {
+        return 0;
+    }
+
+    char git_organisation[GIT_NAME_MAX] = {0};
+    char repo_name[GIT_NAME_MAX] = {0};
+    int8_t status = (int8_t)git_resolve_repo(payload, git_organisation, sizeof(git_organisation),
+                                             repo_name, sizeof(repo_name));
+    buffer_append(reply, &status, 1);
+    buffer_append(reply, git_organisation, strlen(git_organisation) + 1);
+    buffer_append(reply, repo_name, strlen(repo_name) + 1);
+    return 1;
+}
+
+static void append_link(daemon_buffer *reply, const char *text, size_t length, uint8_t resolved) {
+    uint16_t encoded = (uint16_t)(length > UINT16_MAX ? UINT16_MAX : length);
+    buffer_append(reply, &resolved, 1);
+    buffer_append(reply, &encoded, 2);
+    buffer_append(reply, text, encoded);
+}
+
+static int handle_links(daemon_state *state, const char *payload, size_t length, daemon_buffer *reply) {
+    if (!state->links_open || length < 2) {
+        return 0;
+    }
+
+    uint32_t note = link_index_find_note(&state->links, payload + 1);
+    uint8_t found = note != LINK_UNRESOLVED;
+    buffer_append(reply, &found, 1);
+    if (!found) {
+        return 1;
+    }
+
+    size_t count, text_length;
+    if (payload[0]) {
+        const uint32_t *sources = link_index_backlinks(&state->links, note, &count);
+        for (size_t i = 0; i < count; i++) {
+            const char *path = link_note_path(&state->links, sources[i], &text_length);
+            append_link(reply, path, text_length, 1);
+        }
+        return 1;
+    }
+
+    const link_edge *edges = link_index_links(&state->links, note, &count);
+    for (size_t i = 0; i < count; i++) {
+        const char *text = edges[i].target == LINK_UNRESOLVED
+                               ? link_edge_text(&state->links, &edges[i], &text_length)
+                               : link_note_path(&state->links, edges[i].target, &text_length);
+        append_link(reply, text, text_length, edges[i].target != LINK_UNRESOLVED);
+    }
+    return 1;
+}
+
+static int handle_related(daemon_state *state, const char *payload, size_t length, daemon_buffer *reply) {
+    if (!state->related_open || length < 7) {
+        return 0;
+    }
+
+    uint32_t limit;
+    memcpy(&limit, payload, 4);
+    const char *bucket = payload + 5;
+    const char *note = bucket + strlen(bucket) + 1;
+    if (note >= payload + length || limit == 0 || limit > 1000) {
+        return 0;
+    }
+
+    uint32_t id = related_index_find(&state->related, note);
+    uint8_t found = id != UINT32_MAX;
+    buffer_append(reply, &found, 1);
+    if (!found) {
+        return 1;
+    }
+    if (payload[4]) {
+        bucket = related_node_bucket(&state->related, id, NULL);
+    }
+
+    related_hit *hits = malloc(limit * sizeof(related_hit));
+    if (hits == NULL) {
+        return 0;
+    }
+    size_t count = related_index_query(&state->related, id, payload[4] || bucket[0] ? bucket : NULL, hits, limit);
+    for (size_t i = 0; i < count; i++) {
+        size_t path_length;
+        const char *path = related_node_path(&state->related, hits[i].note, &path_length);
+        uint16_t encoded = (uint16_t)(path_length > UINT16_MAX ? UINT16_MAX : path_length);
+        buffer_append(reply, &hits[i].similarity, 4);
+        buffer_append(reply, &encoded, 2);
+        buffer_append(reply, path, encoded);
+    }
+    free(hits);
+    return 1;
+}
+
+// Function to answer one request of a client, returns 0 once the connection should be dropped
+static int serve_request(daemon_state *state, int fd, daemon_buffer *payload, daemon_buffer *reply) {
+    daemon_request_header request;
+    if (!read_all(fd, &request, sizeof(request)) || request.version != DAEMON_PROTOCOL_VERSION ||
+        request.length > DAEMON_PAYLOAD_MAX) {
+        return 0;
+    }
+
+    payload->size = 0;
+    if (!buffer_reserve(payload, request.length + 1) || !read_all(fd, payload->data, request.length)) {
+        return 0;
+    }
+    payload->size = request.length;
+    payload->data[request.length] = '\0';  // Keeps a malformed string from running off the end
+
+    reply->size = 0;
+    int ok = 0;
+    switch (request.op) {
+        case DAEMON_OP_LIST:
+            handle_list(state, reply);
+            ok = 1;
+            break;
+        case DAEMON_OP_COMPLETE:
+            ok = handle_complete(payload->data, payload->size, reply);
+            break;
+        case DAEMON_OP_SEARCH:
+            ok = handle_search(state, payload->data, payload->size, reply);
+            break;
+        case DAEMON_OP_RESOLVE_REPO:
+            ok = handle_resolve_repo(payload->data, payload->size, reply);
+            break;
+        case DAEMON_OP_LINKS:
+            ok = handle_links(state, payload->data, payload->size, reply);
+            break;
+        case DAEMON_OP_RELATED:
+            ok = handle_related(state, payload->data, payload->size, reply);
+            break;
+    }
+
+    daemon_reply_header header = {ok ? DAEMON_STATUS_OK : DAEMON_STATUS_ERROR, {0}, ok ? (uint32_t)reply->size : 0};
+    return write_all(fd, &header, sizeof(header)) && (!ok || write_all(fd, reply->data, reply->size));
+}
+
+// Function to bind the socket, refusing to take over from a daemon that is still answering
+static int open_listener(void) {
+    struct sockaddr_un address;
+    if (!fill_address(&address)) {
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "silica serve is already running on %s\n", address.sun_path);
+        close(probe);
+        return -1;
+    }
+    if (probe >= 0) {
+        close(probe);
+    }
+    unlink(address.sun_path);  // Left behind by a daemon that did not shut down cleanly
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    mode_t old_mask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    umask(old_mask);
+    if (!bound || listen(fd, 16) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to run the daemon until stop is set. The catalog, the search, link and related indexes and completion
+// listings stay in memory and are kept current by the vault watcher, as are the tag, time and duplicate
+// indexes on disk. Returns 1 on a clean shutdown.
+int daemon_serve(const char *root, const volatile sig_atomic_t *stop) {
+    daemon_state state;
+    memset(&state, 0, sizeof(state));
+    catalog_init(&state.cat);
+    catalog_default_path(state.catalog_path, sizeof(state.catalog_path));
+    search_index_default_path(state.index_path, sizeof(state.index_path));
+    link_index_default_path(state.link_path, sizeof(state.link_path));
+    related_index_default_path(state.related_path, sizeof(state.related_path));
+    tag_index_default_path(state.tag_path, sizeof(state.tag_path));
+    time_index_default_path(state.time_path, sizeof(state.time_path));
+    dupe_index_default_path(state.dupe_path, sizeof(state.dupe_path));
+
+    int listener = open_listener();
+    if (listener < 0) {
+        return 0;
+    }
+
+    // Catch up on anything that changed while nothing was running
+    if (!catalog_sync(&state.cat, root, state.catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        close(listener);
+        return 0;
+    }
+    if (catalog_restat(&state.cat) > 0) {
+        catalog_save(&state.cat, state.catalog_path);
+    }
+    search_index_update(&state.cat, state.index_path);
+    reopen_index(&state);
+    refresh_links(&state);
+    refresh_related(&state);
+    refresh_saved_indexes(&state);
+
+    vault_watcher watcher;
+    int using_inotify = watcher_init(&watcher, root);
+
+    char socket_path[CATALOG_PATH_MAX];
+    daemon_socket_path(socket_path, sizeof(socket_path));
+    printf("Serving %s on %s (%zu notes, %s)\n", root, socket_path, state.cat.entry_count,
+           using_inotify ? "inotify" : "polling");
+    fflush(stdout);
+
+    int clients[DAEMON_MAX_CLIENTS];
+    size_t client_count = 0;
+    daemon_buffer payload = {0}, reply = {0};
+
+    while (!*stop) {
+        struct pollfd fds[DAEMON_MAX_CLIENTS + 2];
+        nfds_t nfds = 0;
+        fds[nfds++] = (struct pollfd){listener, POLLIN, 0};
+        if (using_inotify) {
+            fds[nfds++] = (struct pollfd){watcher.fd, POLLIN, 0};
+        }
+        nfds_t first_client = nfds;
+        for (size_t i = 0; i < client_count; i++) {
+            fds[nfds++] = (struct pollfd){clients[i], POLLIN, 0};
+        }
+
+        int ready = poll(fds, nfds, watcher_timeout_ms(&watcher));
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (using_inotify && fds[1].revents) {
+            watcher_read(&watcher);
+        }
+
+        // Clients are answered in order, the ones that hung up or misbehaved are dropped
+        size_t kept = 0;
+        for (size_t i = 0; i < client_count; i++) {
+            short revents = fds[first_client + i].revents;
+            if (revents && !serve_request(&state, clients[i], &payload, &reply)) {
+                close(clients[i]);
+                continue;
+            }
+            clients[kept++] = clients[i];
+        }
+        client_count = kept;
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0 && client_count < DAEMON_MAX_CLIENTS) {
+                set_io_timeout(client);
+                clients[client_count++] = client;
+            } else if (client >= 0) {
+                close(client);
+            }
+        }
+
+        if (watcher_due(&watcher)) {
+            watch_batch batch;
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (!watcher_apply(&watcher, &state.cat, state.catalog_path, state.index_path, &batch)) {
+                fprintf(stderr, "Error applying vault changes\n");
+            } else if (batch.dirs_rescanned > 0 || batch.notes_changed > 0) {
+                state.listing_valid = 0;
+                reopen_index(&state);
+                refresh_links(&state);
+                refresh_related(&state);
+                refresh_saved_indexes(&state);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                printf("%s%zu directories rescanned, %d notes indexed (%lld ms)\n",
+                       batch.overflow ? "event queue overflowed, " : "", batch.dirs_rescanned, batch.notes_indexed,
+                       (long long)(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
+                fflush(stdout);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < client_count; i++) {
+        close(clients[i]);
+    }
+    close(listener);
+    unlink(socket_path);
+    watcher_free(&watcher);
+    if (state.index_open) {
+        search_index_close(&state.index);
+    }
+    if (state.links_open) {
+        link_index_close(&state.links);
+    }
+    if (state.related_open) {
+        related_index_close(&state.related);
+    }
+    catalog_free(&state.cat);
+    free(state.listing.data);
+    free(payload.data);
+    free(reply.data);
+    return 1;
+}
+
+// ---- Client ----
+
+static int client_fd = -2;  // -2 not tried yet, -1 no daemon
+static daemon_buffer client_reply;
+
+// Function to connect to the daemon once per process, every later call reuses the connection
+static int client_connect(void) {
+    if (client_fd != -2) {
+        return client_fd;
+    }
+    client_fd = -1;
+
+    const char *direct = getenv("SILICA_DIRECT");
+    if (direct && direct[0] == '1') {
+        return -1;
+    }
+
+    struct sockaddr_un address;
+    if (!fill_address(&address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);  // No daemon, the caller does the work itself
+        return -1;
+    }
+    set_io_timeout(fd);
+    client_fd = fd;
+    return fd;
+}
+
+// Function to send a request and read the reply into client_reply. Any failure drops the connection
+// so the rest of the process runs in direct mode.
+static int client_request(daemon_op op, const void *part1, size_t size1, const void *part2, size_t size2) {
+    int fd = client_connect();
+    if (fd < 0) {
+        return 0;
+    }
+
+    daemon_request_header request = {(uint8_t)op, DAEMON_PROTOCOL_VERSION, 0, (uint32_t)(size1 + size2)};
+    daemon_reply_header header;
+    if (!write_all(fd, &request, sizeof(request)) || (size1 && !write_all(fd, part1, size1)) ||
+        (size2 && !write_all(fd, part2, size2)) || !read_all(fd, &header, sizeof(header)) ||
+        header.length > DAEMON_PAYLOAD_MAX) {
+        close(fd);
+        client_fd = -1;
+        return 0;
+    }
+
+    client_reply.size = 0;
+    if (!buffer_reserve(&client_reply, header.length + 1) || !read_all(fd, client_reply.data, header.length)) {
+        close(fd);
+        client_fd = -1;
+        return 0;
+    }
+    client_reply.size = header.length;
+    return header.status == DAEMON_STATUS_OK;
+}
+
+// Function to tell whether a daemon is answering, which keeps every index on disk current as the vault changes
+int daemon_running(void) {
+    return client_connect() >= 0;
+}
+
+int daemon_list(void (*emit)(const char *line, void *ctx), void *ctx) {
+    if (!client_request(DAEMON_OP_LIST, NULL, 0, NULL, 0)) {
+        return 0;
+    }
+
+    char *cursor = client_reply.data;
+    char *end = cursor + client_reply.size;
+    while (cursor < end) {
+        char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        emit(cursor, ctx);
+        cursor = newline + 1;
+    }
+    return 1;
+}
+
+// Function to complete through the daemon's warm listing cache, same contract as completion_lookup.
+// The matches stay valid until the next call.
+int daemon_complete(const char *directory, const char *prefix, const completion_entry **matches, size_t *count) {
+    static completion_entry *entries;
+    static size_t capacity;
+    static daemon_buffer names;
+
+    if (!client_request(DAEMON_OP_COMPLETE, directory, strlen(directory) + 1, prefix, strlen(prefix))) {
+        return 0;
+    }
+
+    // Names are copied out with terminators first, pointers are set once the buffer stops moving
+    size_t found = 0;
+    names.size = 0;
+    const char *cursor = client_reply.data;
+    const char *end = cursor + client_reply.size;
+    while (cursor + 3 <= end) {
+        uint16_t length;
+        memcpy(&length, cursor + 1, 2);
+        if (cursor + 3 + length > end) {
+            break;
+        }
+        if (found == capacity) {
+            size_t grown_capacity = capacity ? capacity * 2 : 64;
+            completion_entry *grown = realloc(entries, grown_capacity * sizeof(completion_entry));
+            if (grown == NULL) {
+                return 0;
+            }
+            entries = grown;
+            capacity = grown_capacity;
+        }
+        entries[found].is_dir = cursor[0];
+        entries[found].name = (char *)(uintptr_t)names.size;
+        if (!buffer_append(&names, cursor + 3, length) || !buffer_append(&names, "", 1)) {
+            return 0;
+        }
+        found++;
+        cursor += 3 + length;
+    }
+    for (size_t i = 0; i < found; i++) {
+        entries[i].name = names.data + (uintptr_t)entries[i].name;
+    }
+
+    *matches = entries;
+    *count = found;
+    return 1;
+}
+
+int daemon_search(const char *query, const char *bucket, size_t limit,
+                  void (*emit)(const char *relative_path, void *ctx), void *ctx, size_t *count) {
+    size_t bucket_length = bucket ? strlen(bucket) : 0;
+    size_t query_length = strlen(query);
+    size_t size = 4 + bucket_length + 1 + query_length + 1;
+    char *request = malloc(size);
+    if (request == NULL) {
+        return 0;
+    }
+    uint32_t encoded_limit = (uint32_t)limit;
+    memcpy(request, &encoded_limit, 4);
+    memcpy(request + 4, bucket ? bucket : "", bucket_length + 1);
+    memcpy(request + 4 + bucket_length + 1, query, query_length + 1);
+
+    int ok = client_request(DAEMON_OP_SEARCH, request, size, NULL, 0);
+    free(request);
+    if (!ok) {
+        return 0;
+    }
+
+    *count = 0;
+    char path[CATALOG_PATH_MAX];
+    const char *cursor = client_reply.data;
+    const char *end = cursor + client_reply.size;
+    while (cursor + 6 <= end) {
+        uint16_t length;
+        memcpy(&length, cursor + 4, 2);
+        if (cursor + 6 + length > end || length >= sizeof(path)) {
+            break;
+        }
+        memcpy(path, cursor + 6, length);
+        path[length] = '\0';
+        emit(path, ctx);
+        (*count)++;
+        cursor += 6 + length;
+    }
+    return 1;
+}
+
+int daemon_resolve_repo(const char *cwd, char *git_organisation, size_t organisation_size,
+                        char *repo_name, size_t repo_size, int *result) {
+    if (!client_request(DAEMON_OP_RESOLVE_REPO, cwd, strlen(cwd) + 1, NULL, 0) || client_reply.size < 3) {
+        return 0;
+    }
+
+    const char *organisation = client_reply.data + 1;
+    const char *repo = organisation + strnlen(organisation, client_reply.size - 1) + 1;
+    if (repo >= client_reply.data + client_reply.size) {
+        return 0;
+    }
+    *result = (int8_t)client_reply.data[0];
+    snprintf(git_organisation, organisation_size, "%s", organisation);
+    snprintf(repo_name, repo_size, "%s", repo);
+    return 1;
+}
+
+// Function to list the links of a note, or the notes linking to it, through the daemon's mapped link
+// index. emit gets the target path, or the link text as written when it resolves to no note.
+int daemon_links(const char *note, int backlinks, void (*emit)(const char *text, int resolved, void *ctx), void *ctx,
+                 int *found) {
+    uint8_t direction = (uint8_t)(backlinks != 0);
+    if (!client_request(DAEMON_OP_LINKS, &direction, 1, note, strlen(note) + 1) || client_reply.size < 1) {
+        return 0;
+    }
+
+    *found = client_reply.data[0];
+    char text[CATALOG_PATH_MAX];
+    const char *cursor = client_reply.data + 1;
+    const char *end = client_reply.data + client_reply.size;
+    while (cursor + 3 <= end) {
+        uint16_t length;
+        memcpy(&length, cursor + 1, 2);
+        if (cursor + 3 + length > end || length >= sizeof(text)) {
+            break;
+        }
+        memcpy(text, cursor + 3, length);
+        text[length] = '\0';
+        emit(text, cursor[0], ctx);
+        cursor += 3 + length;
+    }
+    return 1;
+}
+
+// Function to list the notes most related to a note through the daemon's mapped related index, optionally
+// only those in a bucket, or with same_repo in the note's own bucket
+int daemon_related(const char *note, const char *bucket, int same_repo, size_t limit,
+                   void (*emit)(const char *path, float similarity, void *ctx), void *ctx, int *found) {
+    size_t bucket_length = bucket ? strlen(bucket) : 0;
+    size_t note_length = strlen(note);
+    size_t size = 5 + bucket_length + 1 + note_length + 1;
+    char *request = malloc(size);
+    if (request == NULL) {
+        return 0;
+    }
+    uint32_t encoded_limit = (uint32_t)limit;
+    memcpy(request, &encoded_limit, 4);
+    request[4] = (char)(same_repo != 0);
+    memcpy(request + 5, bucket ? bucket : "", bucket_length + 1);
+    memcpy(request + 5 + bucket_length + 1, note, note_length + 1);
+
+    int ok = client_request(DAEMON_OP_RELATED, request, size, NULL, 0) && client_reply.size >= 1;
+    free(request);
+    if (!ok) {
+        return 0;
+    }
+
+    *found = client_reply.data[0];
+    char path[CATALOG_PATH_MAX];
+    const char *cursor = client_reply.data + 1;
+    const char *end = client_reply.data + client_reply.size;
+    while (cursor + 6 <= end) {
+        float similarity;
+        uint16_t length;
+        memcpy(&similarity, cursor, 4);
+        memcpy(&length, cursor + 4, 2);
+        if (cursor + 6 + length > end || length >= sizeof(path)) {
+            break;
+        }
+        memcpy(path, cursor + 6, length);
+        path[length] = '\0';
+        emit(path, similarity, ctx);
+        cursor += 6 + length;
+    }
+    return 1;
+}
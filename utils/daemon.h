@@ -0,0 +1,67 @@
+// daemon.h
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+#include "completion.h"
+
+#define DAEMON_SOCKET_FILE "obs/.silica.sock"
+#define DAEMON_PROTOCOL_VERSION 1
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_IO_TIMEOUT_MS 2000
+#define DAEMON_PAYLOAD_MAX (64 * 1024 * 1024)
+
+// Every request and reply is a fixed header followed by length bytes of payload, in host byte order
+// since both ends always run on the same machine.
+//
+//   LIST          request: empty                 reply: the tree listing, one line per '\n'
+//   COMPLETE      request: directory \0 prefix   reply: { u8 is_dir, u16 length, name } ...
+//   SEARCH        request: u32 limit, bucket \0 query
+//                 reply:   { u32 hits, u16 length, relative path } ...
+//   RESOLVE_REPO  request: directory             reply: i8 git_resolve_repo() result, org \0 repo \0
+//   LINKS         request: u8 backlinks, note    reply: u8 found, { u8 resolved, u16 length, path or target } ...
+//   RELATED       request: u32 limit, u8 same_repo, bucket \0 note
+//                 reply:   u8 found, { f32 similarity, u16 length, relative path } ...
+typedef enum {
+    DAEMON_OP_LIST = 1,
+    DAEMON_OP_COMPLETE = 2,
+    DAEMON_OP_SEARCH = 3,
+    DAEMON_OP_RESOLVE_REPO = 4,
+    DAEMON_OP_LINKS = 5,
+    DAEMON_OP_RELATED = 6
+} daemon_op;
+
+#define DAEMON_STATUS_OK 0
+#define DAEMON_STATUS_ERROR 1
+
+typedef struct {
+    uint8_t op;
+    uint8_t version;
+    uint16_t reserved;
+    uint32_t length;
+} daemon_request_header;
+
+typedef struct {
+    uint8_t status;
+    uint8_t reserved[3];
+    uint32_t length;
+} daemon_reply_header;
+
+// Function declarations
+void daemon_socket_path(char *buf, size_t size);
+int daemon_serve(const char *root, const volatile sig_atomic_t *stop);
+int daemon_running(void);
+int daemon_list(void (*emit)(const char *line, void *ctx), void *ctx);
+int daemon_complete(const char *directory, const char *prefix, const completion_entry **matches, size_t *count);
+int daemon_search(const char *query, const char *bucket, size_t limit,
+                  void (*emit)(const char *relative_path, void *ctx), void *ctx, size_t *count);
+int daemon_resolve_repo(const char *cwd, char *git_organisation, size_t organisation_size,
+                        char *repo_name, size_t repo_size, int *result);
+int daemon_links(const char *note, int backlinks, void (*emit)(const char *text, int resolved, void *ctx), void *ctx,
+                 int *found);
+int daemon_related(const char *note, const char *bucket, int same_repo, size_t limit,
+                   void (*emit)(const char *path, float similarity, void *ctx), void *ctx, int *found);
+
+#endif // DAEMON_H
@@ -0,0 +1,475 @@
+// dupe_index.c
+#include "dupe_index.h"
+#include "hash.h"
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DUPE_MAGIC "SLCDUP1"
+#define DUPE_VERSION 1
+#define DUPE_BIN_SHIFT 57           // Top 7 bits of a shingle hash pick one of the 128 bins
+#define DUPE_SHINGLE_SEED 0x5111ca
+#define DUPE_DENSIFY_ATTEMPTS 1024
+#define NO_NOTE UINT32_MAX
+
+// A note of the index being written
+typedef struct {
+    const char *path;           // Borrowed from the catalog
+    int64_t mtime;
+    int64_t size;
+    uint32_t shingle_count;
+} build_note;
+
+void dupe_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", DUPE_INDEX_FILE);
+}
+
+const char *dupe_note_path(const dupe_index *index, uint32_t note, size_t *len) {
+    const dupe_note *entry = &index->notes[note];
+    if (len) {
+        *len = entry->path_length;
+    }
+    return index->strings + entry->path_offset;
+}
+
+// Function to fold a shingle into the minimum of the bin its hash falls in
+static void add_shingle(uint64_t *mins, const uint64_t *words, size_t word_count) {
+    uint64_t hash = hash_xxh64(words, word_count * sizeof(uint64_t), DUPE_SHINGLE_SEED);
+    uint64_t value = hash & ((1ULL << DUPE_BIN_SHIFT) - 1);
+    size_t bin = (size_t)(hash >> DUPE_BIN_SHIFT);
+    if (value < mins[bin]) {
+        mins[bin] = value;
+    }
+}
+
+// Function to compute a note's MinHash signature with one permutation hashing: each shingle is hashed once
+// and only lowers the minimum of its own bin, instead of being hashed once per signature value. Bins no
+// shingle fell in borrow from another bin picked by a fixed hash of the bin and attempt number, the same
+// for every note, so signatures stay comparable (optimal densification). Returns the number of shingles.
+static uint32_t compute_signature(const char *text, size_t len, uint16_t *signature) {
+    uint64_t mins[DUPE_HASHES];
+    for (size_t i = 0; i < DUPE_HASHES; i++) {
+        mins[i] = UINT64_MAX;
+    }
+
+    uint64_t window[DUPE_SHINGLE_WORDS];
+    size_t word_count = 0, pos = 0, length;
+    uint32_t shingles = 0;
+    char token[SEARCH_TERM_MAX];
+    while ((length = search_next_token(text, len, &pos, token, sizeof(token))) > 0) {
+        if (word_count == DUPE_SHINGLE_WORDS) {
+            memmove(window, window + 1, (DUPE_SHINGLE_WORDS - 1) * sizeof(uint64_t));
+            word_count--;
+        }
+        window[word_count++] = hash_xxh64(token, length, 0);
+        if (word_count == DUPE_SHINGLE_WORDS) {
+            add_shingle(mins, window, word_count);
+            shingles++;
+        }
+    }
+    if (shingles == 0 && word_count > 0) {
+        add_shingle(mins, window, word_count);  // Too short for a full shingle, its words are the one shingle
+        shingles = 1;
+    }
+    if (shingles == 0) {
+        memset(signature, 0, DUPE_HASHES * sizeof(uint16_t));
+        return 0;
+    }
+
+    for (uint64_t i = 0; i < DUPE_HASHES; i++) {
+        uint64_t value = mins[i];
+        for (uint64_t attempt = 1; value == UINT64_MAX && attempt <= DUPE_DENSIFY_ATTEMPTS; attempt++) {
+            uint64_t probe[2] = {i, attempt};
+            value = mins[hash_xxh64(probe, sizeof(probe), 0) % DUPE_HASHES];
+        }
+        for (size_t j = 0; value == UINT64_MAX && j < DUPE_HASHES; j++) {
+            value = mins[j];
+        }
+        signature[i] = (uint16_t)value;
+    }
+    return shingles;
+}
+
+// Function to read a note and compute its signature, a vanished or empty note gets none
+static uint32_t signature_note(const char *root, const char *relative_path, uint16_t *signature) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, relative_path);
+    memset(signature, 0, DUPE_HASHES * sizeof(uint16_t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    uint32_t shingles = compute_signature(text, size, signature);
+    munmap((void *)text, size);
+    return shingles;
+}
+
+// Function to find a note of a mapped index by path, NO_NOTE if it has none
+static uint32_t find_path(const dupe_index *index, const char *path) {
+    size_t low = 0, high = index->data ? index->header->note_count : 0;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(dupe_note_path(index, (uint32_t)mid, NULL), path);
+        if (cmp == 0) {
+            return (uint32_t)mid;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NO_NOTE;
+}
+
+// Function to serialise the notes in path order and their signatures to index_path
+static int write_index(const build_note *notes, const uint16_t *signatures, uint32_t count, const char *index_path) {
+    dupe_note *out = calloc(count + 1, sizeof(dupe_note));
+    size_t strings_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        strings_size += strlen(notes[i].path) + 1;
+    }
+    char *strings = malloc(strings_size + 1);
+    int ok = out && strings;
+    if (!ok) {
+        perror("malloc");
+    }
+
+    size_t used = 0;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        size_t length = strlen(notes[i].path);
+        out[i].path_offset = used;
+        out[i].path_length = (uint32_t)length;
+        out[i].shingle_count = notes[i].shingle_count;
+        out[i].mtime = notes[i].mtime;
+        out[i].size = notes[i].size;
+        memcpy(strings + used, notes[i].path, length + 1);
+        used += length + 1;
+    }
+
+    size_t signature_count = (size_t)count * DUPE_HASHES;
+    dupe_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DUPE_MAGIC, sizeof(DUPE_MAGIC));
+    header.version = DUPE_VERSION;
+    header.note_count = count;
+    header.hash_count = DUPE_HASHES;
+    header.notes_offset = sizeof(dupe_header);
+    header.signatures_offset = header.notes_offset + (uint64_t)count * sizeof(dupe_note);
+    header.strings_offset = header.signatures_offset + (uint64_t)signature_count * sizeof(uint16_t);
+    header.total_size = header.strings_offset + strings_size;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        perror("Failed to open duplicate index");
+        ok = 0;
+    }
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(out, sizeof(dupe_note), count, file) == count &&
+             fwrite(signatures, sizeof(uint16_t), signature_count, file) == signature_count &&
+             fwrite(strings, 1, strings_size, file) == strings_size;
+        if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+            perror("Failed to write duplicate index");
+            unlink(temp_path);
+            ok = 0;
+        }
+    }
+
+    free(out);
+    free(strings);
+    return ok;
+}
+
+static const catalog *sort_catalog;
+
+static int compare_entry_paths(const void *a, const void *b) {
+    return strcmp(sort_catalog->entries[*(const size_t *)a].path, sort_catalog->entries[*(const size_t *)b].path);
+}
+
+// Function to bring the index in line with the catalog. Signatures of notes whose mtime and size are
+// unchanged are copied over, the rest are read and hashed again. Returns the number of notes (re)read,
+// or -1 on failure.
+int dupe_index_update(const catalog *cat, const char *index_path) {
+    dupe_index old;
+    int have_old = dupe_index_open(&old, index_path);
+
+    size_t *order = malloc((cat->entry_count + 1) * sizeof(size_t));
+    build_note *notes = malloc((cat->entry_count + 1) * sizeof(build_note));
+    uint16_t *signatures = malloc((cat->entry_count + 1) * DUPE_HASHES * sizeof(uint16_t));
+    if (order == NULL || notes == NULL || signatures == NULL) {
+        perror("malloc");
+        free(order);
+        free(notes);
+        free(signatures);
+        if (have_old) {
+            dupe_index_close(&old);
+        }
+        return -1;
+    }
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        if (search_is_note(cat->entries[i].path)) {
+            order[count++] = i;
+        }
+    }
+    sort_catalog = cat;
+    qsort(order, count, sizeof(size_t), compare_entry_paths);
+
+    int changes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const catalog_entry *entry = &cat->entries[order[i]];
+        build_note *note = &notes[i];
+        uint16_t *signature = &signatures[(size_t)i * DUPE_HASHES];
+        note->path = entry->path;
+        note->mtime = entry->mtime;
+        note->size = entry->size;
+
+        uint32_t found = find_path(&old, entry->path);
+        if (found != NO_NOTE && old.notes[found].mtime == entry->mtime && old.notes[found].size == entry->size) {
+            note->shingle_count = old.notes[found].shingle_count;
+            memcpy(signature, &old.signatures[(size_t)found * DUPE_HASHES], DUPE_HASHES * sizeof(uint16_t));
+        } else {
+            note->shingle_count = signature_note(cat->root, entry->path, signature);
+            changes++;
+        }
+    }
+
+    int result = 0;
+    if (!have_old || changes > 0 || count != old.header->note_count) {
+        result = write_index(notes, signatures, count, index_path) ? changes : -1;
+    }
+
+    if (have_old) {
+        dupe_index_close(&old);
+    }
+    free(order);
+    free(notes);
+    free(signatures);
+    return result;
+}
+
+// Function to map an index file and validate its layout
+int dupe_index_open(dupe_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(dupe_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const dupe_header *header = data;
+    uint64_t count = header->note_count;
+    if (memcmp(header->magic, DUPE_MAGIC, sizeof(DUPE_MAGIC)) != 0 || header->version != DUPE_VERSION ||
+        header->hash_count != DUPE_HASHES || header->total_size != (uint64_t)st.st_size ||
+        header->notes_offset != sizeof(dupe_header) ||
+        header->signatures_offset != header->notes_offset + count * sizeof(dupe_note) ||
+        header->strings_offset != header->signatures_offset + count * DUPE_HASHES * sizeof(uint16_t) ||
+        header->strings_offset > header->total_size) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->notes = (const dupe_note *)(index->data + header->notes_offset);
+    index->signatures = (const uint16_t *)(index->data + header->signatures_offset);
+    index->strings = (const char *)(index->data + header->strings_offset);
+    return 1;
+}
+
+void dupe_index_close(dupe_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+// Function to estimate the Jaccard similarity of two notes' shingle sets from their signatures. With 16 bit
+// values two unrelated minima agree one time in 65536, which is corrected for.
+double dupe_similarity(const dupe_index *index, uint32_t a, uint32_t b) {
+    if (index->notes[a].shingle_count == 0 || index->notes[b].shingle_count == 0) {
+        return 0.0;
+    }
+    const uint16_t *x = &index->signatures[(size_t)a * DUPE_HASHES];
+    const uint16_t *y = &index->signatures[(size_t)b * DUPE_HASHES];
+    unsigned matches = 0;
+    for (size_t i = 0; i < DUPE_HASHES; i++) {
+        matches += x[i] == y[i];
+    }
+    double chance = 1.0 / 65536.0;
+    double similarity = ((double)matches / DUPE_HASHES - chance) / (1.0 - chance);
+    return similarity < 0.0 ? 0.0 : similarity;
+}
+
+static uint32_t find_root(uint32_t *parent, uint32_t note) {
+    while (parent[note] != note) {
+        parent[note] = parent[parent[note]];
+        note = parent[note];
+    }
+    return note;
+}
+
+// Function to pick the rows per LSH band. Notes are candidates once all rows of one band agree, which for
+// b bands of r rows happens around similarity (1/b)^(1/r), so the most selective split whose curve still
+// sits comfortably below the threshold is used.
+static size_t band_rows(double threshold) {
+    for (size_t rows = 32; rows > 2; rows /= 2) {
+        if (pow(1.0 / (double)(DUPE_HASHES / rows), 1.0 / (double)rows) <= threshold * 0.9) {
+            return rows;
+        }
+    }
+    return 2;
+}
+
+// Function to group notes whose estimated similarity reaches threshold. LSH banding puts notes that agree
+// on a whole band in the same bucket, and only notes sharing a bucket are compared, against a bounded set
+// of representatives, so the work grows with the number of notes rather than the number of pairs. Clusters
+// are the connected components of the matches. Returns the number of clusters of two or more notes.
+size_t dupe_index_clusters(const dupe_index *index, double threshold, dupe_cluster **clusters, uint32_t **members) {
+    *clusters = NULL;
+    *members = NULL;
+    uint32_t count = index->header->note_count;
+    uint32_t *parent = malloc((count + 1) * sizeof(uint32_t));
+    uint32_t *sizes = calloc(count + 1, sizeof(uint32_t));
+    size_t slot_count = 1024;
+    while (slot_count < (size_t)count * 2) {
+        slot_count *= 2;
+    }
+    uint64_t *hashes = malloc((count + 1) * sizeof(uint64_t));
+    uint32_t *next = malloc((count + 1) * sizeof(uint32_t));
+    uint32_t *heads = malloc(slot_count * sizeof(uint32_t));
+    if (parent == NULL || sizes == NULL || hashes == NULL || next == NULL || heads == NULL) {
+        perror("malloc");
+        free(parent);
+        free(sizes);
+        free(hashes);
+        free(next);
+        free(heads);
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        parent[i] = i;
+    }
+
+    // Each band chains the notes with equal band hashes off an open addressing table of chain heads
+    size_t rows = band_rows(threshold);
+    for (size_t band = 0; band < DUPE_HASHES / rows; band++) {
+        memset(heads, 0xff, slot_count * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++) {
+            if (index->notes[i].shingle_count == 0) {
+                continue;
+            }
+            const uint16_t *values = &index->signatures[(size_t)i * DUPE_HASHES + band * rows];
+            uint64_t hash = hash_xxh64(values, rows * sizeof(uint16_t), band);
+            size_t slot = hash & (slot_count - 1);
+            while (heads[slot] != NO_NOTE && hashes[heads[slot]] != hash) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            hashes[i] = hash;
+            next[i] = heads[slot];
+            heads[slot] = i;
+        }
+
+        for (size_t slot = 0; slot < slot_count; slot++) {
+            if (heads[slot] == NO_NOTE || next[heads[slot]] == NO_NOTE) {
+                continue;
+            }
+            uint32_t representatives[DUPE_GROUP_REPRESENTATIVES];
+            size_t representative_count = 0;
+            for (uint32_t note = heads[slot]; note != NO_NOTE; note = next[note]) {
+                int matched = 0;
+                for (size_t r = 0; r < representative_count && !matched; r++) {
+                    uint32_t other = representatives[r];
+                    if (find_root(parent, note) == find_root(parent, other)) {
+                        matched = 1;
+                    } else if (dupe_similarity(index, note, other) >= threshold) {
+                        parent[find_root(parent, note)] = find_root(parent, other);
+                        matched = 1;
+                    }
+                }
+                if (!matched && representative_count < DUPE_GROUP_REPRESENTATIVES) {
+                    representatives[representative_count++] = note;
+                }
+            }
+        }
+    }
+
+    // Lay the clusters out in note order, each starting where its first note falls
+    size_t cluster_count = 0, member_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sizes[find_root(parent, i)]++;
+    }
+    uint32_t *slot = malloc((count + 1) * sizeof(uint32_t));
+    *members = malloc((count + 1) * sizeof(uint32_t));
+    *clusters = malloc((count / 2 + 1) * sizeof(dupe_cluster));
+    if (slot == NULL || *members == NULL || *clusters == NULL) {
+        perror("malloc");
+        free(*members);
+        free(*clusters);
+        *members = NULL;
+        *clusters = NULL;
+    }
+    for (uint32_t i = 0; slot && i < count; i++) {
+        slot[i] = NO_NOTE;
+    }
+    for (uint32_t i = 0; slot && *clusters && i < count; i++) {
+        uint32_t root = find_root(parent, i);
+        if (sizes[root] < 2) {
+            continue;
+        }
+        if (slot[root] == NO_NOTE) {
+            dupe_cluster *cluster = &(*clusters)[cluster_count];
+            cluster->first = member_count;
+            cluster->count = 0;
+            member_count += sizes[root];
+            slot[root] = (uint32_t)cluster_count++;
+        }
+        dupe_cluster *cluster = &(*clusters)[slot[root]];
+        (*members)[cluster->first + cluster->count++] = i;
+    }
+
+    free(slot);
+    free(parent);
+    free(sizes);
+    free(hashes);
+    free(next);
+    free(heads);
+    return *clusters ? cluster_count : 0;
+}
@@ -0,0 +1,61 @@
+// dupe_index.h
+#ifndef DUPE_INDEX_H
+#define DUPE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+
+#define DUPE_INDEX_FILE "obs/.dupe_index"
+#define DUPE_HASHES 128             // MinHash values per signature
+#define DUPE_SHINGLE_WORDS 3        // Notes are compared as sets of overlapping three word runs
+#define DUPE_DEFAULT_THRESHOLD 0.8
+#define DUPE_GROUP_REPRESENTATIVES 32   // Comparisons per note inside one LSH bucket
+
+// On-disk layout, notes sorted by path followed by one signature per note in the same order
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t note_count;
+    uint32_t hash_count;
+    uint32_t reserved;
+    uint64_t notes_offset;
+    uint64_t signatures_offset;
+    uint64_t strings_offset;
+    uint64_t total_size;
+} dupe_header;
+
+typedef struct {
+    uint64_t path_offset;       // Into the string section
+    uint32_t path_length;
+    uint32_t shingle_count;     // 0 for notes without words, which have no signature
+    int64_t mtime;
+    int64_t size;
+} dupe_note;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const dupe_header *header;
+    const dupe_note *notes;
+    const uint16_t *signatures; // Low 16 bits of each minimum (b-bit MinHash)
+    const char *strings;
+} dupe_index;
+
+// A group of near-duplicate notes, members[first .. first + count) in path order
+typedef struct {
+    size_t first;
+    uint32_t count;
+} dupe_cluster;
+
+// Function declarations
+void dupe_index_default_path(char *buf, size_t size);
+int dupe_index_update(const catalog *cat, const char *index_path);
+int dupe_index_open(dupe_index *index, const char *index_path);
+void dupe_index_close(dupe_index *index);
+const char *dupe_note_path(const dupe_index *index, uint32_t note, size_t *len);
+double dupe_similarity(const dupe_index *index, uint32_t a, uint32_t b);
+size_t dupe_index_clusters(const dupe_index *index, double threshold, dupe_cluster **clusters, uint32_t **members);
+
+#endif // DUPE_INDEX_H
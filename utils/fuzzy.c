@@ -0,0 +1,357 @@
+// fuzzy.c
+#include "fuzzy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Bytes of padding after the packed text so vector loads never leave the buffer
+#define FUZZY_PADDING 32
+
+// Scoring constants, following fzf's v1 matcher
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+#define BONUS_BOUNDARY 8
+#define BONUS_PATH_SEPARATOR 10
+#define BONUS_CONSECUTIVE 4
+#define BONUS_FIRST_CHAR_MULTIPLIER 2
+
+typedef int (*subsequence_fn)(const char *text, size_t len, const char *query, size_t query_len);
+
+static subsequence_fn prefilter;
+static const char *prefilter_name = "scalar";
+
+// Function to check that query occurs in text as a subsequence, one byte at a time
+static int subsequence_scalar(const char *text, size_t len, const char *query, size_t query_len) {
+    size_t pos = 0;
+    for (size_t j = 0; j < query_len; j++) {
+        const char *found = memchr(text + pos, query[j], len - pos);
+        if (found == NULL) {
+            return 0;
+        }
+        pos = (size_t)(found - text) + 1;
+    }
+    return 1;
+}
+
+#if defined(__x86_64__)
+// SSE2 is part of the x86-64 baseline, so this variant needs no runtime check
+static int subsequence_sse2(const char *text, size_t len, const char *query, size_t query_len) {
+    size_t pos = 0;
+    for (size_t j = 0; j < query_len; j++) {
+        const __m128i needle = _mm_set1_epi8(query[j]);
+        while (1) {
+            if (pos >= len) {
+                return 0;
+            }
+            __m128i block = _mm_loadu_si128((const __m128i *)(text + pos));
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+            if (len - pos < 16) {
+                mask &= (1u << (len - pos)) - 1;
+            }
+            if (mask) {
+                pos += (size_t)__builtin_ctz(mask) + 1;
+                break;
+            }
+            pos += 16;
+        }
+    }
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static int subsequence_avx2(const char *text, size_t len, const char *query, size_t query_len) {
+    size_t pos = 0;
+    for (size_t j = 0; j < query_len; j++) {
+        const __m256i needle = _mm256_set1_epi8(query[j]);
+        while (1) {
+            if (pos >= len) {
+                return 0;
+            }
+            __m256i block = _mm256_loadu_si256((const __m256i *)(text + pos));
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+            if (len - pos < 32) {
+                mask &= (1u << (len - pos)) - 1;
+            }
+            if (mask) {
+                pos += (size_t)__builtin_ctz(mask) + 1;
+                break;
+            }
+            pos += 32;
+        }
+    }
+    return 1;
+}
+#elif defined(__aarch64__)
+// NEON has no movemask, narrow each comparison byte to a nibble instead
+static int subsequence_neon(const char *text, size_t len, const char *query, size_t query_len) {
+    size_t pos = 0;
+    for (size_t j = 0; j < query_len; j++) {
+        const uint8x16_t needle = vdupq_n_u8((uint8_t)query[j]);
+        while (1) {
+            if (pos >= len) {
+                return 0;
+            }
+            uint8x16_t block = vld1q_u8((const uint8_t *)(text + pos));
+            uint16x8_t eq = vreinterpretq_u16_u8(vceqq_u8(block, needle));
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+            if (len - pos < 16) {
+                mask &= (1ULL << ((len - pos) * 4)) - 1;
+            }
+            if (mask) {
+                pos += (size_t)__builtin_ctzll(mask) / 4 + 1;
+                break;
+            }
+            pos += 16;
+        }
+    }
+    return 1;
+}
+#endif
+
+// Function to pick the widest prefilter the CPU supports
+static void select_prefilter(void) {
+    if (prefilter) {
+        return;
+    }
+    prefilter = subsequence_scalar;
+#if defined(__x86_64__)
+    prefilter = subsequence_sse2;
+    prefilter_name = "sse2";
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        prefilter = subsequence_avx2;
+        prefilter_name = "avx2";
+    }
+#elif defined(__aarch64__)
+    prefilter = subsequence_neon;
+    prefilter_name = "neon";
+#endif
+}
+
+const char *fuzzy_prefilter_name(void) {
+    select_prefilter();
+    return prefilter_name;
+}
+
+// Function to summarise which characters occur in a string as a 64-bit set
+static unsigned long long char_mask(const char *text, size_t len) {
+    unsigned long long mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        mask |= 1ULL << ((unsigned char)text[i] & 63);
+    }
+    return mask;
+}
+
+int fuzzy_index_build(fuzzy_index *index, const char **paths, size_t count) {
+    memset(index, 0, sizeof(*index));
+    select_prefilter();
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += strlen(paths[i]) + 1;
+    }
+
+    index->paths = paths;
+    index->count = count;
+    index->text = malloc(total + FUZZY_PADDING);
+    index->offsets = malloc((count ? count : 1) * sizeof(size_t));
+    index->lengths = malloc((count ? count : 1) * sizeof(unsigned int));
+    index->masks = malloc((count ? count : 1) * sizeof(unsigned long long));
+    index->survivors = malloc((count ? count : 1) * sizeof(unsigned int));
+    if (!index->text || !index->offsets || !index->lengths || !index->masks || !index->survivors) {
+        perror("malloc");
+        fuzzy_index_free(index);
+        return 0;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(paths[i]);
+        for (size_t j = 0; j < len; j++) {
+            index->text[offset + j] = (char)tolower((unsigned char)paths[i][j]);
+        }
+        index->text[offset + len] = '\0';
+        index->offsets[i] = offset;
+        index->lengths[i] = (unsigned int)len;
+        index->masks[i] = char_mask(index->text + offset, len);
+        offset += len + 1;
+    }
+    memset(index->text + offset, 0, FUZZY_PADDING);
+    return 1;
+}
+
+void fuzzy_index_free(fuzzy_index *index) {
+    free(index->text);
+    free(index->offsets);
+    free(index->lengths);
+    free(index->masks);
+    free(index->survivors);
+    memset(index, 0, sizeof(*index));
+}
+
+// Function to score a match starting at position i, higher after separators
+static int boundary_bonus(const char *text, size_t i) {
+    if (i == 0) {
+        return BONUS_PATH_SEPARATOR;
+    }
+    char previous = text[i - 1];
+    if (previous == '/') {
+        return BONUS_PATH_SEPARATOR;
+    }
+    if (previous == '-' || previous == '_' || previous == '.' || previous == ' ') {
+        return BONUS_BOUNDARY;
+    }
+    return 0;
+}
+
+// Function to score a known subsequence match, optionally recording the matched positions
+static int score_candidate(const char *text, size_t len, const char *query, size_t query_len, int *positions) {
+    // Forward pass: leftmost end of the match
+    size_t j = 0, end = 0;
+    for (size_t i = 0; i < len && j < query_len; i++) {
+        if (text[i] == query[j]) {
+            if (++j == query_len) {
+                end = i;
+            }
+        }
+    }
+    if (j < query_len) {
+        return -1;
+    }
+
+    // Backward pass: latest start that still ends at end, giving the shortest span
+    size_t start = end;
+    j = query_len;
+    for (size_t i = end + 1; i-- > 0;) {
+        if (text[i] == query[j - 1]) {
+            if (--j == 0) {
+                start = i;
+                break;
+            }
+        }
+    }
+
+    int score = 0, consecutive = 0, in_gap = 0, first_bonus = 0;
+    j = 0;
+    for (size_t i = start; i <= end; i++) {
+        if (j < query_len && text[i] == query[j]) {
+            int bonus = boundary_bonus(text, i);
+            if (consecutive == 0) {
+                first_bonus = bonus;
+            } else {
+                if (bonus >= BONUS_BOUNDARY && bonus > first_bonus) {
+                    first_bonus = bonus;
+                }
+                if (first_bonus > bonus) {
+                    bonus = first_bonus;
+                }
+                if (BONUS_CONSECUTIVE > bonus) {
+                    bonus = BONUS_CONSECUTIVE;
+                }
+            }
+            score += SCORE_MATCH + (j == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus);
+            if (positions) {
+                positions[j] = (int)i;
+            }
+            consecutive++;
+            in_gap = 0;
+            j++;
+        } else {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            in_gap = 1;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+    }
+    return score;
+}
+
+// Function to insert a result into the top list, kept sorted best first
+static size_t insert_result(fuzzy_result *results, size_t count, size_t max_results,
+                            const fuzzy_index *index, size_t candidate, int score) {
+    size_t pos = count;
+    while (pos > 0) {
+        const fuzzy_result *other = &results[pos - 1];
+        // Ties go to the shorter path
+        if (other->score > score || (other->score == score && index->lengths[other->index] <= index->lengths[candidate])) {
+            break;
+        }
+        pos--;
+    }
+    if (pos >= max_results) {
+        return count;
+    }
+    if (count == max_results) {
+        count--;
+    }
+    memmove(&results[pos + 1], &results[pos], (count - pos) * sizeof(fuzzy_result));
+    results[pos].index = candidate;
+    results[pos].score = score;
+    return count + 1;
+}
+
+// Function to rank candidates against query, returning the best max_results.
+// When query extends the previous query only the previous survivors are rescanned.
+size_t fuzzy_search(fuzzy_index *index, const char *query, fuzzy_result *results, size_t max_results) {
+    char lowered[FUZZY_QUERY_MAX];
+    size_t query_len = 0;
+    for (; query[query_len] && query_len < sizeof(lowered) - 1; query_len++) {
+        lowered[query_len] = (char)tolower((unsigned char)query[query_len]);
+    }
+    lowered[query_len] = '\0';
+
+    int refine = index->has_survivors && index->last_query[0] != '\0' &&
+                 strncmp(lowered, index->last_query, strlen(index->last_query)) == 0;
+    size_t scan_count = refine ? index->survivor_count : index->count;
+    unsigned long long query_mask = char_mask(lowered, query_len);
+
+    size_t result_count = 0;
+    size_t survivor_count = 0;
+    for (size_t k = 0; k < scan_count; k++) {
+        size_t i = refine ? index->survivors[k] : k;
+        if ((index->masks[i] & query_mask) != query_mask) {
+            continue;
+        }
+        const char *text = index->text + index->offsets[i];
+        if (!prefilter(text, index->lengths[i], lowered, query_len)) {
+            continue;
+        }
+
+        index->survivors[survivor_count++] = (unsigned int)i;
+        if (max_results > 0) {
+            int score = query_len ? score_candidate(text, index->lengths[i], lowered, query_len, NULL) : 0;
+            result_count = insert_result(results, result_count, max_results, index, i, score);
+        }
+    }
+
+    index->survivor_count = survivor_count;
+    index->has_survivors = 1;
+    snprintf(index->last_query, sizeof(index->last_query), "%s", lowered);
+    return result_count;
+}
+
+// Function to find which characters of a candidate the query matched, for highlighting
+size_t fuzzy_match_positions(const fuzzy_index *index, size_t candidate, const char *query, int *positions, size_t max_positions) {
+    char lowered[FUZZY_QUERY_MAX];
+    size_t query_len = 0;
+    for (; query[query_len] && query_len < sizeof(lowered) - 1 && query_len < max_positions; query_len++) {
+        lowered[query_len] = (char)tolower((unsigned char)query[query_len]);
+    }
+    if (query_len == 0) {
+        return 0;
+    }
+
+    const char *text = index->text + index->offsets[candidate];
+    if (score_candidate(text, index->lengths[candidate], lowered, query_len, positions) < 0) {
+        return 0;
+    }
+    return query_len;
+}
@@ -0,0 +1,38 @@
+// fuzzy.h
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stddef.h>
+
+#define FUZZY_QUERY_MAX 256
+#define FUZZY_TOP_N 10
+
+// Lowercased candidate paths packed into one buffer so the prefilter can use vector loads
+typedef struct {
+    const char **paths;             // Original paths, borrowed from the caller
+    char *text;                     // Lowercased paths, NUL separated and padded at the end
+    size_t *offsets;
+    unsigned int *lengths;
+    unsigned long long *masks;      // Characters present in each candidate
+    size_t count;
+
+    // Survivors of the previous query, refined when the query is extended
+    char last_query[FUZZY_QUERY_MAX];
+    unsigned int *survivors;
+    size_t survivor_count;
+    int has_survivors;
+} fuzzy_index;
+
+typedef struct {
+    size_t index;
+    int score;
+} fuzzy_result;
+
+// Function declarations
+int fuzzy_index_build(fuzzy_index *index, const char **paths, size_t count);
+void fuzzy_index_free(fuzzy_index *index);
+size_t fuzzy_search(fuzzy_index *index, const char *query, fuzzy_result *results, size_t max_results);
+size_t fuzzy_match_positions(const fuzzy_index *index, size_t candidate, const char *query, int *positions, size_t max_positions);
+const char *fuzzy_prefilter_name(void);
+
+#endif // FUZZY_H
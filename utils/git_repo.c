@@ -0,0 +1,340 @@
+// git_repo.c
+#include "git_repo.h"
+#include "catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define GIT_CACHE_MAX_ENTRIES 256
+#define GIT_LINE_MAX 2048
+
+// One cwd -> (org, repo) mapping, valid while the config file keeps its mtime
+typedef struct {
+    char cwd[GIT_PATH_MAX];
+    char config_path[GIT_PATH_MAX];
+    long long config_mtime;
+    char git_organisation[GIT_NAME_MAX];
+    char repo_name[GIT_NAME_MAX];
+} git_cache_entry;
+
+// Function to strip trailing whitespace and newlines in place
+static void trim_right(char *text) {
+    size_t len = strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1])) {
+        text[--len] = '\0';
+    }
+}
+
+// Function to read the first line of a small file such as a gitfile or commondir
+static int read_first_line(const char *path, char *buf, size_t size) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int ok = fgets(buf, size, file) != NULL;
+    fclose(file);
+    if (ok) {
+        trim_right(buf);
+    }
+    return ok;
+}
+
+// Function to resolve a path that may be relative to base
+static void resolve_relative(char *buf, size_t size, const char *base, const char *path) {
+    if (path[0] == '/') {
+        snprintf(buf, size, "%s", path);
+    } else {
+        snprintf(buf, size, "%s/%s", base, path);
+    }
+}
+
+// Function to fill in the git dir, common dir and config path once .git has been found in dir
+static int locate_git_dir(const char *dir, git_location *location) {
+    char dot_git[GIT_PATH_MAX];
+    snprintf(dot_git, sizeof(dot_git), "%s/.git", dir);
+
+    struct stat st;
+    if (lstat(dot_git, &st) != 0) {
+        return 0;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        snprintf(location->git_dir, sizeof(location->git_dir), "%s", dot_git);
+    } else if (S_ISREG(st.st_mode)) {
+        // Gitfile used by worktrees and submodules: "gitdir: <path>"
+        char line[GIT_PATH_MAX];
+        if (!read_first_line(dot_git, line, sizeof(line)) || strncmp(line, "gitdir:", 7) != 0) {
+            return 0;
+        }
+        char *target = line + 7;
+        while (isspace((unsigned char)*target)) {
+            target++;
+        }
+        resolve_relative(location->git_dir, sizeof(location->git_dir), dir, target);
+    } else {
+        return 0;
+    }
+
+    char head_path[GIT_PATH_MAX];
+    snprintf(head_path, sizeof(head_path), "%s/HEAD", location->git_dir);
+    if (stat(head_path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+
+    // Linked worktrees share the config of the main repository through commondir
+    char commondir_path[GIT_PATH_MAX];
+    char commondir[GIT_PATH_MAX];
+    snprintf(commondir_path, sizeof(commondir_path), "%s/commondir", location->git_dir);
+    if (read_first_line(commondir_path, commondir, sizeof(commondir))) {
+        resolve_relative(location->common_dir, sizeof(location->common_dir), location->git_dir, commondir);
+    } else {
+        snprintf(location->common_dir, sizeof(location->common_dir), "%s", location->git_dir);
+    }
+
+    snprintf(location->config_path, sizeof(location->config_path), "%s/config", location->common_dir);
+    snprintf(location->work_tree, sizeof(location->work_tree), "%s", dir);
+    return 1;
+}
+
+// Function to walk up from start_dir to the nearest .git directory or gitfile
+int git_find_repository(const char *start_dir, git_location *location) {
+    char dir[GIT_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", start_dir);
+
+    while (1) {
+        if (locate_git_dir(dir, location)) {
+            return 1;
+        }
+
+        char *last_slash = strrchr(dir, '/');
+        if (last_slash == NULL || last_slash == dir) {
+            // Check the filesystem root last
+            if (strcmp(dir, "/") != 0 && locate_git_dir("", location)) {
+                return 1;
+            }
+            return 0;
+        }
+        *last_slash = '\0';
+    }
+}
+
+// Function to parse the url of [remote "origin"] out of a git config file
+int git_read_origin_url(const char *config_path, char *url, size_t size) {
+    FILE *file = fopen(config_path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char line[GIT_LINE_MAX];
+    int in_origin = 0;
+    int found = 0;
+
+    while (!found && fgets(line, sizeof(line), file)) {
+        char *text = line;
+        while (isspace((unsigned char)*text)) {
+            text++;
+        }
+        trim_right(text);
+
+        if (text[0] == '\0' || text[0] == '#' || text[0] == ';') {
+            continue;
+        }
+
+        if (text[0] == '[') {
+            // Accept both [remote "origin"] and the legacy [remote.origin]
+            in_origin = strcmp(text, "[remote \"origin\"]") == 0 || strcasecmp(text, "[remote.origin]") == 0;
+            continue;
+        }
+
+        if (!in_origin || strncasecmp(text, "url", 3) != 0) {
+            continue;
+        }
+
+        char *value = text + 3;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        if (*value != '=') {
+            continue;
+        }
+        value++;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+
+        // Drop surrounding quotes, or a trailing comment on an unquoted value
+        if (*value == '"') {
+            value++;
+            char *end_quote = strrchr(value, '"');
+            if (end_quote) {
+                *end_quote = '\0';
+            }
+        } else {
+            value[strcspn(value, "#;")] = '\0';
+            trim_right(value);
+        }
+
+        snprintf(url, size, "%s", value);
+        found = url[0] != '\0';
+    }
+
+    fclose(file);
+    return found;
+}
+
+// Function to build the location of the repo cache under ~/obs
+static void git_cache_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", GIT_CACHE_FILE);
+}
+
+// Function to load the cwd -> repo cache, returns the number of entries read
+static size_t load_git_cache(git_cache_entry *entries, size_t max_entries) {
+    char path[GIT_PATH_MAX];
+    git_cache_path(path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    size_t count = 0;
+    char line[GIT_LINE_MAX * 2];
+    while (count < max_entries && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        // <cwd> <config path> <config mtime> <org> <repo>
+        char *fields[5];
+        char *cursor = line;
+        int n = 0;
+        for (; n < 5 && cursor; n++) {
+            fields[n] = cursor;
+            cursor = strchr(cursor, '\t');
+            if (cursor) {
+                *cursor++ = '\0';
+            }
+        }
+        if (n < 5) {
+            continue;
+        }
+
+        git_cache_entry *entry = &entries[count++];
+        snprintf(entry->cwd, sizeof(entry->cwd), "%s", fields[0]);
+        snprintf(entry->config_path, sizeof(entry->config_path), "%s", fields[1]);
+        entry->config_mtime = strtoll(fields[2], NULL, 10);
+        snprintf(entry->git_organisation, sizeof(entry->git_organisation), "%s", fields[3]);
+        snprintf(entry->repo_name, sizeof(entry->repo_name), "%s", fields[4]);
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Function to write the cache back, most recent lookup first
+static void save_git_cache(const git_cache_entry *latest, const git_cache_entry *entries, size_t count) {
+    char path[GIT_PATH_MAX];
+    char temp_path[GIT_PATH_MAX + 8];
+    git_cache_path(path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) {
+        return;  // The cache is only an optimisation
+    }
+
+    fprintf(file, "%s\t%s\t%lld\t%s\t%s\n", latest->cwd, latest->config_path, latest->config_mtime,
+            latest->git_organisation, latest->repo_name);
+
+    size_t written = 1;
+    for (size_t i = 0; i < count && written < GIT_CACHE_MAX_ENTRIES; i++) {
+        const git_cache_entry *entry = &entries[i];
+        if (strcmp(entry->cwd, latest->cwd) == 0) {
+            continue;
+        }
+        fprintf(file, "%s\t%s\t%lld\t%s\t%s\n", entry->cwd, entry->config_path, entry->config_mtime,
+                entry->git_organisation, entry->repo_name);
+        written++;
+    }
+
+    if (fclose(file) != 0 || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+    }
+}
+
+// Function to split "org/repo.git" into its two names, each cut to fit GIT_NAME_MAX
+static void split_repo_path(const char *path, char *git_organisation, char *repo_name) {
+    const char *slash = strchr(path, '/');
+    if (slash == NULL) {
+        return;
+    }
+    snprintf(git_organisation, GIT_NAME_MAX, "%.*s", (int)(slash - path), path);
+    snprintf(repo_name, GIT_NAME_MAX, "%.*s", (int)strcspn(slash + 1, "."), slash + 1);
+}
+
+// Function to extract the git_organisation and repository name from the URL. Both buffers hold
+// GIT_NAME_MAX bytes.
+void parse_url(const char* url, char* git_organisation, char* repo_name) {
+    char *at_ptr, *colon_ptr, *slash_ptr;
+
+    at_ptr = strchr(url, '@'); // For SSH URLs
+    colon_ptr = strchr(url, ':'); // For SSH URLs
+    slash_ptr = strstr(url, "/"); // For HTTPS URLs
+
+    if (at_ptr && colon_ptr) { // SSH format: git@github.com:git_organisation/repo.git
+        split_repo_path(colon_ptr + 1, git_organisation, repo_name);
+    } else if (slash_ptr) { // HTTPS format: https://github.com/git_organisation/repo.git
+        split_repo_path(slash_ptr + 1, git_organisation, repo_name);
+    }
+}
+
+// Function to find the organisation and repository for cwd without running git.
+// Returns 1 for a repository with an origin, 0 outside a repository and -1 when origin is missing.
+int git_resolve_repo(const char *cwd, char *git_organisation, size_t organisation_size,
+                     char *repo_name, size_t repo_size) {
+    git_cache_entry *entries = calloc(GIT_CACHE_MAX_ENTRIES, sizeof(git_cache_entry));
+    size_t count = entries ? load_git_cache(entries, GIT_CACHE_MAX_ENTRIES) : 0;
+
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        if (strcmp(entries[i].cwd, cwd) == 0 &&
+            stat(entries[i].config_path, &st) == 0 && CATALOG_STAT_MTIME(st) == entries[i].config_mtime) {
+            snprintf(git_organisation, organisation_size, "%s", entries[i].git_organisation);
+            snprintf(repo_name, repo_size, "%s", entries[i].repo_name);
+            free(entries);
+            return 1;
+        }
+    }
+
+    git_location location;
+    if (!git_find_repository(cwd, &location)) {
+        free(entries);
+        return 0;
+    }
+
+    char url[GIT_LINE_MAX];
+    struct stat config_stat;
+    if (stat(location.config_path, &config_stat) != 0 ||
+        !git_read_origin_url(location.config_path, url, sizeof(url))) {
+        free(entries);
+        return -1;
+    }
+
+    git_cache_entry latest = {0};
+    parse_url(url, latest.git_organisation, latest.repo_name);
+    snprintf(latest.cwd, sizeof(latest.cwd), "%s", cwd);
+    snprintf(latest.config_path, sizeof(latest.config_path), "%s", location.config_path);
+    latest.config_mtime = CATALOG_STAT_MTIME(config_stat);
+
+    if (strchr(cwd, '\t') == NULL && strchr(location.config_path, '\t') == NULL) {
+        save_git_cache(&latest, entries, count);
+    }
+
+    snprintf(git_organisation, organisation_size, "%s", latest.git_organisation);
+    snprintf(repo_name, repo_size, "%s", latest.repo_name);
+    free(entries);
+    return 1;
+}
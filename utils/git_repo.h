@@ -0,0 +1,26 @@
+// git_repo.h
+#ifndef GIT_REPO_H
+#define GIT_REPO_H
+
+#include <stddef.h>
+
+#define GIT_CACHE_FILE "obs/.git_cache"
+#define GIT_PATH_MAX 1024
+#define GIT_NAME_MAX 256
+
+// Where a repository found by walking up from a directory keeps its metadata
+typedef struct {
+    char work_tree[GIT_PATH_MAX];
+    char git_dir[GIT_PATH_MAX];       // .git, or the directory a gitfile points to
+    char common_dir[GIT_PATH_MAX];    // Shared git dir for linked worktrees, else git_dir
+    char config_path[GIT_PATH_MAX];
+} git_location;
+
+// Function declarations
+void parse_url(const char* url, char* git_organisation, char* repo_name);
+int git_find_repository(const char *start_dir, git_location *location);
+int git_read_origin_url(const char *config_path, char *url, size_t size);
+int git_resolve_repo(const char *cwd, char *git_organisation, size_t organisation_size,
+                     char *repo_name, size_t repo_size);
+
+#endif // GIT_REPO_H
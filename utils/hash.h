@@ -0,0 +1,11 @@
+// hash.h
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Function declarations
+uint64_t hash_xxh64(const void *data, size_t size, uint64_t seed);
+
+#endif // HASH_H
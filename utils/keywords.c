@@ -0,0 +1,178 @@
+// keywords.c
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define KEYWORDS_SLOTS (KEYWORDS_DISTINCT_MAX * 2)
+#define KEYWORDS_MIN_LENGTH 3
+#define KEYWORDS_TITLE_BOOST 2.0
+
+// Sorted bytewise so lookups can binary search
+static const char *const stopwords[] = {
+    "about", "above", "after", "again", "against", "all", "also", "and", "any", "are", "aren", "because",
+    "been", "before", "being", "below", "between", "both", "but", "can", "cannot", "could", "couldn", "did",
+    "didn", "does", "doesn", "doing", "don", "down", "during", "each", "etc", "few", "for", "from", "further",
+    "get", "gets", "got", "had", "hadn", "has", "hasn", "have", "haven", "having", "her", "here", "hers",
+    "herself", "him", "himself", "his", "how", "http", "https", "into", "isn", "its", "itself", "just", "let",
+    "like", "md", "more", "most", "much", "must", "mustn", "myself", "need", "new", "not", "note", "notes",
+    "now", "off", "once", "one", "only", "other", "our", "ours", "ourselves", "out", "over", "own", "same",
+    "shan", "she", "should", "shouldn", "some", "such", "than", "that", "the", "their", "theirs", "them",
+    "themselves", "then", "there", "these", "they", "this", "those", "through", "too", "under", "until",
+    "use", "used", "using", "very", "via", "was", "wasn", "way", "were", "weren", "what", "when", "where",
+    "which", "while", "who", "whom", "why", "will", "with", "won", "would", "wouldn", "www", "you", "your",
+    "yours", "yourself", "yourselves",
+};
+
+static int compare_stopword(const void *key, const void *element) {
+    return strcmp((const char *)key, *(const char *const *)element);
+}
+
+int keywords_is_stopword(const char *term, size_t len) {
+    (void)len;
+    return bsearch(term, stopwords, sizeof(stopwords) / sizeof(stopwords[0]), sizeof(stopwords[0]),
+                   compare_stopword) != NULL;
+}
+
+// Function to decide whether a token can become part of a filename
+static int is_candidate(const char *term, size_t len) {
+    if (len < KEYWORDS_MIN_LENGTH) {
+        return 0;
+    }
+
+    int has_letter = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)term[i];
+        if (c >= 0x80) {
+            return 0;  // Names are plain ASCII, as the OpenAI prompt asks
+        }
+        has_letter |= c >= 'a' && c <= 'z';
+    }
+    return has_letter && !keywords_is_stopword(term, len);
+}
+
+static uint32_t hash_token(const char *term, size_t len) {
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)term[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int compare_score(const void *a, const void *b) {
+    const keyword *left = a;
+    const keyword *right = b;
+    if (left->score != right->score) {
+        return left->score < right->score ? 1 : -1;
+    }
+    return left->first_position < right->first_position ? -1 : left->first_position > right->first_position;
+}
+
+static int compare_position(const void *a, const void *b) {
+    const keyword *left = a;
+    const keyword *right = b;
+    return left->first_position < right->first_position ? -1 : left->first_position > right->first_position;
+}
+
+// Function to rank the terms of a note by TF-IDF against the vault's document frequencies. Terms on
+// the first line, usually the title, count double. Fills out with the best max terms by score and
+// returns how many there were. Without an index every term is weighted by frequency alone.
+size_t keywords_extract(const search_index *index, const char *text, size_t len, keyword *out, size_t max) {
+    keyword *terms = malloc(KEYWORDS_DISTINCT_MAX * sizeof(keyword));
+    unsigned short *slots = calloc(KEYWORDS_SLOTS, sizeof(unsigned short));
+    if (terms == NULL || slots == NULL) {
+        perror("malloc");
+        free(terms);
+        free(slots);
+        return 0;
+    }
+
+    size_t term_count = 0;
+    size_t first_line_end = len;
+    const char *newline = memchr(text, '\n', len);
+    if (newline) {
+        first_line_end = (size_t)(newline - text);
+    }
+
+    char token[SEARCH_TERM_MAX];
+    size_t pos = 0;
+    size_t position = 0;
+    while (pos < len) {
+        size_t token_len = search_next_token(text, len, &pos, token, sizeof(token));
+        if (token_len == 0) {
+            continue;
+        }
+        position++;
+        if (!is_candidate(token, token_len)) {
+            continue;
+        }
+
+        size_t slot = hash_token(token, token_len) & (KEYWORDS_SLOTS - 1);
+        while (slots[slot] != 0) {
+            keyword *existing = &terms[slots[slot] - 1];
+            if (existing->length == token_len && memcmp(existing->term, token, token_len) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (KEYWORDS_SLOTS - 1);
+        }
+
+        double boost = pos <= first_line_end ? KEYWORDS_TITLE_BOOST : 1.0;
+        if (slots[slot] != 0) {
+            keyword *existing = &terms[slots[slot] - 1];
+            existing->count++;
+            if (boost > existing->score) {
+                existing->score = boost;  // Holds the title boost until scoring
+            }
+        } else if (term_count < KEYWORDS_DISTINCT_MAX) {
+            keyword *added = &terms[term_count++];
+            memcpy(added->term, token, token_len + 1);
+            added->length = token_len;
+            added->count = 1;
+            added->first_position = position;
+            added->score = boost;
+            slots[slot] = (unsigned short)term_count;
+        }
+    }
+    free(slots);
+
+    double note_count = index ? index->header->note_count : 0;
+    for (size_t i = 0; i < term_count; i++) {
+        keyword *term = &terms[i];
+        double document_count = 0;
+        if (index) {
+            const search_term *found = search_index_find_term(index, term->term, term->length);
+            document_count = found ? found->doc_count : 0;
+        }
+        double idf = log((note_count + 1) / (document_count + 1)) + 1;
+        term->score *= (1 + log(term->count)) * idf;
+    }
+
+    qsort(terms, term_count, sizeof(keyword), compare_score);
+    size_t count = term_count < max ? term_count : max;
+    memcpy(out, terms, count * sizeof(keyword));
+    free(terms);
+    return count;
+}
+
+// Function to build a lowercase hyphenated filename from the best keywords of a note, kept in the
+// order they appear in it. Returns the length of the name, 0 when the note has no usable terms.
+size_t keywords_name(const search_index *index, const char *text, size_t len, char *name, size_t size) {
+    keyword best[KEYWORDS_NAME_WORDS];
+    size_t count = keywords_extract(index, text, len, best, KEYWORDS_NAME_WORDS);
+    qsort(best, count, sizeof(keyword), compare_position);
+
+    size_t used = 0;
+    if (size > 0) {
+        name[0] = '\0';
+    }
+    for (size_t i = 0; i < count; i++) {
+        int written = snprintf(name + used, size - used, "%s%s", used ? "-" : "", best[i].term);
+        if (written < 0 || (size_t)written >= size - used) {
+            break;
+        }
+        used += (size_t)written;
+    }
+    return used;
+}
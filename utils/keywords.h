@@ -0,0 +1,25 @@
+// keywords.h
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stddef.h>
+#include "search_index.h"
+
+#define KEYWORDS_NAME_WORDS 3
+#define KEYWORDS_DISTINCT_MAX 4096
+
+// A term of a note with its TF-IDF weight
+typedef struct {
+    char term[SEARCH_TERM_MAX];
+    size_t length;
+    unsigned int count;
+    size_t first_position;      // Token index of the first occurrence
+    double score;
+} keyword;
+
+// Function declarations
+int keywords_is_stopword(const char *term, size_t len);
+size_t keywords_extract(const search_index *index, const char *text, size_t len, keyword *out, size_t max);
+size_t keywords_name(const search_index *index, const char *text, size_t len, char *name, size_t size);
+
+#endif // KEYWORDS_H
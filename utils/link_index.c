@@ -0,0 +1,689 @@
+// link_index.c
+#include "link_index.h"
+#include "hash.h"
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LINK_MAGIC "SLCLNK1"
+#define LINK_VERSION 1
+
+// A link target as written, shared by every note using the same text
+typedef struct {
+    char *text;
+    uint32_t length;
+    uint64_t hash;
+} build_text;
+
+typedef struct {
+    const char *path;           // Borrowed from the catalog
+    int64_t mtime;
+    int64_t size;
+    size_t first_text;          // Into the builder's note text column
+    uint32_t text_count;
+} build_note;
+
+// Notes in path order and the distinct targets each of them links to
+typedef struct {
+    build_text *texts;
+    size_t text_count;
+    size_t text_capacity;
+    uint32_t *text_slots;       // Open addressing table of index + 1
+    size_t text_slot_count;
+    build_note *notes;
+    size_t note_count;
+    uint32_t *note_texts;
+    size_t note_text_count;
+    size_t note_text_capacity;
+} link_builder;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} byte_buffer;
+
+void link_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", LINK_INDEX_FILE);
+}
+
+static int buffer_reserve(byte_buffer *buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->size + extra) {
+        capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        perror("realloc");
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int buffer_append(byte_buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, size)) {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static void builder_free(link_builder *builder) {
+    for (size_t i = 0; i < builder->text_count; i++) {
+        free(builder->texts[i].text);
+    }
+    free(builder->texts);
+    free(builder->text_slots);
+    free(builder->notes);
+    free(builder->note_texts);
+    memset(builder, 0, sizeof(*builder));
+}
+
+static int rehash_texts(link_builder *builder, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return 0;
+    }
+    for (size_t i = 0; i < builder->text_count; i++) {
+        size_t slot = builder->texts[i].hash & (slot_count - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    free(builder->text_slots);
+    builder->text_slots = slots;
+    builder->text_slot_count = slot_count;
+    return 1;
+}
+
+// Function to find or add a target text, returns its builder index or -1
+static long intern_text(link_builder *builder, const char *text, size_t length) {
+    if ((builder->text_count + 1) * 2 > builder->text_slot_count &&
+        !rehash_texts(builder, builder->text_slot_count ? builder->text_slot_count * 2 : 1024)) {
+        return -1;
+    }
+
+    uint64_t hash = hash_xxh64(text, length, 0);
+    size_t slot = hash & (builder->text_slot_count - 1);
+    while (builder->text_slots[slot]) {
+        build_text *existing = &builder->texts[builder->text_slots[slot] - 1];
+        if (existing->hash == hash && existing->length == length && memcmp(existing->text, text, length) == 0) {
+            return builder->text_slots[slot] - 1;
+        }
+        slot = (slot + 1) & (builder->text_slot_count - 1);
+    }
+
+    if (builder->text_count == builder->text_capacity) {
+        size_t capacity = builder->text_capacity ? builder->text_capacity * 2 : 256;
+        build_text *grown = realloc(builder->texts, capacity * sizeof(build_text));
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        builder->texts = grown;
+        builder->text_capacity = capacity;
+    }
+
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    build_text *added = &builder->texts[builder->text_count];
+    added->text = copy;
+    added->length = (uint32_t)length;
+    added->hash = hash;
+    builder->text_slots[slot] = (uint32_t)++builder->text_count;
+    return (long)builder->text_count - 1;
+}
+
+// Function to record a link of the note currently being built, once however often it appears
+static int builder_add(link_builder *builder, const char *text, size_t length) {
+    long index = intern_text(builder, text, length);
+    if (index < 0) {
+        return 0;
+    }
+
+    build_note *note = &builder->notes[builder->note_count - 1];
+    for (uint32_t i = 0; i < note->text_count; i++) {
+        if (builder->note_texts[note->first_text + i] == (uint32_t)index) {
+            return 1;
+        }
+    }
+
+    if (builder->note_text_count == builder->note_text_capacity) {
+        size_t capacity = builder->note_text_capacity ? builder->note_text_capacity * 2 : 1024;
+        uint32_t *grown = realloc(builder->note_texts, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        builder->note_texts = grown;
+        builder->note_text_capacity = capacity;
+    }
+    builder->note_texts[builder->note_text_count++] = (uint32_t)index;
+    note->text_count++;
+    return 1;
+}
+
+void link_scanner_init(link_scanner *scanner, const char *text, size_t len) {
+    markdown_scanner_init(&scanner->markdown, text, len);
+}
+
+// Function to find the next [[target]], [[target|alias]], [[target#heading]] or ![[embed]] outside code.
+// Sets start and length to the target part, the text a rename has to rewrite. Returns 0 at the end.
+int link_scanner_next(link_scanner *scanner, size_t *start, size_t *length) {
+    markdown_token token;
+    while (markdown_scanner_next(&scanner->markdown, &token)) {
+        if (token.type == MARKDOWN_WIKILINK && token.length <= LINK_TARGET_MAX) {
+            *start = token.start;
+            *length = token.length;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to read a note and record the targets it links to
+static int index_note(link_builder *builder, const char *root, const char *relative_path) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, relative_path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;  // Vanished since the catalog was taken, the next update drops it
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    link_scanner scanner;
+    link_scanner_init(&scanner, text, size);
+    size_t start, length;
+    int ok = 1;
+    while (ok && link_scanner_next(&scanner, &start, &length)) {
+        ok = builder_add(builder, text + start, length);
+    }
+    munmap((void *)text, size);
+    return ok;
+}
+
+// Function to copy the targets of an unchanged note over from the previous index without reading it
+static int reuse_note(link_builder *builder, const link_index *old, uint32_t note) {
+    size_t count;
+    const link_edge *edges = link_index_links(old, note, &count);
+    for (size_t i = 0; i < count; i++) {
+        size_t length;
+        const char *text = link_edge_text(old, &edges[i], &length);
+        if (!builder_add(builder, text, length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to find a note of a mapped index by its exact path, LINK_UNRESOLVED if it has none
+static uint32_t find_path(const link_index *index, const char *path) {
+    size_t low = 0, high = index->data ? index->header->note_count : 0;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(link_note_path(index, (uint32_t)mid, NULL), path);
+        if (cmp == 0) {
+            return (uint32_t)mid;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return LINK_UNRESOLVED;
+}
+
+static const char *note_key(const link_index *index, uint32_t note) {
+    return index->bytes + index->notes[note].key_offset;
+}
+
+// Function to find the last path component of a key, the name a bare [[target]] refers to
+static const char *key_name(const char *key, size_t length) {
+    const char *slash = NULL;
+    for (size_t i = length; i > 0; i--) {
+        if (key[i - 1] == '/') {
+            slash = key + i - 1;
+            break;
+        }
+    }
+    return slash ? slash + 1 : key;
+}
+
+static const link_index *sort_index;
+
+static int compare_names(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    const link_note *left = &sort_index->notes[x], *right = &sort_index->notes[y];
+    const char *left_key = note_key(sort_index, x), *right_key = note_key(sort_index, y);
+    int cmp = strcmp(key_name(left_key, left->key_length), key_name(right_key, right->key_length));
+    if (cmp != 0) {
+        return cmp;
+    }
+    if (left->key_length != right->key_length) {
+        return left->key_length < right->key_length ? -1 : 1;
+    }
+    return strcmp(left_key, right_key);
+}
+
+// Function to turn a path or link target into the key it resolves by: lowercased, without a leading
+// slash and without a note extension. Returns the key length, 0 if it does not fit.
+static size_t make_key(const char *text, size_t length, char *key, size_t size) {
+    while (length > 0 && text[0] == '/') {
+        text++;
+        length--;
+    }
+    if (length >= size) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        key[i] = (char)tolower((unsigned char)text[i]);
+    }
+    key[length] = '\0';
+    if (search_is_note(key)) {
+        length -= key[length - 3] == '.' ? 3 : 4;
+        key[length] = '\0';
+    }
+    return length;
+}
+
+// Function to resolve a link target the way Obsidian does: the note whose path matches it without
+// extension, otherwise the note with that name whose path ends in the target, the shortest path winning.
+// Matching ignores case. Returns the note index or LINK_UNRESOLVED.
+uint32_t link_index_resolve(const link_index *index, const char *target, size_t len) {
+    char key[LINK_TARGET_MAX + 1];
+    size_t key_length = make_key(target, len, key, sizeof(key));
+    if (key_length == 0 || index->data == NULL) {
+        return LINK_UNRESOLVED;
+    }
+    const char *name = key_name(key, key_length);
+
+    size_t low = 0, high = index->header->note_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const link_note *note = &index->notes[index->by_name[mid]];
+        if (strcmp(key_name(note_key(index, index->by_name[mid]), note->key_length), name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (size_t i = low; i < index->header->note_count; i++) {
+        uint32_t candidate = index->by_name[i];
+        const link_note *note = &index->notes[candidate];
+        const char *candidate_key = note_key(index, candidate);
+        if (strcmp(key_name(candidate_key, note->key_length), name) != 0) {
+            break;
+        }
+        if (note->key_length == key_length ||
+            (note->key_length > key_length && candidate_key[note->key_length - key_length - 1] == '/')) {
+            if (memcmp(candidate_key + note->key_length - key_length, key, key_length) == 0) {
+                return candidate;
+            }
+        }
+    }
+    return LINK_UNRESOLVED;
+}
+
+// Function to serialise the notes, their resolved links and the reverse adjacency to index_path
+static int write_index(link_builder *builder, const char *index_path) {
+    uint32_t count = (uint32_t)builder->note_count;
+    link_note *notes = calloc(count + 1, sizeof(link_note));
+    uint32_t *by_name = malloc((count + 1) * sizeof(uint32_t));
+    uint64_t *text_offsets = malloc((builder->text_count + 1) * sizeof(uint64_t));
+    uint32_t *targets = malloc((builder->text_count + 1) * sizeof(uint32_t));
+    uint32_t *forward = malloc((count + 1) * sizeof(uint32_t));
+    link_edge *edges = calloc(builder->note_text_count + 1, sizeof(link_edge));
+    uint32_t *reverse = calloc(count + 1, sizeof(uint32_t));
+    uint32_t *last_source = malloc((count + 1) * sizeof(uint32_t));
+    byte_buffer bytes = {NULL, 0, 0};
+    int ok = notes && by_name && text_offsets && targets && forward && edges && reverse && last_source;
+    if (!ok) {
+        perror("malloc");
+    }
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        char key[CATALOG_PATH_MAX];
+        size_t path_length = strlen(builder->notes[i].path);
+        size_t key_length = make_key(builder->notes[i].path, path_length, key, sizeof(key));
+        notes[i].path_offset = bytes.size;
+        notes[i].path_length = (uint32_t)path_length;
+        notes[i].mtime = builder->notes[i].mtime;
+        notes[i].size = builder->notes[i].size;
+        ok = buffer_append(&bytes, builder->notes[i].path, path_length + 1);
+        notes[i].key_offset = bytes.size;
+        notes[i].key_length = (uint32_t)key_length;
+        ok = ok && buffer_append(&bytes, key, key_length + 1);
+        by_name[i] = i;
+    }
+    for (size_t i = 0; ok && i < builder->text_count; i++) {
+        text_offsets[i] = bytes.size;
+        ok = buffer_append(&bytes, builder->texts[i].text, builder->texts[i].length + 1);
+    }
+
+    link_header header;
+    memset(&header, 0, sizeof(header));
+    header.note_count = count;
+    uint32_t source_count = 0;
+    if (ok) {
+        // Resolve against the notes being written, each distinct target once
+        link_index view;
+        memset(&view, 0, sizeof(view));
+        view.data = bytes.data;
+        view.header = &header;
+        view.notes = notes;
+        view.by_name = by_name;
+        view.bytes = (const char *)bytes.data;
+        sort_index = &view;
+        qsort(by_name, count, sizeof(uint32_t), compare_names);
+        for (size_t i = 0; i < builder->text_count; i++) {
+            targets[i] = link_index_resolve(&view, builder->texts[i].text, builder->texts[i].length);
+        }
+
+        // Forward edges in note order, and how many distinct notes link to each note
+        uint32_t edge_count = 0;
+        memset(last_source, 0xff, (count + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++) {
+            forward[i] = edge_count;
+            for (uint32_t j = 0; j < builder->notes[i].text_count; j++) {
+                uint32_t text = builder->note_texts[builder->notes[i].first_text + j];
+                link_edge *edge = &edges[edge_count++];
+                edge->text_offset = text_offsets[text];
+                edge->text_length = builder->texts[text].length;
+                edge->target = targets[text];
+                if (edge->target != LINK_UNRESOLVED && last_source[edge->target] != i) {
+                    last_source[edge->target] = i;
+                    reverse[edge->target]++;
+                }
+            }
+        }
+        forward[count] = edge_count;
+        header.edge_count = edge_count;
+
+        for (uint32_t i = 0; i <= count; i++) {
+            uint32_t incoming = i < count ? reverse[i] : 0;
+            reverse[i] = source_count;
+            source_count += incoming;
+        }
+        header.source_count = source_count;
+    }
+
+    // Sources of each note, in ascending note order since sources are visited in that order
+    uint32_t *sources = ok ? malloc((source_count + 1) * sizeof(uint32_t)) : NULL;
+    uint32_t *fill = ok ? malloc((count + 1) * sizeof(uint32_t)) : NULL;
+    if (ok && (sources == NULL || fill == NULL)) {
+        perror("malloc");
+        ok = 0;
+    }
+    if (ok) {
+        memcpy(fill, reverse, count * sizeof(uint32_t));
+        memset(last_source, 0xff, (count + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++) {
+            for (uint32_t j = forward[i]; j < forward[i + 1]; j++) {
+                uint32_t target = edges[j].target;
+                if (target != LINK_UNRESOLVED && last_source[target] != i) {
+                    last_source[target] = i;
+                    sources[fill[target]++] = i;
+                }
+            }
+        }
+    }
+
+    memcpy(header.magic, LINK_MAGIC, sizeof(LINK_MAGIC));
+    header.version = LINK_VERSION;
+    header.notes_offset = sizeof(link_header);
+    header.by_name_offset = header.notes_offset + (uint64_t)count * sizeof(link_note);
+    header.forward_offset = header.by_name_offset + (uint64_t)count * sizeof(uint32_t);
+    header.edges_offset = align8(header.forward_offset + (uint64_t)(count + 1) * sizeof(uint32_t));
+    header.reverse_offset = header.edges_offset + (uint64_t)header.edge_count * sizeof(link_edge);
+    header.sources_offset = header.reverse_offset + (uint64_t)(count + 1) * sizeof(uint32_t);
+    header.bytes_offset = header.sources_offset + (uint64_t)source_count * sizeof(uint32_t);
+    header.total_size = header.bytes_offset + bytes.size;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        perror("Failed to open link index");
+        ok = 0;
+    }
+    if (file) {
+        static const unsigned char zeros[8];
+        size_t padding = header.edges_offset - (header.forward_offset + (uint64_t)(count + 1) * sizeof(uint32_t));
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(notes, sizeof(link_note), count, file) == count &&
+             fwrite(by_name, sizeof(uint32_t), count, file) == count &&
+             fwrite(forward, sizeof(uint32_t), count + 1, file) == count + 1 &&
+             fwrite(zeros, 1, padding, file) == padding &&
+             fwrite(edges, sizeof(link_edge), header.edge_count, file) == header.edge_count &&
+             fwrite(reverse, sizeof(uint32_t), count + 1, file) == count + 1 &&
+             fwrite(sources, sizeof(uint32_t), source_count, file) == source_count &&
+             fwrite(bytes.data, 1, bytes.size, file) == bytes.size;
+        if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+            perror("Failed to write link index");
+            unlink(temp_path);
+            ok = 0;
+        }
+    }
+
+    free(notes);
+    free(by_name);
+    free(text_offsets);
+    free(targets);
+    free(forward);
+    free(edges);
+    free(reverse);
+    free(last_source);
+    free(sources);
+    free(fill);
+    free(bytes.data);
+    return ok;
+}
+
+static const catalog *sort_catalog;
+
+static int compare_entry_paths(const void *a, const void *b) {
+    return strcmp(sort_catalog->entries[*(const size_t *)a].path, sort_catalog->entries[*(const size_t *)b].path);
+}
+
+// Function to bring the index in line with the catalog, reading only notes whose mtime or size changed.
+// Links of unchanged notes are carried over as written and every target is resolved again, so a new or
+// renamed note picks up the links that were dangling. Returns the number of notes (re)read, or -1 on failure.
+int link_index_update(const catalog *cat, const char *index_path) {
+    link_index old;
+    int have_old = link_index_open(&old, index_path);
+
+    size_t *order = malloc((cat->entry_count + 1) * sizeof(size_t));
+    uint32_t *previous = malloc((cat->entry_count + 1) * sizeof(uint32_t));
+    if (order == NULL || previous == NULL) {
+        perror("malloc");
+        free(order);
+        free(previous);
+        if (have_old) {
+            link_index_close(&old);
+        }
+        return -1;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        if (search_is_note(cat->entries[i].path)) {
+            order[count++] = i;
+        }
+    }
+    sort_catalog = cat;
+    qsort(order, count, sizeof(size_t), compare_entry_paths);
+
+    size_t changes = 0;
+    for (size_t i = 0; i < count; i++) {
+        const catalog_entry *entry = &cat->entries[order[i]];
+        uint32_t found = find_path(&old, entry->path);
+        int reuse = found != LINK_UNRESOLVED && old.notes[found].mtime == entry->mtime &&
+                    old.notes[found].size == entry->size;
+        previous[i] = reuse ? found : LINK_UNRESOLVED;
+        changes += !reuse;
+    }
+
+    int result = 0;
+    if (!have_old || changes > 0 || count != old.header->note_count) {
+        link_builder builder;
+        memset(&builder, 0, sizeof(builder));
+        builder.notes = calloc(count + 1, sizeof(build_note));
+        int ok = builder.notes != NULL;
+        if (!ok) {
+            perror("calloc");
+        }
+
+        for (size_t i = 0; ok && i < count; i++) {
+            const catalog_entry *entry = &cat->entries[order[i]];
+            build_note *note = &builder.notes[builder.note_count++];
+            note->path = entry->path;
+            note->mtime = entry->mtime;
+            note->size = entry->size;
+            note->first_text = builder.note_text_count;
+            if (previous[i] != LINK_UNRESOLVED) {
+                ok = reuse_note(&builder, &old, previous[i]);
+            } else {
+                ok = index_note(&builder, cat->root, entry->path);
+            }
+        }
+        ok = ok && write_index(&builder, index_path);
+
+        builder_free(&builder);
+        result = ok ? (int)changes : -1;
+    }
+
+    if (have_old) {
+        link_index_close(&old);
+    }
+    free(order);
+    free(previous);
+    return result;
+}
+
+// Function to map an index file and validate its layout
+int link_index_open(link_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(link_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const link_header *header = data;
+    uint64_t count = header->note_count;
+    if (memcmp(header->magic, LINK_MAGIC, sizeof(LINK_MAGIC)) != 0 || header->version != LINK_VERSION ||
+        header->total_size != (uint64_t)st.st_size || header->notes_offset != sizeof(link_header) ||
+        header->by_name_offset != header->notes_offset + count * sizeof(link_note) ||
+        header->forward_offset != header->by_name_offset + count * sizeof(uint32_t) ||
+        header->edges_offset != align8(header->forward_offset + (count + 1) * sizeof(uint32_t)) ||
+        header->reverse_offset != header->edges_offset + (uint64_t)header->edge_count * sizeof(link_edge) ||
+        header->sources_offset != header->reverse_offset + (count + 1) * sizeof(uint32_t) ||
+        header->bytes_offset != header->sources_offset + (uint64_t)header->source_count * sizeof(uint32_t) ||
+        header->bytes_offset > header->total_size) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->notes = (const link_note *)(index->data + header->notes_offset);
+    index->by_name = (const uint32_t *)(index->data + header->by_name_offset);
+    index->forward = (const uint32_t *)(index->data + header->forward_offset);
+    index->edges = (const link_edge *)(index->data + header->edges_offset);
+    index->reverse = (const uint32_t *)(index->data + header->reverse_offset);
+    index->sources = (const uint32_t *)(index->data + header->sources_offset);
+    index->bytes = (const char *)(index->data + header->bytes_offset);
+    return 1;
+}
+
+void link_index_close(link_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+const char *link_note_path(const link_index *index, uint32_t note, size_t *len) {
+    const link_note *entry = &index->notes[note];
+    if (len) {
+        *len = entry->path_length;
+    }
+    return index->bytes + entry->path_offset;
+}
+
+const char *link_edge_text(const link_index *index, const link_edge *edge, size_t *len) {
+    if (len) {
+        *len = edge->text_length;
+    }
+    return index->bytes + edge->text_offset;
+}
+
+// Function to find the note a command line names, by its vault-relative path or as a link would
+uint32_t link_index_find_note(const link_index *index, const char *query) {
+    uint32_t note = find_path(index, query);
+    return note != LINK_UNRESOLVED ? note : link_index_resolve(index, query, strlen(query));
+}
+
+// Function to list the links a note makes, resolved or not, in the order they first appear
+const link_edge *link_index_links(const link_index *index, uint32_t note, size_t *count) {
+    *count = index->forward[note + 1] - index->forward[note];
+    return &index->edges[index->forward[note]];
+}
+
+// Function to list the notes linking to a note, in path order
+const uint32_t *link_index_backlinks(const link_index *index, uint32_t note, size_t *count) {
+    *count = index->reverse[note + 1] - index->reverse[note];
+    return &index->sources[index->reverse[note]];
+}
@@ -0,0 +1,82 @@
+// link_index.h
+#ifndef LINK_INDEX_H
+#define LINK_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+#include "markdown.h"
+
+#define LINK_INDEX_FILE "obs/.link_index"
+#define LINK_TARGET_MAX 512
+#define LINK_UNRESOLVED UINT32_MAX
+
+// On-disk layout, every section is addressed by offset so the file can be used straight from mmap.
+// Notes are sorted by path. Outgoing links are a CSR adjacency: the links of note i are
+// edges[forward[i] .. forward[i + 1]), and the notes linking to it are sources[reverse[i] .. reverse[i + 1]).
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t note_count;
+    uint32_t edge_count;
+    uint32_t source_count;
+    uint64_t notes_offset;
+    uint64_t by_name_offset;
+    uint64_t forward_offset;
+    uint64_t edges_offset;
+    uint64_t reverse_offset;
+    uint64_t sources_offset;
+    uint64_t bytes_offset;
+    uint64_t total_size;
+} link_header;
+
+typedef struct {
+    uint64_t path_offset;       // Into the byte section
+    uint64_t key_offset;        // Lowercased path without its extension, what links resolve against
+    uint32_t path_length;
+    uint32_t key_length;
+    int64_t mtime;
+    int64_t size;
+} link_note;
+
+// A [[target]] as written, and the note it resolves to
+typedef struct {
+    uint64_t text_offset;       // Into the byte section
+    uint32_t text_length;
+    uint32_t target;            // Note index or LINK_UNRESOLVED
+} link_edge;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const link_header *header;
+    const link_note *notes;
+    const uint32_t *by_name;    // Note indices by last key component, shortest key first
+    const uint32_t *forward;
+    const link_edge *edges;
+    const uint32_t *reverse;
+    const uint32_t *sources;
+    const char *bytes;
+} link_index;
+
+// Walks the [[wikilinks]] of a note, skipping code blocks and code spans
+typedef struct {
+    markdown_scanner markdown;
+} link_scanner;
+
+// Function declarations
+void link_index_default_path(char *buf, size_t size);
+void link_scanner_init(link_scanner *scanner, const char *text, size_t len);
+int link_scanner_next(link_scanner *scanner, size_t *start, size_t *length);
+int link_index_update(const catalog *cat, const char *index_path);
+int link_index_open(link_index *index, const char *index_path);
+void link_index_close(link_index *index);
+const char *link_note_path(const link_index *index, uint32_t note, size_t *len);
+const char *link_edge_text(const link_index *index, const link_edge *edge, size_t *len);
+uint32_t link_index_resolve(const link_index *index, const char *target, size_t len);
+uint32_t link_index_find_note(const link_index *index, const char *query);
+const link_edge *link_index_links(const link_index *index, uint32_t note, size_t *count);
+const uint32_t *link_index_backlinks(const link_index *index, uint32_t note, size_t *count);
+
+#endif // LINK_INDEX_H
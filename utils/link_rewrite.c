@@ -0,0 +1,577 @@
+// link_rewrite.c
+#include "link_rewrite.h"
+#include "link_index.h"
+#include "catalog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define JOURNAL_LINE_MAX (CATALOG_PATH_MAX * 2 + 8)
+#define NO_RENAME UINT32_MAX
+
+typedef struct {
+    char *old_path;
+    char *new_path;
+} rename_record;
+
+// One [[target]] to rewrite and what it becomes
+typedef struct {
+    char *old_text;
+    char *new_text;
+} text_record;
+
+typedef struct {
+    char *path;                 // Where the note lives now, after its own rename if it had one
+    size_t first_link;
+    size_t link_count;
+    int done;
+} file_record;
+
+// Everything a journal holds, read back in full before anything is rewritten
+typedef struct {
+    rename_record *renames;
+    size_t rename_count;
+    size_t rename_capacity;
+    file_record *files;
+    size_t file_count;
+    size_t file_capacity;
+    text_record *links;
+    size_t link_count;
+    size_t link_capacity;
+    int planned;
+} journal_state;
+
+void link_journal_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", LINK_JOURNAL_FILE);
+}
+
+// Function to tell whether an earlier batch left renames whose links were not all rewritten
+int link_journal_pending(const char *journal_path) {
+    return access(journal_path, F_OK) == 0;
+}
+
+// Function to flush the directory holding path, so the files just created in it survive a crash
+static int sync_directory(const char *path) {
+    char dir[CATALOG_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        snprintf(dir, sizeof(dir), ".");
+    } else {
+        *slash = '\0';
+    }
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// The link index the plan is made from, as it was when the journal was begun
+static void snapshot_path(const char *journal_path, char *buf, size_t size) {
+    snprintf(buf, size, "%s.links", journal_path);
+}
+
+// Function to start the journal of a new batch. A finished journal has been removed, so one still there
+// belongs to a batch whose links are not all rewritten and is never replaced. The link index is kept
+// beside it as it is now, before anything is renamed. Index updates replace the file rather than write
+// into it, so a hard link holds on to this version whatever updates the index meanwhile.
+FILE *link_journal_begin(const char *journal_path, const char *index_path) {
+    int fd = open(journal_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror("Failed to open rename journal");
+        return NULL;
+    }
+    char snapshot[CATALOG_PATH_MAX];
+    snapshot_path(journal_path, snapshot, sizeof(snapshot));
+    unlink(snapshot);  // Left behind by a batch that stopped between removing its journal and this
+    if ((link(index_path, snapshot) != 0 && errno != ENOENT) || !sync_directory(journal_path)) {
+        perror("Failed to keep the link index");
+        close(fd);
+        unlink(journal_path);
+        unlink(snapshot);
+        return NULL;
+    }
+    FILE *journal = fdopen(fd, "w");
+    if (journal == NULL) {
+        perror("Failed to open rename journal");
+        close(fd);
+    }
+    return journal;
+}
+
+// Function to record a rename before it happens. The record is on disk when this returns, so a batch cut
+// short at any point still knows about every note it renamed.
+int link_journal_record(FILE *journal, const char *old_path, const char *new_path) {
+    return fprintf(journal, "R\t%s\t%s\n", old_path, new_path) > 0 && fflush(journal) == 0 &&
+           fsync(fileno(journal)) == 0;
+}
+
+static int grow(void **items, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity) {
+        return 1;
+    }
+    size_t grown_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(*items, grown_capacity * item_size);
+    if (grown == NULL) {
+        perror("realloc");
+        return 0;
+    }
+    *items = grown;
+    *capacity = grown_capacity;
+    return 1;
+}
+
+static void journal_free(journal_state *state) {
+    for (size_t i = 0; i < state->rename_count; i++) {
+        free(state->renames[i].old_path);
+        free(state->renames[i].new_path);
+    }
+    for (size_t i = 0; i < state->file_count; i++) {
+        free(state->files[i].path);
+    }
+    for (size_t i = 0; i < state->link_count; i++) {
+        free(state->links[i].old_text);
+        free(state->links[i].new_text);
+    }
+    free(state->renames);
+    free(state->files);
+    free(state->links);
+    memset(state, 0, sizeof(*state));
+}
+
+static int add_rename(journal_state *state, const char *old_path, const char *new_path) {
+    if (!grow((void **)&state->renames, &state->rename_capacity, state->rename_count, sizeof(rename_record))) {
+        return 0;
+    }
+    rename_record *record = &state->renames[state->rename_count];
+    record->old_path = strdup(old_path);
+    record->new_path = strdup(new_path);
+    state->rename_count++;
+    return record->old_path && record->new_path;
+}
+
+static int add_file(journal_state *state, const char *path) {
+    if (!grow((void **)&state->files, &state->file_capacity, state->file_count, sizeof(file_record))) {
+        return 0;
+    }
+    file_record *file = &state->files[state->file_count++];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    file->first_link = state->link_count;
+    return file->path != NULL;
+}
+
+// Function to add a rewrite to the newest file
+static int add_link(journal_state *state, const char *old_text, const char *new_text) {
+    if (state->file_count == 0 ||
+        !grow((void **)&state->links, &state->link_capacity, state->link_count, sizeof(text_record))) {
+        return 0;
+    }
+    text_record *link = &state->links[state->link_count++];
+    link->old_text = strdup(old_text);
+    link->new_text = strdup(new_text);
+    state->files[state->file_count - 1].link_count++;
+    return link->old_text && link->new_text;
+}
+
+// Function to read a journal back. A last line cut short by a crash is ignored. Returns 0 if it cannot be read.
+static int journal_load(journal_state *state, const char *journal_path) {
+    FILE *journal = fopen(journal_path, "r");
+    if (journal == NULL) {
+        return 0;
+    }
+
+    char line[JOURNAL_LINE_MAX];
+    size_t next_done = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), journal)) {
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            break;
+        }
+        line[length - 1] = '\0';
+
+        char *first = strchr(line, '\t');
+        char *second = first ? strchr(first + 1, '\t') : NULL;
+        if (first) {
+            *first++ = '\0';
+        }
+        if (second) {
+            *second++ = '\0';
+        }
+
+        if (strcmp(line, "R") == 0 && second) {
+            ok = add_rename(state, first, second);
+        } else if (strcmp(line, "F") == 0 && first) {
+            ok = add_file(state, first);
+        } else if (strcmp(line, "L") == 0 && second) {
+            ok = add_link(state, first, second);
+        } else if (strcmp(line, "P") == 0) {
+            state->planned = 1;
+        } else if (strcmp(line, "D") == 0 && first) {
+            // Files are rewritten in order, so the match is almost always the next one
+            for (size_t i = 0; i < state->file_count; i++) {
+                size_t file = (next_done + i) % state->file_count;
+                if (strcmp(state->files[file].path, first) == 0) {
+                    state->files[file].done = 1;
+                    next_done = file + 1;
+                    break;
+                }
+            }
+        }
+    }
+    fclose(journal);
+    return ok;
+}
+
+// Function to find the extension of a note path or link target, "" if it has none a note can have
+static const char *note_extension(const char *text, size_t length) {
+    if (length > 3 && strncasecmp(text + length - 3, ".md", 3) == 0) {
+        return text + length - 3;
+    }
+    if (length > 4 && strncasecmp(text + length - 4, ".txt", 4) == 0) {
+        return text + length - 4;
+    }
+    return text + length;
+}
+
+static const char *last_component(const char *text, const char *end) {
+    const char *slash = end;
+    while (slash > text && slash[-1] != '/') {
+        slash--;
+    }
+    return slash;
+}
+
+// Function to work out what a link to a renamed note should now say. Only the name is swapped, keeping any
+// folder and extension the link was written with. When the new name would resolve to another note, the
+// full path without extension is used instead.
+static void renamed_target(const link_index *index, const char *text, size_t length, const rename_record *record,
+                           char *out, size_t size) {
+    size_t old_length = strlen(record->old_path), new_length = strlen(record->new_path);
+    const char *old_end = note_extension(record->old_path, old_length);
+    const char *old_name = last_component(record->old_path, old_end);
+    const char *new_end = note_extension(record->new_path, new_length);
+    const char *new_name = last_component(record->new_path, new_end);
+
+    const char *text_end = note_extension(text, length);
+    const char *text_name = last_component(text, text_end);
+    size_t name_length = (size_t)(old_end - old_name);
+    if ((size_t)(text_end - text_name) == name_length && strncasecmp(text_name, old_name, name_length) == 0) {
+        snprintf(out, size, "%.*s%.*s%s", (int)(text_name - text), text, (int)(new_end - new_name), new_name,
+                 text_end);
+    } else {
+        snprintf(out, size, "%.*s", (int)(new_end - record->new_path), record->new_path);
+    }
+
+    uint32_t clash = link_index_resolve(index, out, strlen(out));
+    if (clash != LINK_UNRESOLVED && strcmp(link_note_path(index, clash, NULL), record->new_path) != 0) {
+        snprintf(out, size, "%.*s", (int)(new_end - record->new_path), record->new_path);
+    }
+}
+
+static int compare_notes(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Function to plan the rewrites from the reverse links of the renamed notes and append them to the journal.
+// Only the notes linking to a renamed note are looked at.
+static int journal_plan(journal_state *state, const link_index *index, FILE *journal, link_rewrite_stats *stats) {
+    uint32_t note_count = index->data ? index->header->note_count : 0;
+    uint32_t *renamed = malloc((note_count + 1) * sizeof(uint32_t));
+    uint32_t *sources = NULL;
+    size_t source_count = 0, source_capacity = 0;
+    if (renamed == NULL) {
+        perror("malloc");
+        return 0;
+    }
+    memset(renamed, 0xff, (note_count + 1) * sizeof(uint32_t));
+
+    int ok = 1;
+    for (size_t r = 0; ok && r < state->rename_count; r++) {
+        uint32_t note = note_count ? link_index_find_note(index, state->renames[r].old_path) : LINK_UNRESOLVED;
+        if (note == LINK_UNRESOLVED || strcmp(link_note_path(index, note, NULL), state->renames[r].old_path) != 0) {
+            stats->renames_unindexed++;
+            continue;
+        }
+        renamed[note] = (uint32_t)r;
+
+        size_t count;
+        const uint32_t *linking = link_index_backlinks(index, note, &count);
+        for (size_t i = 0; ok && i < count; i++) {
+            ok = grow((void **)&sources, &source_capacity, source_count, sizeof(uint32_t));
+            if (ok) {
+                sources[source_count++] = linking[i];
+            }
+        }
+    }
+
+    // A note linking to several renamed notes is rewritten once
+    qsort(sources, source_count, sizeof(uint32_t), compare_notes);
+    for (size_t i = 0; ok && i < source_count; i++) {
+        if (i > 0 && sources[i] == sources[i - 1]) {
+            continue;
+        }
+        uint32_t source = sources[i];
+        const char *path = renamed[source] != NO_RENAME ? state->renames[renamed[source]].new_path
+                                                        : link_note_path(index, source, NULL);
+        ok = add_file(state, path) && fprintf(journal, "F\t%s\n", path) > 0;
+
+        size_t count;
+        const link_edge *edges = link_index_links(index, source, &count);
+        for (size_t j = 0; ok && j < count; j++) {
+            if (edges[j].target == LINK_UNRESOLVED || renamed[edges[j].target] == NO_RENAME) {
+                continue;
+            }
+            size_t length;
+            const char *text = link_edge_text(index, &edges[j], &length);
+            if (memchr(text, '\t', length)) {
+                continue;
+            }
+            char new_text[CATALOG_PATH_MAX];
+            renamed_target(index, text, length, &state->renames[renamed[edges[j].target]], new_text,
+                           sizeof(new_text));
+            ok = add_link(state, text, new_text) && fprintf(journal, "L\t%s\t%s\n", text, new_text) > 0;
+        }
+    }
+
+    ok = ok && fprintf(journal, "P\n") > 0 && fflush(journal) == 0 && fsync(fileno(journal)) == 0;
+    state->planned = ok;
+    free(renamed);
+    free(sources);
+    return ok;
+}
+
+// Function to drop the renames that were journaled but never happened, because the batch stopped or the
+// rename failed in between. Names are only handed out while free, so the new path exists once it happened.
+static void drop_unrenamed(journal_state *state, const char *root) {
+    size_t kept = 0;
+    for (size_t i = 0; i < state->rename_count; i++) {
+        rename_record *record = &state->renames[i];
+        char old_path[CATALOG_PATH_MAX * 2], new_path[CATALOG_PATH_MAX * 2];
+        snprintf(old_path, sizeof(old_path), "%s/%s", root, record->old_path);
+        snprintf(new_path, sizeof(new_path), "%s/%s", root, record->new_path);
+        struct stat st;
+        if (lstat(new_path, &st) != 0 && lstat(old_path, &st) == 0) {
+            free(record->old_path);
+            free(record->new_path);
+            continue;
+        }
+        state->renames[kept++] = *record;
+    }
+    state->rename_count = kept;
+}
+
+// Function to rewrite the journal with only its renames, replacing it atomically, and reopen it for appending
+static FILE *restart_journal(journal_state *state, const char *journal_path) {
+    for (size_t i = 0; i < state->file_count; i++) {
+        free(state->files[i].path);
+    }
+    for (size_t i = 0; i < state->link_count; i++) {
+        free(state->links[i].old_text);
+        free(state->links[i].new_text);
+    }
+    state->file_count = 0;
+    state->link_count = 0;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", journal_path);
+    FILE *journal = fopen(temp_path, "w");
+    if (journal == NULL) {
+        return NULL;
+    }
+    int ok = 1;
+    for (size_t i = 0; ok && i < state->rename_count; i++) {
+        ok = fprintf(journal, "R\t%s\t%s\n", state->renames[i].old_path, state->renames[i].new_path) > 0;
+    }
+    ok = ok && fflush(journal) == 0 && fsync(fileno(journal)) == 0;
+    if (fclose(journal) != 0 || !ok || rename(temp_path, journal_path) != 0) {
+        unlink(temp_path);
+        return NULL;
+    }
+    return fopen(journal_path, "a");
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            return 0;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 1;
+}
+
+// Function to rewrite the links of one note in a single pass and swap the result in atomically.
+// Links already rewritten no longer match, so running it twice is harmless. Returns -1 on failure,
+// otherwise the number of links rewritten.
+static long rewrite_file(const char *root, const journal_state *state, const file_record *file) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, file->path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;  // Deleted since, nothing left to fix
+    }
+    struct stat st;
+    char *text = NULL;
+    if (fstat(fd, &st) != 0 || (text = malloc((size_t)st.st_size + 1)) == NULL ||
+        read(fd, text, (size_t)st.st_size) != st.st_size) {
+        perror("Failed to read note");
+        close(fd);
+        free(text);
+        return -1;
+    }
+    close(fd);
+    size_t size = (size_t)st.st_size;
+
+    // Rewritten text is at most the longest new target longer per link
+    size_t longest = 0;
+    for (size_t i = 0; i < file->link_count; i++) {
+        size_t length = strlen(state->links[file->first_link + i].new_text);
+        longest = length > longest ? length : longest;
+    }
+    size_t capacity = size + 1, used = 0, copied = 0;
+    char *out = malloc(capacity);
+    long rewritten = 0;
+
+    link_scanner scanner;
+    link_scanner_init(&scanner, text, size);
+    size_t start, length;
+    while (out && link_scanner_next(&scanner, &start, &length)) {
+        const text_record *match = NULL;
+        for (size_t i = 0; i < file->link_count && match == NULL; i++) {
+            const text_record *link = &state->links[file->first_link + i];
+            if (strlen(link->old_text) == length && memcmp(link->old_text, text + start, length) == 0) {
+                match = link;
+            }
+        }
+        if (match == NULL) {
+            continue;
+        }
+
+        size_t new_length = strlen(match->new_text);
+        if (used + (start - copied) + new_length + (size - start) > capacity) {
+            capacity = used + (start - copied) + new_length + (size - start) + longest * 8;
+            char *grown = realloc(out, capacity);
+            if (grown == NULL) {
+                free(out);
+                out = NULL;
+                break;
+            }
+            out = grown;
+        }
+        memcpy(out + used, text + copied, start - copied);
+        used += start - copied;
+        memcpy(out + used, match->new_text, new_length);
+        used += new_length;
+        copied = start + length;
+        rewritten++;
+    }
+    if (out == NULL) {
+        perror("malloc");
+        free(text);
+        return -1;
+    }
+    if (rewritten == 0) {
+        free(text);
+        free(out);
+        return 0;
+    }
+    memcpy(out + used, text + copied, size - copied);
+    used += size - copied;
+    free(text);
+
+    char temp_path[CATALOG_PATH_MAX * 2 + 16];
+    snprintf(temp_path, sizeof(temp_path), "%s.silica-tmp", path);
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777);
+    int ok = fd >= 0 && write_all(fd, out, used) && fsync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(temp_path, path) != 0) {
+        perror("Failed to rewrite note");
+        unlink(temp_path);
+        rewritten = -1;
+    }
+    free(out);
+    return rewritten;
+}
+
+// Function to carry out a journal: plan the rewrites from the link index kept when it was begun if that has
+// not been done yet, then rewrite every note not yet marked done, recording each as it completes. The journal
+// is removed once every note is rewritten. Returns 1 on success.
+int link_rewrite_apply(const char *root, const char *index_path, const char *journal_path, link_rewrite_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    journal_state state;
+    memset(&state, 0, sizeof(state));
+    if (!journal_load(&state, journal_path)) {
+        journal_free(&state);
+        return !link_journal_pending(journal_path);
+    }
+    if (!state.planned) {
+        drop_unrenamed(&state, root);
+    }
+    stats->renames = state.rename_count;
+
+    // A half written plan is dropped and the journal restarted from its renames
+    FILE *journal = state.planned ? fopen(journal_path, "a") : restart_journal(&state, journal_path);
+    if (journal == NULL) {
+        perror("Failed to open rename journal");
+        journal_free(&state);
+        return 0;
+    }
+
+    // The plan comes from the index kept when the batch began, an index updated since no longer knows the
+    // old paths. A journal begun without one falls back to the current index.
+    char snapshot[CATALOG_PATH_MAX];
+    snapshot_path(journal_path, snapshot, sizeof(snapshot));
+    if (access(snapshot, F_OK) == 0) {
+        index_path = snapshot;
+    }
+
+    int ok = 1;
+    if (!state.planned) {
+        link_index index;
+        int have_index = link_index_open(&index, index_path);
+        ok = journal_plan(&state, &index, journal, stats);
+        if (have_index) {
+            link_index_close(&index);
+        }
+    }
+
+    for (size_t i = 0; ok && i < state.file_count; i++) {
+        if (state.files[i].done) {
+            continue;
+        }
+        long rewritten = rewrite_file(root, &state, &state.files[i]);
+        if (rewritten < 0) {
+            ok = 0;
+            break;
+        }
+        stats->links_rewritten += (size_t)rewritten;
+        stats->files_rewritten += rewritten > 0;
+        ok = fprintf(journal, "D\t%s\n", state.files[i].path) > 0 && fflush(journal) == 0;
+    }
+
+    if (fclose(journal) != 0) {
+        ok = 0;
+    }
+    if (ok) {
+        unlink(journal_path);
+        unlink(snapshot);
+    }
+    journal_free(&state);
+    return ok;
+}
@@ -0,0 +1,37 @@
+// link_rewrite.h
+#ifndef LINK_REWRITE_H
+#define LINK_REWRITE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define LINK_JOURNAL_FILE "obs/.rename_journal"
+
+// The journal is a text file appended to as a batch of renames goes along, one record per line:
+//
+//   R \t old path \t new path     a note is being renamed, paths relative to the vault
+//   F \t path                     a note whose links need rewriting, followed by its L records
+//   L \t old target \t new target
+//   P                             every F and L record has been written
+//   D \t path                     the note has been rewritten
+//
+// Each R record is on disk before its rename is made. A batch that stops part way leaves the journal
+// behind and link_rewrite_apply() picks it up again, skipping the renames that never happened. The link
+// index as it was before the first rename is kept beside the journal, with .links appended, until the
+// journal is done.
+
+typedef struct {
+    size_t renames;
+    size_t files_rewritten;
+    size_t links_rewritten;
+    size_t renames_unindexed;   // Renamed notes the link index did not know, their links were left alone
+} link_rewrite_stats;
+
+// Function declarations
+void link_journal_default_path(char *buf, size_t size);
+int link_journal_pending(const char *journal_path);
+FILE *link_journal_begin(const char *journal_path, const char *index_path);
+int link_journal_record(FILE *journal, const char *old_path, const char *new_path);
+int link_rewrite_apply(const char *root, const char *index_path, const char *journal_path, link_rewrite_stats *stats);
+
+#endif // LINK_REWRITE_H
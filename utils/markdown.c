@@ -0,0 +1,315 @@
+// markdown.c
+#include "markdown.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// The bytes that can start or end something the scanner tracks: line breaks for fences, headings and
+// tasks, backticks for code spans, brackets for wikilinks and # for tags. Everything else is skipped
+// a whole block at a time.
+static const unsigned char structural[256] = {['\n'] = 1, ['`'] = 1, ['['] = 1, [']'] = 1, ['#'] = 1};
+
+static uint64_t classify_scalar(const char *block) {
+    uint64_t mask = 0;
+    for (int i = 0; i < MARKDOWN_BLOCK; i++) {
+        mask |= (uint64_t)structural[(unsigned char)block[i]] << i;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static uint64_t classify_avx2(const char *block) {
+    uint64_t mask = 0;
+    for (int half = 0; half < 2; half++) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + half * 32));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+                                       _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('`')));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('[')));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']')));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('#')));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hits) << (half * 32);
+    }
+    return mask;
+}
+
+// PCMPESTRM matches each byte against the whole set in one instruction
+__attribute__((target("sse4.2"))) static uint64_t classify_sse42(const char *block) {
+    const __m128i set = _mm_setr_epi8('\n', '`', '[', ']', '#', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i * 16));
+        __m128i bits = _mm_cmpestrm(set, 5, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        mask |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(bits) << (i * 16);
+    }
+    return mask;
+}
+#elif defined(__aarch64__)
+static uint64_t classify_neon(const char *block) {
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t weight = vld1q_u8(weights);
+    uint8x16_t parts[4];
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)block + i * 16);
+        uint8x16_t hits = vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')), vceqq_u8(chunk, vdupq_n_u8('`')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8('[')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8(']')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8('#')));
+        parts[i] = vandq_u8(hits, weight);
+    }
+    // Three rounds of pairwise adds fold each run of 8 weighted lanes into one mask byte
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(parts[0], parts[1]), vpaddq_u8(parts[2], parts[3]));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    uint64_t (*classify)(const char *block);
+} classify_kernel;
+
+static const classify_kernel *active_kernel;
+
+// Function to tell whether the CPU can run a kernel
+static int kernel_supported(const classify_kernel *kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (kernel->classify == classify_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (kernel->classify == classify_sse42) {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    return kernel != NULL;
+}
+
+// Best first, the scalar loop last so something always runs
+static const classify_kernel kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx2", classify_avx2},
+    {"sse4.2", classify_sse42},
+#elif defined(__aarch64__)
+    {"neon", classify_neon},
+#endif
+    {"scalar", classify_scalar},
+};
+
+// Function to pick the classifier by name, or the fastest the CPU supports for NULL. Returns 0 when the
+// named one is unknown or unsupported, leaving the choice as it was.
+int markdown_select_kernel(const char *name) {
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if ((name == NULL || strcmp(name, kernels[i].name) == 0) && kernel_supported(&kernels[i])) {
+            active_kernel = &kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *markdown_kernel_name(void) {
+    if (active_kernel == NULL) {
+        markdown_select_kernel(NULL);
+    }
+    return active_kernel->name;
+}
+
+// Function to return the structural bytes of a MARKDOWN_BLOCK byte block as a bitmask, bit i for block[i]
+uint64_t markdown_classify(const char *block) {
+    if (active_kernel == NULL) {
+        markdown_select_kernel(NULL);
+    }
+    return active_kernel->classify(block);
+}
+
+void markdown_scanner_init(markdown_scanner *scanner, const char *text, size_t len) {
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->text = text;
+    scanner->len = len;
+    scanner->line_start = 1;
+    scanner->block_base = SIZE_MAX;
+}
+
+// Function to find the first structural byte at or after from, or len when there is none
+static size_t next_structural(markdown_scanner *scanner, size_t from) {
+    while (from < scanner->len) {
+        size_t base = from & ~(size_t)(MARKDOWN_BLOCK - 1);
+        if (base != scanner->block_base) {
+            scanner->block_base = base;
+            if (base + MARKDOWN_BLOCK <= scanner->len) {
+                scanner->block_mask = markdown_classify(scanner->text + base);
+            } else {
+                char tail[MARKDOWN_BLOCK] = {0};  // NUL is not structural
+                memcpy(tail, scanner->text + base, scanner->len - base);
+                scanner->block_mask = markdown_classify(tail);
+            }
+        }
+        uint64_t mask = scanner->block_mask & (~0ULL << (from - base));
+        if (mask) {
+            return base + (size_t)__builtin_ctzll(mask);
+        }
+        from = base + MARKDOWN_BLOCK;
+    }
+    return scanner->len;
+}
+
+static void set_span(markdown_token *token, const char *text, size_t start, size_t end) {
+    while (start < end && isspace((unsigned char)text[start])) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)text[end - 1])) {
+        end--;
+    }
+    token->start = start;
+    token->length = end - start;
+}
+
+// Function to look at the start of a line for a code fence, a heading or a task. Moves past what it
+// recognised and returns 1 with the token, otherwise leaves the line to the inline scan.
+static int line_token(markdown_scanner *scanner, markdown_token *token) {
+    const char *text = scanner->text;
+    size_t pos = scanner->pos, len = scanner->len;
+    size_t i = pos;
+    while (i < len && i - pos < 3 && text[i] == ' ') {
+        i++;
+    }
+    if (!scanner->in_fence && (i == len || !strchr("`~#-*+ \t", text[i]))) {
+        return 0;  // A line of prose, the common case
+    }
+    const char *newline = memchr(text + pos, '\n', len - pos);
+    size_t end = newline ? (size_t)(newline - text) : len;
+    if (i + 3 <= end && (memcmp(text + i, "```", 3) == 0 || memcmp(text + i, "~~~", 3) == 0)) {
+        scanner->in_fence = !scanner->in_fence;
+        while (i < end && (text[i] == '`' || text[i] == '~')) {
+            i++;
+        }
+        token->type = MARKDOWN_FENCE;
+        token->level = (uint32_t)scanner->in_fence;
+        set_span(token, text, i, end);
+        scanner->pos = end;
+        return 1;
+    }
+    if (scanner->in_fence) {
+        scanner->pos = end;
+        return 0;
+    }
+
+    if (i < end && text[i] == '#') {
+        size_t hashes = i;
+        while (hashes < end && hashes - i < 7 && text[hashes] == '#') {
+            hashes++;
+        }
+        if (hashes - i <= 6 && (hashes == end || text[hashes] == ' ' || text[hashes] == '\t')) {
+            token->type = MARKDOWN_HEADING;
+            token->level = (uint32_t)(hashes - i);
+            set_span(token, text, hashes, end);
+            scanner->pos = hashes;  // Links and tags in the heading are still found
+            return 1;
+        }
+    }
+
+    while (i < end && (text[i] == ' ' || text[i] == '\t')) {
+        i++;  // Tasks nest to any depth
+    }
+    if (i + 5 <= end && (text[i] == '-' || text[i] == '*' || text[i] == '+') && text[i + 1] == ' ' &&
+        text[i + 2] == '[' && (text[i + 3] == ' ' || text[i + 3] == 'x' || text[i + 3] == 'X') &&
+        text[i + 4] == ']' && (i + 5 == end || text[i + 5] == ' ' || text[i + 5] == '\t')) {
+        token->type = MARKDOWN_TASK;
+        token->level = text[i + 3] != ' ';
+        set_span(token, text, i + 5, end);
+        scanner->pos = i + 5;
+        return 1;
+    }
+    return 0;
+}
+
+// Function to read the [[wikilink]] whose first bracket is at open - 2. Returns 1 with the target when it
+// is closed on the same line, setting pos past it, otherwise 0 with pos just inside the brackets so a
+// [[ that starts within it is still found.
+static int wikilink_token(markdown_scanner *scanner, size_t open, markdown_token *token) {
+    const char *text = scanner->text;
+    size_t len = scanner->len;
+    size_t close = next_structural(scanner, open);
+    while (close + 1 < len && text[close] != '\n' && text[close] != '[' &&
+           !(text[close] == ']' && text[close + 1] == ']')) {
+        close = next_structural(scanner, close + 1);
+    }
+    if (close + 1 >= len || text[close] != ']' || text[close + 1] != ']') {
+        scanner->pos = open;  // Unclosed, or another [[ starts inside it
+        return 0;
+    }
+    scanner->pos = close + 2;
+
+    size_t end = open;
+    while (end < close && text[end] != '|' && text[end] != '#') {
+        end++;
+    }
+    if (end > open && end < close && text[end] == '|' && text[end - 1] == '\\') {
+        end--;  // [[target\|alias]] inside a table
+    }
+    token->type = MARKDOWN_WIKILINK;
+    token->level = open >= 3 && text[open - 3] == '!';
+    set_span(token, text, open, end);
+    return token->length > 0;
+}
+
+static int is_tag_byte(unsigned char c) {
+    return isalnum(c) || c == '_' || c == '-' || c == '/' || c >= 0x80;
+}
+
+// Function to find the next heading, wikilink, tag, code fence or task. Code blocks and code spans are
+// skipped, apart from the fences themselves. Returns 0 at the end of the text.
+int markdown_scanner_next(markdown_scanner *scanner, markdown_token *token) {
+    const char *text = scanner->text;
+    size_t len = scanner->len;
+    while (scanner->pos < len) {
+        if (scanner->line_start) {
+            scanner->line_start = 0;
+            scanner->in_code = 0;
+            if (line_token(scanner, token)) {
+                return 1;
+            }
+        }
+
+        size_t at = next_structural(scanner, scanner->pos);
+        if (at >= len) {
+            scanner->pos = len;
+            break;
+        }
+        scanner->pos = at + 1;
+        char c = text[at];
+        if (c == '\n') {
+            scanner->line_start = 1;
+        } else if (c == '`') {
+            scanner->in_code = !scanner->in_code;
+        } else if (scanner->in_code) {
+            continue;
+        } else if (c == '[' && at + 1 < len && text[at + 1] == '[') {
+            if (wikilink_token(scanner, at + 2, token)) {
+                return 1;
+            }
+        } else if (c == '#' && (at == 0 || isspace((unsigned char)text[at - 1]) || text[at - 1] == '(' ||
+                                text[at - 1] == ',')) {
+            size_t end = at + 1;
+            int has_letter = 0;
+            while (end < len && is_tag_byte((unsigned char)text[end])) {
+                has_letter |= !isdigit((unsigned char)text[end]);
+                end++;
+            }
+            if (has_letter) {
+                token->type = MARKDOWN_TAG;
+                token->level = 0;
+                token->start = at + 1;
+                token->length = end - at - 1;
+                scanner->pos = end;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+// markdown.h
+#ifndef MARKDOWN_H
+#define MARKDOWN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MARKDOWN_BLOCK 64           // Bytes classified per step, one bit each
+
+typedef enum {
+    MARKDOWN_HEADING,               // level is 1 to 6, the span is the heading text
+    MARKDOWN_WIKILINK,              // level is 1 for an ![[embed]], the span is the target
+    MARKDOWN_TAG,                   // The span is the tag without its #
+    MARKDOWN_FENCE,                 // level is 1 when the fence opens a code block, the span is its info string
+    MARKDOWN_TASK                   // level is 1 when checked, the span is the task text
+} markdown_token_type;
+
+typedef struct {
+    markdown_token_type type;
+    uint32_t level;
+    size_t start;                   // Offset of the span in the text
+    size_t length;
+} markdown_token;
+
+// Walks the structure of a note. Only the bytes that can change what the scanner does are looked at,
+// found a block at a time through a bitmask built with vector compares.
+typedef struct {
+    const char *text;
+    size_t len;
+    size_t pos;
+    int line_start;
+    int in_fence;
+    int in_code;
+    size_t block_base;              // Offset of the classified block, SIZE_MAX before the first one
+    uint64_t block_mask;            // Bit i set when text[block_base + i] is structural
+} markdown_scanner;
+
+// Function declarations
+const char *markdown_kernel_name(void);
+int markdown_select_kernel(const char *name);
+uint64_t markdown_classify(const char *block);
+void markdown_scanner_init(markdown_scanner *scanner, const char *text, size_t len);
+int markdown_scanner_next(markdown_scanner *scanner, markdown_token *token);
+
+#endif // MARKDOWN_H
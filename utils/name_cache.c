@@ -0,0 +1,226 @@
+// name_cache.c
+#include "name_cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#define NAME_CACHE_MAGIC "SILICA-NAMES 1"
+#define NAME_CACHE_LINE_MAX 4096
+
+void name_cache_init(name_cache *cache) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+void name_cache_free(name_cache *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        free(cache->entries[i].name);
+    }
+    free(cache->entries);
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
+
+void name_cache_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", NAME_CACHE_FILE);
+}
+
+// Function to derive the cache key of a note, names from different engines never mix
+uint64_t name_cache_key(const void *data, size_t size, int engine) {
+    return hash_xxh64(data, size, (uint64_t)engine + 1);
+}
+
+// Function to find the slot holding a hash, or the empty slot where it belongs
+static size_t find_slot(const name_cache *cache, uint64_t hash, uint64_t size) {
+    size_t mask = cache->slot_count - 1;
+    for (size_t slot = (size_t)hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t index = cache->slots[slot];
+        if (index == 0) {
+            return slot;
+        }
+        const name_cache_entry *entry = &cache->entries[index - 1];
+        if (entry->hash == hash && entry->size == size) {
+            return slot;
+        }
+    }
+}
+
+// Function to keep the table at most half full so probe sequences stay short
+static int reserve_slots(name_cache *cache, size_t count) {
+    if (cache->slot_count >= count * 2 && cache->slot_count > 0) {
+        return 1;
+    }
+
+    size_t slot_count = cache->slot_count ? cache->slot_count : 64;
+    while (slot_count < count * 2) {
+        slot_count *= 2;
+    }
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return 0;
+    }
+
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_count = slot_count;
+    for (size_t i = 0; i < cache->count; i++) {
+        cache->slots[find_slot(cache, cache->entries[i].hash, cache->entries[i].size)] = (uint32_t)(i + 1);
+    }
+    return 1;
+}
+
+static int add_entry(name_cache *cache, uint64_t hash, uint64_t size, uint64_t last_used, const char *name) {
+    if (!reserve_slots(cache, cache->count + 1)) {
+        return 0;
+    }
+
+    size_t slot = find_slot(cache, hash, size);
+    if (cache->slots[slot] != 0) {
+        name_cache_entry *entry = &cache->entries[cache->slots[slot] - 1];
+        char *copy = strdup(name);
+        if (copy == NULL) {
+            return 0;
+        }
+        free(entry->name);
+        entry->name = copy;
+        entry->last_used = last_used;
+        return 1;
+    }
+
+    if (cache->count == cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 256;
+        name_cache_entry *entries = realloc(cache->entries, capacity * sizeof(name_cache_entry));
+        if (entries == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+
+    name_cache_entry *entry = &cache->entries[cache->count];
+    entry->name = strdup(name);
+    if (entry->name == NULL) {
+        return 0;
+    }
+    entry->hash = hash;
+    entry->size = size;
+    entry->last_used = last_used;
+    cache->slots[slot] = (uint32_t)(++cache->count);
+    return 1;
+}
+
+// Function to load the cache, a missing or unreadable file just starts an empty one
+int name_cache_load(name_cache *cache, const char *cache_path) {
+    FILE *file = fopen(cache_path, "r");
+    if (file == NULL) {
+        return 1;
+    }
+
+    char line[NAME_CACHE_LINE_MAX];
+    if (fgets(line, sizeof(line), file) == NULL || strncmp(line, NAME_CACHE_MAGIC, strlen(NAME_CACHE_MAGIC)) != 0) {
+        fclose(file);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        uint64_t hash, size, last_used;
+        int name_offset = 0;
+        if (line[0] == 'C' && line[1] == '\t') {
+            cache->clock = strtoull(line + 2, NULL, 10);
+        } else if (sscanf(line, "%" SCNx64 "\t%" SCNu64 "\t%" SCNu64 "\t%n", &hash, &size, &last_used, &name_offset) == 3 &&
+                   name_offset > 0 && line[name_offset] != '\0') {
+            if (!add_entry(cache, hash, size, last_used, line + name_offset)) {
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+static int compare_recent(const void *a, const void *b) {
+    const name_cache_entry *left = *(const name_cache_entry *const *)a;
+    const name_cache_entry *right = *(const name_cache_entry *const *)b;
+    return left->last_used < right->last_used ? 1 : left->last_used > right->last_used ? -1 : 0;
+}
+
+// Function to write the cache back, keeping only the most recently used entries
+int name_cache_save(name_cache *cache, const char *cache_path) {
+    if (!cache->dirty) {
+        return 1;
+    }
+
+    const name_cache_entry **order = malloc((cache->count + 1) * sizeof(name_cache_entry *));
+    if (order == NULL) {
+        perror("malloc");
+        return 0;
+    }
+    for (size_t i = 0; i < cache->count; i++) {
+        order[i] = &cache->entries[i];
+    }
+    size_t keep = cache->count;
+    if (keep > NAME_CACHE_MAX_ENTRIES) {
+        qsort(order, cache->count, sizeof(name_cache_entry *), compare_recent);
+        keep = NAME_CACHE_MAX_ENTRIES;
+    }
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) {
+        perror("Failed to open name cache file");
+        free(order);
+        return 0;
+    }
+
+    fprintf(file, "%s\n", NAME_CACHE_MAGIC);
+    fprintf(file, "C\t%" PRIu64 "\n", cache->clock);
+    for (size_t i = 0; i < keep; i++) {
+        fprintf(file, "%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n", order[i]->hash, order[i]->size,
+                order[i]->last_used, order[i]->name);
+    }
+    free(order);
+
+    if (fclose(file) != 0 || rename(temp_path, cache_path) != 0) {
+        perror("Failed to write name cache file");
+        unlink(temp_path);
+        return 0;
+    }
+    cache->dirty = 0;
+    return 1;
+}
+
+// Function to look up the name suggested for a note before, returns a copy or NULL
+char *name_cache_get(name_cache *cache, uint64_t hash, uint64_t size) {
+    char *name = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    if (cache->slot_count > 0) {
+        uint32_t index = cache->slots[find_slot(cache, hash, size)];
+        if (index != 0) {
+            name_cache_entry *entry = &cache->entries[index - 1];
+            entry->last_used = ++cache->clock;
+            cache->dirty = 1;
+            name = strdup(entry->name);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return name;
+}
+
+void name_cache_put(name_cache *cache, uint64_t hash, uint64_t size, const char *name) {
+    pthread_mutex_lock(&cache->lock);
+    if (add_entry(cache, hash, size, ++cache->clock, name)) {
+        cache->dirty = 1;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
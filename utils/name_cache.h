@@ -0,0 +1,42 @@
+// name_cache.h
+#ifndef NAME_CACHE_H
+#define NAME_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define NAME_CACHE_FILE "obs/.name_cache"
+#define NAME_CACHE_MAX_ENTRIES 8192
+
+// A suggested name remembered for one note content
+typedef struct {
+    uint64_t hash;              // XXH64 of the note, seeded with the naming engine
+    uint64_t size;
+    uint64_t last_used;         // Logical clock, the smallest values are evicted first
+    char *name;
+} name_cache_entry;
+
+// Entries plus an open-addressed table of entry indexes, safe to share between pool threads
+typedef struct {
+    name_cache_entry *entries;
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;            // Entry index + 1, 0 for an empty slot
+    size_t slot_count;          // Always a power of two
+    uint64_t clock;
+    int dirty;
+    pthread_mutex_t lock;
+} name_cache;
+
+// Function declarations
+void name_cache_init(name_cache *cache);
+void name_cache_free(name_cache *cache);
+void name_cache_default_path(char *buf, size_t size);
+int name_cache_load(name_cache *cache, const char *cache_path);
+int name_cache_save(name_cache *cache, const char *cache_path);
+uint64_t name_cache_key(const void *data, size_t size, int engine);
+char *name_cache_get(name_cache *cache, uint64_t hash, uint64_t size);
+void name_cache_put(name_cache *cache, uint64_t hash, uint64_t size, const char *name);
+
+#endif // NAME_CACHE_H
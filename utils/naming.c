@@ -0,0 +1,535 @@
+// naming.c
+#include "naming.h"
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MOCK_NAME_WORDS 5
+#define NAMING_PARTS_MAX 3
+
+// Placed between the head and the tail of a truncated note
+static const char truncation_marker[] = "\n[...]\n";
+
+void naming_default_options(naming_options *options) {
+    options->engine = NAMING_ENGINE_OPENAI;
+    options->mock_latency_ms = 200;
+    options->mock_failure_rate = 0.0;
+    options->token_budget = NAMING_DEFAULT_TOKEN_BUDGET;
+    options->head_bytes = -1;
+    options->tail_bytes = -1;
+    naming_load_config(options);
+}
+
+// Function to read the NAMING_* keys of ~/obs/.config, keys that are absent keep their defaults
+void naming_load_config(naming_options *options) {
+    char config_path[1024];
+    const char *home = getenv("HOME");
+    snprintf(config_path, sizeof(config_path), "%s/%s", home ? home : ".", NAMING_CONFIG_FILE);
+
+    FILE *file = fopen(config_path, "r");
+    if (!file) {
+        return;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "NAMING_TOKEN_BUDGET=", 20) == 0) {
+            options->token_budget = strtol(line + 20, NULL, 10);
+        } else if (strncmp(line, "NAMING_HEAD_BYTES=", 18) == 0) {
+            options->head_bytes = strtol(line + 18, NULL, 10);
+        } else if (strncmp(line, "NAMING_TAIL_BYTES=", 18) == 0) {
+            options->tail_bytes = strtol(line + 18, NULL, 10);
+        }
+    }
+    fclose(file);
+}
+
+// Function to consume a naming flag at argv[*index], returns 1 if it was one
+int naming_parse_option(naming_options *options, int argc, char *argv[], int *index) {
+    const char *arg = argv[*index];
+
+    if (strncmp(arg, "--engine=", 9) == 0) {
+        if (strcmp(arg + 9, "mock") == 0) {
+            options->engine = NAMING_ENGINE_MOCK;
+        } else if (strcmp(arg + 9, "local") == 0) {
+            options->engine = NAMING_ENGINE_LOCAL;
+        } else if (strcmp(arg + 9, "stub") == 0) {
+            options->engine = NAMING_ENGINE_STUB;
+        } else if (strcmp(arg + 9, "openai") == 0) {
+            options->engine = NAMING_ENGINE_OPENAI;
+        } else {
+            fprintf(stderr, "Unknown naming engine: %s\n", arg + 9);
+        }
+        return 1;
+    }
+    if (strcmp(arg, "--mock-latency") == 0 && *index + 1 < argc) {
+        options->mock_latency_ms = atoi(argv[++*index]);
+        return 1;
+    }
+    if (strcmp(arg, "--mock-failure-rate") == 0 && *index + 1 < argc) {
+        options->mock_failure_rate = atof(argv[++*index]);
+        return 1;
+    }
+    if (strcmp(arg, "--token-budget") == 0 && *index + 1 < argc) {
+        options->token_budget = strtol(argv[++*index], NULL, 10);
+        return 1;
+    }
+    if (strcmp(arg, "--head-bytes") == 0 && *index + 1 < argc) {
+        options->head_bytes = strtol(argv[++*index], NULL, 10);
+        return 1;
+    }
+    if (strcmp(arg, "--tail-bytes") == 0 && *index + 1 < argc) {
+        options->tail_bytes = strtol(argv[++*index], NULL, 10);
+        return 1;
+    }
+    return 0;
+}
+
+// Function to map a note read-only. Empty notes are not mapped, their view is simply empty.
+int naming_note_open(naming_note *note, const char *path) {
+    memset(note, 0, sizeof(*note));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file for reading");
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        close(fd);
+        return 0;
+    }
+
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return 0;
+        }
+        note->map = map;
+        note->map_size = (size_t)st.st_size;
+        note->data = map;
+        note->size = (size_t)st.st_size;
+    }
+    close(fd);
+    return 1;
+}
+
+void naming_note_close(naming_note *note) {
+    if (note->map) {
+        munmap(note->map, note->map_size);
+    }
+    memset(note, 0, sizeof(*note));
+}
+
+// Function to pick the parts of a note that fit the budget: all of it when small enough, otherwise
+// its head and tail around a marker. Cuts never split a UTF-8 sequence. Returns the part count.
+int naming_note_segments(const naming_options *options, const naming_note *note, struct iovec *parts) {
+    size_t budget = options->token_budget > 0 ? (size_t)options->token_budget * NAMING_BYTES_PER_TOKEN : 0;
+    size_t head = options->head_bytes >= 0 ? (size_t)options->head_bytes : budget - budget / 4;
+    size_t tail = options->tail_bytes >= 0 ? (size_t)options->tail_bytes : budget / 4;
+
+    if (budget > 0 && head + tail > budget) {
+        // Explicit head and tail sizes are scaled down to respect the budget
+        head = head * budget / (head + tail);
+        tail = budget - head;
+    }
+
+    if ((budget == 0 && options->head_bytes < 0 && options->tail_bytes < 0) || head + tail >= note->size) {
+        parts[0].iov_base = (void *)note->data;
+        parts[0].iov_len = note->size;
+        return 1;
+    }
+
+    const unsigned char *data = (const unsigned char *)note->data;
+    while (head > 0 && head < note->size && (data[head] & 0xC0) == 0x80) {
+        head--;
+    }
+    size_t tail_start = note->size - tail;
+    while (tail_start < note->size && (data[tail_start] & 0xC0) == 0x80) {
+        tail_start++;
+    }
+
+    int count = 0;
+    parts[count].iov_base = (void *)note->data;
+    parts[count++].iov_len = head;
+    parts[count].iov_base = (void *)truncation_marker;
+    parts[count++].iov_len = sizeof(truncation_marker) - 1;
+    if (tail_start < note->size) {
+        parts[count].iov_base = (void *)(note->data + tail_start);
+        parts[count++].iov_len = note->size - tail_start;
+    }
+    return count;
+}
+
+// Function to turn a suggested name into something safe to use as a filename
+void naming_sanitize(char *name) {
+    size_t out = 0;
+    int pending_dash = 0;
+
+    for (size_t i = 0; name[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (isalnum(c)) {
+            if (pending_dash && out > 0) {
+                name[out++] = '-';
+            }
+            pending_dash = 0;
+            name[out++] = (char)tolower(c);
+        } else {
+            pending_dash = 1;  // Spaces, underscores and punctuation collapse into a single dash
+        }
+    }
+    name[out] = '\0';
+
+    // Model output sometimes carries the extension already
+    if (out > 3 && strcmp(name + out - 3, "-md") == 0) {
+        name[out - 3] = '\0';
+    }
+}
+
+// Serialises worker spawns so no child inherits the pipes of a sibling started by another thread
+static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Function to start file_parsing.py in worker mode with a pipe to each end of it
+int naming_worker_start(naming_worker *worker, const naming_options *options) {
+    char script[1024];
+    const char *home = getenv("HOME");
+    snprintf(script, sizeof(script), "%s/%s", home ? home : ".", NAMING_WORKER_SCRIPT);
+
+    char latency[16];
+    snprintf(latency, sizeof(latency), "%d", options->mock_latency_ms);
+    char *argv[] = {"python3", script, "--worker", NULL, NULL, NULL, NULL};
+    if (options->engine == NAMING_ENGINE_STUB) {
+        argv[3] = "--stub";
+        argv[4] = "--stub-latency";
+        argv[5] = latency;
+    }
+
+    pthread_mutex_lock(&spawn_lock);
+    int in[2], out[2];
+    if (pipe(in) != 0) {
+        perror("pipe");
+        pthread_mutex_unlock(&spawn_lock);
+        return 0;
+    }
+    if (pipe(out) != 0) {
+        perror("pipe");
+        close(in[0]);
+        close(in[1]);
+        pthread_mutex_unlock(&spawn_lock);
+        return 0;
+    }
+    fcntl(in[1], F_SETFD, FD_CLOEXEC);
+    fcntl(out[0], F_SETFD, FD_CLOEXEC);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(out[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+    pthread_mutex_unlock(&spawn_lock);
+
+    if (pid < 0) {
+        perror("fork");
+        close(in[1]);
+        close(out[0]);
+        return 0;
+    }
+
+    worker->pid = pid;
+    worker->to_worker = in[1];
+    worker->from_worker = out[0];
+    return 1;
+}
+
+void naming_worker_stop(naming_worker *worker) {
+    if (worker->pid <= 0) {
+        return;
+    }
+
+    // Closing stdin is the worker's signal to exit once the request in flight is answered
+    close(worker->to_worker);
+    close(worker->from_worker);
+    int status;
+    while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    worker->pid = 0;
+}
+
+// Function to stop a worker that stopped answering. It may be stuck in a request and never read the closed
+// stdin, so it is sent SIGTERM, and SIGKILL if it is still there after NAMING_WORKER_KILL_MS.
+static void naming_worker_kill(naming_worker *worker) {
+    if (worker->pid <= 0) {
+        return;
+    }
+
+    close(worker->to_worker);
+    close(worker->from_worker);
+    kill(worker->pid, SIGTERM);
+    for (int waited = 0; waitpid(worker->pid, NULL, WNOHANG) == 0; waited += 10) {
+        if (waited >= NAMING_WORKER_KILL_MS) {
+            kill(worker->pid, SIGKILL);
+            while (waitpid(worker->pid, NULL, 0) < 0 && errno == EINTR) {
+            }
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    worker->pid = 0;
+}
+
+// Function to write every part with as few system calls as possible, resuming after short writes. A
+// dead worker fails the write only when the process ignores SIGPIPE, as obs does in main.
+static int writev_all(int fd, struct iovec *parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char *)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+    return 1;
+}
+
+// Function to read exactly size bytes, giving up if the worker stays silent past the timeout
+static int read_all(int fd, void *data, size_t size) {
+    char *cursor = data;
+    while (size > 0) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, NAMING_WORKER_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return 0;
+        }
+
+        ssize_t got = read(fd, cursor, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        cursor += got;
+        size -= (size_t)got;
+    }
+    return 1;
+}
+
+static void put_be32(unsigned char *out, unsigned int value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static unsigned int get_be32(const unsigned char *in) {
+    return (unsigned int)in[0] << 24 | (unsigned int)in[1] << 16 | (unsigned int)in[2] << 8 | in[3];
+}
+
+// Function to send one note to the worker and read back its reply. The parts go straight from the
+// mapped note into the pipe behind the length prefix. Returns the reply status, or -1 if the worker
+// could not be reached, in which case it has been killed.
+int naming_worker_request(naming_worker *worker, const struct iovec *parts, int part_count, char *name,
+                          size_t name_size) {
+    unsigned char header[5];
+    struct iovec frame[NAMING_PARTS_MAX + 1];
+    size_t size = 0;
+    for (int i = 0; i < part_count; i++) {
+        frame[i + 1] = parts[i];
+        size += parts[i].iov_len;
+    }
+    put_be32(header, (unsigned int)size);
+    frame[0].iov_base = header;
+    frame[0].iov_len = 4;
+
+    if (!writev_all(worker->to_worker, frame, part_count + 1) || !read_all(worker->from_worker, header, 5)) {
+        naming_worker_kill(worker);
+        return -1;
+    }
+
+    // Replies longer than the buffer are drained so the stream stays in step
+    unsigned int length = get_be32(header + 1);
+    size_t keep = length < name_size ? length : name_size - 1;
+    if (!read_all(worker->from_worker, name, keep)) {
+        naming_worker_kill(worker);
+        return -1;
+    }
+    name[keep] = '\0';
+    for (unsigned int left = length - (unsigned int)keep; left > 0;) {
+        char discard[256];
+        unsigned int chunk = left < sizeof(discard) ? left : sizeof(discard);
+        if (!read_all(worker->from_worker, discard, chunk)) {
+            naming_worker_kill(worker);
+            return -1;
+        }
+        left -= chunk;
+    }
+    return header[0];
+}
+
+void naming_session_init(naming_session *session, const naming_options *options) {
+    memset(session, 0, sizeof(*session));
+    session->options = *options;
+    session->seed = (unsigned int)time(NULL) ^ (unsigned int)(size_t)session;
+}
+
+void naming_session_close(naming_session *session) {
+    naming_worker_stop(&session->worker);
+    if (session->index_state > 0) {
+        search_index_close(&session->index);
+    }
+    session->index_state = 0;
+}
+
+// Function to name a note from its highest TF-IDF terms, never leaving the process
+static char *local_suggest(naming_session *session, const struct iovec *parts, int part_count) {
+    if (session->index_state == 0) {
+        char index_path[1024];
+        search_index_default_path(index_path, sizeof(index_path));
+        session->index_state = search_index_open(&session->index, index_path) ? 1 : -1;
+    }
+
+    char *name = malloc(NAMING_NAME_MAX);
+    if (name == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    // The head of a note carries its title, the tail is only used when the head has no usable terms
+    const search_index *index = session->index_state > 0 ? &session->index : NULL;
+    size_t length = keywords_name(index, parts[0].iov_base, parts[0].iov_len, name, NAMING_NAME_MAX);
+    if (length == 0 && part_count == 3) {
+        length = keywords_name(index, parts[2].iov_base, parts[2].iov_len, name, NAMING_NAME_MAX);
+    }
+    if (length == 0) {
+        free(name);
+        return NULL;
+    }
+    return name;
+}
+
+// Function to name a note from its first words, standing in for the model when testing offline
+static char *mock_suggest(naming_session *session, const char *contents, size_t size, int *retryable) {
+    const naming_options *options = &session->options;
+
+    if (options->mock_latency_ms > 0) {
+        struct timespec delay = {options->mock_latency_ms / 1000, (options->mock_latency_ms % 1000) * 1000000L};
+        nanosleep(&delay, NULL);
+    }
+
+    if (options->mock_failure_rate > 0 &&
+        rand_r(&session->seed) < options->mock_failure_rate * ((double)RAND_MAX + 1)) {
+        *retryable = 1;
+        return NULL;
+    }
+
+    char *name = malloc(NAMING_NAME_MAX);
+    if (name == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    size_t out = 0;
+    int words = 0;
+    int in_word = 0;
+    for (size_t i = 0; i < size && words < MOCK_NAME_WORDS && out < 64; i++) {
+        unsigned char c = (unsigned char)contents[i];
+        if (isalnum(c)) {
+            if (!in_word && out > 0) {
+                name[out++] = ' ';
+            }
+            in_word = 1;
+            name[out++] = (char)c;
+        } else if (in_word) {
+            in_word = 0;
+            words++;
+        }
+    }
+    name[out] = '\0';
+    naming_sanitize(name);
+
+    if (name[0] == '\0') {
+        snprintf(name, NAMING_NAME_MAX, "untitled");
+    }
+    return name;
+}
+
+// Function to suggest a filename for a note, without the extension. Returns NULL on failure and
+// sets *retryable when trying again may succeed.
+char *naming_suggest(naming_session *session, const naming_note *note, int *retryable) {
+    *retryable = 0;
+
+    struct iovec parts[NAMING_PARTS_MAX];
+    int part_count = naming_note_segments(&session->options, note, parts);
+
+    if (session->options.engine == NAMING_ENGINE_MOCK) {
+        return mock_suggest(session, parts[0].iov_base, parts[0].iov_len, retryable);
+    }
+    if (session->options.engine == NAMING_ENGINE_LOCAL) {
+        return local_suggest(session, parts, part_count);
+    }
+
+    if (session->worker.pid == 0 && !naming_worker_start(&session->worker, &session->options)) {
+        return NULL;
+    }
+
+    char *name = malloc(NAMING_NAME_MAX);
+    if (name == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    int status = naming_worker_request(&session->worker, parts, part_count, name, NAMING_NAME_MAX);
+    if (status != NAMING_STATUS_OK) {
+        if (status < 0) {
+            fprintf(stderr, "Naming worker exited, restarting it for the next request\n");
+        } else {
+            fprintf(stderr, "Naming backend: %s\n", name);
+        }
+        *retryable = status != NAMING_STATUS_FAILED;
+        free(name);
+        return NULL;
+    }
+
+    naming_sanitize(name);
+    if (name[0] == '\0') {
+        free(name);
+        *retryable = 1;
+        return NULL;
+    }
+    return name;
+}
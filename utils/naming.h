@@ -0,0 +1,80 @@
+// naming.h
+#ifndef NAMING_H
+#define NAMING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "search_index.h"
+
+#define NAMING_NAME_MAX 2048
+#define NAMING_WORKER_SCRIPT "obs/file_parsing.py"
+#define NAMING_WORKER_TIMEOUT_MS 120000
+#define NAMING_WORKER_KILL_MS 2000       // Grace given to a stuck worker between SIGTERM and SIGKILL
+#define NAMING_CONFIG_FILE "obs/.config"
+#define NAMING_DEFAULT_TOKEN_BUDGET 2000
+#define NAMING_BYTES_PER_TOKEN 4        // Rough average for English prose
+
+// Reply status of the naming worker protocol
+#define NAMING_STATUS_OK 0
+#define NAMING_STATUS_RETRY 1
+#define NAMING_STATUS_FAILED 2
+
+// Backends that can suggest a filename for a note
+typedef enum {
+    NAMING_ENGINE_OPENAI,       // ~/obs/file_parsing.py --worker
+    NAMING_ENGINE_STUB,         // The same worker answering without network access
+    NAMING_ENGINE_MOCK,         // In-process stand-in for offline runs and throughput tests
+    NAMING_ENGINE_LOCAL         // TF-IDF keywords against the search index, nothing leaves the machine
+} naming_engine;
+
+typedef struct {
+    naming_engine engine;
+    int mock_latency_ms;        // Also passed to the stub worker
+    double mock_failure_rate;
+    long token_budget;          // Upper bound on what is sent per note, 0 for no limit
+    long head_bytes;            // Taken from the start of a note, -1 to derive from the budget
+    long tail_bytes;            // Taken from the end of a note, -1 to derive from the budget
+} naming_options;
+
+// A note mapped read-only, only the pages that are sent to the backend are ever touched
+typedef struct {
+    const char *data;
+    size_t size;
+    void *map;
+    size_t map_size;
+} naming_note;
+
+// A long-lived file_parsing.py process, requests and replies are length-prefixed frames
+typedef struct {
+    pid_t pid;                  // 0 when not running
+    int to_worker;
+    int from_worker;
+} naming_worker;
+
+// One thread's connection to a naming backend, the worker is started on the first request
+typedef struct {
+    naming_options options;
+    naming_worker worker;
+    unsigned int seed;          // For rand_r, each thread has its own session
+    search_index index;         // Document frequencies for the local engine
+    int index_state;            // 0 not opened yet, 1 mapped, -1 unavailable
+} naming_session;
+
+// Function declarations
+void naming_default_options(naming_options *options);
+int naming_parse_option(naming_options *options, int argc, char *argv[], int *index);
+void naming_load_config(naming_options *options);
+int naming_note_open(naming_note *note, const char *path);
+void naming_note_close(naming_note *note);
+int naming_note_segments(const naming_options *options, const naming_note *note, struct iovec *parts);
+void naming_session_init(naming_session *session, const naming_options *options);
+void naming_session_close(naming_session *session);
+char *naming_suggest(naming_session *session, const naming_note *note, int *retryable);
+void naming_sanitize(char *name);
+int naming_worker_start(naming_worker *worker, const naming_options *options);
+void naming_worker_stop(naming_worker *worker);
+int naming_worker_request(naming_worker *worker, const struct iovec *parts, int part_count, char *name,
+                          size_t name_size);
+
+#endif // NAMING_H
@@ -0,0 +1,1044 @@
+// related_index.c
+#include "related_index.h"
+#include "keywords.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define RELATED_MAGIC "SLCREL1"
+#define RELATED_VERSION 1
+#define RELATED_TERMS_MAX 256           // Best TF-IDF terms hashed into an embedding
+#define RELATED_REBUILD_MIN 64          // Deleted nodes tolerated before the graph is rebuilt
+#define RELATED_EXACT_MAX 4096          // Indexes this small are scanned rather than searched
+#define NO_NODE UINT32_MAX
+
+typedef struct {
+    float distance;
+    uint32_t node;
+} heap_item;
+
+// Binary heap of nodes, nearest or furthest first
+typedef struct {
+    heap_item *items;
+    size_t count;
+    size_t capacity;
+    int furthest_first;
+} node_heap;
+
+// What searching needs of a graph, whether it is mapped from disk or being built
+typedef struct {
+    const related_node *nodes;
+    const float *vectors;
+    const uint32_t *layer0;
+    const uint32_t *upper;
+    uint32_t node_count;
+    uint32_t entry_point;
+    uint32_t max_level;
+} graph_view;
+
+typedef struct {
+    uint32_t *visited;          // Stamp per node of the search that last reached it
+    size_t visited_capacity;
+    uint32_t stamp;
+    node_heap candidates;
+    node_heap found;
+    heap_item *nearest;         // The found heap drained nearest first
+    size_t nearest_capacity;
+} search_scratch;
+
+// Keeps the nodes a search passes that a query would accept, the worst on top
+typedef struct {
+    const char *bucket;         // NULL for any bucket
+    size_t bucket_length;
+    uint32_t exclude;
+    node_heap *heap;
+    size_t limit;
+} result_filter;
+
+// The graph being written, in the file's own layout so searching it works the same
+typedef struct {
+    related_node *nodes;
+    char **paths;
+    char **buckets;
+    size_t count;
+    size_t capacity;
+    float *vectors;
+    uint32_t *layer0;
+    uint32_t *upper;
+    size_t upper_count;
+    size_t upper_capacity;
+    uint32_t live_count;
+    int has_entry;
+    graph_view view;
+} graph_builder;
+
+void related_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", RELATED_INDEX_FILE);
+}
+
+const char *related_node_path(const related_index *index, uint32_t note, size_t *len) {
+    const related_node *node = &index->nodes[note];
+    if (len) {
+        *len = node->path_length;
+    }
+    return index->strings + node->path_offset;
+}
+
+const char *related_node_bucket(const related_index *index, uint32_t note, size_t *len) {
+    const related_node *node = &index->nodes[note];
+    if (len) {
+        *len = node->bucket_length;
+    }
+    return index->strings + node->path_offset + node->path_length + 1;
+}
+
+// ---- Dot products ----
+
+static float dot_scalar(const float *a, const float *b) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < RELATED_DIMS; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma"))) static float dot_avx2(const float *a, const float *b) {
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    for (size_t i = 0; i < RELATED_DIMS; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+__attribute__((target("sse2"))) static float dot_sse2(const float *a, const float *b) {
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (size_t i = 0; i < RELATED_DIMS; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(sum0, sum1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+#elif defined(__ARM_NEON)
+static float dot_neon(const float *a, const float *b) {
+    float32x4_t sum0 = vdupq_n_f32(0.0f), sum1 = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < RELATED_DIMS; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t sum = vaddq_f32(sum0, sum1);
+    float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+}
+#endif
+
+static float (*dot_kernel)(const float *a, const float *b);
+
+// Function to take the dot product of two embeddings with the widest vector unit the CPU has, picked on
+// first use. Embeddings are unit length, so this is their cosine similarity.
+float related_dot(const float *a, const float *b) {
+    if (dot_kernel == NULL) {
+        dot_kernel = dot_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        dot_kernel = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? dot_avx2 : dot_sse2;
+#elif defined(__ARM_NEON)
+        dot_kernel = dot_neon;
+#endif
+    }
+    return dot_kernel(a, b);
+}
+
+// ---- Embeddings ----
+
+// Function to embed a note: its best terms by TF-IDF against the search index are hashed into RELATED_DIMS
+// buckets with a hashed sign, so colliding terms tend to cancel rather than add up, and the vector is scaled
+// to unit length. The same text and index always give the same vector. Notes without terms get zeros.
+void related_embed(const search_index *terms, const char *text, size_t len, float *vector) {
+    memset(vector, 0, RELATED_DIMS * sizeof(float));
+    keyword *best = malloc(RELATED_TERMS_MAX * sizeof(keyword));
+    if (best == NULL) {
+        perror("malloc");
+        return;
+    }
+
+    size_t count = keywords_extract(terms, text, len, best, RELATED_TERMS_MAX);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t hash = hash_xxh64(best[i].term, best[i].length, 0);
+        float weight = (float)best[i].score;
+        vector[hash % RELATED_DIMS] += hash >> 63 ? -weight : weight;
+    }
+    free(best);
+
+    float norm = sqrtf(dot_scalar(vector, vector));
+    for (size_t i = 0; norm > 0.0f && i < RELATED_DIMS; i++) {
+        vector[i] /= norm;
+    }
+}
+
+// Function to read and embed a note, returns 0 if it has nothing to embed
+static int embed_note(const search_index *terms, const char *root, const char *relative_path, float *vector) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, relative_path);
+    memset(vector, 0, RELATED_DIMS * sizeof(float));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    related_embed(terms, text, size, vector);
+    munmap((void *)text, size);
+    return dot_scalar(vector, vector) > 0.0f;
+}
+
+// ---- Heaps ----
+
+static int heap_before(const node_heap *heap, const heap_item *a, const heap_item *b) {
+    return heap->furthest_first ? a->distance > b->distance : a->distance < b->distance;
+}
+
+static int heap_push(node_heap *heap, float distance, uint32_t node) {
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 128;
+        heap_item *items = realloc(heap->items, capacity * sizeof(heap_item));
+        if (items == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        heap->items = items;
+        heap->capacity = capacity;
+    }
+
+    size_t child = heap->count++;
+    heap->items[child] = (heap_item){distance, node};
+    while (child > 0) {
+        size_t parent = (child - 1) / 2;
+        if (!heap_before(heap, &heap->items[child], &heap->items[parent])) {
+            break;
+        }
+        heap_item swap = heap->items[parent];
+        heap->items[parent] = heap->items[child];
+        heap->items[child] = swap;
+        child = parent;
+    }
+    return 1;
+}
+
+static heap_item heap_pop(node_heap *heap) {
+    heap_item top = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+    size_t parent = 0;
+    for (;;) {
+        size_t best = parent, left = parent * 2 + 1, right = left + 1;
+        if (left < heap->count && heap_before(heap, &heap->items[left], &heap->items[best])) {
+            best = left;
+        }
+        if (right < heap->count && heap_before(heap, &heap->items[right], &heap->items[best])) {
+            best = right;
+        }
+        if (best == parent) {
+            break;
+        }
+        heap_item swap = heap->items[parent];
+        heap->items[parent] = heap->items[best];
+        heap->items[best] = swap;
+        parent = best;
+    }
+    return top;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const heap_item *x = a, *y = b;
+    if (x->distance != y->distance) {
+        return x->distance < y->distance ? -1 : 1;
+    }
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+static void scratch_free(search_scratch *scratch) {
+    free(scratch->visited);
+    free(scratch->candidates.items);
+    free(scratch->found.items);
+    free(scratch->nearest);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// ---- Searching ----
+
+static const float *node_vector(const graph_view *graph, uint32_t node) {
+    return &graph->vectors[(size_t)node * RELATED_DIMS];
+}
+
+static const uint32_t *node_links(const graph_view *graph, uint32_t node, uint32_t level) {
+    if (level == 0) {
+        return &graph->layer0[(size_t)node * (RELATED_M0 + 1)];
+    }
+    return &graph->upper[graph->nodes[node].upper_offset + (size_t)(level - 1) * (RELATED_M + 1)];
+}
+
+static float distance_to(const graph_view *graph, const float *query, uint32_t node) {
+    return 1.0f - related_dot(query, node_vector(graph, node));
+}
+
+// Function to offer a node to a query's results, keeping the best filter->limit. Notes with nothing in
+// common with the query are not results at all.
+static int offer_result(const graph_view *graph, const related_index *index, result_filter *filter, float distance,
+                        uint32_t node) {
+    if (distance >= 1.0f || node == filter->exclude || (graph->nodes[node].flags & (RELATED_NODE_DELETED | RELATED_NODE_EMPTY))) {
+        return 1;
+    }
+    if (filter->bucket) {
+        size_t length;
+        const char *bucket = related_node_bucket(index, node, &length);
+        if (length != filter->bucket_length || memcmp(bucket, filter->bucket, length) != 0) {
+            return 1;
+        }
+    }
+    if (filter->heap->count < filter->limit) {
+        return heap_push(filter->heap, distance, node);
+    }
+    if (distance < filter->heap->items[0].distance) {
+        heap_pop(filter->heap);
+        return heap_push(filter->heap, distance, node);
+    }
+    return 1;
+}
+
+// Function to walk down from the entry point to the given level, one greedy step at a time
+static uint32_t greedy_descend(const graph_view *graph, const float *query, uint32_t level, float *distance) {
+    uint32_t current = graph->entry_point;
+    *distance = distance_to(graph, query, current);
+    for (uint32_t layer = graph->max_level; layer > level; layer--) {
+        int moved = 1;
+        while (moved) {
+            moved = 0;
+            const uint32_t *links = node_links(graph, current, layer);
+            for (uint32_t i = 1; i <= links[0]; i++) {
+                float candidate = distance_to(graph, query, links[i]);
+                if (candidate < *distance) {
+                    *distance = candidate;
+                    current = links[i];
+                    moved = 1;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+// Function to run the HNSW beam search of one layer from the given entries, keeping the ef nearest nodes.
+// They are left in scratch->nearest, nearest first, and the count is returned. Every node reached is
+// also offered to the filter when one is given.
+static size_t search_layer(const graph_view *graph, const float *query, search_scratch *scratch,
+                           const heap_item *entries, size_t entry_count, uint32_t level, size_t ef,
+                           const related_index *index, result_filter *filter) {
+    if (scratch->visited_capacity < graph->node_count) {
+        free(scratch->visited);
+        scratch->visited = calloc(graph->node_count, sizeof(uint32_t));
+        scratch->visited_capacity = scratch->visited ? graph->node_count : 0;
+        scratch->stamp = 0;
+        if (scratch->visited == NULL) {
+            perror("calloc");
+            return 0;
+        }
+    }
+    if (++scratch->stamp == 0) {
+        memset(scratch->visited, 0, scratch->visited_capacity * sizeof(uint32_t));
+        scratch->stamp = 1;
+    }
+
+    node_heap *candidates = &scratch->candidates, *found = &scratch->found;
+    candidates->count = 0;
+    candidates->furthest_first = 0;
+    found->count = 0;
+    found->furthest_first = 1;
+    for (size_t i = 0; i < entry_count; i++) {
+        scratch->visited[entries[i].node] = scratch->stamp;
+        heap_push(candidates, entries[i].distance, entries[i].node);
+        heap_push(found, entries[i].distance, entries[i].node);
+        if (filter) {
+            offer_result(graph, index, filter, entries[i].distance, entries[i].node);
+        }
+    }
+    while (found->count > ef) {
+        heap_pop(found);
+    }
+
+    while (candidates->count > 0) {
+        heap_item nearest = heap_pop(candidates);
+        if (found->count >= ef && nearest.distance > found->items[0].distance) {
+            break;
+        }
+        const uint32_t *links = node_links(graph, nearest.node, level);
+        for (uint32_t i = 1; i <= links[0]; i++) {
+            uint32_t neighbour = links[i];
+            if (scratch->visited[neighbour] == scratch->stamp) {
+                continue;
+            }
+            scratch->visited[neighbour] = scratch->stamp;
+            float distance = distance_to(graph, query, neighbour);
+            if (filter) {
+                offer_result(graph, index, filter, distance, neighbour);
+            }
+            if (found->count < ef || distance < found->items[0].distance) {
+                heap_push(candidates, distance, neighbour);
+                heap_push(found, distance, neighbour);
+                if (found->count > ef) {
+                    heap_pop(found);
+                }
+            }
+        }
+    }
+
+    if (scratch->nearest_capacity < found->count) {
+        free(scratch->nearest);
+        scratch->nearest = malloc(found->count * sizeof(heap_item));
+        scratch->nearest_capacity = scratch->nearest ? found->count : 0;
+        if (scratch->nearest == NULL) {
+            perror("malloc");
+            return 0;
+        }
+    }
+    size_t count = found->count;
+    for (size_t i = count; i > 0; i--) {
+        scratch->nearest[i - 1] = heap_pop(found);
+    }
+    return count;
+}
+
+// ---- Building ----
+
+static void builder_free(graph_builder *builder) {
+    for (size_t i = 0; i < builder->count; i++) {
+        free(builder->paths[i]);
+        free(builder->buckets[i]);
+    }
+    free(builder->nodes);
+    free(builder->paths);
+    free(builder->buckets);
+    free(builder->vectors);
+    free(builder->layer0);
+    free(builder->upper);
+    memset(builder, 0, sizeof(*builder));
+}
+
+static void builder_sync_view(graph_builder *builder) {
+    builder->view.nodes = builder->nodes;
+    builder->view.vectors = builder->vectors;
+    builder->view.layer0 = builder->layer0;
+    builder->view.upper = builder->upper;
+    builder->view.node_count = (uint32_t)builder->count;
+}
+
+// Function to pick how many layers a note reaches from a hash of its path, so rebuilding the same notes
+// gives the same graph
+static uint32_t node_level(const char *path) {
+    uint64_t hash = hash_xxh64(path, strlen(path), 0x4e5357);
+    double uniform = ((double)(hash >> 11) + 1.0) / 9007199254740993.0;
+    uint32_t level = (uint32_t)(-log(uniform) / log((double)RELATED_M));
+    return level < RELATED_MAX_LEVEL ? level : RELATED_MAX_LEVEL;
+}
+
+// Function to append a node with its vector and empty neighbour lists. Returns its index or NO_NODE.
+static uint32_t builder_add(graph_builder *builder, const char *path, const char *bucket, int64_t mtime,
+                            int64_t size, uint32_t flags, const float *vector) {
+    if (builder->count == builder->capacity) {
+        size_t capacity = builder->capacity ? builder->capacity * 2 : 1024;
+        related_node *nodes = realloc(builder->nodes, capacity * sizeof(related_node));
+        if (nodes) {
+            builder->nodes = nodes;
+        }
+        char **paths = realloc(builder->paths, capacity * sizeof(char *));
+        if (paths) {
+            builder->paths = paths;
+        }
+        char **buckets = realloc(builder->buckets, capacity * sizeof(char *));
+        if (buckets) {
+            builder->buckets = buckets;
+        }
+        float *vectors = realloc(builder->vectors, capacity * RELATED_DIMS * sizeof(float));
+        if (vectors) {
+            builder->vectors = vectors;
+        }
+        uint32_t *layer0 = realloc(builder->layer0, capacity * (RELATED_M0 + 1) * sizeof(uint32_t));
+        if (layer0) {
+            builder->layer0 = layer0;
+        }
+        if (!nodes || !paths || !buckets || !vectors || !layer0) {
+            perror("realloc");
+            return NO_NODE;
+        }
+        builder->capacity = capacity;
+    }
+
+    uint32_t level = flags & RELATED_NODE_EMPTY ? 0 : node_level(path);
+    size_t upper_needed = (size_t)level * (RELATED_M + 1);
+    if (builder->upper_count + upper_needed > builder->upper_capacity) {
+        size_t capacity = builder->upper_capacity ? builder->upper_capacity * 2 : 4096;
+        while (capacity < builder->upper_count + upper_needed) {
+            capacity *= 2;
+        }
+        uint32_t *upper = realloc(builder->upper, capacity * sizeof(uint32_t));
+        if (upper == NULL) {
+            perror("realloc");
+            return NO_NODE;
+        }
+        builder->upper = upper;
+        builder->upper_capacity = capacity;
+    }
+
+    uint32_t node = (uint32_t)builder->count;
+    related_node *added = &builder->nodes[node];
+    memset(added, 0, sizeof(*added));
+    added->mtime = mtime;
+    added->size = size;
+    added->level = level;
+    added->flags = flags;
+    added->upper_offset = builder->upper_count;
+    builder->paths[node] = strdup(path);
+    builder->buckets[node] = strdup(bucket);
+    if (builder->paths[node] == NULL || builder->buckets[node] == NULL) {
+        perror("strdup");
+        free(builder->paths[node]);
+        free(builder->buckets[node]);
+        return NO_NODE;
+    }
+    memcpy(&builder->vectors[(size_t)node * RELATED_DIMS], vector, RELATED_DIMS * sizeof(float));
+    builder->layer0[(size_t)node * (RELATED_M0 + 1)] = 0;
+    for (uint32_t l = 0; l < level; l++) {
+        builder->upper[builder->upper_count + (size_t)l * (RELATED_M + 1)] = 0;
+    }
+    builder->upper_count += upper_needed;
+    builder->count++;
+    builder->live_count += !(flags & RELATED_NODE_DELETED);
+    builder_sync_view(builder);
+    return node;
+}
+
+static uint32_t *mutable_links(graph_builder *builder, uint32_t node, uint32_t level) {
+    return (uint32_t *)node_links(&builder->view, node, level);
+}
+
+// Function to choose up to max neighbours from candidates sorted nearest first with the HNSW heuristic:
+// a candidate is kept only if it is nearer to the base than to every neighbour kept so far, which spreads
+// the links out in different directions instead of bunching them in one cluster.
+static size_t select_neighbours(const graph_view *graph, const heap_item *candidates, size_t count, size_t max,
+                                uint32_t *selected) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count && kept < max; i++) {
+        const float *vector = node_vector(graph, candidates[i].node);
+        int diverse = 1;
+        for (size_t j = 0; j < kept && diverse; j++) {
+            diverse = 1.0f - related_dot(vector, node_vector(graph, selected[j])) >= candidates[i].distance;
+        }
+        if (diverse) {
+            selected[kept++] = candidates[i].node;
+        }
+    }
+    return kept;
+}
+
+// Function to link from to node on a layer, pruning from's list with the heuristic when it is full
+static void add_link(graph_builder *builder, uint32_t from, uint32_t node, uint32_t level) {
+    uint32_t *links = mutable_links(builder, from, level);
+    size_t max = level == 0 ? RELATED_M0 : RELATED_M;
+    if (links[0] < max) {
+        links[++links[0]] = node;
+        return;
+    }
+
+    heap_item candidates[RELATED_M0 + 1];
+    const float *base = node_vector(&builder->view, from);
+    size_t count = 0;
+    for (uint32_t i = 1; i <= links[0]; i++) {
+        candidates[count++] = (heap_item){distance_to(&builder->view, base, links[i]), links[i]};
+    }
+    candidates[count++] = (heap_item){distance_to(&builder->view, base, node), node};
+    qsort(candidates, count, sizeof(heap_item), compare_items);
+    links[0] = (uint32_t)select_neighbours(&builder->view, candidates, count, max, links + 1);
+}
+
+// Function to insert a node into the graph: descend greedily to its top layer, then on each layer from
+// there down search for its nearest nodes, link it to a diverse subset of them and link them back
+static int builder_insert(graph_builder *builder, uint32_t node, search_scratch *scratch) {
+    const graph_view *graph = &builder->view;
+    uint32_t level = builder->nodes[node].level;
+    if (!builder->has_entry) {
+        builder->view.entry_point = node;
+        builder->view.max_level = level;
+        builder->has_entry = 1;
+        return 1;
+    }
+
+    const float *query = node_vector(graph, node);
+    heap_item entry;
+    entry.node = greedy_descend(graph, query, level, &entry.distance);
+    const heap_item *entries = &entry;
+    size_t entry_count = 1;
+
+    for (uint32_t layer = level < graph->max_level ? level : graph->max_level;; layer--) {
+        size_t count = search_layer(graph, query, scratch, entries, entry_count, layer, RELATED_EF_CONSTRUCTION,
+                                    NULL, NULL);
+        if (count == 0) {
+            return 0;
+        }
+        uint32_t selected[RELATED_M0];
+        size_t max = layer == 0 ? RELATED_M0 : RELATED_M;
+        uint32_t *links = mutable_links(builder, node, layer);
+        links[0] = (uint32_t)select_neighbours(graph, scratch->nearest, count, max, selected);
+        memcpy(links + 1, selected, links[0] * sizeof(uint32_t));
+        for (uint32_t i = 0; i < links[0]; i++) {
+            add_link(builder, selected[i], node, layer);
+        }
+
+        entries = scratch->nearest;
+        entry_count = count;
+        if (layer == 0) {
+            break;
+        }
+    }
+
+    if (level > graph->max_level) {
+        builder->view.entry_point = node;
+        builder->view.max_level = level;
+    }
+    return 1;
+}
+
+// Function to copy a mapped index into a builder so nodes can be added to it
+static int builder_load(graph_builder *builder, const related_index *old) {
+    uint32_t count = old->header->node_count;
+    for (uint32_t i = 0; i < count; i++) {
+        const related_node *node = &old->nodes[i];
+        uint32_t added = builder_add(builder, related_node_path(old, i, NULL), related_node_bucket(old, i, NULL),
+                                     node->mtime, node->size, node->flags, &old->vectors[(size_t)i * RELATED_DIMS]);
+        if (added == NO_NODE) {
+            return 0;
+        }
+        // Same path, same level, so the upper layout matches the old one slot for slot
+        memcpy(&builder->layer0[(size_t)i * (RELATED_M0 + 1)], &old->layer0[(size_t)i * (RELATED_M0 + 1)],
+               (RELATED_M0 + 1) * sizeof(uint32_t));
+        memcpy(&builder->upper[builder->nodes[i].upper_offset], &old->upper[node->upper_offset],
+               (size_t)node->level * (RELATED_M + 1) * sizeof(uint32_t));
+    }
+    builder->view.entry_point = old->header->entry_point;
+    builder->view.max_level = old->header->max_level;
+    builder->has_entry = old->header->entry_point != NO_NODE;  // Empty notes are never linked in
+    return 1;
+}
+
+static const graph_builder *sort_builder;
+
+static int compare_builder_paths(const void *a, const void *b) {
+    return strcmp(sort_builder->paths[*(const uint32_t *)a], sort_builder->paths[*(const uint32_t *)b]);
+}
+
+// Function to serialise the graph to index_path
+static int write_index(graph_builder *builder, const char *index_path) {
+    uint32_t count = (uint32_t)builder->count;
+    uint32_t *by_path = malloc((builder->live_count + 1) * sizeof(uint32_t));
+    size_t strings_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        strings_size += strlen(builder->paths[i]) + strlen(builder->buckets[i]) + 2;
+    }
+    char *strings = malloc(strings_size + 1);
+    int ok = by_path && strings;
+    if (!ok) {
+        perror("malloc");
+    }
+
+    uint32_t live = 0;
+    size_t used = 0;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        related_node *node = &builder->nodes[i];
+        size_t path_length = strlen(builder->paths[i]), bucket_length = strlen(builder->buckets[i]);
+        node->path_offset = used;
+        node->path_length = (uint32_t)path_length;
+        node->bucket_length = (uint32_t)bucket_length;
+        memcpy(strings + used, builder->paths[i], path_length + 1);
+        memcpy(strings + used + path_length + 1, builder->buckets[i], bucket_length + 1);
+        used += path_length + bucket_length + 2;
+        if (!(node->flags & RELATED_NODE_DELETED)) {
+            by_path[live++] = i;
+        }
+    }
+    if (ok) {
+        sort_builder = builder;
+        qsort(by_path, live, sizeof(uint32_t), compare_builder_paths);
+    }
+
+    related_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RELATED_MAGIC, sizeof(RELATED_MAGIC));
+    header.version = RELATED_VERSION;
+    header.node_count = count;
+    header.live_count = live;
+    header.dims = RELATED_DIMS;
+    header.entry_point = builder->has_entry ? builder->view.entry_point : NO_NODE;
+    header.max_level = builder->view.max_level;
+    header.upper_count = builder->upper_count;
+    header.nodes_offset = sizeof(related_header);
+    header.by_path_offset = header.nodes_offset + (uint64_t)count * sizeof(related_node);
+    header.vectors_offset = header.by_path_offset + (uint64_t)live * sizeof(uint32_t);
+    header.layer0_offset = header.vectors_offset + (uint64_t)count * RELATED_DIMS * sizeof(float);
+    header.upper_offset = header.layer0_offset + (uint64_t)count * (RELATED_M0 + 1) * sizeof(uint32_t);
+    header.strings_offset = header.upper_offset + (uint64_t)builder->upper_count * sizeof(uint32_t);
+    header.total_size = header.strings_offset + strings_size;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        perror("Failed to open related index");
+        ok = 0;
+    }
+    if (file) {
+        size_t layer0_count = (size_t)count * (RELATED_M0 + 1);
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(builder->nodes, sizeof(related_node), count, file) == count &&
+             fwrite(by_path, sizeof(uint32_t), live, file) == live &&
+             fwrite(builder->vectors, sizeof(float) * RELATED_DIMS, count, file) == count &&
+             fwrite(builder->layer0, sizeof(uint32_t), layer0_count, file) == layer0_count &&
+             fwrite(builder->upper, sizeof(uint32_t), builder->upper_count, file) == builder->upper_count &&
+             fwrite(strings, 1, strings_size, file) == strings_size;
+        if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+            perror("Failed to write related index");
+            unlink(temp_path);
+            ok = 0;
+        }
+    }
+
+    free(by_path);
+    free(strings);
+    return ok;
+}
+
+// Function to find the live node of a mapped index with this exact path, NO_NODE if there is none
+static uint32_t find_path(const related_index *index, const char *path) {
+    size_t low = 0, high = index->data ? index->header->live_count : 0;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(related_node_path(index, index->by_path[mid], NULL), path);
+        if (cmp == 0) {
+            return index->by_path[mid];
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NO_NODE;
+}
+
+static const catalog *sort_catalog;
+
+static int compare_entry_paths(const void *a, const void *b) {
+    return strcmp(sort_catalog->entries[*(const size_t *)a].path, sort_catalog->entries[*(const size_t *)b].path);
+}
+
+// Function to bring the index in line with the catalog. New and changed notes are embedded and inserted
+// into the existing graph, the nodes they replace and those of deleted notes are only marked, and they keep
+// routing searches. Once marked nodes outnumber half the live ones the graph is rebuilt from the stored
+// vectors, without reading unchanged notes again. Returns the number of notes embedded, or -1 on failure.
+int related_index_update(const catalog *cat, const search_index *terms, const char *index_path) {
+    related_index old;
+    int have_old = related_index_open(&old, index_path);
+
+    size_t *order = malloc((cat->entry_count + 1) * sizeof(size_t));
+    uint32_t *previous = malloc((cat->entry_count + 1) * sizeof(uint32_t));
+    if (order == NULL || previous == NULL) {
+        perror("malloc");
+        free(order);
+        free(previous);
+        if (have_old) {
+            related_index_close(&old);
+        }
+        return -1;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        if (search_is_note(cat->entries[i].path)) {
+            order[count++] = i;
+        }
+    }
+    sort_catalog = cat;
+    qsort(order, count, sizeof(size_t), compare_entry_paths);
+
+    // Notes whose node is current, everything else is embedded again
+    size_t changes = 0, kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        const catalog_entry *entry = &cat->entries[order[i]];
+        uint32_t found = find_path(&old, entry->path);
+        int current = found != NO_NODE && old.nodes[found].mtime == entry->mtime &&
+                      old.nodes[found].size == entry->size;
+        previous[i] = current ? found : NO_NODE;
+        changes += !current;
+        kept += current;
+    }
+    size_t removed = have_old ? old.header->live_count - kept : 0;
+    if (have_old && changes == 0 && removed == 0) {
+        related_index_close(&old);
+        free(order);
+        free(previous);
+        return 0;
+    }
+
+    size_t deleted_after = have_old ? old.header->node_count - kept : 0;
+    int rebuild = !have_old || (deleted_after >= RELATED_REBUILD_MIN && deleted_after * 2 > count);
+
+    graph_builder builder;
+    memset(&builder, 0, sizeof(builder));
+    search_scratch scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    int ok = rebuild || builder_load(&builder, &old);
+
+    // Replaced and deleted nodes are marked, the notes still present are found again by path
+    uint32_t *current = NULL;
+    if (ok && !rebuild) {
+        current = calloc(old.header->node_count + 1, sizeof(uint32_t));
+        ok = current != NULL;
+        for (size_t i = 0; ok && i < count; i++) {
+            if (previous[i] != NO_NODE) {
+                current[previous[i]] = 1;
+            }
+        }
+        for (uint32_t i = 0; ok && i < old.header->node_count; i++) {
+            if (!current[i] && !(builder.nodes[i].flags & RELATED_NODE_DELETED)) {
+                builder.nodes[i].flags |= RELATED_NODE_DELETED;
+                builder.live_count--;
+            }
+        }
+    }
+
+    float vector[RELATED_DIMS];
+    int embedded = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        const catalog_entry *entry = &cat->entries[order[i]];
+        if (!rebuild && previous[i] != NO_NODE) {
+            continue;
+        }
+        uint32_t flags = 0;
+        if (previous[i] != NO_NODE) {
+            const related_node *node = &old.nodes[previous[i]];
+            memcpy(vector, &old.vectors[(size_t)previous[i] * RELATED_DIMS], sizeof(vector));
+            flags = node->flags & RELATED_NODE_EMPTY;
+        } else {
+            flags = embed_note(terms, cat->root, entry->path, vector) ? 0 : RELATED_NODE_EMPTY;
+            embedded++;
+        }
+        uint32_t node = builder_add(&builder, entry->path, entry->bucket ? entry->bucket : "", entry->mtime,
+                                    entry->size, flags, vector);
+        ok = node != NO_NODE && ((flags & RELATED_NODE_EMPTY) || builder_insert(&builder, node, &scratch));
+    }
+    ok = ok && write_index(&builder, index_path);
+
+    free(current);
+    scratch_free(&scratch);
+    builder_free(&builder);
+    if (have_old) {
+        related_index_close(&old);
+    }
+    free(order);
+    free(previous);
+    return ok ? embedded : -1;
+}
+
+// ---- Querying ----
+
+// Function to map an index file and validate its layout
+int related_index_open(related_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(related_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const related_header *header = data;
+    uint64_t count = header->node_count;
+    if (memcmp(header->magic, RELATED_MAGIC, sizeof(RELATED_MAGIC)) != 0 || header->version != RELATED_VERSION ||
+        header->dims != RELATED_DIMS || header->total_size != (uint64_t)st.st_size ||
+        header->live_count > header->node_count || header->nodes_offset != sizeof(related_header) ||
+        header->by_path_offset != header->nodes_offset + count * sizeof(related_node) ||
+        header->vectors_offset != header->by_path_offset + (uint64_t)header->live_count * sizeof(uint32_t) ||
+        header->layer0_offset != header->vectors_offset + count * RELATED_DIMS * sizeof(float) ||
+        header->upper_offset != header->layer0_offset + count * (RELATED_M0 + 1) * sizeof(uint32_t) ||
+        header->strings_offset != header->upper_offset + header->upper_count * sizeof(uint32_t) ||
+        header->strings_offset > header->total_size) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->nodes = (const related_node *)(index->data + header->nodes_offset);
+    index->by_path = (const uint32_t *)(index->data + header->by_path_offset);
+    index->vectors = (const float *)(index->data + header->vectors_offset);
+    index->layer0 = (const uint32_t *)(index->data + header->layer0_offset);
+    index->upper = (const uint32_t *)(index->data + header->upper_offset);
+    index->strings = (const char *)(index->data + header->strings_offset);
+    return 1;
+}
+
+void related_index_close(related_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+// Function to find the note a command line names: its path in the vault, that path without the .md, or
+// failing those the first note in path order with that file name
+uint32_t related_index_find(const related_index *index, const char *query) {
+    uint32_t note = find_path(index, query);
+    if (note != NO_NODE || index->data == NULL) {
+        return note;
+    }
+
+    char with_extension[CATALOG_PATH_MAX];
+    snprintf(with_extension, sizeof(with_extension), "%s.md", query);
+    note = find_path(index, with_extension);
+    if (note != NO_NODE) {
+        return note;
+    }
+
+    size_t query_length = strlen(query);
+    for (uint32_t i = 0; i < index->header->live_count; i++) {
+        size_t length;
+        const char *path = related_node_path(index, index->by_path[i], &length);
+        const char *slash = strrchr(path, '/');
+        const char *name = slash ? slash + 1 : path;
+        size_t name_length = length - (size_t)(name - path);
+        if (name_length >= query_length && strncasecmp(name, query, query_length) == 0 &&
+            (name_length == query_length || strcasecmp(name + query_length, ".md") == 0 ||
+             strcasecmp(name + query_length, ".txt") == 0)) {
+            return index->by_path[i];
+        }
+    }
+    return NO_NODE;
+}
+
+// Function to find the first live node, in path order, whose path sorts at or after key
+static size_t lower_bound_path(const related_index *index, const char *key) {
+    size_t low = 0, high = index->header->live_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(related_node_path(index, index->by_path[mid], NULL), key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Function to find the notes most related to a note, optionally only those in one bucket, most similar first.
+// A bucket's notes all sit under "org/repo/", so they are one run of the path order, and a small bucket is
+// simply scanned. Otherwise the graph search offers every node it reaches to the results, so a filter does
+// not cut the search short, and when it still finds too few the notes are scanned after all. Returns the
+// number of hits.
+size_t related_index_query(const related_index *index, uint32_t note, const char *bucket, related_hit *hits,
+                           size_t count) {
+    const related_header *header = index->header;
+    if (count == 0 || note >= header->node_count || (index->nodes[note].flags & RELATED_NODE_EMPTY) ||
+        header->entry_point == NO_NODE) {
+        return 0;
+    }
+
+    graph_view graph = {index->nodes, index->vectors, index->layer0, index->upper, header->node_count,
+                        header->entry_point, header->max_level};
+    const float *query = node_vector(&graph, note);
+    node_heap results;
+    memset(&results, 0, sizeof(results));
+    results.furthest_first = 1;
+    result_filter filter = {bucket, bucket ? strlen(bucket) : 0, note, &results, count};
+
+    // Live nodes to scan if the search comes up short, all of them unless the bucket narrows it down
+    size_t first = 0, last = header->live_count;
+    if (bucket && filter.bucket_length >= CATALOG_BUCKET_MAX) {
+        return 0;
+    }
+    if (bucket && bucket[0]) {
+        char key[CATALOG_BUCKET_MAX + 2];
+        snprintf(key, sizeof(key), "%s/", bucket);
+        first = lower_bound_path(index, key);
+        key[filter.bucket_length] = '/' + 1;
+        last = lower_bound_path(index, key);
+    }
+
+    int scan = last - first <= RELATED_EXACT_MAX || (last - first) * 8 <= header->live_count;
+    if (!scan) {
+        search_scratch scratch;
+        memset(&scratch, 0, sizeof(scratch));
+        heap_item entry;
+        entry.node = greedy_descend(&graph, query, 0, &entry.distance);
+        size_t ef = count * 2 > RELATED_EF_SEARCH ? count * 2 : RELATED_EF_SEARCH;
+        search_layer(&graph, query, &scratch, &entry, 1, 0, ef, index, &filter);
+        scratch_free(&scratch);
+        scan = results.count < count && bucket;
+    }
+    if (scan) {
+        results.count = 0;
+        for (size_t i = first; i < last; i++) {
+            uint32_t node = index->by_path[i];
+            offer_result(&graph, index, &filter, distance_to(&graph, query, node), node);
+        }
+    }
+
+    size_t found = results.count;
+    for (size_t i = found; i > 0; i--) {
+        heap_item item = heap_pop(&results);
+        hits[i - 1].note = item.node;
+        hits[i - 1].similarity = 1.0f - item.distance;
+    }
+    free(results.items);
+    return found;
+}
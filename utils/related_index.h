@@ -0,0 +1,85 @@
+// related_index.h
+#ifndef RELATED_INDEX_H
+#define RELATED_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+#include "search_index.h"
+
+#define RELATED_INDEX_FILE "obs/.related_index"
+#define RELATED_DIMS 128            // Floats per embedding
+#define RELATED_M 16                // Neighbours per node on the upper layers
+#define RELATED_M0 32               // And on layer 0
+#define RELATED_MAX_LEVEL 16
+#define RELATED_EF_CONSTRUCTION 64
+#define RELATED_EF_SEARCH 64
+#define RELATED_DEFAULT_COUNT 10
+
+#define RELATED_NODE_DELETED 1      // Replaced or removed, still routes searches until the next rebuild
+#define RELATED_NODE_EMPTY 2        // No words to embed, kept out of the graph
+
+// On-disk layout, every section is addressed by offset so the file can be used straight from mmap.
+// Each node has RELATED_M0 + 1 layer 0 slots (a count then neighbours) and, for every layer above
+// 0 it reaches, RELATED_M + 1 slots starting at upper_offset.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_count;
+    uint32_t live_count;
+    uint32_t dims;
+    uint32_t entry_point;
+    uint32_t max_level;
+    uint64_t upper_count;       // Upper layer slots in total
+    uint64_t nodes_offset;
+    uint64_t by_path_offset;    // Live nodes sorted by path
+    uint64_t vectors_offset;
+    uint64_t layer0_offset;
+    uint64_t upper_offset;
+    uint64_t strings_offset;
+    uint64_t total_size;
+} related_header;
+
+typedef struct {
+    uint64_t path_offset;       // Into the string section, followed by the bucket
+    uint32_t path_length;
+    uint32_t bucket_length;
+    int64_t mtime;
+    int64_t size;
+    uint32_t level;
+    uint32_t flags;
+    uint64_t upper_offset;
+} related_node;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const related_header *header;
+    const related_node *nodes;
+    const uint32_t *by_path;
+    const float *vectors;
+    const uint32_t *layer0;
+    const uint32_t *upper;
+    const char *strings;
+} related_index;
+
+typedef struct {
+    uint32_t note;
+    float similarity;           // Cosine similarity of the two embeddings
+} related_hit;
+
+// Function declarations
+void related_index_default_path(char *buf, size_t size);
+void related_embed(const search_index *terms, const char *text, size_t len, float *vector);
+float related_dot(const float *a, const float *b);
+int related_index_update(const catalog *cat, const search_index *terms, const char *index_path);
+int related_index_open(related_index *index, const char *index_path);
+void related_index_close(related_index *index);
+const char *related_node_path(const related_index *index, uint32_t note, size_t *len);
+const char *related_node_bucket(const related_index *index, uint32_t note, size_t *len);
+uint32_t related_index_find(const related_index *index, const char *query);
+size_t related_index_query(const related_index *index, uint32_t note, const char *bucket, related_hit *hits,
+                           size_t count);
+
+#endif // RELATED_INDEX_H
@@ -0,0 +1,503 @@
+// scan.c
+#include "scan.h"
+#include "catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+#define SCAN_DENTS_BUFFER 65536
+
+// Record layout returned by the getdents64 system call
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#else
+#include <dirent.h>
+#endif
+
+#define SCAN_IDLE_SPINS 64          // Failed polls before an idle thread starts sleeping
+#define SCAN_IDLE_SLEEP_NS 50000
+
+// A directory's listing on its way from a worker to the consumer
+typedef struct {
+    scan_dir dir;
+    size_t entry_capacity;
+    size_t *name_offsets;       // Into names, turned into pointers once the listing is complete
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    char *path;
+} scan_batch;
+
+// Directories waiting to be read. The owning worker pushes and pops at the bottom, idle workers
+// steal from the top, so thieves take the oldest and usually largest subtrees.
+typedef struct {
+    char **tasks;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+    pthread_mutex_t lock;
+} task_deque;
+
+typedef struct {
+    atomic_size_t sequence;
+    scan_batch *batch;
+} queue_cell;
+
+// Bounded lock-free multi-producer queue of finished batches, each cell's sequence number says whether
+// it is ready to be written (== position) or read (== position + 1)
+typedef struct {
+    queue_cell *cells;
+    size_t mask;
+    atomic_size_t head;
+    char padding[64];           // Keep producers and the consumer off each other's cache line
+    atomic_size_t tail;
+} batch_queue;
+
+typedef struct {
+    int root_fd;
+    int include_hidden;
+    int thread_count;
+    task_deque deques[SCAN_MAX_THREADS];
+    atomic_long pending;        // Directories queued or being read, the scan is over at zero
+    atomic_long scanned;
+    atomic_int failed;
+    batch_queue queue;
+} scan_state;
+
+typedef struct {
+    scan_state *state;
+    int id;
+    unsigned int seed;
+} scan_worker;
+
+void scan_default_options(scan_options *options) {
+    memset(options, 0, sizeof(*options));
+}
+
+// Function to back off while there is nothing to do, yielding first and then sleeping briefly
+static void idle_wait(int *spins) {
+    if (++*spins < SCAN_IDLE_SPINS) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = {0, SCAN_IDLE_SLEEP_NS};
+    nanosleep(&pause, NULL);
+}
+
+static int queue_init(batch_queue *queue, size_t capacity) {
+    queue->cells = malloc(capacity * sizeof(queue_cell));
+    if (queue->cells == NULL) {
+        perror("malloc");
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].batch = NULL;
+    }
+    queue->mask = capacity - 1;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 1;
+}
+
+// Function to add a batch to the queue, returns 0 when it is full
+static int queue_push(batch_queue *queue, scan_batch *batch) {
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;) {
+        queue_cell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->batch = batch;
+                atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+                return 1;
+            }
+        } else if (difference < 0) {
+            return 0;
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// Function to take the oldest batch off the queue, NULL when it is empty
+static scan_batch *queue_pop(batch_queue *queue) {
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;) {
+        queue_cell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                scan_batch *batch = cell->batch;
+                atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+                return batch;
+            }
+        } else if (difference < 0) {
+            return NULL;
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
+
+static int deque_push(task_deque *deque, char *task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom == deque->capacity) {
+        if (deque->top > 0) {
+            // Reclaim the slots thieves have emptied before growing
+            memmove(deque->tasks, deque->tasks + deque->top, (deque->bottom - deque->top) * sizeof(char *));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        }
+        if (deque->bottom == deque->capacity) {
+            size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+            char **grown = realloc(deque->tasks, capacity * sizeof(char *));
+            if (grown == NULL) {
+                pthread_mutex_unlock(&deque->lock);
+                perror("realloc");
+                return 0;
+            }
+            deque->tasks = grown;
+            deque->capacity = capacity;
+        }
+    }
+    deque->tasks[deque->bottom++] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return 1;
+}
+
+static char *deque_take(task_deque *deque, int steal) {
+    char *task = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        task = steal ? deque->tasks[deque->top++] : deque->tasks[--deque->bottom];
+        if (deque->top == deque->bottom) {
+            deque->top = deque->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return task;
+}
+
+// Function to find the next directory for a worker, its own newest task first, then one stolen from
+// a victim chosen at random
+static char *next_task(scan_worker *worker) {
+    scan_state *state = worker->state;
+    char *task = deque_take(&state->deques[worker->id], 0);
+    int start = state->thread_count > 1 ? (int)(rand_r(&worker->seed) % (unsigned int)state->thread_count) : 0;
+    for (int i = 0; task == NULL && i < state->thread_count; i++) {
+        int victim = (start + i) % state->thread_count;
+        if (victim != worker->id) {
+            task = deque_take(&state->deques[victim], 1);
+        }
+    }
+    return task;
+}
+
+static void free_batch(scan_batch *batch) {
+    free(batch->dir.entries);
+    free(batch->name_offsets);
+    free(batch->names);
+    free(batch->path);
+    free(batch);
+}
+
+static int batch_add(scan_batch *batch, const char *name, const struct stat *st) {
+    if (batch->dir.entry_count == batch->entry_capacity) {
+        size_t capacity = batch->entry_capacity ? batch->entry_capacity * 2 : 32;
+        scan_entry *entries = realloc(batch->dir.entries, capacity * sizeof(scan_entry));
+        size_t *offsets = entries ? realloc(batch->name_offsets, capacity * sizeof(size_t)) : NULL;
+        if (entries) {
+            batch->dir.entries = entries;
+        }
+        if (offsets == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        batch->name_offsets = offsets;
+        batch->entry_capacity = capacity;
+    }
+
+    size_t length = strlen(name) + 1;
+    if (batch->names_size + length > batch->names_capacity) {
+        size_t capacity = batch->names_capacity ? batch->names_capacity : 1024;
+        while (capacity < batch->names_size + length) {
+            capacity *= 2;
+        }
+        char *names = realloc(batch->names, capacity);
+        if (names == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        batch->names = names;
+        batch->names_capacity = capacity;
+    }
+    memcpy(batch->names + batch->names_size, name, length);
+
+    scan_entry *entry = &batch->dir.entries[batch->dir.entry_count];
+    entry->size = st->st_size;
+    entry->mtime = CATALOG_STAT_MTIME(*st);
+    entry->inode = st->st_ino;
+    entry->is_dir = S_ISDIR(st->st_mode);
+    batch->name_offsets[batch->dir.entry_count++] = batch->names_size;
+    batch->names_size += length;
+    return 1;
+}
+
+// Function to record one directory entry, queueing subdirectories as new tasks for this worker
+static int visit_entry(scan_worker *worker, int fd, scan_batch *batch, const char *name) {
+    scan_state *state = worker->state;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0') || !state->include_hidden)) {
+        return 1;
+    }
+
+    // Symlinks are not followed, a link back up the tree would be walked forever and one leading out of
+    // the vault would index notes that are not in it
+    struct stat st;
+    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))) {
+        return 1;
+    }
+    if (!batch_add(batch, name, &st)) {
+        return 0;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        char child[CATALOG_PATH_MAX];
+        int written = batch->path[0] ? snprintf(child, sizeof(child), "%s/%s", batch->path, name)
+                                     : snprintf(child, sizeof(child), "%s", name);
+        if (written < 0 || (size_t)written >= sizeof(child)) {
+            return 1;  // Too deep to address, like the catalog
+        }
+        char *task = strdup(child);
+        if (task == NULL) {
+            perror("strdup");
+            return 0;
+        }
+        atomic_fetch_add(&state->pending, 1);
+        if (!deque_push(&state->deques[worker->id], task)) {
+            atomic_fetch_sub(&state->pending, 1);
+            free(task);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to read a directory's entries, with raw getdents64 calls on Linux
+static int read_entries(scan_worker *worker, int fd, scan_batch *batch) {
+#ifdef __linux__
+    static _Thread_local char buffer[SCAN_DENTS_BUFFER] __attribute__((aligned(8)));
+    for (;;) {
+        long read = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (read <= 0) {
+            return read == 0;
+        }
+        for (long offset = 0; offset < read;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buffer + offset);
+            if (!visit_entry(worker, fd, batch, entry->d_name)) {
+                return 0;
+            }
+            offset += entry->d_reclen;
+        }
+    }
+#else
+    int listing_fd = dup(fd);
+    DIR *dir = listing_fd >= 0 ? fdopendir(listing_fd) : NULL;
+    if (dir == NULL) {
+        if (listing_fd >= 0) {
+            close(listing_fd);
+        }
+        return 1;
+    }
+    int ok = 1;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        ok = visit_entry(worker, fd, batch, entry->d_name);
+    }
+    closedir(dir);
+    return ok;
+#endif
+}
+
+// Function to list one directory and hand the batch to the consumer
+static int scan_directory(scan_worker *worker, char *path) {
+    scan_state *state = worker->state;
+    int fd = openat(state->root_fd, path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(path);
+        return 1;  // Vanished or unreadable, skipped like the catalog does
+    }
+
+    scan_batch *batch = calloc(1, sizeof(scan_batch));
+    if (batch == NULL) {
+        perror("calloc");
+        close(fd);
+        free(path);
+        return 0;
+    }
+    batch->path = path;
+    batch->dir.path = path;
+    batch->dir.mtime = CATALOG_STAT_MTIME(st);
+
+    int ok = read_entries(worker, fd, batch);
+    close(fd);
+    for (size_t i = 0; i < batch->dir.entry_count; i++) {
+        batch->dir.entries[i].name = batch->names + batch->name_offsets[i];
+    }
+    if (!ok) {
+        free_batch(batch);
+        return 0;
+    }
+
+    int spins = 0;
+    while (!queue_push(&state->queue, batch)) {
+        idle_wait(&spins);  // The consumer is behind
+    }
+    atomic_fetch_add(&state->scanned, 1);
+    return 1;
+}
+
+static void *scan_worker_main(void *arg) {
+    scan_worker *worker = arg;
+    scan_state *state = worker->state;
+    int spins = 0;
+
+    for (;;) {
+        char *task = next_task(worker);
+        if (task) {
+            spins = 0;
+            if (!scan_directory(worker, task)) {
+                atomic_store(&state->failed, 1);
+            }
+            // Children were counted before the parent is released, so zero really means done
+            atomic_fetch_sub(&state->pending, 1);
+            continue;
+        }
+        if (atomic_load(&state->pending) == 0) {
+            break;
+        }
+        idle_wait(&spins);
+    }
+    return NULL;
+}
+
+static int default_thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 4 ? 4 : (int)cpus;  // Directory reads mostly wait on the disk or the network
+}
+
+// Function to walk the tree under root with a pool of work-stealing threads reading directories through
+// openat and fstatat. Every directory's listing is handed to emit on the calling thread, in no particular
+// order. Returns the number of directories read, or -1 if the walk could not be completed.
+long scan_tree(const char *root, const scan_options *options, void (*emit)(const scan_dir *dir, void *ctx),
+               void *ctx) {
+    scan_state *state = calloc(1, sizeof(scan_state));
+    if (state == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    state->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state->root_fd < 0) {
+        perror("open");
+        free(state);
+        return -1;
+    }
+
+    int threads = options && options->threads > 0 ? options->threads : default_thread_count();
+    state->thread_count = threads > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : threads;
+    state->include_hidden = options ? options->include_hidden : 0;
+    atomic_init(&state->pending, 1);
+    atomic_init(&state->scanned, 0);
+    atomic_init(&state->failed, 0);
+    for (int i = 0; i < state->thread_count; i++) {
+        pthread_mutex_init(&state->deques[i].lock, NULL);
+    }
+
+    char *root_task = strdup("");
+    int ok = queue_init(&state->queue, SCAN_QUEUE_CAPACITY) && root_task && deque_push(&state->deques[0], root_task);
+    if (!ok) {
+        free(root_task);
+    }
+
+    scan_worker workers[SCAN_MAX_THREADS];
+    pthread_t threads_started[SCAN_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; ok && i < state->thread_count; i++) {
+        workers[i].state = state;
+        workers[i].id = i;
+        workers[i].seed = (unsigned int)i * 2654435761u + 1;
+        if (pthread_create(&threads_started[i], NULL, scan_worker_main, &workers[i]) != 0) {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+    if (ok && started == 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        atomic_store(&state->pending, 0);  // Nothing will run, let any started worker leave
+    }
+
+    // Consume batches until every worker is out of directories and the queue has drained. Without a
+    // queue or a worker there is nothing to consume, and no worker was started.
+    int spins = 0;
+    while (ok) {
+        scan_batch *batch = queue_pop(&state->queue);
+        if (batch) {
+            spins = 0;
+            emit(&batch->dir, ctx);
+            free_batch(batch);
+            continue;
+        }
+        if (atomic_load(&state->pending) == 0) {
+            while ((batch = queue_pop(&state->queue)) != NULL) {
+                emit(&batch->dir, ctx);
+                free_batch(batch);
+            }
+            break;
+        }
+        idle_wait(&spins);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads_started[i], NULL);
+    }
+    for (int i = 0; i < state->thread_count; i++) {
+        for (size_t t = state->deques[i].top; t < state->deques[i].bottom; t++) {
+            free(state->deques[i].tasks[t]);
+        }
+        free(state->deques[i].tasks);
+        pthread_mutex_destroy(&state->deques[i].lock);
+    }
+
+    long scanned = ok && !atomic_load(&state->failed) ? atomic_load(&state->scanned) : -1;
+    close(state->root_fd);
+    free(state->queue.cells);
+    free(state);
+    return scanned;
+}
@@ -0,0 +1,37 @@
+// scan.h
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+#define SCAN_MAX_THREADS 64
+#define SCAN_QUEUE_CAPACITY 1024    // Directory batches in flight between the workers and the consumer
+
+// A regular file or directory found by the scan, name is relative to its directory
+typedef struct {
+    const char *name;
+    long long size;
+    long long mtime;            // Nanoseconds since the epoch
+    unsigned long long inode;
+    int is_dir;
+} scan_entry;
+
+// One directory's listing, entries are in the order the filesystem returned them
+typedef struct {
+    const char *path;           // Relative to the scan root, "" for the root itself
+    long long mtime;
+    scan_entry *entries;
+    size_t entry_count;
+} scan_dir;
+
+typedef struct {
+    int threads;                // 0 for one per online CPU
+    int include_hidden;         // Also report and descend into dot entries
+} scan_options;
+
+// Function declarations
+void scan_default_options(scan_options *options);
+long scan_tree(const char *root, const scan_options *options, void (*emit)(const scan_dir *dir, void *ctx),
+               void *ctx);
+
+#endif // SCAN_H
@@ -0,0 +1,1146 @@
+// search_index.c
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SEARCH_MAGIC "SLCIDX1"
+#define SEARCH_VERSION 2
+#define NO_DOC UINT32_MAX
+#define SEARCH_REBUILD_MIN 64           // Marked notes tolerated before the index is rebuilt
+
+// A posting collected while building, its positions live in the builder's pool
+typedef struct {
+    uint32_t doc;
+    uint32_t position_count;
+    size_t first_position;
+} build_posting;
+
+typedef struct {
+    char *term;
+    uint32_t length;
+    uint64_t hash;
+    build_posting *postings;
+    size_t count;
+    size_t capacity;
+} build_term;
+
+// Term dictionary and postings of the index being written, terms are addressed by stable index
+typedef struct {
+    build_term *terms;
+    size_t term_count;
+    size_t term_capacity;
+    uint32_t *slots;            // Open addressing table of term index + 1
+    size_t slot_count;
+    uint32_t *positions;
+    size_t position_count;
+    size_t position_capacity;
+} index_builder;
+
+// A (term, position) occurrence within the note being tokenized
+typedef struct {
+    uint32_t term;
+    uint32_t position;
+} occurrence;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} byte_buffer;
+
+// Postings of one term decoded for querying
+typedef struct {
+    uint32_t *docs;
+    uint32_t *counts;
+    size_t *starts;
+    size_t doc_count;
+    uint32_t *positions;
+    size_t position_count;
+} decoded_postings;
+
+typedef struct {
+    const char *path;
+    uint32_t note;
+} note_lookup;
+
+// A stretch of the postings section being written, copied from the previous index or from the encoded buffer
+typedef struct {
+    const unsigned char *kept;  // Postings of the previous index, NULL for the encoded buffer
+    uint64_t offset;
+    uint64_t size;
+} postings_run;
+
+typedef struct {
+    postings_run *runs;
+    size_t count;
+    size_t capacity;
+    uint64_t size;
+} postings_plan;
+
+void search_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", SEARCH_INDEX_FILE);
+}
+
+// Function to decide which catalog entries hold text worth indexing
+int search_is_note(const char *path) {
+    size_t len = strlen(path);
+    return (len > 3 && strcmp(path + len - 3, ".md") == 0) ||
+           (len > 4 && strcmp(path + len - 4, ".txt") == 0);
+}
+
+static int is_word_byte(unsigned char c) {
+    return isalnum(c) || c >= 0x80;  // Keep UTF-8 sequences inside words
+}
+
+// Function to find the next word in text from *pos, writing it lowercased into token.
+// Returns the token length, or 0 once the text is exhausted. Overlong words are truncated.
+size_t search_next_token(const char *text, size_t len, size_t *pos, char *token, size_t token_size) {
+    size_t i = *pos;
+    while (i < len && !is_word_byte((unsigned char)text[i])) {
+        i++;
+    }
+
+    size_t n = 0;
+    while (i < len && is_word_byte((unsigned char)text[i])) {
+        if (n + 1 < token_size) {
+            token[n++] = (char)tolower((unsigned char)text[i]);
+        }
+        i++;
+    }
+
+    if (token_size > 0) {
+        token[n] = '\0';
+    }
+    *pos = i;
+    return n;
+}
+
+static uint64_t hash_term(const char *term, size_t len) {
+    uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)term[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int buffer_reserve(byte_buffer *buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->size + extra) {
+        capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        perror("realloc");
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int buffer_append(byte_buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, size)) {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+static int buffer_varint(byte_buffer *buffer, uint32_t value) {
+    if (!buffer_reserve(buffer, 5)) {
+        return 0;
+    }
+    while (value >= 0x80) {
+        buffer->data[buffer->size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buffer->data[buffer->size++] = (unsigned char)value;
+    return 1;
+}
+
+static uint32_t read_varint(const unsigned char **cursor, const unsigned char *end) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (*cursor < end) {
+        unsigned char byte = *(*cursor)++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+        shift += 7;
+    }
+    return value;
+}
+
+static void builder_free(index_builder *builder) {
+    for (size_t i = 0; i < builder->term_count; i++) {
+        free(builder->terms[i].term);
+        free(builder->terms[i].postings);
+    }
+    free(builder->terms);
+    free(builder->slots);
+    free(builder->positions);
+    memset(builder, 0, sizeof(*builder));
+}
+
+static int builder_rehash(index_builder *builder, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return 0;
+    }
+    for (size_t i = 0; i < builder->term_count; i++) {
+        size_t slot = builder->terms[i].hash & (slot_count - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    free(builder->slots);
+    builder->slots = slots;
+    builder->slot_count = slot_count;
+    return 1;
+}
+
+// Function to look up a term in the builder, adding it if needed. Returns its index or -1.
+static long builder_intern(index_builder *builder, const char *term, size_t len) {
+    if ((builder->term_count + 1) * 2 > builder->slot_count &&
+        !builder_rehash(builder, builder->slot_count ? builder->slot_count * 2 : 4096)) {
+        return -1;
+    }
+
+    uint64_t hash = hash_term(term, len);
+    size_t slot = hash & (builder->slot_count - 1);
+    while (builder->slots[slot]) {
+        build_term *existing = &builder->terms[builder->slots[slot] - 1];
+        if (existing->hash == hash && existing->length == len && memcmp(existing->term, term, len) == 0) {
+            return builder->slots[slot] - 1;
+        }
+        slot = (slot + 1) & (builder->slot_count - 1);
+    }
+
+    if (builder->term_count == builder->term_capacity) {
+        size_t capacity = builder->term_capacity ? builder->term_capacity * 2 : 4096;
+        build_term *terms = realloc(builder->terms, capacity * sizeof(build_term));
+        if (terms == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        builder->terms = terms;
+        builder->term_capacity = capacity;
+    }
+
+    build_term *added = &builder->terms[builder->term_count];
+    memset(added, 0, sizeof(*added));
+    added->term = malloc(len + 1);
+    if (added->term == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(added->term, term, len);
+    added->term[len] = '\0';
+    added->length = (uint32_t)len;
+    added->hash = hash;
+
+    builder->slots[slot] = (uint32_t)builder->term_count + 1;
+    return (long)builder->term_count++;
+}
+
+// Function to record the positions of a term within one note
+static int builder_add_posting(index_builder *builder, uint32_t term, uint32_t doc,
+                               const uint32_t *positions, uint32_t count) {
+    if (builder->position_count + count > builder->position_capacity) {
+        size_t capacity = builder->position_capacity ? builder->position_capacity : 65536;
+        while (capacity < builder->position_count + count) {
+            capacity *= 2;
+        }
+        uint32_t *grown = realloc(builder->positions, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        builder->positions = grown;
+        builder->position_capacity = capacity;
+    }
+
+    build_term *entry = &builder->terms[term];
+    if (entry->count == entry->capacity) {
+        size_t capacity = entry->capacity ? entry->capacity * 2 : 4;
+        build_posting *grown = realloc(entry->postings, capacity * sizeof(build_posting));
+        if (grown == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        entry->postings = grown;
+        entry->capacity = capacity;
+    }
+
+    build_posting *posting = &entry->postings[entry->count++];
+    posting->doc = doc;
+    posting->position_count = count;
+    posting->first_position = builder->position_count;
+    memcpy(builder->positions + builder->position_count, positions, count * sizeof(uint32_t));
+    builder->position_count += count;
+    return 1;
+}
+
+static int compare_occurrences(const void *a, const void *b) {
+    const occurrence *x = a, *y = b;
+    if (x->term != y->term) {
+        return x->term < y->term ? -1 : 1;
+    }
+    return x->position < y->position ? -1 : (x->position > y->position);
+}
+
+// Function to tokenize one note from disk and add its postings
+static int index_note(index_builder *builder, const char *root, const char *path, uint32_t doc) {
+    char full_path[CATALOG_PATH_MAX];
+    snprintf(full_path, sizeof(full_path), "%s/%s", root, path);
+
+    int fd = open(full_path, O_RDONLY);
+    if (fd < 0) {
+        return 1;  // Vanished since the catalog was refreshed
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+    char *text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    occurrence *occurrences = NULL;
+    size_t count = 0, capacity = 0;
+    int ok = 1;
+
+    char token[SEARCH_TERM_MAX];
+    size_t pos = 0, len;
+    uint32_t position = 0;
+    while (ok && (len = search_next_token(text, (size_t)st.st_size, &pos, token, sizeof(token))) > 0) {
+        long term = builder_intern(builder, token, len);
+        if (term < 0) {
+            ok = 0;
+            break;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            occurrence *grown = realloc(occurrences, capacity * sizeof(occurrence));
+            if (grown == NULL) {
+                perror("realloc");
+                ok = 0;
+                break;
+            }
+            occurrences = grown;
+        }
+        occurrences[count].term = (uint32_t)term;
+        occurrences[count++].position = position++;
+    }
+    munmap(text, (size_t)st.st_size);
+
+    // Group occurrences by term so each term gets one posting with ascending positions
+    qsort(occurrences, count, sizeof(occurrence), compare_occurrences);
+    uint32_t *positions = ok && count ? malloc(count * sizeof(uint32_t)) : NULL;
+    for (size_t i = 0; ok && i < count;) {
+        size_t j = i;
+        while (j < count && occurrences[j].term == occurrences[i].term) {
+            positions[j - i] = occurrences[j].position;
+            j++;
+        }
+        ok = builder_add_posting(builder, occurrences[i].term, doc, positions, (uint32_t)(j - i));
+        i = j;
+    }
+
+    free(positions);
+    free(occurrences);
+    return ok;
+}
+
+// Function to decode a term's postings out of a mapped index
+static int decode_postings(const search_index *index, const search_term *term, decoded_postings *out) {
+    memset(out, 0, sizeof(*out));
+    out->docs = malloc((term->doc_count + 1) * sizeof(uint32_t));
+    out->counts = malloc((term->doc_count + 1) * sizeof(uint32_t));
+    out->starts = malloc((term->doc_count + 1) * sizeof(size_t));
+    if (!out->docs || !out->counts || !out->starts) {
+        perror("malloc");
+        return 0;
+    }
+
+    const unsigned char *cursor = index->postings + term->postings_offset;
+    const unsigned char *end = cursor + term->postings_size;
+    size_t position_capacity = 0;
+    uint32_t doc = 0;
+
+    for (uint32_t i = 0; i < term->doc_count && cursor < end; i++) {
+        doc += read_varint(&cursor, end);
+        uint32_t count = read_varint(&cursor, end);
+        if (doc >= index->header->note_count || count > (size_t)(end - cursor)) {
+            break;  // Corrupt, every position takes at least a byte
+        }
+
+        if (out->position_count + count > position_capacity) {
+            position_capacity = (out->position_count + count) * 2;
+            uint32_t *grown = realloc(out->positions, position_capacity * sizeof(uint32_t));
+            if (grown == NULL) {
+                perror("realloc");
+                return 0;
+            }
+            out->positions = grown;
+        }
+
+        out->docs[i] = doc;
+        out->counts[i] = count;
+        out->starts[i] = out->position_count;
+        uint32_t position = 0;
+        for (uint32_t j = 0; j < count; j++) {
+            position += read_varint(&cursor, end);
+            out->positions[out->position_count++] = position;
+        }
+        out->doc_count++;
+    }
+    return 1;
+}
+
+static void free_decoded(decoded_postings *postings) {
+    free(postings->docs);
+    free(postings->counts);
+    free(postings->starts);
+    free(postings->positions);
+    memset(postings, 0, sizeof(*postings));
+}
+
+// Function to carry the postings of unchanged notes over from the previous index without reading them
+static int reuse_postings(index_builder *builder, const search_index *old, const uint32_t *doc_map) {
+    for (uint32_t t = 0; t < old->header->term_count; t++) {
+        const search_term *term = &old->terms[t];
+        decoded_postings postings;
+        if (!decode_postings(old, term, &postings)) {
+            free_decoded(&postings);
+            return 0;
+        }
+
+        long index = -1;
+        int ok = 1;
+        for (size_t i = 0; ok && i < postings.doc_count; i++) {
+            uint32_t doc = postings.docs[i] < old->header->note_count ? doc_map[postings.docs[i]] : NO_DOC;
+            if (doc == NO_DOC) {
+                continue;
+            }
+            if (index < 0) {
+                index = builder_intern(builder, old->strings + term->string_offset, term->length);
+                if (index < 0) {
+                    ok = 0;
+                    break;
+                }
+            }
+            ok = builder_add_posting(builder, (uint32_t)index, doc, postings.positions + postings.starts[i], postings.counts[i]);
+        }
+
+        free_decoded(&postings);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int compare_term_strings(const char *a, size_t a_length, const char *b, size_t b_length) {
+    size_t len = a_length < b_length ? a_length : b_length;
+    int cmp = memcmp(a, b, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+static const index_builder *sort_builder;
+
+static int compare_term_indices(const void *a, const void *b) {
+    const build_term *x = &sort_builder->terms[*(const uint32_t *)a];
+    const build_term *y = &sort_builder->terms[*(const uint32_t *)b];
+    return compare_term_strings(x->term, x->length, y->term, y->length);
+}
+
+static int compare_postings(const void *a, const void *b) {
+    uint32_t x = ((const build_posting *)a)->doc, y = ((const build_posting *)b)->doc;
+    return (x > y) - (x < y);
+}
+
+// Function to sort the builder's terms bytewise, returns the term indices in that order or NULL
+static uint32_t *sort_terms(const index_builder *builder) {
+    uint32_t *order = malloc((builder->term_count + 1) * sizeof(uint32_t));
+    if (order == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    for (size_t i = 0; i < builder->term_count; i++) {
+        order[i] = (uint32_t)i;
+    }
+    sort_builder = builder;
+    qsort(order, builder->term_count, sizeof(uint32_t), compare_term_indices);
+    return order;
+}
+
+// Function to encode a term's postings onto a posting list whose last note is previous_doc
+static int encode_postings(byte_buffer *postings, const index_builder *builder, build_term *term,
+                           uint32_t previous_doc) {
+    qsort(term->postings, term->count, sizeof(build_posting), compare_postings);
+
+    int ok = 1;
+    for (size_t p = 0; ok && p < term->count; p++) {
+        const build_posting *posting = &term->postings[p];
+        ok = buffer_varint(postings, posting->doc - previous_doc) &&
+             buffer_varint(postings, posting->position_count);
+        previous_doc = posting->doc;
+
+        uint32_t previous_position = 0;
+        for (uint32_t j = 0; ok && j < posting->position_count; j++) {
+            uint32_t position = builder->positions[posting->first_position + j];
+            ok = buffer_varint(postings, position - previous_position);
+            previous_position = position;
+        }
+    }
+    return ok;
+}
+
+// Function to add a stretch of postings to the section being written, joining it to the previous one if it
+// follows on from it
+static int plan_run(postings_plan *plan, const unsigned char *kept, uint64_t offset, uint64_t size) {
+    postings_run *last = plan->count ? &plan->runs[plan->count - 1] : NULL;
+    if (size == 0 || (last && last->kept == kept && last->offset + last->size == offset)) {
+        if (last) {
+            last->size += size;
+        }
+        plan->size += size;
+        return 1;
+    }
+    if (plan->count == plan->capacity) {
+        size_t capacity = plan->capacity ? plan->capacity * 2 : 64;
+        postings_run *runs = realloc(plan->runs, capacity * sizeof(postings_run));
+        if (runs == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        plan->runs = runs;
+        plan->capacity = capacity;
+    }
+    plan->runs[plan->count].kept = kept;
+    plan->runs[plan->count].offset = offset;
+    plan->runs[plan->count++].size = size;
+    plan->size += size;
+    return 1;
+}
+
+// Function to fill in a note's entry, its path and bucket go to the end of the string section
+static int add_note(search_note *note, const catalog_entry *entry, byte_buffer *strings, size_t strings_base) {
+    memset(note, 0, sizeof(*note));
+    note->path_offset = strings_base + strings->size;
+    note->path_length = (uint32_t)strlen(entry->path);
+    int ok = buffer_append(strings, entry->path, note->path_length + 1);
+    note->bucket_offset = strings_base + strings->size;
+    note->bucket_length = (uint32_t)strlen(entry->bucket);
+    ok = ok && buffer_append(strings, entry->bucket, note->bucket_length + 1);
+    note->mtime = entry->mtime;
+    note->size = entry->size;
+    return ok;
+}
+
+// Function to lay out the header and write the sections to index_path through a temporary file. The postings
+// are written run by run from the plan, the string section is kept_strings, copied as it is, then strings.
+static int save_index(const char *index_path, search_header *header, const search_note *notes,
+                      const search_term *terms, const postings_plan *plan, const byte_buffer *postings,
+                      const char *kept_strings, size_t kept_size, const byte_buffer *strings) {
+    memcpy(header->magic, SEARCH_MAGIC, sizeof(SEARCH_MAGIC));
+    header->version = SEARCH_VERSION;
+    header->notes_offset = sizeof(search_header);
+    header->terms_offset = header->notes_offset + (uint64_t)header->note_count * sizeof(search_note);
+    header->postings_offset = header->terms_offset + (uint64_t)header->term_count * sizeof(search_term);
+    header->strings_offset = header->postings_offset + plan->size;
+    header->total_size = header->strings_offset + kept_size + strings->size;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        perror("Failed to open search index");
+        return 0;
+    }
+    int ok = fwrite(header, sizeof(*header), 1, file) == 1 &&
+             fwrite(notes, sizeof(search_note), header->note_count, file) == header->note_count &&
+             fwrite(terms, sizeof(search_term), header->term_count, file) == header->term_count;
+    for (size_t i = 0; ok && i < plan->count; i++) {
+        const postings_run *run = &plan->runs[i];
+        const unsigned char *data = run->kept ? run->kept + run->offset : postings->data + run->offset;
+        ok = fwrite(data, 1, run->size, file) == run->size;
+    }
+    ok = ok && fwrite(kept_strings, 1, kept_size, file) == kept_size &&
+             fwrite(strings->data, 1, strings->size, file) == strings->size;
+    if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+        perror("Failed to write search index");
+        unlink(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Function to serialise the builder and the note table to index_path
+static int write_index(index_builder *builder, const catalog *cat, const uint32_t *note_entries,
+                       uint32_t note_count, const char *index_path) {
+    uint32_t *order = sort_terms(builder);
+    search_note *notes = calloc(note_count + 1, sizeof(search_note));
+    search_term *terms = calloc(builder->term_count + 1, sizeof(search_term));
+    byte_buffer postings = {0}, strings = {0};
+    int ok = order && notes && terms;
+
+    for (uint32_t i = 0; ok && i < note_count; i++) {
+        ok = add_note(&notes[i], &cat->entries[note_entries[i]], &strings, 0);
+    }
+
+    for (size_t t = 0; ok && t < builder->term_count; t++) {
+        build_term *term = &builder->terms[order[t]];
+        terms[t].string_offset = strings.size;
+        terms[t].length = term->length;
+        terms[t].doc_count = (uint32_t)term->count;
+        terms[t].postings_offset = postings.size;
+        ok = buffer_append(&strings, term->term, term->length + 1) && encode_postings(&postings, builder, term, 0);
+        terms[t].postings_size = (uint32_t)(postings.size - terms[t].postings_offset);
+        terms[t].last_doc = term->postings[term->count - 1].doc;
+    }
+
+    search_header header;
+    memset(&header, 0, sizeof(header));
+    header.note_count = note_count;
+    header.live_count = note_count;
+    header.term_count = (uint32_t)builder->term_count;
+    postings_run run = {NULL, 0, postings.size};
+    postings_plan plan = {&run, 1, 1, postings.size};
+    ok = ok && save_index(index_path, &header, notes, terms, &plan, &postings, NULL, 0, &strings);
+
+    free(order);
+    free(notes);
+    free(terms);
+    free(postings.data);
+    free(strings.data);
+    return ok;
+}
+
+// Function to write the previous index with the builder's notes appended. The previous posting lists are
+// copied without decoding them, the new postings are added at their ends and the notes that are no longer
+// current are marked deleted.
+static int patch_index(const search_index *old, index_builder *builder, const catalog *cat,
+                       const uint32_t *added_entries, uint32_t added_count, const unsigned char *current,
+                       uint32_t live_count, const char *index_path) {
+    const search_header *old_header = old->header;
+    uint32_t note_count = old_header->note_count + added_count;
+    size_t kept_size = old_header->total_size - old_header->strings_offset;
+
+    uint32_t *order = sort_terms(builder);
+    search_note *notes = malloc((note_count + 1) * sizeof(search_note));
+    search_term *terms = malloc((old_header->term_count + builder->term_count + 1) * sizeof(search_term));
+    byte_buffer postings = {0}, strings = {0};
+    postings_plan plan = {0};
+    int ok = order && notes && terms;
+    if (!notes || !terms) {
+        perror("malloc");
+    }
+
+    if (ok) {
+        memcpy(notes, old->notes, old_header->note_count * sizeof(search_note));
+    }
+    for (uint32_t i = 0; ok && i < old_header->note_count; i++) {
+        if (!current[i]) {
+            notes[i].flags |= SEARCH_NOTE_DELETED;
+        }
+    }
+    for (uint32_t i = 0; ok && i < added_count; i++) {
+        ok = add_note(&notes[old_header->note_count + i], &cat->entries[added_entries[i]], &strings, kept_size);
+    }
+
+    // Merge the two sorted term tables, a term in both keeps its old postings and gains the new ones
+    size_t a = 0, b = 0, term_count = 0;
+    while (ok && (a < old_header->term_count || b < builder->term_count)) {
+        const search_term *old_term = a < old_header->term_count ? &old->terms[a] : NULL;
+        build_term *new_term = b < builder->term_count ? &builder->terms[order[b]] : NULL;
+        int cmp = old_term == NULL ? 1 : new_term == NULL ? -1 :
+                  compare_term_strings(old->strings + old_term->string_offset, old_term->length,
+                                       new_term->term, new_term->length);
+
+        search_term *term = &terms[term_count++];
+        if (cmp <= 0) {
+            *term = *old_term;
+            term->postings_offset = plan.size;
+            ok = plan_run(&plan, old->postings, old_term->postings_offset, old_term->postings_size);
+            a++;
+        } else {
+            memset(term, 0, sizeof(*term));
+            term->string_offset = kept_size + strings.size;
+            term->length = new_term->length;
+            term->postings_offset = plan.size;
+            ok = buffer_append(&strings, new_term->term, new_term->length + 1);
+        }
+        if (ok && cmp >= 0) {
+            size_t start = postings.size;
+            ok = encode_postings(&postings, builder, new_term, cmp == 0 ? old_term->last_doc : 0) &&
+                 plan_run(&plan, NULL, start, postings.size - start);
+            term->doc_count += (uint32_t)new_term->count;
+            term->last_doc = new_term->postings[new_term->count - 1].doc;
+            b++;
+        }
+        term->postings_size = (uint32_t)(plan.size - term->postings_offset);
+    }
+
+    search_header header;
+    memset(&header, 0, sizeof(header));
+    header.note_count = note_count;
+    header.live_count = live_count;
+    header.term_count = (uint32_t)term_count;
+    ok = ok && save_index(index_path, &header, notes, terms, &plan, &postings, old->strings, kept_size, &strings);
+
+    free(order);
+    free(notes);
+    free(terms);
+    free(plan.runs);
+    free(postings.data);
+    free(strings.data);
+    return ok;
+}
+
+static int compare_note_lookup(const void *a, const void *b) {
+    return strcmp(((const note_lookup *)a)->path, ((const note_lookup *)b)->path);
+}
+
+// Function to bring the index in line with the catalog, tokenizing only notes whose mtime or size changed.
+// Their postings are appended to the previous index and the notes they replace are only marked, until
+// marked notes outnumber half the live ones and the index is rebuilt from the decoded postings.
+// Returns the number of notes (re)indexed, or -1 on failure.
+int search_index_update(const catalog *cat, const char *index_path) {
+    search_index old;
+    int have_old = search_index_open(&old, index_path);
+    uint32_t old_count = have_old ? old.header->note_count : 0;
+
+    uint32_t *note_entries = malloc((cat->entry_count + 1) * sizeof(uint32_t));
+    uint32_t *changed = malloc((cat->entry_count + 1) * sizeof(uint32_t));
+    uint32_t *doc_map = malloc((old_count + 1) * sizeof(uint32_t));
+    note_lookup *lookup = malloc((old_count + 1) * sizeof(note_lookup));
+    unsigned char *current = calloc(old_count + 1, 1);
+    if (!note_entries || !changed || !doc_map || !lookup || !current) {
+        perror("malloc");
+        free(note_entries);
+        free(changed);
+        free(doc_map);
+        free(lookup);
+        free(current);
+        if (have_old) {
+            search_index_close(&old);
+        }
+        return -1;
+    }
+
+    uint32_t lookup_count = 0;
+    for (uint32_t i = 0; i < old_count; i++) {
+        doc_map[i] = NO_DOC;
+        if (!(old.notes[i].flags & SEARCH_NOTE_DELETED)) {
+            lookup[lookup_count].path = search_note_path(&old, i, NULL);
+            lookup[lookup_count++].note = i;
+        }
+    }
+    qsort(lookup, lookup_count, sizeof(note_lookup), compare_note_lookup);
+
+    uint32_t note_count = 0, changed_count = 0, reused_count = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        const catalog_entry *entry = &cat->entries[i];
+        if (!search_is_note(entry->path)) {
+            continue;
+        }
+
+        note_lookup key = {entry->path, 0};
+        note_lookup *found = lookup_count ? bsearch(&key, lookup, lookup_count, sizeof(note_lookup), compare_note_lookup) : NULL;
+        if (found && old.notes[found->note].mtime == entry->mtime && old.notes[found->note].size == entry->size) {
+            doc_map[found->note] = note_count;
+            current[found->note] = 1;
+            reused_count++;
+        } else {
+            changed[changed_count++] = note_count;
+        }
+        note_entries[note_count++] = (uint32_t)i;
+    }
+
+    int result = 0;
+    uint32_t marked = old_count - reused_count;
+    if (have_old && changed_count == 0 && reused_count == lookup_count) {
+        result = 0;  // Already up to date
+    } else if (!have_old || (marked >= SEARCH_REBUILD_MIN && (uint64_t)marked * 2 > note_count)) {
+        index_builder builder;
+        memset(&builder, 0, sizeof(builder));
+
+        int ok = !have_old || reuse_postings(&builder, &old, doc_map);
+        for (uint32_t i = 0; ok && i < changed_count; i++) {
+            ok = index_note(&builder, cat->root, cat->entries[note_entries[changed[i]]].path, changed[i]);
+        }
+        ok = ok && write_index(&builder, cat, note_entries, note_count, index_path);
+
+        builder_free(&builder);
+        result = ok ? (int)changed_count : -1;
+    } else {
+        index_builder builder;
+        memset(&builder, 0, sizeof(builder));
+
+        // New and changed notes are numbered after every previous one
+        int ok = 1;
+        for (uint32_t i = 0; ok && i < changed_count; i++) {
+            changed[i] = note_entries[changed[i]];
+            ok = index_note(&builder, cat->root, cat->entries[changed[i]].path, old_count + i);
+        }
+        ok = ok && patch_index(&old, &builder, cat, changed, changed_count, current, note_count, index_path);
+
+        builder_free(&builder);
+        result = ok ? (int)changed_count : -1;
+    }
+
+    if (have_old) {
+        search_index_close(&old);
+    }
+    free(note_entries);
+    free(changed);
+    free(doc_map);
+    free(lookup);
+    free(current);
+    return result;
+}
+
+// Function to check that a string of the index lies inside the string section and is terminated there
+static int string_fits(const unsigned char *data, const search_header *header, uint64_t offset, uint64_t length) {
+    uint64_t size = header->total_size - header->strings_offset;
+    return offset < size && length < size - offset && data[header->strings_offset + offset + length] == '\0';
+}
+
+// Function to check every note's path and bucket and every term's string and postings against their sections,
+// so a truncated or corrupt index is rejected on open instead of read past its end by a query
+static int sections_fit(const unsigned char *data, const search_header *header) {
+    const search_note *notes = (const search_note *)(data + header->notes_offset);
+    for (uint32_t i = 0; i < header->note_count; i++) {
+        if (!string_fits(data, header, notes[i].path_offset, notes[i].path_length) ||
+            !string_fits(data, header, notes[i].bucket_offset, notes[i].bucket_length)) {
+            return 0;
+        }
+    }
+
+    const search_term *terms = (const search_term *)(data + header->terms_offset);
+    uint64_t postings_size = header->strings_offset - header->postings_offset;
+    for (uint32_t i = 0; i < header->term_count; i++) {
+        if (!string_fits(data, header, terms[i].string_offset, terms[i].length) ||
+            terms[i].postings_offset > postings_size ||
+            terms[i].postings_size > postings_size - terms[i].postings_offset) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to map an index file and validate its layout
+int search_index_open(search_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(search_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const search_header *header = data;
+    if (memcmp(header->magic, SEARCH_MAGIC, sizeof(SEARCH_MAGIC)) != 0 || header->version != SEARCH_VERSION ||
+        header->total_size != (uint64_t)st.st_size || header->live_count > header->note_count ||
+        header->terms_offset != header->notes_offset + (uint64_t)header->note_count * sizeof(search_note) ||
+        header->postings_offset != header->terms_offset + (uint64_t)header->term_count * sizeof(search_term) ||
+        header->notes_offset < sizeof(search_header) || header->strings_offset < header->postings_offset ||
+        header->strings_offset > header->total_size || !sections_fit(data, header)) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->notes = (const search_note *)(index->data + header->notes_offset);
+    index->terms = (const search_term *)(index->data + header->terms_offset);
+    index->postings = index->data + header->postings_offset;
+    index->strings = (const char *)(index->data + header->strings_offset);
+    return 1;
+}
+
+void search_index_close(search_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+const char *search_note_path(const search_index *index, uint32_t note, size_t *len) {
+    if (len) {
+        *len = index->notes[note].path_length;
+    }
+    return index->strings + index->notes[note].path_offset;
+}
+
+const char *search_note_bucket(const search_index *index, uint32_t note, size_t *len) {
+    if (len) {
+        *len = index->notes[note].bucket_length;
+    }
+    return index->strings + index->notes[note].bucket_offset;
+}
+
+// Function to binary search the sorted term table
+const search_term *search_index_find_term(const search_index *index, const char *term, size_t len) {
+    size_t low = 0, high = index->header->term_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const search_term *candidate = &index->terms[mid];
+        size_t common = candidate->length < len ? candidate->length : len;
+        int cmp = memcmp(index->strings + candidate->string_offset, term, common);
+        if (cmp == 0) {
+            cmp = (candidate->length > len) - (candidate->length < len);
+        }
+        if (cmp == 0) {
+            return candidate;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+// Function to find the slot of doc in a decoded posting list
+static long find_doc(const decoded_postings *postings, uint32_t doc) {
+    size_t low = 0, high = postings->doc_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (postings->docs[mid] == doc) {
+            return (long)mid;
+        }
+        if (postings->docs[mid] < doc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return -1;
+}
+
+static int has_position(const uint32_t *positions, uint32_t count, uint32_t position) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (positions[mid] == position) {
+            return 1;
+        }
+        if (positions[mid] < position) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+// Function to evaluate one term or phrase clause into (note, hits) pairs sorted by note
+static size_t evaluate_clause(const search_index *index, char terms[][SEARCH_TERM_MAX], const size_t *lengths,
+                              size_t term_count, search_hit **out) {
+    *out = NULL;
+    decoded_postings postings[SEARCH_QUERY_TERMS_MAX];
+    memset(postings, 0, sizeof(postings));
+
+    int ok = 1;
+    for (size_t i = 0; ok && i < term_count; i++) {
+        const search_term *term = search_index_find_term(index, terms[i], lengths[i]);
+        ok = term != NULL && decode_postings(index, term, &postings[i]);
+    }
+
+    size_t count = 0;
+    search_hit *hits = ok ? malloc((postings[0].doc_count + 1) * sizeof(search_hit)) : NULL;
+    for (size_t d = 0; hits && d < postings[0].doc_count; d++) {
+        uint32_t doc = postings[0].docs[d];
+        if (index->notes[doc].flags & SEARCH_NOTE_DELETED) {
+            continue;
+        }
+        const uint32_t *first = postings[0].positions + postings[0].starts[d];
+        uint32_t first_count = postings[0].counts[d];
+
+        long slots[SEARCH_QUERY_TERMS_MAX];
+        int present = 1;
+        for (size_t i = 1; present && i < term_count; i++) {
+            slots[i] = find_doc(&postings[i], doc);
+            present = slots[i] >= 0;
+        }
+        if (!present) {
+            continue;
+        }
+
+        // Count occurrences where every following word sits at the next position
+        uint32_t matches = 0;
+        for (uint32_t p = 0; p < first_count; p++) {
+            int chained = 1;
+            for (size_t i = 1; chained && i < term_count; i++) {
+                const decoded_postings *next = &postings[i];
+                chained = has_position(next->positions + next->starts[slots[i]], next->counts[slots[i]], first[p] + (uint32_t)i);
+            }
+            matches += chained;
+        }
+
+        if (matches > 0) {
+            hits[count].note = doc;
+            hits[count++].hits = matches;
+        }
+    }
+
+    for (size_t i = 0; i < term_count; i++) {
+        free_decoded(&postings[i]);
+    }
+    *out = hits;
+    return count;
+}
+
+// Function to check a note's bucket against a filter, "org" matches every repo of that org
+static int bucket_matches(const search_index *index, uint32_t note, const char *filter) {
+    size_t len;
+    const char *bucket = search_note_bucket(index, note, &len);
+    size_t filter_len = strlen(filter);
+    if (len == filter_len && memcmp(bucket, filter, len) == 0) {
+        return 1;
+    }
+    return strchr(filter, '/') == NULL && len > filter_len &&
+           memcmp(bucket, filter, filter_len) == 0 && bucket[filter_len] == '/';
+}
+
+static const search_index *sort_index;
+
+static int compare_hits(const void *a, const void *b) {
+    const search_hit *x = a, *y = b;
+    if (x->hits != y->hits) {
+        return x->hits > y->hits ? -1 : 1;
+    }
+    return strcmp(search_note_path(sort_index, x->note, NULL), search_note_path(sort_index, y->note, NULL));
+}
+
+// Function to answer a query of words and "quoted phrases", all of which must match.
+// Returns the number of hits, best first, in a malloc'd array the caller frees.
+size_t search_index_query(const search_index *index, const char *query, const char *bucket, search_hit **hits) {
+    *hits = NULL;
+    search_hit *result = NULL;
+    size_t result_count = 0;
+    int first_clause = 1;
+
+    size_t i = 0, query_len = strlen(query);
+    while (i < query_len) {
+        while (i < query_len && isspace((unsigned char)query[i])) {
+            i++;
+        }
+        if (i >= query_len) {
+            break;
+        }
+
+        // A clause is a quoted phrase or a run of non-space characters
+        size_t start, end;
+        if (query[i] == '"') {
+            start = ++i;
+            while (i < query_len && query[i] != '"') {
+                i++;
+            }
+            end = i++;
+        } else {
+            start = i;
+            while (i < query_len && !isspace((unsigned char)query[i])) {
+                i++;
+            }
+            end = i;
+        }
+
+        char terms[SEARCH_QUERY_TERMS_MAX][SEARCH_TERM_MAX];
+        size_t lengths[SEARCH_QUERY_TERMS_MAX];
+        size_t term_count = 0, pos = start;
+        while (term_count < SEARCH_QUERY_TERMS_MAX &&
+               (lengths[term_count] = search_next_token(query, end, &pos, terms[term_count], SEARCH_TERM_MAX)) > 0) {
+            term_count++;
+        }
+        if (term_count == 0) {
+            continue;
+        }
+
+        search_hit *clause_hits;
+        size_t clause_count = evaluate_clause(index, terms, lengths, term_count, &clause_hits);
+
+        if (first_clause) {
+            result = clause_hits;
+            result_count = clause_count;
+            first_clause = 0;
+        } else {
+            // Intersect with the notes matched so far, both lists are sorted by note
+            size_t a = 0, b = 0, kept = 0;
+            while (a < result_count && b < clause_count) {
+                if (result[a].note < clause_hits[b].note) {
+                    a++;
+                } else if (result[a].note > clause_hits[b].note) {
+                    b++;
+                } else {
+                    result[kept].note = result[a].note;
+                    result[kept++].hits = result[a++].hits + clause_hits[b++].hits;
+                }
+            }
+            result_count = kept;
+            free(clause_hits);
+        }
+
+        if (result_count == 0) {
+            break;
+        }
+    }
+
+    if (bucket && bucket[0]) {
+        size_t kept = 0;
+        for (size_t k = 0; k < result_count; k++) {
+            if (bucket_matches(index, result[k].note, bucket)) {
+                result[kept++] = result[k];
+            }
+        }
+        result_count = kept;
+    }
+
+    sort_index = index;
+    qsort(result, result_count, sizeof(search_hit), compare_hits);
+
+    if (result_count == 0) {
+        free(result);
+        result = NULL;
+    }
+    *hits = result;
+    return result_count;
+}
@@ -0,0 +1,82 @@
+// search_index.h
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+
+#define SEARCH_INDEX_FILE "obs/.search_index"
+#define SEARCH_TERM_MAX 64
+#define SEARCH_QUERY_TERMS_MAX 32
+
+#define SEARCH_NOTE_DELETED 1       // Replaced or removed, its postings are skipped until the next rebuild
+
+// On-disk layout, every section is addressed by offset so the file can be used straight from mmap.
+// An update appends new and changed notes after the existing ones, so their postings can be added to the
+// end of each list, and only marks the notes they replace.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t note_count;        // Including the notes marked deleted
+    uint32_t term_count;
+    uint32_t live_count;
+    uint64_t notes_offset;
+    uint64_t terms_offset;
+    uint64_t postings_offset;
+    uint64_t strings_offset;
+    uint64_t total_size;
+} search_header;
+
+typedef struct {
+    uint64_t path_offset;       // Into the string section
+    uint32_t path_length;
+    uint32_t bucket_length;
+    uint64_t bucket_offset;
+    int64_t mtime;
+    int64_t size;
+    uint32_t flags;
+    uint32_t reserved;
+} search_note;
+
+// Terms are sorted bytewise so lookups can binary search the table
+typedef struct {
+    uint64_t string_offset;
+    uint64_t postings_offset;   // Into the postings section
+    uint32_t length;
+    uint32_t doc_count;         // Counting notes marked deleted
+    uint32_t postings_size;
+    uint32_t last_doc;          // Note of the last posting, the next appended posting is encoded against it
+} search_term;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const search_header *header;
+    const search_note *notes;
+    const search_term *terms;
+    const unsigned char *postings;
+    const char *strings;
+} search_index;
+
+// One matching note of a query
+typedef struct {
+    uint32_t note;
+    uint32_t hits;
+} search_hit;
+
+// Function declarations
+void search_index_default_path(char *buf, size_t size);
+size_t search_next_token(const char *text, size_t len, size_t *pos, char *token, size_t token_size);
+int search_is_note(const char *path);
+int search_index_update(const catalog *cat, const char *index_path);
+int search_index_open(search_index *index, const char *index_path);
+void search_index_close(search_index *index);
+const search_term *search_index_find_term(const search_index *index, const char *term, size_t len);
+const char *search_note_path(const search_index *index, uint32_t note, size_t *len);
+const char *search_note_bucket(const search_index *index, uint32_t note, size_t *len);
+size_t search_index_query(const search_index *index, const char *query, const char *bucket,
+                          search_hit **hits);
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,1025 @@
+// silica.c
+#include "silica.h"
+#include "git_repo.h"
+#include "daemon.h"
+#include "search_index.h"
+#include "link_index.h"
+#include "dupe_index.h"
+#include "related_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+void silica_config_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", SILICA_CONFIG_FILE);
+}
+
+// Function to read ~/obs/.config, returns 1 when both the vault and the API key are set
+int silica_config_load(silica_config *config) {
+    memset(config, 0, sizeof(*config));
+    char config_path[CATALOG_PATH_MAX];
+    silica_config_path(config_path, sizeof(config_path));
+
+    FILE *file = fopen(config_path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[SILICA_CONFIG_LINE_MAX];
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+
+        if (strncmp(line, "TARGET_DIR=", 11) == 0) {
+            snprintf(config->target_dir, sizeof(config->target_dir), "%s", line + 11);
+        } else if (strncmp(line, "OPEN_AI_API_KEY=", 16) == 0) {
+            snprintf(config->api_key, sizeof(config->api_key), "%s", line + 16);
+        } else if (strncmp(line, "AUTO_NAME=", 10) == 0) {
+            config->auto_name = strcmp(line + 10, "1") == 0 || strcmp(line + 10, "true") == 0 ||
+                                strcmp(line + 10, "local") == 0;
+        }
+    }
+
+    fclose(file);
+    return config->target_dir[0] != '\0' && config->api_key[0] != '\0';
+}
+
+// Function to write the vault and the API key to ~/obs/.config, keeping any other settings, such as the
+// NAMING_* keys, that were added to the file by hand. Returns 1 on success.
+int silica_config_save(const silica_config *config) {
+    char config_path[CATALOG_PATH_MAX];
+    silica_config_path(config_path, sizeof(config_path));
+
+    char other_lines[4096] = "";
+    FILE *file = fopen(config_path, "r");
+    if (file) {
+        char line[SILICA_CONFIG_LINE_MAX];
+        size_t used = 0;
+        while (fgets(line, sizeof(line), file)) {
+            if (strncmp(line, "TARGET_DIR=", 11) != 0 && strncmp(line, "OPEN_AI_API_KEY=", 16) != 0 &&
+                used + strlen(line) < sizeof(other_lines)) {
+                strcpy(other_lines + used, line);
+                used += strlen(line);
+            }
+        }
+        fclose(file);
+    }
+
+    file = fopen(config_path, "w");
+    if (!file) {
+        perror("Failed to open config file");
+        return 0;
+    }
+    fprintf(file, "TARGET_DIR=%s\n", config->target_dir);
+    fprintf(file, "OPEN_AI_API_KEY=%s\n", config->api_key);
+    fputs(other_lines, file);
+    if (fclose(file) != 0) {
+        perror("Failed to write config file");
+        return 0;
+    }
+    return 1;
+}
+
+// Function to open the vault catalog, rescanning only the directories that changed since it was saved
+int silica_vault_open(silica_vault *vault, const char *root) {
+    memset(vault, 0, sizeof(*vault));
+    catalog_init(&vault->cat);
+
+    char catalog_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+    if (!catalog_sync(&vault->cat, root, catalog_path)) {
+        catalog_free(&vault->cat);
+        return 0;
+    }
+
+    vault->dir_count = vault->cat.dir_count > 0 ? vault->cat.dir_count - 1 : 0;
+    vault->note_count = vault->cat.entry_count;
+    return 1;
+}
+
+// Function to open the vault as the catalog last saved it, without looking at the disk, for a first view
+// while silica_vault_open brings a copy up to date. Returns 0 when there is no catalog of root.
+int silica_vault_load(silica_vault *vault, const char *root) {
+    memset(vault, 0, sizeof(*vault));
+    catalog_init(&vault->cat);
+
+    char catalog_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+    if (!catalog_load(&vault->cat, catalog_path) || strcmp(vault->cat.root, root) != 0 ||
+        vault->cat.dir_count == 0) {
+        catalog_free(&vault->cat);
+        return 0;
+    }
+
+    vault->dir_count = vault->cat.dir_count - 1;
+    vault->note_count = vault->cat.entry_count;
+    return 1;
+}
+
+void silica_vault_close(silica_vault *vault) {
+    catalog_free(&vault->cat);
+    memset(vault, 0, sizeof(*vault));
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(((const silica_item *)a)->name, ((const silica_item *)b)->name);
+}
+
+// Function to list the directories and notes directly inside a directory, 0 being the vault root, sorted
+// by name as `tree` does. The items point into the vault and the array is the caller's to free.
+size_t silica_vault_children(const silica_vault *vault, int dir, silica_item **items) {
+    *items = NULL;
+    const catalog *cat = &vault->cat;
+    if (dir < 0 || (size_t)dir >= cat->dir_count) {
+        return 0;
+    }
+
+    const catalog_dir *parent = &cat->dirs[dir];
+    size_t count = parent->entry_count;
+    for (int child = parent->first_child; child >= 0; child = cat->dirs[child].next_sibling) {
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    *items = malloc(count * sizeof(silica_item));
+    if (*items == NULL) {
+        perror("malloc");
+        return 0;
+    }
+
+    size_t n = 0;
+    for (int child = parent->first_child; child >= 0; child = cat->dirs[child].next_sibling) {
+        const catalog_dir *sub = &cat->dirs[child];
+        (*items)[n++] = (silica_item){base_name(sub->path), sub->path, child, sub->mtime, 0};
+    }
+    for (size_t i = parent->first_entry; i < parent->first_entry + parent->entry_count; i++) {
+        const catalog_entry *entry = &cat->entries[i];
+        (*items)[n++] = (silica_item){base_name(entry->path), entry->path, -1, entry->mtime, entry->size};
+    }
+    qsort(*items, count, sizeof(silica_item), compare_items);
+    return count;
+}
+
+static int make_directory(const char *path) {
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        perror("Failed to create directory");
+        return 0;
+    }
+    return 1;
+}
+
+// Function to pick and create the directory a note written from cwd belongs in: org/repo for a git
+// repository with an origin, temp outside one. Returns 1 for a repository, 2 for temp and 0 on failure.
+int silica_note_directory(const silica_config *config, const char *cwd, char *dir, size_t size) {
+    char git_organisation[GIT_NAME_MAX] = {0};
+    char repo_name[GIT_NAME_MAX] = {0};
+    int git_status;
+    if (!daemon_resolve_repo(cwd, git_organisation, sizeof(git_organisation), repo_name, sizeof(repo_name),
+                             &git_status)) {
+        git_status = git_resolve_repo(cwd, git_organisation, sizeof(git_organisation), repo_name,
+                                      sizeof(repo_name));
+    }
+
+    if (git_status < 0) {
+        fprintf(stderr, "Failed to retrieve remote URL.\n");
+        return 0;
+    }
+    if (git_status == 0) {
+        snprintf(dir, size, "%s/temp", config->target_dir);
+        return make_directory(dir) ? 2 : 0;
+    }
+
+    snprintf(dir, size, "%s/%s", config->target_dir, git_organisation);
+    if (!make_directory(dir)) {
+        return 0;
+    }
+    snprintf(dir, size, "%s/%s/%s", config->target_dir, git_organisation, repo_name);
+    return make_directory(dir);
+}
+
+// Function to create a timestamp-named note for cwd, returns 1 with its path. A note in temp starts
+// with a placeholder line.
+int silica_create_note(const silica_config *config, const char *cwd, char *path, size_t size) {
+    char dir[CATALOG_PATH_MAX];
+    int kind = silica_note_directory(config, cwd, dir, sizeof(dir));
+    if (kind == 0) {
+        return 0;
+    }
+
+    char timestamp[64];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d_%H-%M-%S", &local);
+    snprintf(path, size, "%s/%s.md", dir, timestamp);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Failed to create file");
+        return 0;
+    }
+    if (kind == 2) {
+        fprintf(file, "New note created.\n");
+    }
+    fclose(file);
+    return 1;
+}
+
+// ---- Queries ----
+
+void silica_hits_free(silica_hits *hits) {
+    for (size_t i = 0; i < hits->count; i++) {
+        free(hits->hits[i].path);
+    }
+    free(hits->hits);
+    memset(hits, 0, sizeof(*hits));
+}
+
+void silica_clusters_free(silica_cluster *clusters, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        silica_hits_free(&clusters[i].notes);
+    }
+    free(clusters);
+}
+
+// Function to append a copy of the first length bytes of path, returns the new hit or NULL
+static silica_hit *add_hit(silica_hits *hits, const char *path, size_t length) {
+    if (hits->count == hits->capacity) {
+        size_t capacity = hits->capacity ? hits->capacity * 2 : 16;
+        silica_hit *grown = realloc(hits->hits, capacity * sizeof(silica_hit));
+        if (grown == NULL) {
+            perror("realloc");
+            return NULL;
+        }
+        hits->hits = grown;
+        hits->capacity = capacity;
+    }
+
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    silica_hit *hit = &hits->hits[hits->count++];
+    *hit = (silica_hit){copy, 0, 0.0f, 1};
+    return hit;
+}
+
+// Function to name a note relative to the vault when it was given as an absolute path inside it
+static const char *vault_relative(const char *root, const char *path) {
+    size_t root_length = strlen(root);
+    if (strncmp(path, root, root_length) == 0 && path[root_length] == '/') {
+        return path + root_length + 1;
+    }
+    return path;
+}
+
+// Function to turn a directory given relative to the vault or as an absolute path inside it into a
+// prefix of catalog paths, returns its length without trailing slashes
+static size_t vault_subdir(const char *root, const char **subdir) {
+    size_t root_length = strlen(root);
+    const char *dir = *subdir;
+    if (strncmp(dir, root, root_length) == 0 && (dir[root_length] == '/' || dir[root_length] == '\0')) {
+        dir += root_length;
+    }
+    while (*dir == '/') {
+        dir++;
+    }
+    size_t length = strlen(dir);
+    while (length > 0 && dir[length - 1] == '/') {
+        length--;
+    }
+    *subdir = dir;
+    return length;
+}
+
+static int in_subdir(const char *path, const char *subdir, size_t subdir_length) {
+    return subdir_length == 0 || (strncmp(path, subdir, subdir_length) == 0 && path[subdir_length] == '/');
+}
+
+// Function to bring the catalog and the requested SILICA_INDEX_* indexes up to date. A running daemon
+// already keeps them current, so they are trusted as saved. Otherwise only the directories whose mtime moved
+// are rescanned, which sees every note added, removed or saved by replacing the file. Notes edited in place
+// are only looked at with SILICA_INDEX_RESCAN. Only notes whose mtime or size changed are read, and only
+// for the tag, link, duplicate and related indexes. The related index weighs terms by the search index, so
+// that is brought up to date first. Returns 1 on success.
+int silica_update_indexes(const char *root, int indexes) {
+    if (!(indexes & SILICA_INDEX_RESCAN) && daemon_running()) {
+        return 1;
+    }
+
+    char catalog_path[CATALOG_PATH_MAX];
+    char index_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, root, catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        catalog_free(&cat);
+        return 0;
+    }
+    if ((indexes & SILICA_INDEX_RESCAN) && catalog_restat(&cat) > 0) {
+        catalog_save(&cat, catalog_path);
+    }
+
+    int ok = 1;
+    if (indexes & SILICA_INDEX_TAGS) {
+        tag_index_default_path(index_path, sizeof(index_path));
+        if (tag_index_update(&cat, index_path) < 0) {
+            fprintf(stderr, "Error updating the tag index\n");
+            ok = 0;
+        }
+    }
+    if ((indexes & SILICA_INDEX_TIMES) && ok) {
+        time_index_default_path(index_path, sizeof(index_path));
+        if (time_index_update(&cat, index_path) < 0) {
+            fprintf(stderr, "Error updating the time index\n");
+            ok = 0;
+        }
+    }
+    if ((indexes & SILICA_INDEX_LINKS) && ok) {
+        link_index_default_path(index_path, sizeof(index_path));
+        if (link_index_update(&cat, index_path) < 0) {
+            fprintf(stderr, "Error updating the link index\n");
+            ok = 0;
+        }
+    }
+    if ((indexes & SILICA_INDEX_DUPES) && ok) {
+        dupe_index_default_path(index_path, sizeof(index_path));
+        if (dupe_index_update(&cat, index_path) < 0) {
+            fprintf(stderr, "Error updating the duplicate index\n");
+            ok = 0;
+        }
+    }
+    if ((indexes & SILICA_INDEX_RELATED) && ok) {
+        search_index terms;
+        search_index_default_path(index_path, sizeof(index_path));
+        ok = search_index_update(&cat, index_path) >= 0 && search_index_open(&terms, index_path);
+        if (ok) {
+            related_index_default_path(index_path, sizeof(index_path));
+            ok = related_index_update(&cat, &terms, index_path) >= 0;
+            search_index_close(&terms);
+        }
+        if (!ok) {
+            fprintf(stderr, "Error updating the related index\n");
+        }
+    }
+    catalog_free(&cat);
+    return ok;
+}
+
+// Function to list the notes matching tag and frontmatter terms from the tag index. Returns 1 on success.
+int silica_list_tagged(const char *root, const tag_term *terms, size_t term_count, silica_hits *hits) {
+    memset(hits, 0, sizeof(*hits));
+    if (!silica_update_indexes(root, SILICA_INDEX_TAGS)) {
+        return 0;
+    }
+
+    char index_path[CATALOG_PATH_MAX];
+    tag_index_default_path(index_path, sizeof(index_path));
+    tag_index index;
+    if (!tag_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the tag index\n");
+        return 0;
+    }
+
+    uint32_t *notes;
+    size_t note_count = tag_index_query(&index, terms, term_count, &notes);
+    for (size_t i = 0; i < note_count; i++) {
+        size_t length;
+        const char *path = tag_note_path(&index, notes[i], &length);
+        add_hit(hits, path, length);
+    }
+
+    free(notes);
+    tag_index_close(&index);
+    return 1;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Function to list up to recent notes (0 for all) newest first by modification or creation time, walking
+// the sorted time index down from the end of the [since, until] range. Tag terms, when given, filter the
+// walk. Returns 1 on success.
+int silica_list_recent(const char *root, const tag_term *terms, size_t term_count, time_field field, long recent,
+                       int64_t since, int64_t until, silica_hits *hits) {
+    memset(hits, 0, sizeof(*hits));
+    if (!silica_update_indexes(root, (term_count > 0 ? SILICA_INDEX_TAGS : 0) | SILICA_INDEX_TIMES)) {
+        return 0;
+    }
+
+    char index_path[CATALOG_PATH_MAX];
+    time_index_default_path(index_path, sizeof(index_path));
+    time_index index;
+    if (!time_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the time index\n");
+        return 0;
+    }
+
+    // Matching paths come back sorted, so membership is a binary search
+    tag_index tags;
+    uint32_t *notes = NULL;
+    const char **allowed = NULL;
+    size_t allowed_count = 0;
+    if (term_count > 0) {
+        tag_index_default_path(index_path, sizeof(index_path));
+        if (!tag_index_open(&tags, index_path)) {
+            fprintf(stderr, "Error opening the tag index\n");
+            time_index_close(&index);
+            return 0;
+        }
+        allowed_count = tag_index_query(&tags, terms, term_count, &notes);
+        allowed = malloc((allowed_count + 1) * sizeof(const char *));
+        for (size_t i = 0; allowed && i < allowed_count; i++) {
+            allowed[i] = tag_note_path(&tags, notes[i], NULL);
+        }
+    }
+
+    size_t first, last;
+    time_index_range(&index, field, since, until, &first, &last);
+    for (size_t rank = last; rank > first && (recent <= 0 || (long)hits->count < recent); rank--) {
+        const time_record *record = time_index_at(&index, field, rank - 1);
+        const char *path = time_record_path(&index, record);
+        if (term_count > 0 && (allowed == NULL ||
+                               !bsearch(&path, allowed, allowed_count, sizeof(const char *), compare_paths))) {
+            continue;
+        }
+
+        silica_hit *hit = add_hit(hits, path, strlen(path));
+        if (hit == NULL) {
+            break;
+        }
+        hit->time = time_record_value(record, field);
+    }
+
+    if (term_count > 0) {
+        free(notes);
+        free(allowed);
+        tag_index_close(&tags);
+    }
+    time_index_close(&index);
+    return 1;
+}
+
+static void collect_link(const char *text, int resolved, void *ctx) {
+    silica_hit *hit = add_hit(ctx, text, strlen(text));
+    if (hit) {
+        hit->resolved = resolved;
+    }
+}
+
+// Function to list the notes a note links to, or with backlinks the notes linking to it, through the
+// daemon when one is running. The note is named by its path or the way a [[link]] would name it.
+// Returns 1 with the hits, 0 when no note matches and -1 on error.
+int silica_links(const char *root, const char *note, int backlinks, silica_hits *hits) {
+    memset(hits, 0, sizeof(*hits));
+    note = vault_relative(root, note);
+    int found;
+    if (daemon_links(note, backlinks, collect_link, hits, &found)) {
+        return found;
+    }
+    silica_hits_free(hits);
+
+    if (!silica_update_indexes(root, SILICA_INDEX_LINKS)) {
+        return -1;
+    }
+    char index_path[CATALOG_PATH_MAX];
+    link_index_default_path(index_path, sizeof(index_path));
+    link_index index;
+    if (!link_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the link index\n");
+        return -1;
+    }
+
+    uint32_t id = link_index_find_note(&index, note);
+    found = id != LINK_UNRESOLVED;
+    size_t count = 0, length;
+    if (found && backlinks) {
+        const uint32_t *sources = link_index_backlinks(&index, id, &count);
+        for (size_t i = 0; i < count; i++) {
+            const char *path = link_note_path(&index, sources[i], &length);
+            add_hit(hits, path, length);
+        }
+    } else if (found) {
+        const link_edge *edges = link_index_links(&index, id, &count);
+        for (size_t i = 0; i < count; i++) {
+            int resolved = edges[i].target != LINK_UNRESOLVED;
+            const char *text = resolved ? link_note_path(&index, edges[i].target, &length)
+                                        : link_edge_text(&index, &edges[i], &length);
+            silica_hit *hit = add_hit(hits, text, length);
+            if (hit) {
+                hit->resolved = resolved;
+            }
+        }
+    }
+    link_index_close(&index);
+    return found;
+}
+
+static void collect_related(const char *path, float similarity, void *ctx) {
+    silica_hit *hit = add_hit(ctx, path, strlen(path));
+    if (hit) {
+        hit->similarity = similarity;
+    }
+}
+
+// Function to list the count notes whose contents are most like a note's, by the cosine similarity of
+// their embeddings, through the daemon when one is running. Results can be kept to one org/repo bucket,
+// or with same_repo to the note's own. Returns 1 with the hits, 0 when no note matches and -1 on error.
+int silica_related(const char *root, const char *note, const char *bucket, int same_repo, size_t count,
+                   silica_hits *hits) {
+    memset(hits, 0, sizeof(*hits));
+    note = vault_relative(root, note);
+    int found;
+    if (daemon_related(note, bucket, same_repo, count, collect_related, hits, &found)) {
+        return found;
+    }
+    silica_hits_free(hits);
+
+    if (!silica_update_indexes(root, SILICA_INDEX_RELATED)) {
+        return -1;
+    }
+    char index_path[CATALOG_PATH_MAX];
+    related_index_default_path(index_path, sizeof(index_path));
+    related_index index;
+    if (!related_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the related index\n");
+        return -1;
+    }
+
+    uint32_t id = related_index_find(&index, note);
+    found = id != UINT32_MAX;
+    related_hit *related = malloc(count * sizeof(related_hit));
+    if (found && related) {
+        const char *filter = same_repo ? related_node_bucket(&index, id, NULL) : bucket;
+        size_t related_count = related_index_query(&index, id, filter, related, count);
+        for (size_t i = 0; i < related_count; i++) {
+            size_t length;
+            const char *path = related_node_path(&index, related[i].note, &length);
+            silica_hit *hit = add_hit(hits, path, length);
+            if (hit) {
+                hit->similarity = related[i].similarity;
+            }
+        }
+    }
+    free(related);
+    related_index_close(&index);
+    return found;
+}
+
+static const dupe_index *sort_dupes;
+static const uint32_t *sort_members;
+
+// Function to order clusters by the bucket of their first note, then by its path
+static int compare_clusters(const void *a, const void *b) {
+    const char *x = dupe_note_path(sort_dupes, sort_members[((const dupe_cluster *)a)->first], NULL);
+    const char *y = dupe_note_path(sort_dupes, sort_members[((const dupe_cluster *)b)->first], NULL);
+    char x_bucket[CATALOG_BUCKET_MAX], y_bucket[CATALOG_BUCKET_MAX];
+    catalog_bucket_for(x, x_bucket, sizeof(x_bucket));
+    catalog_bucket_for(y, y_bucket, sizeof(y_bucket));
+    int cmp = strcmp(x_bucket, y_bucket);
+    return cmp != 0 ? cmp : strcmp(x, y);
+}
+
+// Function to find the clusters of near-duplicate notes at threshold similarity or more, ordered by bucket,
+// each note after the first with its estimated similarity to it. A directory keeps the clusters with a note
+// under it. The clusters are the caller's to free with silica_clusters_free. Returns 1 on success.
+int silica_find_duplicates(const char *root, const char *subdir, double threshold, silica_cluster **clusters,
+                           size_t *count) {
+    *clusters = NULL;
+    *count = 0;
+    size_t subdir_length = vault_subdir(root, &subdir);
+    if (!silica_update_indexes(root, SILICA_INDEX_DUPES)) {
+        return 0;
+    }
+
+    char index_path[CATALOG_PATH_MAX];
+    dupe_index_default_path(index_path, sizeof(index_path));
+    dupe_index index;
+    if (!dupe_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the duplicate index\n");
+        return 0;
+    }
+
+    dupe_cluster *found;
+    uint32_t *members;
+    size_t found_count = dupe_index_clusters(&index, threshold, &found, &members);
+    sort_dupes = &index;
+    sort_members = members;
+    if (found_count > 0) {
+        qsort(found, found_count, sizeof(dupe_cluster), compare_clusters);
+        *clusters = calloc(found_count, sizeof(silica_cluster));
+    }
+
+    for (size_t i = 0; *clusters && i < found_count; i++) {
+        const uint32_t *cluster = &members[found[i].first];
+        int wanted = 0;
+        for (uint32_t j = 0; j < found[i].count && !wanted; j++) {
+            wanted = in_subdir(dupe_note_path(&index, cluster[j], NULL), subdir, subdir_length);
+        }
+        if (!wanted) {
+            continue;
+        }
+
+        silica_cluster *kept = &(*clusters)[(*count)++];
+        catalog_bucket_for(dupe_note_path(&index, cluster[0], NULL), kept->bucket, sizeof(kept->bucket));
+        for (uint32_t j = 0; j < found[i].count; j++) {
+            size_t length;
+            const char *path = dupe_note_path(&index, cluster[j], &length);
+            silica_hit *hit = add_hit(&kept->notes, path, length);
+            if (hit) {
+                hit->similarity = j == 0 ? 1.0f : (float)dupe_similarity(&index, cluster[0], cluster[j]);
+            }
+        }
+    }
+
+    free(found);
+    free(members);
+    dupe_index_close(&index);
+    return found_count == 0 || *clusters != NULL;
+}
+
+static void collect_path(const char *relative_path, void *ctx) {
+    add_hit(ctx, relative_path, strlen(relative_path));
+}
+
+// Function to search note contents through the inverted index, from the daemon when one is running.
+// Returns 1 with up to limit hits (0 for all), best first.
+int silica_grep(const char *root, const char *query, const char *bucket, size_t limit, silica_hits *hits) {
+    memset(hits, 0, sizeof(*hits));
+
+    // A running daemon keeps the index current and mapped
+    size_t daemon_hits;
+    if (daemon_search(query, bucket, limit, collect_path, hits, &daemon_hits)) {
+        return 1;
+    }
+    silica_hits_free(hits);
+
+    char catalog_path[CATALOG_PATH_MAX];
+    char index_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+    search_index_default_path(index_path, sizeof(index_path));
+
+    // Bring the index up to date, only notes whose mtime or size changed are read
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, root, catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        catalog_free(&cat);
+        return 0;
+    }
+    if (catalog_restat(&cat) > 0) {
+        catalog_save(&cat, catalog_path);
+    }
+    int indexed = search_index_update(&cat, index_path);
+    catalog_free(&cat);
+    if (indexed < 0) {
+        fprintf(stderr, "Error updating the search index\n");
+        return 0;
+    }
+
+    search_index index;
+    if (!search_index_open(&index, index_path)) {
+        fprintf(stderr, "Error opening the search index\n");
+        return 0;
+    }
+
+    search_hit *found;
+    size_t hit_count = search_index_query(&index, query, bucket, &found);
+    for (size_t i = 0; i < hit_count && (limit == 0 || i < limit); i++) {
+        size_t length;
+        const char *path = search_note_path(&index, found[i].note, &length);
+        add_hit(hits, path, length);
+    }
+
+    free(found);
+    search_index_close(&index);
+    return 1;
+}
+
+// Function to find the first line of a note that mentions any query word. Returns its line number with the
+// line, leading whitespace trimmed, in line, or 0 when no line does or the note cannot be read.
+int silica_snippet(const char *root, const char *path, const char *query, char *line, size_t size) {
+    char words[SEARCH_QUERY_TERMS_MAX][SEARCH_TERM_MAX];
+    size_t word_count = 0, pos = 0, query_len = strlen(query);
+    while (word_count < SEARCH_QUERY_TERMS_MAX &&
+           search_next_token(query, query_len, &pos, words[word_count], SEARCH_TERM_MAX) > 0) {
+        word_count++;
+    }
+
+    char full_path[CATALOG_PATH_MAX];
+    snprintf(full_path, sizeof(full_path), "%s/%s", root, path);
+    FILE *file = fopen(full_path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char text[1024];
+    char lowered[1024];
+    int line_number = 0;
+    while (fgets(text, sizeof(text), file)) {
+        line_number++;
+        text[strcspn(text, "\n")] = '\0';
+        for (size_t i = 0; i <= strlen(text); i++) {
+            lowered[i] = (char)tolower((unsigned char)text[i]);
+        }
+
+        for (size_t w = 0; w < word_count; w++) {
+            if (strstr(lowered, words[w]) != NULL) {
+                const char *start = text;
+                while (isspace((unsigned char)*start)) {
+                    start++;
+                }
+                snprintf(line, size, "%s", start);
+                fclose(file);
+                return line_number;
+            }
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// ---- Renames ----
+
+// Function to rewrite the links pointing at the notes renamed in a journal. Only the notes the link index
+// lists as linking to them are opened, each once however many renamed notes it links to.
+static int rewrite_renamed_links(const char *root, const char *journal_path, link_rewrite_stats *stats) {
+    char index_path[CATALOG_PATH_MAX];
+    link_index_default_path(index_path, sizeof(index_path));
+    return link_rewrite_apply(root, index_path, journal_path, stats);
+}
+
+// Function to finish the link rewrite of a clean that was cut short. Returns 1 when one was finished, 0
+// when none was pending and -1 when its journal is still waiting.
+int silica_finish_renames(const char *root, link_rewrite_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    char journal_path[CATALOG_PATH_MAX];
+    link_journal_default_path(journal_path, sizeof(journal_path));
+    if (!link_journal_pending(journal_path)) {
+        return 0;
+    }
+    return rewrite_renamed_links(root, journal_path, stats) ? 1 : -1;
+}
+
+// Function to rename a note and point the links elsewhere in the vault at its new name, planned from the
+// link index as it was before the rename. Only the backlinks of the one note are looked up, in the index as
+// saved, which a running daemon keeps current and which is otherwise as of the last query or clean. It is
+// only built when there is none. Returns 1 once renamed, 0 when the note could not be renamed and -1 when it
+// was but the link rewrite was left for the next clean to finish.
+int silica_rename_note(const char *root, const char *path, const char *new_path, link_rewrite_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    char journal_path[CATALOG_PATH_MAX];
+    char index_path[CATALOG_PATH_MAX];
+    link_journal_default_path(journal_path, sizeof(journal_path));
+    link_index_default_path(index_path, sizeof(index_path));
+
+    size_t root_length = strlen(root);
+    int in_vault = strncmp(path, root, root_length) == 0 && path[root_length] == '/' &&
+                   (access(index_path, F_OK) == 0 || silica_update_indexes(root, SILICA_INDEX_LINKS));
+    FILE *journal = in_vault ? link_journal_begin(journal_path, index_path) : NULL;
+    if (journal && !link_journal_record(journal, path + root_length + 1, new_path + root_length + 1)) {
+        perror("Failed to journal rename");
+        fclose(journal);
+        rewrite_renamed_links(root, journal_path, stats);
+        return 0;
+    }
+
+    int renamed = rename(path, new_path) == 0;
+    if (!renamed) {
+        perror("Error renaming file");
+    }
+    if (journal == NULL) {
+        return renamed;
+    }
+    fclose(journal);
+
+    // A rename that failed is dropped from the journal, which is then simply removed
+    int rewritten = rewrite_renamed_links(root, journal_path, stats);
+    return !renamed ? 0 : rewritten ? 1 : -1;
+}
+
+// Function to read a monotonic clock in milliseconds
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// What the batch clean hands the report of each note
+typedef struct {
+    FILE *journal;              // Renames are journaled here, NULL on a dry run
+    size_t root_length;
+    silica_clean_report report;
+    void *ctx;
+} clean_context;
+
+// Function to journal a rename of the batch before it is made
+static int journal_rename(const char *path, const char *new_path, void *ctx) {
+    const clean_context *clean = ctx;
+    if (!link_journal_record(clean->journal, path + clean->root_length, new_path + clean->root_length)) {
+        perror("Failed to journal rename");
+        return 0;
+    }
+    return 1;
+}
+
+static void forward_clean_result(const clean_job *job, size_t done, size_t total, void *ctx) {
+    const clean_context *clean = ctx;
+    if (clean->report) {
+        clean->report(job, done, total, clean->ctx);
+    }
+}
+
+// Function to name every note under a directory of the vault that still carries its timestamp name, then
+// point the links to the renamed notes at their new names. Each note is reported as soon as it completes.
+// A journal left by an interrupted clean should be finished with silica_finish_renames first. Returns 1 with
+// the outcome in result, 0 when the vault could not be read.
+int silica_clean_all(const char *root, const char *subdir, clean_batch_options *options, int use_cache,
+                     silica_clean_report report, void *ctx, silica_clean_result *result) {
+    memset(result, 0, sizeof(*result));
+    size_t subdir_length = vault_subdir(root, &subdir);
+
+    char catalog_path[CATALOG_PATH_MAX];
+    char journal_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+    link_journal_default_path(journal_path, sizeof(journal_path));
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, root, catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        catalog_free(&cat);
+        return 0;
+    }
+
+    clean_job *jobs = calloc(cat.entry_count + 1, sizeof(clean_job));
+    if (jobs == NULL) {
+        perror("calloc");
+        catalog_free(&cat);
+        return 0;
+    }
+
+    size_t job_count = 0;
+    for (size_t i = 0; i < cat.entry_count; i++) {
+        const char *path = cat.entries[i].path;
+        const char *slash = strrchr(path, '/');
+        if (!in_subdir(path, subdir, subdir_length) || !clean_is_timestamp_name(slash ? slash + 1 : path)) {
+            continue;
+        }
+
+        size_t size = strlen(cat.root) + strlen(path) + 2;
+        jobs[job_count].path = malloc(size);
+        if (jobs[job_count].path == NULL) {
+            perror("malloc");
+            break;
+        }
+        snprintf(jobs[job_count].path, size, "%s/%s", cat.root, path);
+        job_count++;
+    }
+    clean_context clean = {NULL, strlen(cat.root) + 1, report, ctx};
+
+    // The local engine weighs terms by the document frequencies of the search index, and rewriting links
+    // needs the link index as it is before anything is renamed
+    if (job_count > 0 && (options->naming.engine == NAMING_ENGINE_LOCAL || !options->dry_run)) {
+        char index_path[CATALOG_PATH_MAX];
+        if (catalog_restat(&cat) > 0) {
+            catalog_save(&cat, catalog_path);
+        }
+        if (options->naming.engine == NAMING_ENGINE_LOCAL) {
+            search_index_default_path(index_path, sizeof(index_path));
+            search_index_update(&cat, index_path);
+        }
+        link_index_default_path(index_path, sizeof(index_path));
+        if (!options->dry_run && link_index_update(&cat, index_path) >= 0) {
+            clean.journal = link_journal_begin(journal_path, index_path);
+        }
+    }
+    catalog_free(&cat);
+
+    result->jobs = job_count;
+    if (job_count == 0) {
+        free(jobs);
+        return 1;
+    }
+
+    char cache_path[CATALOG_PATH_MAX];
+    name_cache_default_path(cache_path, sizeof(cache_path));
+    name_cache cache;
+    name_cache_init(&cache);
+    if (use_cache) {
+        name_cache_load(&cache, cache_path);
+        options->cache = &cache;
+    }
+
+    if (report) {
+        report(NULL, 0, job_count, ctx);
+    }
+    if (clean.journal) {
+        options->before_rename = journal_rename;
+        options->rename_ctx = &clean;
+    }
+    long long start = monotonic_ms();
+    result->renamed = clean_batch_run(jobs, job_count, options, forward_clean_result, &clean);
+    result->elapsed_ms = monotonic_ms() - start;
+    if (clean.journal) {
+        options->before_rename = NULL;
+        options->rename_ctx = NULL;
+        fclose(clean.journal);
+        result->links_pending = !rewrite_renamed_links(root, journal_path, &result->links);
+    }
+
+    if (use_cache) {
+        name_cache_save(&cache, cache_path);
+        options->cache = NULL;
+    }
+    name_cache_free(&cache);
+
+    for (size_t i = 0; i < job_count; i++) {
+        result->failed += jobs[i].status == CLEAN_FAILED;
+        result->cancelled += jobs[i].status == CLEAN_CANCELLED;
+        free(jobs[i].path);
+        free(jobs[i].new_path);
+    }
+    free(jobs);
+    return 1;
+}
+
+// ---- Watching ----
+
+// Function to keep the catalog and search index in step with the vault until stop is set. Returns 1 once
+// stopped, 0 when the vault could not be read.
+int silica_watch(const char *root, const volatile sig_atomic_t *stop, silica_watch_report report, void *ctx) {
+    char catalog_path[CATALOG_PATH_MAX];
+    char index_path[CATALOG_PATH_MAX];
+    catalog_default_path(catalog_path, sizeof(catalog_path));
+    search_index_default_path(index_path, sizeof(index_path));
+
+    // Catch up on anything that changed while nothing was watching
+    catalog cat;
+    catalog_init(&cat);
+    if (!catalog_sync(&cat, root, catalog_path)) {
+        fprintf(stderr, "Error reading the vault catalog\n");
+        catalog_free(&cat);
+        return 0;
+    }
+    if (catalog_restat(&cat) > 0) {
+        catalog_save(&cat, catalog_path);
+    }
+    search_index_update(&cat, index_path);
+
+    vault_watcher watcher;
+    int using_inotify = watcher_init(&watcher, root);
+    report(&watcher, NULL, 0, ctx);
+
+    while (!*stop) {
+        struct pollfd pfd = {watcher.fd, POLLIN, 0};
+        int ready = poll(&pfd, using_inotify ? 1 : 0, watcher_timeout_ms(&watcher));
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (ready > 0) {
+            watcher_read(&watcher);
+        }
+        if (!watcher_due(&watcher)) {
+            continue;
+        }
+
+        watch_batch batch;
+        long long start = monotonic_ms();
+        if (!watcher_apply(&watcher, &cat, catalog_path, index_path, &batch)) {
+            fprintf(stderr, "Error applying vault changes\n");
+        } else if (batch.dirs_rescanned > 0 || batch.notes_changed > 0) {
+            report(&watcher, &batch, monotonic_ms() - start, ctx);
+        }
+    }
+
+    watcher_free(&watcher);
+    catalog_free(&cat);
+    return 1;
+}
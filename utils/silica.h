@@ -0,0 +1,118 @@
+// silica.h
+#ifndef SILICA_H
+#define SILICA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+#include "catalog.h"
+#include "tag_index.h"
+#include "time_index.h"
+#include "clean_batch.h"
+#include "link_rewrite.h"
+#include "watch.h"
+
+#define SILICA_CONFIG_FILE "obs/.config"
+#define SILICA_CONFIG_VALUE_MAX 128
+#define SILICA_CONFIG_LINE_MAX 256
+
+// Indexes silica_update_indexes() can bring up to date
+#define SILICA_INDEX_TAGS 1
+#define SILICA_INDEX_TIMES 2
+#define SILICA_INDEX_LINKS 4
+#define SILICA_INDEX_DUPES 8
+#define SILICA_INDEX_RELATED 16
+#define SILICA_INDEX_RESCAN 32      // Look at every note, for edits that left their directory's mtime alone
+
+// The settings in ~/obs/.config
+typedef struct {
+    char target_dir[SILICA_CONFIG_VALUE_MAX];
+    char api_key[SILICA_CONFIG_VALUE_MAX];
+    int auto_name;              // Name new notes with the local engine once the editor closes
+} silica_config;
+
+// The vault as the catalog last saw it, brought up to date when opened
+typedef struct {
+    catalog cat;
+    size_t dir_count;           // Directories below the root
+    size_t note_count;
+} silica_vault;
+
+// One directory or note of the vault
+typedef struct {
+    const char *name;           // Last component of the path
+    const char *path;           // Relative to the vault root
+    int dir;                    // Catalog directory index to list its children, -1 for a note
+    long long mtime;            // Nanoseconds since the epoch
+    long long size;             // Bytes, 0 for a directory
+} silica_item;
+
+// One note a query returned
+typedef struct {
+    char *path;                 // Relative to the vault root, or the text of a link that names no note
+    long long time;             // Nanoseconds since the epoch, for listings by time
+    float similarity;           // For related and near-duplicate notes
+    int resolved;               // 0 for a link that names no note
+} silica_hit;
+
+// The notes a query returned, in order, the paths belong to the list
+typedef struct {
+    silica_hit *hits;
+    size_t count;
+    size_t capacity;
+} silica_hits;
+
+// Near-duplicate notes, the first is the one the others are compared with
+typedef struct {
+    char bucket[CATALOG_BUCKET_MAX];
+    silica_hits notes;
+} silica_cluster;
+
+// How a batch clean went
+typedef struct {
+    size_t jobs;                // Timestamp-named notes found
+    int renamed;                // -1 when the naming workers could not start
+    size_t failed;
+    size_t cancelled;
+    long long elapsed_ms;
+    link_rewrite_stats links;
+    int links_pending;          // The link rewrite stopped, the next clean finishes it
+} silica_clean_result;
+
+// Called once with a NULL job before the first note is named, then as each note completes
+typedef void (*silica_clean_report)(const clean_job *job, size_t done, size_t total, void *ctx);
+
+// Called once with a NULL batch when watching starts, then after every batch that changed something
+typedef void (*silica_watch_report)(const vault_watcher *watcher, const watch_batch *batch, long long elapsed_ms,
+                                    void *ctx);
+
+// Function declarations
+void silica_config_path(char *buf, size_t size);
+int silica_config_load(silica_config *config);
+int silica_config_save(const silica_config *config);
+int silica_vault_open(silica_vault *vault, const char *root);
+int silica_vault_load(silica_vault *vault, const char *root);
+void silica_vault_close(silica_vault *vault);
+size_t silica_vault_children(const silica_vault *vault, int dir, silica_item **items);
+int silica_note_directory(const silica_config *config, const char *cwd, char *dir, size_t size);
+int silica_create_note(const silica_config *config, const char *cwd, char *path, size_t size);
+void silica_hits_free(silica_hits *hits);
+void silica_clusters_free(silica_cluster *clusters, size_t count);
+int silica_update_indexes(const char *root, int indexes);
+int silica_list_tagged(const char *root, const tag_term *terms, size_t term_count, silica_hits *hits);
+int silica_list_recent(const char *root, const tag_term *terms, size_t term_count, time_field field, long recent,
+                       int64_t since, int64_t until, silica_hits *hits);
+int silica_links(const char *root, const char *note, int backlinks, silica_hits *hits);
+int silica_related(const char *root, const char *note, const char *bucket, int same_repo, size_t count,
+                   silica_hits *hits);
+int silica_find_duplicates(const char *root, const char *subdir, double threshold, silica_cluster **clusters,
+                           size_t *count);
+int silica_grep(const char *root, const char *query, const char *bucket, size_t limit, silica_hits *hits);
+int silica_snippet(const char *root, const char *path, const char *query, char *line, size_t size);
+int silica_finish_renames(const char *root, link_rewrite_stats *stats);
+int silica_rename_note(const char *root, const char *path, const char *new_path, link_rewrite_stats *stats);
+int silica_clean_all(const char *root, const char *subdir, clean_batch_options *options, int use_cache,
+                     silica_clean_report report, void *ctx, silica_clean_result *result);
+int silica_watch(const char *root, const volatile sig_atomic_t *stop, silica_watch_report report, void *ctx);
+
+#endif // SILICA_H
@@ -0,0 +1,1053 @@
+// tag_index.c
+#include "tag_index.h"
+#include "hash.h"
+#include "search_index.h"
+#include "markdown.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TAG_MAGIC "SLCTAG1"
+#define TAG_VERSION 1
+#define NO_NOTE UINT32_MAX
+#define NO_ENTRY SIZE_MAX
+#define TAG_COMPACT_MIN 64      // Tombstones tolerated before IDs are reassigned
+
+typedef struct {
+    char *text;
+    uint32_t length;
+    uint64_t hash;
+} build_string;
+
+// A key=value pair and the notes carrying it, in ascending note ID order
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+    uint32_t *notes;
+    size_t count;
+    size_t capacity;
+} build_attr;
+
+typedef struct {
+    const char *path;           // Borrowed from the catalog, NULL for tombstones
+    uint32_t flags;
+    int64_t mtime;
+    int64_t size;
+    size_t first_attr;          // Into the builder's note attribute column
+    uint32_t attr_count;
+} build_note;
+
+// Dictionary, attributes and notes of the index being written
+typedef struct {
+    build_string *strings;
+    size_t string_count;
+    size_t string_capacity;
+    uint32_t *string_slots;     // Open addressing tables of index + 1
+    size_t string_slot_count;
+    build_attr *attrs;
+    size_t attr_count;
+    size_t attr_capacity;
+    uint32_t *attr_slots;
+    size_t attr_slot_count;
+    build_note *notes;
+    size_t note_count;
+    uint32_t *note_attrs;
+    size_t note_attr_count;
+    size_t note_attr_capacity;
+} tag_builder;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} byte_buffer;
+
+typedef struct {
+    const char *path;
+    uint32_t note;
+} note_lookup;
+
+// What happens to one note ID during an update
+typedef struct {
+    uint32_t old;               // ID in the previous index, NO_NOTE for new notes
+    size_t entry;               // Catalog entry, NO_ENTRY once deleted
+    int reuse;                  // Unchanged since the previous index, its attributes are copied over
+} note_plan;
+
+void tag_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", TAG_INDEX_FILE);
+}
+
+static int buffer_reserve(byte_buffer *buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->size + extra) {
+        capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        perror("realloc");
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int buffer_append(byte_buffer *buffer, const void *data, size_t size) {
+    if (!buffer_reserve(buffer, size)) {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 1;
+}
+
+// Function to zero-pad the buffer so the next section starts on an 8 byte boundary
+static int buffer_align(byte_buffer *buffer) {
+    static const unsigned char zeros[8];
+    return buffer_append(buffer, zeros, (8 - buffer->size % 8) % 8);
+}
+
+static void builder_free(tag_builder *builder) {
+    for (size_t i = 0; i < builder->string_count; i++) {
+        free(builder->strings[i].text);
+    }
+    for (size_t i = 0; i < builder->attr_count; i++) {
+        free(builder->attrs[i].notes);
+    }
+    free(builder->strings);
+    free(builder->string_slots);
+    free(builder->attrs);
+    free(builder->attr_slots);
+    free(builder->notes);
+    free(builder->note_attrs);
+    memset(builder, 0, sizeof(*builder));
+}
+
+static uint64_t attr_hash(uint32_t key, uint32_t value) {
+    uint64_t pair = (uint64_t)key << 32 | value;
+    return hash_xxh64(&pair, sizeof(pair), 0);
+}
+
+static int rehash_strings(tag_builder *builder, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return 0;
+    }
+    for (size_t i = 0; i < builder->string_count; i++) {
+        size_t slot = builder->strings[i].hash & (slot_count - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    free(builder->string_slots);
+    builder->string_slots = slots;
+    builder->string_slot_count = slot_count;
+    return 1;
+}
+
+static int rehash_attrs(tag_builder *builder, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) {
+        perror("calloc");
+        return 0;
+    }
+    for (size_t i = 0; i < builder->attr_count; i++) {
+        size_t slot = attr_hash(builder->attrs[i].key, builder->attrs[i].value) & (slot_count - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    free(builder->attr_slots);
+    builder->attr_slots = slots;
+    builder->attr_slot_count = slot_count;
+    return 1;
+}
+
+// Function to find or add a dictionary string, returns its builder index or -1
+static long intern_string(tag_builder *builder, const char *text, size_t length) {
+    if ((builder->string_count + 1) * 2 > builder->string_slot_count &&
+        !rehash_strings(builder, builder->string_slot_count ? builder->string_slot_count * 2 : 1024)) {
+        return -1;
+    }
+
+    uint64_t hash = hash_xxh64(text, length, 0);
+    size_t slot = hash & (builder->string_slot_count - 1);
+    while (builder->string_slots[slot]) {
+        build_string *existing = &builder->strings[builder->string_slots[slot] - 1];
+        if (existing->hash == hash && existing->length == length && memcmp(existing->text, text, length) == 0) {
+            return builder->string_slots[slot] - 1;
+        }
+        slot = (slot + 1) & (builder->string_slot_count - 1);
+    }
+
+    if (builder->string_count == builder->string_capacity) {
+        size_t capacity = builder->string_capacity ? builder->string_capacity * 2 : 256;
+        build_string *grown = realloc(builder->strings, capacity * sizeof(build_string));
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        builder->strings = grown;
+        builder->string_capacity = capacity;
+    }
+
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    build_string *added = &builder->strings[builder->string_count];
+    added->text = copy;
+    added->length = (uint32_t)length;
+    added->hash = hash;
+    builder->string_slots[slot] = (uint32_t)++builder->string_count;
+    return (long)builder->string_count - 1;
+}
+
+static long intern_attr(tag_builder *builder, uint32_t key, uint32_t value) {
+    if ((builder->attr_count + 1) * 2 > builder->attr_slot_count &&
+        !rehash_attrs(builder, builder->attr_slot_count ? builder->attr_slot_count * 2 : 1024)) {
+        return -1;
+    }
+
+    size_t slot = attr_hash(key, value) & (builder->attr_slot_count - 1);
+    while (builder->attr_slots[slot]) {
+        build_attr *existing = &builder->attrs[builder->attr_slots[slot] - 1];
+        if (existing->key == key && existing->value == value) {
+            return builder->attr_slots[slot] - 1;
+        }
+        slot = (slot + 1) & (builder->attr_slot_count - 1);
+    }
+
+    if (builder->attr_count == builder->attr_capacity) {
+        size_t capacity = builder->attr_capacity ? builder->attr_capacity * 2 : 256;
+        build_attr *grown = realloc(builder->attrs, capacity * sizeof(build_attr));
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        builder->attrs = grown;
+        builder->attr_capacity = capacity;
+    }
+
+    build_attr *added = &builder->attrs[builder->attr_count];
+    memset(added, 0, sizeof(*added));
+    added->key = key;
+    added->value = value;
+    builder->attr_slots[slot] = (uint32_t)++builder->attr_count;
+    return (long)builder->attr_count - 1;
+}
+
+// Function to record key=value for the note currently being built, the newest note in the builder
+static int builder_add(tag_builder *builder, const char *key, size_t key_length, const char *value,
+                       size_t value_length) {
+    long key_index = intern_string(builder, key, key_length);
+    long value_index = key_index < 0 ? -1 : intern_string(builder, value, value_length);
+    long index = value_index < 0 ? -1 : intern_attr(builder, (uint32_t)key_index, (uint32_t)value_index);
+    if (index < 0) {
+        return 0;
+    }
+
+    uint32_t note = (uint32_t)builder->note_count - 1;
+    build_attr *attr = &builder->attrs[index];
+    if (attr->count > 0 && attr->notes[attr->count - 1] == note) {
+        return 1;  // Already recorded for this note
+    }
+    if (attr->count == attr->capacity) {
+        size_t capacity = attr->capacity ? attr->capacity * 2 : 4;
+        uint32_t *grown = realloc(attr->notes, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        attr->notes = grown;
+        attr->capacity = capacity;
+    }
+    attr->notes[attr->count++] = note;
+
+    if (builder->note_attr_count == builder->note_attr_capacity) {
+        size_t capacity = builder->note_attr_capacity ? builder->note_attr_capacity * 2 : 1024;
+        uint32_t *grown = realloc(builder->note_attrs, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        builder->note_attrs = grown;
+        builder->note_attr_capacity = capacity;
+    }
+    builder->note_attrs[builder->note_attr_count++] = (uint32_t)index;
+    builder->notes[note].attr_count++;
+    return 1;
+}
+
+// Function to normalise a frontmatter value or tag and record it: trimmed, unquoted and lowercased
+static int add_value(tag_builder *builder, const char *key, size_t key_length, const char *value, size_t length) {
+    while (length > 0 && isspace((unsigned char)*value)) {
+        value++;
+        length--;
+    }
+    while (length > 0 && isspace((unsigned char)value[length - 1])) {
+        length--;
+    }
+    if (length >= 2 && (value[0] == '"' || value[0] == '\'') && value[length - 1] == value[0]) {
+        value++;
+        length -= 2;
+    }
+    int is_tag = key_length == strlen(TAG_KEY) && memcmp(key, TAG_KEY, key_length) == 0;
+    if (is_tag && length > 0 && value[0] == '#') {
+        value++;
+        length--;
+    }
+    if (length == 0) {
+        return 1;
+    }
+
+    char lowered[TAG_VALUE_MAX];
+    if (length >= sizeof(lowered)) {
+        length = sizeof(lowered) - 1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        lowered[i] = (char)tolower((unsigned char)value[i]);
+    }
+    return builder_add(builder, key, key_length, lowered, length);
+}
+
+// Function to record a frontmatter value, splitting flow lists and the space separated tags: shorthand
+static int add_values(tag_builder *builder, const char *key, size_t key_length, const char *value, size_t length) {
+    int is_tag = key_length == strlen(TAG_KEY) && memcmp(key, TAG_KEY, key_length) == 0;
+    int list = length >= 2 && value[0] == '[' && value[length - 1] == ']';
+    if (list) {
+        value++;
+        length -= 2;
+    } else if (!is_tag) {
+        return add_value(builder, key, key_length, value, length);
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i <= length; i++) {
+        if (i == length || value[i] == ',' || (is_tag && value[i] == ' ')) {
+            if (!add_value(builder, key, key_length, value + start, i - start)) {
+                return 0;
+            }
+            start = i + 1;
+        }
+    }
+    return 1;
+}
+
+static size_t line_end(const char *text, size_t len, size_t pos) {
+    const char *newline = memchr(text + pos, '\n', len - pos);
+    return newline ? (size_t)(newline - text) : len;
+}
+
+// Function to test whether a line holds only a frontmatter fence such as "---"
+static int is_fence(const char *line, size_t length, const char *fence) {
+    size_t fence_length = strlen(fence);
+    if (length < fence_length || memcmp(line, fence, fence_length) != 0) {
+        return 0;
+    }
+    for (size_t i = fence_length; i < length; i++) {
+        if (!isspace((unsigned char)line[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to read the top-level keys of a YAML frontmatter block, returns the offset where the body starts
+static size_t parse_frontmatter(tag_builder *builder, const char *text, size_t len, int *ok) {
+    size_t end = line_end(text, len, 0);
+    if (!is_fence(text, end, "---")) {
+        return 0;
+    }
+
+    char key[TAG_KEY_MAX];
+    size_t key_length = 0;
+    size_t pos = end + 1;
+    while (pos < len && *ok) {
+        end = line_end(text, len, pos);
+        const char *line = text + pos;
+        size_t length = end - pos;
+        pos = end + 1;
+
+        if (is_fence(line, length, "---") || is_fence(line, length, "...")) {
+            return pos < len ? pos : len;
+        }
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+
+        if (isspace((unsigned char)line[0]) || line[0] == '-') {
+            // Block list item of the last key
+            size_t i = 0;
+            while (i < length && isspace((unsigned char)line[i])) {
+                i++;
+            }
+            if (key_length > 0 && i < length && line[i] == '-' && (i + 1 == length || line[i + 1] == ' ')) {
+                *ok = add_value(builder, key, key_length, line + i + 1, length - i - 1);
+            }
+            continue;
+        }
+
+        const char *colon = memchr(line, ':', length);
+        key_length = 0;
+        if (colon == NULL || (size_t)(colon - line) >= sizeof(key)) {
+            continue;
+        }
+        size_t name_length = (size_t)(colon - line);
+        while (name_length > 0 && isspace((unsigned char)line[name_length - 1])) {
+            name_length--;
+        }
+        for (size_t i = 0; i < name_length; i++) {
+            key[i] = (char)tolower((unsigned char)line[i]);
+        }
+        key_length = name_length;
+        if (key_length == 4 && memcmp(key, "tags", 4) == 0) {
+            key_length = strlen(TAG_KEY);  // tags: and tag: are the same as inline #tags
+        }
+        if (key_length == 0) {
+            continue;
+        }
+
+        const char *value = colon + 1;
+        size_t value_length = length - (size_t)(value - line);
+        size_t i = 0;
+        while (i < value_length && isspace((unsigned char)value[i])) {
+            i++;
+        }
+        if (i < value_length) {
+            *ok = add_values(builder, key, key_length, value + i, value_length - i);
+        }
+    }
+    return 0;  // Never closed, so it was not frontmatter
+}
+
+// Function to collect inline #tags from the body, skipping code fences and code spans
+static int parse_inline_tags(tag_builder *builder, const char *text, size_t len, size_t pos) {
+    markdown_scanner scanner;
+    markdown_token token;
+    markdown_scanner_init(&scanner, text + pos, len - pos);
+    while (markdown_scanner_next(&scanner, &token)) {
+        if (token.type == MARKDOWN_TAG &&
+            !add_value(builder, TAG_KEY, strlen(TAG_KEY), text + pos + token.start, token.length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Function to read a note and record its frontmatter keys and tags
+static int index_note(tag_builder *builder, const char *root, const char *relative_path) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, relative_path);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;  // Vanished since the catalog was taken, the next update drops it
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    int ok = 1;
+    size_t body = parse_frontmatter(builder, text, size, &ok);
+    ok = ok && parse_inline_tags(builder, text, size, body);
+    munmap((void *)text, size);
+    return ok;
+}
+
+// Function to copy the attributes of an unchanged note over from the previous index without reading it
+static int reuse_note(tag_builder *builder, const tag_index *old, uint32_t note) {
+    const tag_note *previous = &old->notes[note];
+    for (uint32_t i = 0; i < previous->attr_count; i++) {
+        const tag_attr *attr = &old->attrs[old->note_attrs[previous->attrs_offset + i]];
+        const tag_string *key = &old->strings[attr->key];
+        const tag_string *value = &old->strings[attr->value];
+        if (!builder_add(builder, old->bytes + key->offset, key->length, old->bytes + value->offset, value->length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static const tag_builder *sort_builder;
+static const uint32_t *sort_rank;
+
+static int compare_string_indices(const void *a, const void *b) {
+    const build_string *x = &sort_builder->strings[*(const uint32_t *)a];
+    const build_string *y = &sort_builder->strings[*(const uint32_t *)b];
+    size_t len = x->length < y->length ? x->length : y->length;
+    int cmp = memcmp(x->text, y->text, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (x->length > y->length) - (x->length < y->length);
+}
+
+static int compare_attr_indices(const void *a, const void *b) {
+    const build_attr *x = &sort_builder->attrs[*(const uint32_t *)a];
+    const build_attr *y = &sort_builder->attrs[*(const uint32_t *)b];
+    uint32_t xk = sort_rank[x->key], yk = sort_rank[y->key];
+    if (xk != yk) {
+        return (xk > yk) - (xk < yk);
+    }
+    uint32_t xv = sort_rank[x->value], yv = sort_rank[y->value];
+    return (xv > yv) - (xv < yv);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Function to serialise the builder to index_path through a temporary file. Strings and attributes
+// are renumbered into sorted order, each attribute's notes are stored as whichever container is smaller.
+static int write_index(tag_builder *builder, const char *index_path) {
+    uint32_t note_count = (uint32_t)builder->note_count;
+    uint32_t *string_order = malloc((builder->string_count + 1) * sizeof(uint32_t));
+    uint32_t *string_rank = malloc((builder->string_count + 1) * sizeof(uint32_t));
+    uint32_t *attr_order = malloc((builder->attr_count + 1) * sizeof(uint32_t));
+    uint32_t *attr_rank = malloc((builder->attr_count + 1) * sizeof(uint32_t));
+    byte_buffer out = {0}, containers = {0}, bytes = {0};
+    int ok = string_order && string_rank && attr_order && attr_rank;
+
+    for (size_t i = 0; ok && i < builder->string_count; i++) {
+        string_order[i] = (uint32_t)i;
+    }
+    for (size_t i = 0; ok && i < builder->attr_count; i++) {
+        attr_order[i] = (uint32_t)i;
+    }
+    if (ok) {
+        sort_builder = builder;
+        qsort(string_order, builder->string_count, sizeof(uint32_t), compare_string_indices);
+        for (size_t i = 0; i < builder->string_count; i++) {
+            string_rank[string_order[i]] = (uint32_t)i;
+        }
+        sort_rank = string_rank;
+        qsort(attr_order, builder->attr_count, sizeof(uint32_t), compare_attr_indices);
+        for (size_t i = 0; i < builder->attr_count; i++) {
+            attr_rank[attr_order[i]] = (uint32_t)i;
+        }
+    }
+
+    tag_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TAG_MAGIC, sizeof(TAG_MAGIC));
+    header.version = TAG_VERSION;
+    header.note_count = note_count;
+    header.string_count = (uint32_t)builder->string_count;
+    header.attr_count = (uint32_t)builder->attr_count;
+    ok = ok && buffer_append(&out, &header, sizeof(header));
+
+    header.notes_offset = out.size;
+    for (uint32_t i = 0; ok && i < note_count; i++) {
+        const build_note *source = &builder->notes[i];
+        tag_note note;
+        memset(&note, 0, sizeof(note));
+        note.flags = source->flags;
+        note.mtime = source->mtime;
+        note.size = source->size;
+        note.attrs_offset = source->first_attr;
+        note.attr_count = source->attr_count;
+        if (source->path) {
+            note.path_offset = bytes.size;
+            note.path_length = (uint32_t)strlen(source->path);
+            ok = buffer_append(&bytes, source->path, note.path_length + 1);
+            header.live_count++;
+        }
+        ok = ok && buffer_append(&out, &note, sizeof(note));
+    }
+
+    // The per-note column of attribute IDs, sorted within each note
+    header.note_attrs_offset = out.size;
+    for (size_t i = 0; ok && i < builder->note_attr_count; i++) {
+        builder->note_attrs[i] = attr_rank[builder->note_attrs[i]];
+    }
+    for (uint32_t i = 0; ok && i < note_count; i++) {
+        qsort(builder->note_attrs + builder->notes[i].first_attr, builder->notes[i].attr_count, sizeof(uint32_t),
+              compare_u32);
+    }
+    ok = ok && buffer_append(&out, builder->note_attrs, builder->note_attr_count * sizeof(uint32_t)) &&
+         buffer_align(&out);
+
+    header.strings_offset = out.size;
+    for (size_t i = 0; ok && i < builder->string_count; i++) {
+        const build_string *source = &builder->strings[string_order[i]];
+        tag_string string;
+        memset(&string, 0, sizeof(string));
+        string.offset = bytes.size;
+        string.length = source->length;
+        ok = buffer_append(&bytes, source->text, source->length + 1) && buffer_append(&out, &string, sizeof(string));
+    }
+
+    header.attrs_offset = out.size;
+    size_t word_count = (note_count + 63) / 64;
+    for (size_t i = 0; ok && i < builder->attr_count; i++) {
+        const build_attr *source = &builder->attrs[attr_order[i]];
+        tag_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.key = string_rank[source->key];
+        attr.value = string_rank[source->value];
+        attr.note_count = (uint32_t)source->count;
+        attr.data_offset = containers.size;
+
+        if (source->count * sizeof(uint32_t) > word_count * sizeof(uint64_t)) {
+            attr.container = TAG_CONTAINER_BITMAP;
+            uint64_t *words = calloc(word_count, sizeof(uint64_t));
+            ok = words != NULL;
+            for (size_t n = 0; ok && n < source->count; n++) {
+                words[source->notes[n] / 64] |= 1ULL << (source->notes[n] % 64);
+            }
+            ok = ok && buffer_append(&containers, words, word_count * sizeof(uint64_t));
+            free(words);
+        } else {
+            attr.container = TAG_CONTAINER_ARRAY;
+            ok = buffer_append(&containers, source->notes, source->count * sizeof(uint32_t)) &&
+                 buffer_align(&containers);
+        }
+        ok = ok && buffer_append(&out, &attr, sizeof(attr));
+    }
+
+    header.containers_offset = out.size;
+    header.bytes_offset = header.containers_offset + containers.size;
+    header.total_size = header.bytes_offset + bytes.size;
+    if (ok) {
+        memcpy(out.data, &header, sizeof(header));
+    }
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        perror("Failed to open tag index");
+        ok = 0;
+    }
+    if (file) {
+        ok = fwrite(out.data, 1, out.size, file) == out.size &&
+             fwrite(containers.data, 1, containers.size, file) == containers.size &&
+             fwrite(bytes.data, 1, bytes.size, file) == bytes.size;
+        if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+            perror("Failed to write tag index");
+            unlink(temp_path);
+            ok = 0;
+        }
+    }
+
+    free(string_order);
+    free(string_rank);
+    free(attr_order);
+    free(attr_rank);
+    free(out.data);
+    free(containers.data);
+    free(bytes.data);
+    return ok;
+}
+
+static int compare_note_lookup(const void *a, const void *b) {
+    return strcmp(((const note_lookup *)a)->path, ((const note_lookup *)b)->path);
+}
+
+// Function to lay out the note IDs of the new index. Surviving notes keep their ID, deleted ones leave a
+// tombstone and new ones are appended, unless tombstones outnumber live notes and the IDs are compacted.
+// Returns the number of planned IDs and sets *changes to how many notes need reading or dropping.
+static size_t plan_notes(const catalog *cat, const tag_index *old, int have_old, note_plan *plan, size_t *changes) {
+    uint32_t old_count = have_old ? old->header->note_count : 0;
+    note_lookup *lookup = malloc((old_count + 1) * sizeof(note_lookup));
+    if (lookup == NULL) {
+        perror("malloc");
+        return SIZE_MAX;
+    }
+
+    size_t live = 0, planned = 0;
+    for (uint32_t i = 0; i < old_count; i++) {
+        plan[i].old = i;
+        plan[i].entry = NO_ENTRY;
+        plan[i].reuse = 0;
+        if (!(old->notes[i].flags & TAG_NOTE_TOMBSTONE)) {
+            lookup[live].path = tag_note_path(old, i, NULL);
+            lookup[live++].note = i;
+        }
+    }
+    qsort(lookup, live, sizeof(note_lookup), compare_note_lookup);
+    planned = old_count;
+
+    *changes = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        const catalog_entry *entry = &cat->entries[i];
+        if (!search_is_note(entry->path)) {
+            continue;
+        }
+        note_lookup key = {entry->path, 0};
+        note_lookup *found = live ? bsearch(&key, lookup, live, sizeof(note_lookup), compare_note_lookup) : NULL;
+        note_plan *slot = found ? &plan[found->note] : &plan[planned++];
+        if (!found) {
+            slot->old = NO_NOTE;
+        }
+        slot->entry = i;
+        slot->reuse = found && old->notes[found->note].mtime == entry->mtime &&
+                      old->notes[found->note].size == entry->size;
+        *changes += !slot->reuse;
+    }
+
+    size_t tombstones = 0;
+    for (size_t i = 0; i < planned; i++) {
+        if (plan[i].entry == NO_ENTRY) {
+            tombstones++;
+            *changes += plan[i].old != NO_NOTE && !(old->notes[plan[i].old].flags & TAG_NOTE_TOMBSTONE);
+        }
+    }
+    if (tombstones >= TAG_COMPACT_MIN && tombstones > planned - tombstones) {
+        size_t kept = 0;
+        for (size_t i = 0; i < planned; i++) {
+            if (plan[i].entry != NO_ENTRY) {
+                plan[kept++] = plan[i];
+            }
+        }
+        planned = kept;
+        *changes += 1;
+    }
+
+    free(lookup);
+    return planned;
+}
+
+// Function to bring the index in line with the catalog, reading only notes whose mtime or size changed.
+// Returns the number of notes (re)read, or -1 on failure.
+int tag_index_update(const catalog *cat, const char *index_path) {
+    tag_index old;
+    int have_old = tag_index_open(&old, index_path);
+    size_t old_count = have_old ? old.header->note_count : 0;
+
+    note_plan *plan = malloc((old_count + cat->entry_count + 1) * sizeof(note_plan));
+    if (plan == NULL) {
+        perror("malloc");
+        if (have_old) {
+            tag_index_close(&old);
+        }
+        return -1;
+    }
+
+    size_t changes = 0;
+    size_t planned = plan_notes(cat, &old, have_old, plan, &changes);
+    int result = 0;
+    if (planned == SIZE_MAX) {
+        result = -1;
+    } else if (!have_old || changes > 0) {
+        tag_builder builder;
+        memset(&builder, 0, sizeof(builder));
+        builder.notes = calloc(planned + 1, sizeof(build_note));
+        int ok = builder.notes != NULL;
+
+        int read_count = 0;
+        for (size_t i = 0; ok && i < planned; i++) {
+            build_note *note = &builder.notes[builder.note_count++];
+            note->first_attr = builder.note_attr_count;
+            if (plan[i].entry == NO_ENTRY) {
+                note->flags = TAG_NOTE_TOMBSTONE;
+                continue;
+            }
+
+            const catalog_entry *entry = &cat->entries[plan[i].entry];
+            note->path = entry->path;
+            note->mtime = entry->mtime;
+            note->size = entry->size;
+            if (plan[i].reuse) {
+                ok = reuse_note(&builder, &old, plan[i].old);
+            } else {
+                ok = index_note(&builder, cat->root, entry->path);
+                read_count++;
+            }
+        }
+        ok = ok && write_index(&builder, index_path);
+
+        builder_free(&builder);
+        result = ok ? read_count : -1;
+    }
+
+    if (have_old) {
+        tag_index_close(&old);
+    }
+    free(plan);
+    return result;
+}
+
+// Function to map an index file and validate its layout
+// Function to check that a string of the index lies inside the byte section and is terminated there
+static int string_fits(const unsigned char *data, const tag_header *header, uint64_t offset, uint64_t length) {
+    uint64_t size = header->total_size - header->bytes_offset;
+    return offset < size && length < size - offset && data[header->bytes_offset + offset + length] == '\0';
+}
+
+// Function to check every note's path and attribute column, every dictionary string and every attribute's
+// container against their sections, so a truncated or corrupt index is rejected on open instead of read past
+// its end by a query
+static int sections_fit(const unsigned char *data, const tag_header *header) {
+    const tag_note *notes = (const tag_note *)(data + header->notes_offset);
+    const uint32_t *note_attrs = (const uint32_t *)(data + header->note_attrs_offset);
+    uint64_t note_attr_count = (header->strings_offset - header->note_attrs_offset) / sizeof(uint32_t);
+    for (uint32_t i = 0; i < header->note_count; i++) {
+        const tag_note *note = &notes[i];
+        if (note->attrs_offset > note_attr_count || note->attr_count > note_attr_count - note->attrs_offset ||
+            (!(note->flags & TAG_NOTE_TOMBSTONE) && !string_fits(data, header, note->path_offset, note->path_length))) {
+            return 0;
+        }
+        for (uint32_t a = 0; a < note->attr_count; a++) {
+            if (note_attrs[note->attrs_offset + a] >= header->attr_count) {
+                return 0;
+            }
+        }
+    }
+
+    const tag_string *strings = (const tag_string *)(data + header->strings_offset);
+    for (uint32_t i = 0; i < header->string_count; i++) {
+        if (!string_fits(data, header, strings[i].offset, strings[i].length)) {
+            return 0;
+        }
+    }
+
+    const tag_attr *attrs = (const tag_attr *)(data + header->attrs_offset);
+    uint64_t containers_size = header->bytes_offset - header->containers_offset;
+    uint64_t bitmap_size = (uint64_t)(header->note_count + 63) / 64 * sizeof(uint64_t);
+    for (uint32_t i = 0; i < header->attr_count; i++) {
+        const tag_attr *attr = &attrs[i];
+        uint64_t size = attr->container == TAG_CONTAINER_BITMAP ? bitmap_size
+                                                                : (uint64_t)attr->note_count * sizeof(uint32_t);
+        if (attr->key >= header->string_count || attr->value >= header->string_count ||
+            attr->data_offset > containers_size || size > containers_size - attr->data_offset) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int tag_index_open(tag_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tag_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const tag_header *header = data;
+    if (memcmp(header->magic, TAG_MAGIC, sizeof(TAG_MAGIC)) != 0 || header->version != TAG_VERSION ||
+        header->total_size != (uint64_t)st.st_size || header->notes_offset != sizeof(tag_header) ||
+        header->note_attrs_offset != header->notes_offset + (uint64_t)header->note_count * sizeof(tag_note) ||
+        header->attrs_offset != header->strings_offset + (uint64_t)header->string_count * sizeof(tag_string) ||
+        header->containers_offset != header->attrs_offset + (uint64_t)header->attr_count * sizeof(tag_attr) ||
+        header->strings_offset < header->note_attrs_offset || header->bytes_offset < header->containers_offset ||
+        header->bytes_offset > header->total_size || !sections_fit(data, header)) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->notes = (const tag_note *)(index->data + header->notes_offset);
+    index->note_attrs = (const uint32_t *)(index->data + header->note_attrs_offset);
+    index->strings = (const tag_string *)(index->data + header->strings_offset);
+    index->attrs = (const tag_attr *)(index->data + header->attrs_offset);
+    index->containers = index->data + header->containers_offset;
+    index->bytes = (const char *)(index->data + header->bytes_offset);
+    return 1;
+}
+
+void tag_index_close(tag_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+const char *tag_note_path(const tag_index *index, uint32_t note, size_t *len) {
+    if (len) {
+        *len = index->notes[note].path_length;
+    }
+    return index->bytes + index->notes[note].path_offset;
+}
+
+// Function to look a lowercased string up in the dictionary, returns its ID or UINT32_MAX
+static uint32_t find_string(const tag_index *index, const char *text, size_t length) {
+    size_t low = 0, high = index->header->string_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const tag_string *string = &index->strings[mid];
+        size_t common = string->length < length ? string->length : length;
+        int cmp = memcmp(index->bytes + string->offset, text, common);
+        if (cmp == 0) {
+            cmp = (string->length > length) - (string->length < length);
+        }
+        if (cmp == 0) {
+            return (uint32_t)mid;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Function to find the first attribute at or after (key, value)
+static size_t lower_bound_attr(const tag_index *index, uint32_t key, uint32_t value) {
+    size_t low = 0, high = index->header->attr_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const tag_attr *attr = &index->attrs[mid];
+        if (attr->key < key || (attr->key == key && attr->value < value)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static void or_container(const tag_index *index, const tag_attr *attr, uint64_t *bits, size_t word_count) {
+    const unsigned char *data = index->containers + attr->data_offset;
+    if (attr->container == TAG_CONTAINER_BITMAP) {
+        const uint64_t *words = (const uint64_t *)data;
+        for (size_t w = 0; w < word_count; w++) {
+            bits[w] |= words[w];
+        }
+    } else {
+        const uint32_t *notes = (const uint32_t *)data;
+        for (uint32_t n = 0; n < attr->note_count; n++) {
+            if (notes[n] / 64 < word_count) {  // An ID past the notes could only come from a corrupt file
+                bits[notes[n] / 64] |= 1ULL << (notes[n] % 64);
+            }
+        }
+    }
+}
+
+static size_t lowercase_copy(char *out, size_t size, const char *text) {
+    size_t length = 0;
+    while (text[length] && length + 1 < size) {
+        out[length] = (char)tolower((unsigned char)text[length]);
+        length++;
+    }
+    out[length] = '\0';
+    return length;
+}
+
+// Function to set the bit of every note matching one term
+static void term_bits(const tag_index *index, const tag_term *term, uint64_t *bits, size_t word_count) {
+    char key[TAG_KEY_MAX], value[TAG_VALUE_MAX];
+    size_t key_length = lowercase_copy(key, sizeof(key), term->key);
+    if (key_length == 4 && memcmp(key, "tags", 4) == 0) {
+        key_length = strlen(TAG_KEY);
+    }
+    uint32_t key_id = find_string(index, key, key_length);
+    if (key_id == UINT32_MAX) {
+        return;
+    }
+
+    if (term->value) {
+        int is_tag = key_length == strlen(TAG_KEY) && memcmp(key, TAG_KEY, key_length) == 0;
+        const char *text = is_tag && term->value[0] == '#' ? term->value + 1 : term->value;
+        uint32_t value_id = find_string(index, value, lowercase_copy(value, sizeof(value), text));
+        size_t i = value_id == UINT32_MAX ? index->header->attr_count : lower_bound_attr(index, key_id, value_id);
+        if (i < index->header->attr_count && index->attrs[i].key == key_id && index->attrs[i].value == value_id) {
+            or_container(index, &index->attrs[i], bits, word_count);
+        }
+        return;
+    }
+
+    for (size_t i = lower_bound_attr(index, key_id, 0); i < index->header->attr_count; i++) {
+        if (index->attrs[i].key != key_id) {
+            break;
+        }
+        or_container(index, &index->attrs[i], bits, word_count);
+    }
+}
+
+static const tag_index *sort_index;
+
+static int compare_note_paths(const void *a, const void *b) {
+    return strcmp(tag_note_path(sort_index, *(const uint32_t *)a, NULL),
+                  tag_note_path(sort_index, *(const uint32_t *)b, NULL));
+}
+
+// Function to evaluate terms left to right over note-ID bitmaps, each term joined to the ones before it
+// by AND unless it asks for OR. Sets *notes to the matching note IDs sorted by path and returns the count.
+size_t tag_index_query(const tag_index *index, const tag_term *terms, size_t term_count, uint32_t **notes) {
+    *notes = NULL;
+    size_t word_count = (index->header->note_count + 63) / 64;
+    uint64_t *result = calloc(word_count + 1, sizeof(uint64_t));
+    uint64_t *bits = calloc(word_count + 1, sizeof(uint64_t));
+    if (result == NULL || bits == NULL) {
+        perror("calloc");
+        free(result);
+        free(bits);
+        return 0;
+    }
+
+    for (size_t t = 0; t < term_count; t++) {
+        memset(bits, 0, word_count * sizeof(uint64_t));
+        term_bits(index, &terms[t], bits, word_count);
+        for (size_t w = 0; w < word_count; w++) {
+            result[w] = t == 0 ? bits[w] : terms[t].or ? result[w] | bits[w] : result[w] & bits[w];
+        }
+    }
+
+    size_t count = 0;
+    for (size_t w = 0; w < word_count; w++) {
+        count += (size_t)__builtin_popcountll(result[w]);
+    }
+    *notes = malloc((count + 1) * sizeof(uint32_t));
+    if (*notes == NULL) {
+        perror("malloc");
+        count = 0;
+    }
+
+    size_t found = 0;
+    for (size_t w = 0; *notes && w < word_count; w++) {
+        for (uint64_t word = result[w]; word; word &= word - 1) {
+            (*notes)[found++] = (uint32_t)(w * 64 + (size_t)__builtin_ctzll(word));
+        }
+    }
+    sort_index = index;
+    qsort(*notes, count, sizeof(uint32_t), compare_note_paths);
+
+    free(result);
+    free(bits);
+    return count;
+}
@@ -0,0 +1,94 @@
+// tag_index.h
+#ifndef TAG_INDEX_H
+#define TAG_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+
+#define TAG_INDEX_FILE "obs/.tag_index"
+#define TAG_KEY "tag"               // Inline #tags and frontmatter tags: are both filed under this key
+#define TAG_KEY_MAX 64
+#define TAG_VALUE_MAX 256
+#define TAG_NOTE_TOMBSTONE 1
+
+// On-disk layout, every section is addressed by offset so the file can be used straight from mmap.
+// Notes keep their ID across updates, a deleted note leaves a tombstone until the table is compacted.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t note_count;        // Including tombstones
+    uint32_t live_count;
+    uint32_t string_count;
+    uint32_t attr_count;
+    uint32_t reserved;
+    uint64_t notes_offset;
+    uint64_t note_attrs_offset;
+    uint64_t strings_offset;
+    uint64_t attrs_offset;
+    uint64_t containers_offset;
+    uint64_t bytes_offset;
+    uint64_t total_size;
+} tag_header;
+
+typedef struct {
+    uint64_t path_offset;       // Into the byte section
+    uint32_t path_length;
+    uint32_t flags;
+    uint64_t attrs_offset;      // First entry of the note's column in the note attribute section
+    uint32_t attr_count;
+    uint32_t reserved;
+    int64_t mtime;
+    int64_t size;
+} tag_note;
+
+// The string dictionary is sorted bytewise, so string IDs compare like the strings themselves
+typedef struct {
+    uint64_t offset;            // Into the byte section
+    uint32_t length;
+    uint32_t reserved;
+} tag_string;
+
+typedef enum {
+    TAG_CONTAINER_ARRAY = 0,    // Sorted uint32 note IDs
+    TAG_CONTAINER_BITMAP = 1    // One bit per note ID in uint64 words
+} tag_container;
+
+// A key=value pair, sorted by (key, value) so every value of a key is contiguous
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+    uint32_t note_count;
+    uint32_t container;
+    uint64_t data_offset;       // Into the container section
+} tag_attr;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const tag_header *header;
+    const tag_note *notes;
+    const uint32_t *note_attrs;
+    const tag_string *strings;
+    const tag_attr *attrs;
+    const unsigned char *containers;
+    const char *bytes;
+} tag_index;
+
+// One term of a query, value NULL matches any value of the key
+typedef struct {
+    const char *key;
+    const char *value;
+    int or;                     // Combine with the terms before it by OR instead of AND
+} tag_term;
+
+// Function declarations
+void tag_index_default_path(char *buf, size_t size);
+int tag_index_update(const catalog *cat, const char *index_path);
+int tag_index_open(tag_index *index, const char *index_path);
+void tag_index_close(tag_index *index);
+const char *tag_note_path(const tag_index *index, uint32_t note, size_t *len);
+size_t tag_index_query(const tag_index *index, const tag_term *terms, size_t term_count, uint32_t **notes);
+
+#endif // TAG_INDEX_H
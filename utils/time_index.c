@@ -0,0 +1,463 @@
+// time_index.c
+#ifdef __linux__
+#define _GNU_SOURCE  // statx
+#endif
+#include "time_index.h"
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TIME_MAGIC "SLCTIM1"
+#define TIME_VERSION 1
+#define NS_PER_SECOND 1000000000LL
+
+typedef struct {
+    uint64_t inode;
+    uint32_t record;
+} inode_lookup;
+
+// A note of the index being written
+typedef struct {
+    const char *path;           // Borrowed from the catalog
+    int64_t created;
+    int64_t modified;
+    uint64_t inode;
+} build_record;
+
+// Lookups into the previous index for working out creation times. The inode side, needed only when a
+// note turns up under a path the index has not seen, is built on first use.
+typedef struct {
+    const catalog *cat;
+    const time_index *old;
+    inode_lookup *by_inode;
+    const char **current_paths;
+    size_t current_count;
+    int ready;
+} created_lookup;
+
+void time_index_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    snprintf(buf, size, "%s/%s", home ? home : ".", TIME_INDEX_FILE);
+}
+
+int64_t time_record_value(const time_record *record, time_field field) {
+    return field == TIME_CREATED ? record->created : record->modified;
+}
+
+const char *time_record_path(const time_index *index, const time_record *record) {
+    return index->strings + record->path_offset;
+}
+
+// Function to read the creation time encoded in a generate_timestamp() filename, 0 if it is not one
+static int64_t timestamp_name_time(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int used = 0;
+    if (sscanf(name, "%4d-%2d-%2d_%2d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+               &tm.tm_sec, &used) != 6 || used != 19 ||
+        (strcmp(name + used, ".md") != 0 && strcmp(name + used, ".txt") != 0)) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t seconds = mktime(&tm);
+    return seconds == (time_t)-1 ? 0 : (int64_t)seconds * NS_PER_SECOND;
+}
+
+// Function to ask the filesystem when a note was born, 0 where it does not record it
+static int64_t birth_time(const char *root, const char *relative_path) {
+    char path[CATALOG_PATH_MAX * 2];
+    snprintf(path, sizeof(path), "%s/%s", root, relative_path);
+#if defined(__APPLE__)
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        return (int64_t)st.st_birthtimespec.tv_sec * NS_PER_SECOND + st.st_birthtimespec.tv_nsec;
+    }
+#elif defined(__linux__) && defined(STATX_BTIME)
+    struct statx stx;
+    if (statx(AT_FDCWD, path, 0, STATX_BTIME, &stx) == 0 && (stx.stx_mask & STATX_BTIME)) {
+        return (int64_t)stx.stx_btime.tv_sec * NS_PER_SECOND + stx.stx_btime.tv_nsec;
+    }
+#else
+    (void)path;
+#endif
+    return 0;
+}
+
+static int compare_lookup_inode(const void *a, const void *b) {
+    uint64_t x = ((const inode_lookup *)a)->inode, y = ((const inode_lookup *)b)->inode;
+    return (x > y) - (x < y);
+}
+
+static int compare_path_pointers(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Function to find a note of a mapped index by path through its path order, NULL if it has none
+static const time_record *find_path(const time_index *index, const char *path) {
+    size_t low = 0, high = index->data ? index->header->note_count : 0;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const time_record *record = &index->records[index->by_path[mid]];
+        int cmp = strcmp(time_record_path(index, record), path);
+        if (cmp == 0) {
+            return record;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+static int prepare_renames(created_lookup *lookup) {
+    const time_index *old = lookup->old;
+    size_t old_count = old->header->note_count;
+    lookup->by_inode = malloc((old_count + 1) * sizeof(inode_lookup));
+    lookup->current_paths = malloc((lookup->cat->entry_count + 1) * sizeof(const char *));
+    if (lookup->by_inode == NULL || lookup->current_paths == NULL) {
+        perror("malloc");
+        return 0;
+    }
+
+    for (size_t i = 0; i < old_count; i++) {
+        lookup->by_inode[i].inode = old->records[i].inode;
+        lookup->by_inode[i].record = (uint32_t)i;
+    }
+    qsort(lookup->by_inode, old_count, sizeof(inode_lookup), compare_lookup_inode);
+
+    for (size_t i = 0; i < lookup->cat->entry_count; i++) {
+        if (search_is_note(lookup->cat->entries[i].path)) {
+            lookup->current_paths[lookup->current_count++] = lookup->cat->entries[i].path;
+        }
+    }
+    qsort(lookup->current_paths, lookup->current_count, sizeof(const char *), compare_path_pointers);
+    lookup->ready = 1;
+    return 1;
+}
+
+static const build_record *sort_records;
+
+static int compare_created(const void *a, const void *b) {
+    const build_record *x = a, *y = b;
+    if (x->created != y->created) {
+        return x->created < y->created ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+static int compare_modified(const void *a, const void *b) {
+    const build_record *x = &sort_records[*(const uint32_t *)a], *y = &sort_records[*(const uint32_t *)b];
+    if (x->modified != y->modified) {
+        return x->modified < y->modified ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+static int compare_record_paths(const void *a, const void *b) {
+    return strcmp(sort_records[*(const uint32_t *)a].path, sort_records[*(const uint32_t *)b].path);
+}
+
+// Function to work out when a note the index has not seen under this path was created: from the
+// timestamp filename create_note() gives it, then from a vanished note with the same inode, which carries
+// the time across a clean rename, then from the filesystem's birth time and finally from its mtime.
+static int64_t created_time(created_lookup *lookup, const catalog_entry *entry) {
+    int64_t created = timestamp_name_time(entry->path);
+    if (created != 0) {
+        return created;
+    }
+
+    const time_index *old = lookup->old;
+    if (old->data && entry->inode && (lookup->ready || prepare_renames(lookup))) {
+        inode_lookup key = {entry->inode, 0};
+        const inode_lookup *found = bsearch(&key, lookup->by_inode, old->header->note_count, sizeof(inode_lookup),
+                                            compare_lookup_inode);
+        if (found) {
+            // Inodes are reused, so only trust one whose old path is gone
+            const char *old_path = time_record_path(old, &old->records[found->record]);
+            if (!bsearch(&old_path, lookup->current_paths, lookup->current_count, sizeof(const char *),
+                         compare_path_pointers)) {
+                return old->records[found->record].created;
+            }
+        }
+    }
+
+    created = birth_time(lookup->cat->root, entry->path);
+    return created != 0 ? created : entry->mtime;
+}
+
+// Function to serialise the records sorted by creation time plus the modification and path orders to index_path
+static int write_index(build_record *records, uint32_t count, const char *index_path) {
+    qsort(records, count, sizeof(build_record), compare_created);
+
+    uint32_t *by_modified = malloc((count + 1) * sizeof(uint32_t));
+    uint32_t *by_path = malloc((count + 1) * sizeof(uint32_t));
+    time_record *out = calloc(count + 1, sizeof(time_record));
+    size_t strings_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        strings_size += strlen(records[i].path) + 1;
+    }
+    char *strings = malloc(strings_size + 1);
+    int ok = by_modified && by_path && out && strings;
+    if (!ok) {
+        perror("malloc");
+    }
+
+    size_t used = 0;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        size_t length = strlen(records[i].path);
+        out[i].created = records[i].created;
+        out[i].modified = records[i].modified;
+        out[i].inode = records[i].inode;
+        out[i].path_offset = used;
+        out[i].path_length = (uint32_t)length;
+        memcpy(strings + used, records[i].path, length + 1);
+        used += length + 1;
+        by_modified[i] = i;
+        by_path[i] = i;
+    }
+    if (ok) {
+        sort_records = records;
+        qsort(by_modified, count, sizeof(uint32_t), compare_modified);
+        qsort(by_path, count, sizeof(uint32_t), compare_record_paths);
+    }
+
+    time_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TIME_MAGIC, sizeof(TIME_MAGIC));
+    header.version = TIME_VERSION;
+    header.note_count = count;
+    header.records_offset = sizeof(time_header);
+    header.by_modified_offset = header.records_offset + (uint64_t)count * sizeof(time_record);
+    header.by_path_offset = header.by_modified_offset + (uint64_t)count * sizeof(uint32_t);
+    header.strings_offset = header.by_path_offset + (uint64_t)count * sizeof(uint32_t);
+    header.total_size = header.strings_offset + strings_size;
+
+    char temp_path[CATALOG_PATH_MAX];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (ok && file == NULL) {
+        perror("Failed to open time index");
+        ok = 0;
+    }
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(out, sizeof(time_record), count, file) == count &&
+             fwrite(by_modified, sizeof(uint32_t), count, file) == count &&
+             fwrite(by_path, sizeof(uint32_t), count, file) == count &&
+             fwrite(strings, 1, strings_size, file) == strings_size;
+        if (fclose(file) != 0 || !ok || rename(temp_path, index_path) != 0) {
+            perror("Failed to write time index");
+            unlink(temp_path);
+            ok = 0;
+        }
+    }
+
+    free(by_modified);
+    free(by_path);
+    free(out);
+    free(strings);
+    return ok;
+}
+
+// Function to bring the index in line with the catalog. Only the catalog's stat data is used, notes
+// are never opened. Returns the number of notes added or changed, or -1 on failure.
+int time_index_update(const catalog *cat, const char *index_path) {
+    time_index old;
+    int have_old = time_index_open(&old, index_path);
+    size_t old_count = have_old ? old.header->note_count : 0;
+
+    build_record *records = malloc((cat->entry_count + 1) * sizeof(build_record));
+    if (records == NULL) {
+        perror("malloc");
+        if (have_old) {
+            time_index_close(&old);
+        }
+        return -1;
+    }
+
+    created_lookup lookup;
+    memset(&lookup, 0, sizeof(lookup));
+    lookup.cat = cat;
+    lookup.old = &old;
+
+    uint32_t count = 0;
+    int changed = 0;
+    for (size_t i = 0; i < cat->entry_count; i++) {
+        const catalog_entry *entry = &cat->entries[i];
+        if (!search_is_note(entry->path)) {
+            continue;
+        }
+
+        build_record *record = &records[count++];
+        record->path = entry->path;
+        record->modified = entry->mtime;
+        record->inode = entry->inode;
+
+        const time_record *found = find_path(&old, entry->path);
+        if (found) {
+            record->created = found->created;  // Creation never changes under the same path
+        } else {
+            record->created = created_time(&lookup, entry);
+        }
+        changed += !found || found->modified != entry->mtime || found->inode != entry->inode;
+    }
+
+    int result = 0;
+    if (!have_old || changed > 0 || count != old_count) {
+        result = write_index(records, count, index_path) ? changed : -1;
+    }
+
+    if (have_old) {
+        time_index_close(&old);
+    }
+    free(lookup.by_inode);
+    free(lookup.current_paths);
+    free(records);
+    return result;
+}
+
+// Function to map an index file and validate its layout
+int time_index_open(time_index *index, const char *index_path) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(time_header)) {
+        close(fd);
+        return 0;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    const time_header *header = data;
+    if (memcmp(header->magic, TIME_MAGIC, sizeof(TIME_MAGIC)) != 0 || header->version != TIME_VERSION ||
+        header->total_size != (uint64_t)st.st_size || header->records_offset != sizeof(time_header) ||
+        header->by_modified_offset != header->records_offset + (uint64_t)header->note_count * sizeof(time_record) ||
+        header->by_path_offset != header->by_modified_offset + (uint64_t)header->note_count * sizeof(uint32_t) ||
+        header->strings_offset != header->by_path_offset + (uint64_t)header->note_count * sizeof(uint32_t) ||
+        header->strings_offset > header->total_size) {
+        munmap(data, (size_t)st.st_size);
+        return 0;  // Stale or corrupt, the next update rewrites it
+    }
+
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = header;
+    index->records = (const time_record *)(index->data + header->records_offset);
+    index->by_modified = (const uint32_t *)(index->data + header->by_modified_offset);
+    index->by_path = (const uint32_t *)(index->data + header->by_path_offset);
+    index->strings = (const char *)(index->data + header->strings_offset);
+    return 1;
+}
+
+void time_index_close(time_index *index) {
+    if (index->data) {
+        munmap((void *)index->data, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+// Function to fetch the note at a rank of the ascending order by field, the newest is note_count - 1
+const time_record *time_index_at(const time_index *index, time_field field, size_t rank) {
+    return field == TIME_CREATED ? &index->records[rank] : &index->records[index->by_modified[rank]];
+}
+
+static size_t lower_bound(const time_index *index, time_field field, int64_t value) {
+    size_t low = 0, high = index->header->note_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (time_record_value(time_index_at(index, field, mid), field) < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Function to find the ranks [first, last) whose time falls within [since, until]
+void time_index_range(const time_index *index, time_field field, int64_t since, int64_t until, size_t *first,
+                      size_t *last) {
+    *first = lower_bound(index, field, since);
+    *last = until == INT64_MAX ? index->header->note_count : lower_bound(index, field, until + 1);
+    if (*last < *first) {
+        *last = *first;
+    }
+}
+
+// Function to parse a --since/--until argument: YYYY-MM-DD with an optional [T ]HH:MM[:SS], "today",
+// "yesterday" or an age such as 36h, 7d or 2w. A bare date stands for its first moment, or its last
+// with end_of_day. Returns 1 on success.
+int time_parse(const char *text, int end_of_day, int64_t *out) {
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    char *end;
+    long amount = strtol(text, &end, 10);
+    if (end != text && end[0] != '\0' && end[1] == '\0' && amount >= 0 && strchr("hdw", end[0])) {
+        long long unit = end[0] == 'h' ? 3600 : end[0] == 'd' ? 86400 : 7 * 86400;
+        *out = ((int64_t)now - amount * unit) * NS_PER_SECOND;
+        return 1;
+    }
+
+    int has_time = 0;
+    if (strcmp(text, "today") == 0 || strcmp(text, "yesterday") == 0) {
+        tm.tm_mday -= text[0] == 'y';
+    } else {
+        int used = 0;
+        memset(&tm, 0, sizeof(tm));
+        if (sscanf(text, "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &used) != 3) {
+            return 0;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        if (text[used] == 'T' || text[used] == ' ') {
+            int time_used = 0;
+            if (sscanf(text + used + 1, "%2d:%2d%n:%2d%n", &tm.tm_hour, &tm.tm_min, &time_used, &tm.tm_sec,
+                       &time_used) < 2) {
+                return 0;
+            }
+            used += 1 + time_used;
+            has_time = 1;
+        }
+        if (text[used] != '\0') {
+            return 0;
+        }
+    }
+
+    if (!has_time) {
+        tm.tm_hour = end_of_day ? 23 : 0;
+        tm.tm_min = end_of_day ? 59 : 0;
+        tm.tm_sec = end_of_day ? 59 : 0;
+    }
+    tm.tm_isdst = -1;
+    time_t seconds = mktime(&tm);
+    if (seconds == (time_t)-1) {
+        return 0;
+    }
+    *out = (int64_t)seconds * NS_PER_SECOND + (end_of_day && !has_time ? NS_PER_SECOND - 1 : 0);
+    return 1;
+}
@@ -0,0 +1,62 @@
+// time_index.h
+#ifndef TIME_INDEX_H
+#define TIME_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "catalog.h"
+
+#define TIME_INDEX_FILE "obs/.time_index"
+
+typedef enum {
+    TIME_MODIFIED,
+    TIME_CREATED
+} time_field;
+
+// On-disk layout, every section is addressed by offset so the file can be used straight from mmap
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t note_count;
+    uint64_t records_offset;
+    uint64_t by_modified_offset;
+    uint64_t by_path_offset;
+    uint64_t strings_offset;
+    uint64_t total_size;
+} time_header;
+
+// Records are sorted by creation time, by_modified and by_path order the same records by modification
+// time and by path
+typedef struct {
+    int64_t created;            // Nanoseconds since the epoch
+    int64_t modified;
+    uint64_t inode;
+    uint64_t path_offset;       // Into the string section
+    uint32_t path_length;
+    uint32_t reserved;
+} time_record;
+
+// A mapped index file
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const time_header *header;
+    const time_record *records;
+    const uint32_t *by_modified;
+    const uint32_t *by_path;
+    const char *strings;
+} time_index;
+
+// Function declarations
+void time_index_default_path(char *buf, size_t size);
+int time_index_update(const catalog *cat, const char *index_path);
+int time_index_open(time_index *index, const char *index_path);
+void time_index_close(time_index *index);
+const char *time_record_path(const time_index *index, const time_record *record);
+int64_t time_record_value(const time_record *record, time_field field);
+const time_record *time_index_at(const time_index *index, time_field field, size_t rank);
+void time_index_range(const time_index *index, time_field field, int64_t since, int64_t until, size_t *first,
+                      size_t *last);
+int time_parse(const char *text, int end_of_day, int64_t *out);
+
+#endif // TIME_INDEX_H
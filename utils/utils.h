@@ -10,7 +10,6 @@
 int is_git_repository();
 char* get_remote_url();
 void generate_timestamp(char *timestamp, size_t size);
-void parse_url(const char* url, char* git_organisation, char* repo_name);
 void create_directory(const char *path);
 int dir_exists(const char *path);
 int file_exists(const char *path);
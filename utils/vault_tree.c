@@ -0,0 +1,263 @@
+// vault_tree.c
+#include "vault_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Function to count the directories between dir and the vault root
+static int dir_depth(const catalog *cat, int dir) {
+    int depth = 0;
+    for (int parent = cat->dirs[dir].parent; parent >= 0; parent = cat->dirs[parent].parent) {
+        depth++;
+    }
+    return depth;
+}
+
+// Function to add delta rows to every open directory above dir
+static void add_rows(vault_tree *tree, int dir, long long delta) {
+    const catalog *cat = &tree->vault->cat;
+    for (int parent = cat->dirs[dir].parent; parent >= 0; parent = cat->dirs[parent].parent) {
+        vault_tree_dir *open = &tree->open[tree->slots[parent]];
+        open->rows = (size_t)((long long)open->rows + delta);
+    }
+}
+
+// Function to start an outline of the vault with only its root open, returns 1 on success
+int vault_tree_init(vault_tree *tree, const silica_vault *vault) {
+    memset(tree, 0, sizeof(*tree));
+    tree->vault = vault;
+    size_t dir_count = vault->cat.dir_count;
+    if (dir_count == 0) {
+        return 1;
+    }
+
+    tree->slots = malloc(dir_count * sizeof(int));
+    if (tree->slots == NULL) {
+        perror("malloc");
+        return 0;
+    }
+    for (size_t i = 0; i < dir_count; i++) {
+        tree->slots[i] = -1;
+    }
+    return vault_tree_open(tree, 0);
+}
+
+void vault_tree_free(vault_tree *tree) {
+    for (size_t i = 0; i < tree->open_count; i++) {
+        free(tree->open[i].items);
+    }
+    free(tree->open);
+    free(tree->slots);
+    memset(tree, 0, sizeof(*tree));
+}
+
+size_t vault_tree_rows(const vault_tree *tree) {
+    return tree->open_count > 0 ? tree->open[tree->slots[0]].rows : 0;
+}
+
+int vault_tree_is_open(const vault_tree *tree, int dir) {
+    return dir >= 0 && (size_t)dir < tree->vault->cat.dir_count && tree->slots[dir] >= 0;
+}
+
+// Function to list a directory's children into the outline. Its parent has to be open already.
+// Returns 1 when the directory is open.
+int vault_tree_open(vault_tree *tree, int dir) {
+    const catalog *cat = &tree->vault->cat;
+    if (dir < 0 || (size_t)dir >= cat->dir_count) {
+        return 0;
+    }
+    if (tree->slots[dir] >= 0) {
+        return 1;
+    }
+    int parent = cat->dirs[dir].parent;
+    if ((parent >= 0 && tree->slots[parent] < 0) || dir_depth(cat, dir) >= VAULT_TREE_DEPTH_MAX) {
+        return 0;
+    }
+
+    if (tree->open_count == tree->open_capacity) {
+        size_t capacity = tree->open_capacity ? tree->open_capacity * 2 : 16;
+        vault_tree_dir *open = realloc(tree->open, capacity * sizeof(vault_tree_dir));
+        if (open == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        tree->open = open;
+        tree->open_capacity = capacity;
+    }
+
+    vault_tree_dir *open = &tree->open[tree->open_count];
+    open->dir = dir;
+    open->count = silica_vault_children(tree->vault, dir, &open->items);
+    open->rows = open->count;
+    tree->slots[dir] = (int)tree->open_count++;
+    add_rows(tree, dir, (long long)open->count);
+    return 1;
+}
+
+// Function to fold a directory and everything open below it away, freeing their listings. The root stays open.
+void vault_tree_close(vault_tree *tree, int dir) {
+    if (dir <= 0 || !vault_tree_is_open(tree, dir)) {
+        return;
+    }
+
+    // Children first, so the rows they took away from this directory are already gone
+    vault_tree_dir *open = &tree->open[tree->slots[dir]];
+    for (size_t i = 0; i < open->count; i++) {
+        if (open->items[i].dir >= 0 && tree->slots[open->items[i].dir] >= 0) {
+            vault_tree_close(tree, open->items[i].dir);
+            open = &tree->open[tree->slots[dir]];
+        }
+    }
+
+    add_rows(tree, dir, -(long long)open->rows);
+    free(open->items);
+
+    // Move the last open directory into the freed slot
+    int slot = tree->slots[dir];
+    tree->slots[dir] = -1;
+    tree->open_count--;
+    if ((size_t)slot != tree->open_count) {
+        tree->open[slot] = tree->open[tree->open_count];
+        tree->slots[tree->open[slot].dir] = slot;
+    }
+}
+
+static int compare_path_length(const void *a, const void *b) {
+    size_t length_a = strlen(*(const char *const *)a);
+    size_t length_b = strlen(*(const char *const *)b);
+    return (length_a > length_b) - (length_a < length_b);
+}
+
+// Function to open the directories that were open in an outline of an older copy of the vault, matched by path
+void vault_tree_reopen(vault_tree *tree, const vault_tree *previous) {
+    if (previous->open_count == 0 || tree->vault->cat.dir_count == 0) {
+        return;
+    }
+
+    const char **paths = malloc(previous->open_count * sizeof(char *));
+    if (paths == NULL) {
+        perror("malloc");
+        return;
+    }
+    for (size_t i = 0; i < previous->open_count; i++) {
+        paths[i] = previous->vault->cat.dirs[previous->open[i].dir].path;
+    }
+
+    // Parents have shorter paths than their children, so they are opened first
+    qsort(paths, previous->open_count, sizeof(char *), compare_path_length);
+    const catalog *cat = &tree->vault->cat;
+    for (size_t i = 0; i < previous->open_count; i++) {
+        for (size_t dir = 0; dir < cat->dir_count; dir++) {
+            if (strcmp(cat->dirs[dir].path, paths[i]) == 0) {
+                vault_tree_open(tree, (int)dir);
+                break;
+            }
+        }
+    }
+    free(paths);
+}
+
+// Function to place a cursor on a row of the outline, returns 0 past the last row
+int vault_tree_seek(const vault_tree *tree, size_t row, vault_tree_cursor *cursor) {
+    cursor->tree = tree;
+    cursor->row = row;
+    cursor->depth = 0;
+    if (row >= vault_tree_rows(tree)) {
+        return 0;
+    }
+
+    size_t remaining = row;
+    cursor->slot[0] = tree->slots[0];
+    while (1) {
+        const vault_tree_dir *open = &tree->open[cursor->slot[cursor->depth]];
+        size_t i = 0;
+        int descended = 0;
+        for (; i < open->count; i++) {
+            if (remaining == 0) {
+                break;
+            }
+            remaining--;
+
+            int child = open->items[i].dir;
+            if (child >= 0 && tree->slots[child] >= 0) {
+                size_t rows = tree->open[tree->slots[child]].rows;
+                if (remaining < rows) {
+                    cursor->index[cursor->depth] = i;
+                    cursor->slot[++cursor->depth] = tree->slots[child];
+                    descended = 1;
+                    break;
+                }
+                remaining -= rows;
+            }
+        }
+        if (!descended) {
+            cursor->index[cursor->depth] = i;
+            return 1;
+        }
+    }
+}
+
+// Function to move a cursor to the following row, returns 0 past the last row
+int vault_tree_next(vault_tree_cursor *cursor) {
+    const vault_tree *tree = cursor->tree;
+    const silica_item *item = vault_tree_item(cursor);
+    cursor->row++;
+
+    // Step into an open directory
+    if (item->dir >= 0 && tree->slots[item->dir] >= 0 && tree->open[tree->slots[item->dir]].count > 0) {
+        cursor->slot[++cursor->depth] = tree->slots[item->dir];
+        cursor->index[cursor->depth] = 0;
+        return 1;
+    }
+
+    // Or to the next sibling, climbing out of directories that have run out
+    cursor->index[cursor->depth]++;
+    while (cursor->index[cursor->depth] >= tree->open[cursor->slot[cursor->depth]].count) {
+        if (cursor->depth == 0) {
+            return 0;
+        }
+        cursor->depth--;
+        cursor->index[cursor->depth]++;
+    }
+    return 1;
+}
+
+// Function to find the row of the directory a cursor's row is listed in, the row itself at the top level
+size_t vault_tree_parent_row(const vault_tree_cursor *cursor) {
+    if (cursor->depth == 0) {
+        return cursor->row;
+    }
+
+    // Step back over the earlier siblings and everything open below them
+    const vault_tree *tree = cursor->tree;
+    const vault_tree_dir *open = &tree->open[cursor->slot[cursor->depth]];
+    size_t row = cursor->row - 1;
+    for (size_t i = 0; i < cursor->index[cursor->depth]; i++) {
+        int child = open->items[i].dir;
+        row -= 1 + (child >= 0 && tree->slots[child] >= 0 ? tree->open[tree->slots[child]].rows : 0);
+    }
+    return row;
+}
+
+const silica_item *vault_tree_item(const vault_tree_cursor *cursor) {
+    const vault_tree_dir *open = &cursor->tree->open[cursor->slot[cursor->depth]];
+    return &open->items[cursor->index[cursor->depth]];
+}
+
+// Function to draw the row under a cursor the way `tree` does, directories ending in a slash
+void vault_tree_format(const vault_tree_cursor *cursor, char *line, size_t size) {
+    const vault_tree *tree = cursor->tree;
+    size_t used = 0;
+    line[0] = '\0';
+
+    for (int level = 0; level <= cursor->depth && used < size; level++) {
+        int last = cursor->index[level] + 1 == tree->open[cursor->slot[level]].count;
+        const char *part = level < cursor->depth ? (last ? "    " : "│   ") : (last ? "└── " : "├── ");
+        used += snprintf(line + used, size - used, "%s", part);
+    }
+
+    const silica_item *item = vault_tree_item(cursor);
+    if (used < size) {
+        snprintf(line + used, size - used, "%s%s", item->name, item->dir >= 0 ? "/" : "");
+    }
+}
@@ -0,0 +1,52 @@
+// vault_tree.h
+#ifndef VAULT_TREE_H
+#define VAULT_TREE_H
+
+#include <stddef.h>
+#include "silica.h"
+
+#define VAULT_TREE_DEPTH_MAX 64     // Deeper directories are shown but cannot be opened
+#define VAULT_TREE_LINE_MAX 1024
+
+// A directory the tree has opened, its children are listed only while it stays open
+typedef struct {
+    int dir;                        // Catalog directory index
+    silica_item *items;             // Children sorted by name
+    size_t count;
+    size_t rows;                    // Rows below the directory, counting those of open subdirectories
+} vault_tree_dir;
+
+// The vault as an outline where only open directories have rows. Nothing is listed until a directory is
+// opened, so a large vault costs the directories being looked at rather than every note.
+typedef struct {
+    const silica_vault *vault;
+    int *slots;                     // Per catalog directory, its index in open or -1 while closed
+    vault_tree_dir *open;
+    size_t open_count;
+    size_t open_capacity;
+} vault_tree;
+
+// A position in the outline, walked forward one row at a time
+typedef struct {
+    const vault_tree *tree;
+    size_t row;
+    int depth;                      // Number of open directories above the row
+    int slot[VAULT_TREE_DEPTH_MAX];
+    size_t index[VAULT_TREE_DEPTH_MAX];
+} vault_tree_cursor;
+
+// Function declarations
+int vault_tree_init(vault_tree *tree, const silica_vault *vault);
+void vault_tree_free(vault_tree *tree);
+size_t vault_tree_rows(const vault_tree *tree);
+int vault_tree_is_open(const vault_tree *tree, int dir);
+int vault_tree_open(vault_tree *tree, int dir);
+void vault_tree_close(vault_tree *tree, int dir);
+void vault_tree_reopen(vault_tree *tree, const vault_tree *previous);
+int vault_tree_seek(const vault_tree *tree, size_t row, vault_tree_cursor *cursor);
+int vault_tree_next(vault_tree_cursor *cursor);
+size_t vault_tree_parent_row(const vault_tree_cursor *cursor);
+const silica_item *vault_tree_item(const vault_tree_cursor *cursor);
+void vault_tree_format(const vault_tree_cursor *cursor, char *line, size_t size);
+
+#endif // VAULT_TREE_H
@@ -0,0 +1,374 @@
+// watch.c
+#include "watch.h"
+#include "search_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR)
+#define WATCH_BUFFER_SIZE 65536
+#endif
+
+void watcher_free(vault_watcher *watcher) {
+    for (size_t i = 0; i < watcher->dir_capacity; i++) {
+        free(watcher->dirs[i].path);
+    }
+    free(watcher->dirs);
+    free(watcher->dirty);
+    if (watcher->fd >= 0) {
+        close(watcher->fd);
+    }
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->fd = -1;
+}
+
+int watcher_has_changes(const vault_watcher *watcher) {
+    return watcher->fd < 0 || watcher->dirty_count > 0 || watcher->overflow;
+}
+
+static long long now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Function to check whether the pending changes should be applied now. Bursts such as an editor's
+// write-rename-delete save are coalesced into one batch, but no batch waits longer than the max delay.
+int watcher_due(const vault_watcher *watcher) {
+    long long now = now_ms();
+    if (watcher->fd < 0) {
+        return now - watcher->last_apply_ms >= WATCH_POLL_INTERVAL_MS;
+    }
+    if (!watcher_has_changes(watcher)) {
+        return 0;
+    }
+    int quiet = now - watcher->last_event_ms >= WATCH_DEBOUNCE_MS;
+    int overdue = watcher->first_event_ms != 0 && now - watcher->first_event_ms >= WATCH_MAX_DELAY_MS;
+    return quiet || overdue;
+}
+
+// Function to work out how long poll() may sleep before the next batch is due, -1 for no limit
+int watcher_timeout_ms(const vault_watcher *watcher) {
+    long long now = now_ms();
+    long long wait;
+    if (watcher->fd < 0) {
+        wait = watcher->last_apply_ms + WATCH_POLL_INTERVAL_MS - now;
+    } else if (!watcher_has_changes(watcher)) {
+        return -1;
+    } else {
+        wait = watcher->last_event_ms + WATCH_DEBOUNCE_MS - now;
+        if (watcher->first_event_ms != 0 && watcher->first_event_ms + WATCH_MAX_DELAY_MS - now < wait) {
+            wait = watcher->first_event_ms + WATCH_MAX_DELAY_MS - now;
+        }
+    }
+    return wait < 0 ? 0 : (int)wait;
+}
+
+#ifdef __linux__
+// Function to remember which relative directory a watch descriptor belongs to
+static int set_watch_path(vault_watcher *watcher, int wd, const char *path) {
+    if ((size_t)wd >= watcher->dir_capacity) {
+        size_t capacity = watcher->dir_capacity ? watcher->dir_capacity : 256;
+        while (capacity <= (size_t)wd) {
+            capacity *= 2;
+        }
+        watched_dir *dirs = realloc(watcher->dirs, capacity * sizeof(watched_dir));
+        if (dirs == NULL) {
+            perror("realloc");
+            return 0;
+        }
+        memset(dirs + watcher->dir_capacity, 0, (capacity - watcher->dir_capacity) * sizeof(watched_dir));
+        watcher->dirs = dirs;
+        watcher->dir_capacity = capacity;
+    }
+
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        perror("strdup");
+        return 0;
+    }
+    if (watcher->dirs[wd].path == NULL) {
+        watcher->watch_count++;
+    }
+    free(watcher->dirs[wd].path);
+    watcher->dirs[wd].path = copy;
+    return 1;
+}
+
+static void mark_dirty(vault_watcher *watcher, int wd) {
+    if (watcher->dirs[wd].dirty) {
+        return;
+    }
+    if (watcher->dirty_count == watcher->dirty_capacity) {
+        size_t capacity = watcher->dirty_capacity ? watcher->dirty_capacity * 2 : 64;
+        int *dirty = realloc(watcher->dirty, capacity * sizeof(int));
+        if (dirty == NULL) {
+            watcher->overflow = 1;  // Fall back to a rescan rather than losing the change
+            return;
+        }
+        watcher->dirty = dirty;
+        watcher->dirty_capacity = capacity;
+    }
+    watcher->dirs[wd].dirty = 1;
+    watcher->dirty[watcher->dirty_count++] = wd;
+}
+
+// Function to watch a single directory, re-adding an existing watch just refreshes its path
+static int add_watch(vault_watcher *watcher, const char *relative_path, char *full_path, size_t size) {
+    if (relative_path[0] != '\0') {
+        snprintf(full_path, size, "%s/%s", watcher->root, relative_path);
+    } else {
+        snprintf(full_path, size, "%s", watcher->root);
+    }
+
+    int wd = inotify_add_watch(watcher->fd, full_path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Out of inotify watches, raise fs.inotify.max_user_watches\n");
+        }
+        return 0;
+    }
+    return set_watch_path(watcher, wd, relative_path);
+}
+
+// Function to watch a directory and everything below it
+static void add_tree(vault_watcher *watcher, const char *relative_path) {
+    char full_path[CATALOG_PATH_MAX];
+    if (!add_watch(watcher, relative_path, full_path, sizeof(full_path))) {
+        return;
+    }
+
+    DIR *dir = opendir(full_path);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {  // Skip hidden files and directories
+            continue;
+        }
+
+        int is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (!is_dir) {
+            continue;
+        }
+
+        char child[CATALOG_PATH_MAX];
+        if (relative_path[0] != '\0') {
+            snprintf(child, sizeof(child), "%s/%s", relative_path, entry->d_name);
+        } else {
+            snprintf(child, sizeof(child), "%s", entry->d_name);
+        }
+        add_tree(watcher, child);
+    }
+    closedir(dir);
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Function to watch the catalog directories that have no watch yet, such as ones created while events
+// were lost
+static void watch_new_dirs(vault_watcher *watcher, const catalog *cat) {
+    const char **watched = malloc((watcher->watch_count + 1) * sizeof(char *));
+    if (watched == NULL) {
+        perror("malloc");
+        return;
+    }
+    size_t watched_count = 0;
+    for (size_t wd = 0; wd < watcher->dir_capacity && watched_count < watcher->watch_count; wd++) {
+        if (watcher->dirs[wd].path) {
+            watched[watched_count++] = watcher->dirs[wd].path;
+        }
+    }
+    qsort(watched, watched_count, sizeof(char *), compare_strings);
+
+    char full_path[CATALOG_PATH_MAX];
+    for (size_t i = 0; i < cat->dir_count; i++) {
+        const char *path = cat->dirs[i].path;
+        if (bsearch(&path, watched, watched_count, sizeof(char *), compare_strings) == NULL) {
+            add_watch(watcher, path, full_path, sizeof(full_path));
+        }
+    }
+    free(watched);
+}
+
+// Function to drop the watches of a directory that moved out from under its old path
+static void remove_tree(vault_watcher *watcher, const char *relative_path) {
+    size_t len = strlen(relative_path);
+    for (size_t wd = 0; wd < watcher->dir_capacity; wd++) {
+        const char *path = watcher->dirs[wd].path;
+        if (path && strncmp(path, relative_path, len) == 0 && (path[len] == '\0' || path[len] == '/')) {
+            inotify_rm_watch(watcher->fd, (int)wd);
+        }
+    }
+}
+#endif
+
+// Function to start watching every directory of the vault. Returns 1 when inotify is active,
+// 0 when the caller has to fall back to polling.
+int watcher_init(vault_watcher *watcher, const char *root) {
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->fd = -1;
+    watcher->last_apply_ms = now_ms();
+    snprintf(watcher->root, sizeof(watcher->root), "%s", root);
+
+#ifdef __linux__
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        perror("inotify_init1");
+        return 0;
+    }
+    add_tree(watcher, "");
+    return watcher->watch_count > 0;
+#else
+    return 0;
+#endif
+}
+
+// Function to drain pending inotify events into the dirty set, returns the number of events read
+int watcher_read(vault_watcher *watcher) {
+#ifdef __linux__
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int events = 0;
+
+    while (1) {
+        ssize_t len = read(watcher->fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            if (len < 0 && errno != EAGAIN && errno != EINTR) {
+                perror("read");
+            }
+            break;
+        }
+
+        for (char *cursor = buffer; cursor < buffer + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+            events++;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                watcher->overflow = 1;
+                continue;
+            }
+            if (event->wd < 0 || (size_t)event->wd >= watcher->dir_capacity || watcher->dirs[event->wd].path == NULL) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                free(watcher->dirs[event->wd].path);
+                watcher->dirs[event->wd].path = NULL;
+                watcher->watch_count--;
+                continue;
+            }
+            if (event->len > 0 && event->name[0] == '.') {
+                continue;  // Editor swap files and other hidden entries are not part of the vault
+            }
+
+            mark_dirty(watcher, event->wd);
+            watcher->pending_events++;
+            watcher->last_event_ms = now_ms();
+            if (watcher->first_event_ms == 0) {
+                watcher->first_event_ms = watcher->last_event_ms;
+            }
+
+            if (event->len > 0 && (event->mask & IN_ISDIR)) {
+                const char *parent = watcher->dirs[event->wd].path;
+                char child[CATALOG_PATH_MAX];
+                if (parent[0] != '\0') {
+                    snprintf(child, sizeof(child), "%s/%s", parent, event->name);
+                } else {
+                    snprintf(child, sizeof(child), "%s", event->name);
+                }
+
+                if (event->mask & IN_MOVED_FROM) {
+                    remove_tree(watcher, child);
+                } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    add_tree(watcher, child);
+                }
+            }
+        }
+    }
+    return events;
+#else
+    (void)watcher;
+    return 0;
+#endif
+}
+
+// Function to apply the changes gathered since the last batch to the catalog and the search index
+int watcher_apply(vault_watcher *watcher, catalog *cat, const char *catalog_path, const char *index_path,
+                  watch_batch *batch) {
+    memset(batch, 0, sizeof(*batch));
+    int rescanned = 0;
+    int changed = 0;
+
+    if (watcher->fd < 0) {
+        // Polling: directory mtimes find creates, deletes and renames, a stat per note finds edits
+        rescanned = catalog_refresh(cat, watcher->root);
+        changed = rescanned < 0 ? 0 : catalog_restat(cat);
+    } else {
+        const char **dirs = malloc((watcher->dirty_count + 1) * sizeof(char *));
+        if (dirs == NULL) {
+            perror("malloc");
+            return 0;
+        }
+        size_t dir_count = 0;
+        for (size_t i = 0; i < watcher->dirty_count; i++) {
+            const char *path = watcher->dirs[watcher->dirty[i]].path;
+            if (path) {
+                dirs[dir_count++] = path;
+            }
+        }
+
+        // After an overflow the lost events could have touched any directory: the dirty ones are still
+        // read in full, every other directory is only read if its mtime moved. Notes rewritten in place
+        // elsewhere while events were lost wait for their next event or a --rescan.
+        rescanned = catalog_refresh_dirs(cat, dirs, dir_count, !watcher->overflow);
+        free(dirs);
+
+        if (watcher->overflow && rescanned >= 0) {
+            batch->overflow = 1;
+#ifdef __linux__
+            watch_new_dirs(watcher, cat);
+#endif
+        }
+    }
+
+    for (size_t i = 0; i < watcher->dirty_count; i++) {
+        if ((size_t)watcher->dirty[i] < watcher->dir_capacity) {
+            watcher->dirs[watcher->dirty[i]].dirty = 0;
+        }
+    }
+    watcher->dirty_count = 0;
+    watcher->overflow = 0;
+    watcher->pending_events = 0;
+    watcher->first_event_ms = 0;
+    watcher->last_apply_ms = now_ms();
+
+    if (rescanned < 0) {
+        return 0;
+    }
+
+    batch->dirs_rescanned = (size_t)rescanned;
+    batch->notes_changed = (size_t)changed;
+    if (rescanned > 0 || changed > 0) {
+        catalog_save(cat, catalog_path);
+        batch->notes_indexed = search_index_update(cat, index_path);
+    }
+    return batch->notes_indexed >= 0;
+}
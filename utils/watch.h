@@ -0,0 +1,52 @@
+// watch.h
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stddef.h>
+#include "catalog.h"
+
+#define WATCH_DEBOUNCE_MS 300
+#define WATCH_MAX_DELAY_MS 2000
+#define WATCH_POLL_INTERVAL_MS 2000
+
+// A watched directory of the vault, indexed by its inotify watch descriptor
+typedef struct {
+    char *path;                 // Relative to the vault root, NULL for unused descriptors
+    int dirty;
+} watched_dir;
+
+typedef struct {
+    int fd;                     // inotify descriptor, -1 when falling back to polling
+    char root[CATALOG_PATH_MAX];
+    watched_dir *dirs;
+    size_t dir_capacity;
+    size_t watch_count;
+    int *dirty;                 // Watch descriptors touched since the last batch
+    size_t dirty_count;
+    size_t dirty_capacity;
+    int overflow;               // Events were lost, a bounded rescan is needed
+    size_t pending_events;
+    long long first_event_ms;   // Monotonic time of the first event of the pending batch, 0 if none
+    long long last_event_ms;
+    long long last_apply_ms;
+} vault_watcher;
+
+// Summary of one applied batch
+typedef struct {
+    size_t dirs_rescanned;
+    size_t notes_changed;
+    int notes_indexed;
+    int overflow;
+} watch_batch;
+
+// Function declarations
+int watcher_init(vault_watcher *watcher, const char *root);
+void watcher_free(vault_watcher *watcher);
+int watcher_read(vault_watcher *watcher);
+int watcher_has_changes(const vault_watcher *watcher);
+int watcher_timeout_ms(const vault_watcher *watcher);
+int watcher_due(const vault_watcher *watcher);
+int watcher_apply(vault_watcher *watcher, catalog *cat, const char *catalog_path, const char *index_path,
+                  watch_batch *batch);
+
+#endif // WATCH_H